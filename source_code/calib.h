@@ -0,0 +1,95 @@
+/****************************************************************************
+ * calib.h
+ * Tomatotificatorul
+ *
+ * Copyright 2021 Iulian-Razvan Matesica <iulian.matesica@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ****************************************************************************/
+
+#ifndef __CALIB_H
+#define __CALIB_H
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <stdint.h>
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+/* Per-unit calibration block.
+ *
+ * The block lives at a fixed address at the very end of the flash, so a
+ * host tool (tools/calpatch) can rewrite it directly in main.hex for every
+ * unit, without recompiling. The firmware only reads it at boot.
+ *
+ * The layout is naturally aligned, so the same structure can be used on
+ * the host side as well. Do not reorder the fields.
+ */
+
+#define CALIB_VERSION         1
+#define CALIB_SIZE            10
+
+/* Flash address on the ATtiny13: FLASHEND + 1 - CALIB_SIZE. The Makefile
+ * computes it for the other devices.
+ */
+
+#define CALIB_ADDR            0x3f6
+
+/* 'osccal' value meaning "keep the factory OSCCAL". */
+
+#define CALIB_OSCCAL_FACTORY  0xff
+
+/* 'ppm' of the calibration mode result. It follows from 'overflows' and
+ * 'remainder'; working it out on the device would take 32-bit division.
+ */
+
+#define CALIB_PPM_UNKNOWN     (-32767 - 1)
+
+/* First ADC channel with an offset in 'adc_offset'. */
+
+#define CALIB_ADC_FIRST       2
+#define CALIB_ADC_COUNT       2
+
+#ifdef __AVR__
+#  define CALIB_SECTION __attribute__((used, section(".calib")))
+#else
+#  define CALIB_SECTION
+#endif
+
+/****************************************************************************
+ * Public Types
+ ****************************************************************************/
+
+struct calib_s
+{
+    uint8_t  version;    /* CALIB_VERSION */
+    uint8_t  osccal;     /* OSCCAL value or CALIB_OSCCAL_FACTORY */
+    int16_t  ppm;        /* Measured clock error vs. CLOCK (informative),
+                          * CALIB_PPM_UNKNOWN from the calibration mode */
+    uint16_t overflows;  /* Timer0 overflows per second */
+    uint8_t  remainder;  /* Timer0 ticks per second, modulo 256 */
+
+    /* Added to the raw conversion result of ADC2 (solar panel)
+     * and ADC3 (duration potentiometer).
+     */
+
+    int8_t   adc_offset[CALIB_ADC_COUNT];
+
+    uint8_t  reserved;
+};
+
+#endif /* __CALIB_H */
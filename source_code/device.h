@@ -0,0 +1,152 @@
+/****************************************************************************
+ * device.h
+ * Tomatotificatorul
+ *
+ * Copyright 2021 Iulian-Razvan Matesica <iulian.matesica@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ****************************************************************************/
+
+#ifndef __DEVICE_H
+#define __DEVICE_H
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <avr/io.h>
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+/* Supported devices. They are pin compatible, so the same board takes any
+ * of them. The bigger ones get richer features (see the tiers below).
+ *
+ *   Device      Flash  RAM   EEPROM  Tier
+ *   ATtiny13    1K     64    64      0
+ *   ATtiny25    2K     128   128     1
+ *   ATtiny45    4K     256   256     2
+ *   ATtiny85    8K     512   512     3
+ *
+ * CONFIG_TIER can be forced from the command line to try a smaller
+ * feature set on a bigger device.
+ */
+
+#if defined(__AVR_ATtiny13__) || defined(__AVR_ATtiny13A__)
+#  define DEVICE_TINY13
+#  ifndef CONFIG_TIER
+#    define CONFIG_TIER 0
+#  endif
+#elif defined(__AVR_ATtiny25__)
+#  ifndef CONFIG_TIER
+#    define CONFIG_TIER 1
+#  endif
+#elif defined(__AVR_ATtiny45__)
+#  ifndef CONFIG_TIER
+#    define CONFIG_TIER 2
+#  endif
+#elif defined(__AVR_ATtiny85__)
+#  ifndef CONFIG_TIER
+#    define CONFIG_TIER 3
+#  endif
+#else
+#  error "Unsupported device"
+#endif
+
+/* Register layer.
+ *
+ * The ATtiny25/45/85 share one interrupt mask and flag register
+ * between Timer0 and Timer1. Bit names are the same.
+ */
+
+#if !defined(TIMSK0) && defined(TIMSK)
+#  define TIMSK0 TIMSK
+#  define TIFR0  TIFR
+#endif
+
+/* The ATtiny13 OSCCAL has 7 bits. The ATtiny25/45/85 OSCCAL has 8 bits
+ * and two overlapping ranges selected by bit 7; the calibration mode
+ * stays in the range of the factory value.
+ */
+
+#define DEVICE_OSCCAL_RANGE  0x80
+
+/* Feature tiers:
+ *
+ *   CONFIG_SCHEDULE_EEPROM - Up to CONFIG_SCHEDULE_MAX watering events,
+ *                            loaded from EEPROM (avrdude -U eeprom:w).
+ *   CONFIG_SOLAR_WINDOW    - Watering events with a window of up to 7h,
+ *                            started as soon as the panel has a surplus,
+ *                            at the end of the window otherwise.
+ *   CONFIG_LOG             - Log of the last CONFIG_LOG_ENTRIES waterings
+ *                            in EEPROM (avrdude -U eeprom:r).
+ *   CONFIG_ENERGY_PLAN     - History of the last CONFIG_HISTORY_DAYS days
+ *                            of harvest and battery charge in EEPROM, and
+ *                            a daily energy budget for the scheduled
+ *                            waterings from the harvest forecast.
+ */
+
+#if CONFIG_TIER >= 1
+#  define CONFIG_SCHEDULE_EEPROM
+#  define CONFIG_SCHEDULE_MAX  (CONFIG_TIER >= 3 ? 16 : 8)
+#  define CONFIG_SOLAR_WINDOW
+#endif
+
+#if CONFIG_TIER >= 2
+#  define CONFIG_LOG
+#  define CONFIG_LOG_ENTRIES   (CONFIG_TIER >= 3 ? 48 : 20)
+#  define CONFIG_ENERGY_PLAN
+#  define CONFIG_HISTORY_DAYS  (CONFIG_TIER >= 3 ? 21 : 14)
+#endif
+
+/* What each feature builds on, for whoever moves one to another tier.
+ * The energy plan keys its budget on the day count of the log, drops
+ * the log entry of a skipped watering and leaves waterings on a solar
+ * surplus out of the budget. Windows are stored with the events in RAM.
+ */
+
+#if defined(CONFIG_ENERGY_PLAN) && !defined(CONFIG_LOG)
+#  error "CONFIG_ENERGY_PLAN needs CONFIG_LOG"
+#endif
+
+#if defined(CONFIG_ENERGY_PLAN) && !defined(CONFIG_SOLAR_WINDOW)
+#  error "CONFIG_ENERGY_PLAN needs CONFIG_SOLAR_WINDOW"
+#endif
+
+#if defined(CONFIG_SOLAR_WINDOW) && !defined(CONFIG_SCHEDULE_EEPROM)
+#  error "CONFIG_SOLAR_WINDOW needs CONFIG_SCHEDULE_EEPROM"
+#endif
+
+/* EEPROM layout, at fixed addresses so the host tools and avrdude users
+ * can find things:
+ *
+ *   0x00  struct calib_s       calibration mode result
+ *   0x10  schedule             count, then (hour, minute, second)
+ *                              per event; count 0xff = flash defaults.
+ *                              Bits 7..5 of the hour are the window in
+ *                              hours, 0 for a fixed time.
+ *   0x4f  history head         index of the next history entry
+ *   0x50  history              ring of struct history_entry_s
+ *   0x7f  log head             index of the next log entry
+ *   0x80  log                  ring of struct log_entry_s
+ */
+
+#define EE_CALIB_ADDR        0x00
+#define EE_SCHEDULE_ADDR     0x10
+#define EE_HISTORY_HEAD_ADDR 0x4f
+#define EE_HISTORY_ADDR      0x50
+#define EE_LOG_HEAD_ADDR     0x7f
+#define EE_LOG_ADDR          0x80
+
+#endif /* __DEVICE_H */
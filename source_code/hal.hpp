@@ -0,0 +1,276 @@
+/****************************************************************************
+ * hal.hpp
+ * Tomatotificatorul
+ *
+ * Copyright 2021 Iulian-Razvan Matesica <iulian.matesica@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ****************************************************************************/
+
+#ifndef __HAL_HPP
+#define __HAL_HPP
+
+/* Compile-time hardware abstraction for avr-g++ (C++11 or later).
+ *
+ * Pins, ADC channels and timer modes are types, so every access folds
+ * into the same sbi/cbi/in/out instructions the PUMP_ON() style macros
+ * produce. A board is a list of roles; two roles on the same pin (e.g.
+ * PB0 as PWM output and as GPIO) fail a static_assert:
+ *
+ *   typedef hal::Gpio<hal::Pin<hal::PortB, 0> >      pump;
+ *   typedef hal::Gpio<hal::Pin<hal::PortB, 2> >      status_led;
+ *   typedef hal::AdcChannel<3>                       duration_pot;
+ *   typedef hal::Board<pump, status_led, duration_pot> board;
+ *
+ *   board::check();
+ *   hal::Adc<hal::ADC_DIV128>::init();
+ *   pump::set();
+ *
+ * 'make size-compare' compares it, operation by operation, with the
+ * same register sequences written by hand and fails if any is bigger.
+ * main.c is C and does not use it yet.
+ */
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <avr/io.h>
+
+#include <stdint.h>
+
+#include "device.h"
+
+/****************************************************************************
+ * Public Types
+ ****************************************************************************/
+
+namespace hal
+{
+
+/* Ports. 'id' only has to be unique, it keys the conflict check. */
+
+struct PortB
+{
+    static const uint8_t id = 'B';
+
+    static volatile uint8_t &port() { return PORTB; }
+    static volatile uint8_t &ddr()  { return DDRB; }
+    static volatile uint8_t &pin()  { return PINB; }
+};
+
+template <typename Port, uint8_t Bit>
+struct Pin
+{
+    static_assert(Bit < 8, "bit out of range");
+
+    static const uint8_t  mask = 1 << Bit;
+    static const uint16_t key = (uint16_t)Port::id << 8 | Bit;
+
+    static void output()  { Port::ddr() |= mask; }
+    static void input()   { Port::ddr() &= ~mask; }
+    static void set()     { Port::port() |= mask; }
+    static void clear()   { Port::port() &= ~mask; }
+    static bool read()    { return Port::pin() & mask; }
+
+    /* Writing a one to PINx toggles the output: ldi/out instead of
+     * in/eor/out.
+     */
+
+    static void toggle()  { Port::pin() = mask; }
+};
+
+/* Roles. Each role claims exactly one pin, exposed as 'pin'. */
+
+template <typename P>
+struct Gpio : P
+{
+    typedef P pin;
+};
+
+/* Input with the internal pull-up. */
+
+template <typename P>
+struct PullupInput : P
+{
+    typedef P pin;
+
+    static void init()
+    {
+        P::input();
+        P::set();
+    }
+};
+
+/* ADC channels and the pin each one takes. */
+
+template <uint8_t Channel>
+struct AdcPin;
+
+template <> struct AdcPin<0> { typedef Pin<PortB, 5> type; };
+template <> struct AdcPin<1> { typedef Pin<PortB, 2> type; };
+template <> struct AdcPin<2> { typedef Pin<PortB, 4> type; };
+template <> struct AdcPin<3> { typedef Pin<PortB, 3> type; };
+
+enum AdcPrescaler : uint8_t
+{
+    ADC_DIV2   = 1,
+    ADC_DIV4   = 2,
+    ADC_DIV8   = 3,
+    ADC_DIV16  = 4,
+    ADC_DIV32  = 5,
+    ADC_DIV64  = 6,
+    ADC_DIV128 = 7,
+};
+
+/* The converter, shared by the channels. */
+
+template <AdcPrescaler Prescaler = ADC_DIV128>
+struct Adc
+{
+    static void init() { ADCSRA |= Prescaler << ADPS0; }
+};
+
+template <uint8_t Channel>
+struct AdcChannel
+{
+    static_assert(Channel < 4, "ADC channel out of range");
+
+    typedef typename AdcPin<Channel>::type pin;
+
+    /* Input, digital buffer off. ADC0 (PB5) is RESET and has no DIDR
+     * bit worth touching.
+     */
+
+    static void init()
+    {
+        pin::input();
+
+        if (Channel == 1)
+        {
+            DIDR0 |= 1 << ADC1D;
+        }
+        else if (Channel == 2)
+        {
+            DIDR0 |= 1 << ADC2D;
+        }
+        else if (Channel == 3)
+        {
+            DIDR0 |= 1 << ADC3D;
+        }
+    }
+
+    /* Single conversion, the ADC is powered only while converting. */
+
+    static uint16_t read()
+    {
+        ADMUX = (ADMUX & ~((1 << MUX1) | (1 << MUX0))) | Channel;
+        ADCSRA |= 1 << ADEN;
+        ADCSRA |= 1 << ADSC;
+
+        while (ADCSRA & (1 << ADSC));
+
+        uint16_t val = ADC;
+
+        ADCSRA &= ~(1 << ADEN);
+        return val;
+    }
+};
+
+/* Timer0. */
+
+enum TimerClock : uint8_t
+{
+    TIMER_STOP    = 0,
+    TIMER_DIV1    = 1,
+    TIMER_DIV8    = 2,
+    TIMER_DIV64   = 3,
+    TIMER_DIV256  = 4,
+    TIMER_DIV1024 = 5,
+};
+
+template <TimerClock Clock>
+struct Timer0Normal
+{
+    static void init()
+    {
+        TCNT0 = 0;
+        TCCR0B |= Clock;
+    }
+
+    static void enable_overflow()  { TIMSK0 |= 1 << TOIE0; }
+    static void enable_compare_a() { TIMSK0 |= 1 << OCIE0A; }
+    static void disable_compare_a() { TIMSK0 &= ~(1 << OCIE0A); }
+};
+
+/* PWM on OC0A (PB0) or OC0B (PB1), fast PWM with TOP = 0xff. */
+
+template <TimerClock Clock, char Channel>
+struct Timer0Pwm
+{
+    static_assert(Channel == 'A' || Channel == 'B', "no such channel");
+
+    typedef Pin<PortB, Channel == 'A' ? 0 : 1> pin;
+
+    static void init()
+    {
+        pin::output();
+        TCCR0A = (Channel == 'A' ? 2 << COM0A0 : 2 << COM0B0) |
+                 (1 << WGM01) | (1 << WGM00);
+        TCCR0B = Clock;
+    }
+
+    static void duty(uint8_t val)
+    {
+        if (Channel == 'A')
+        {
+            OCR0A = val;
+        }
+        else
+        {
+            OCR0B = val;
+        }
+    }
+};
+
+/* Board: the roles in use. Instantiating it checks that no pin is
+ * claimed twice.
+ */
+
+template <typename... Roles>
+struct Board;
+
+template <>
+struct Board<>
+{
+    static constexpr bool uses(uint16_t) { return false; }
+    static void check() { }
+};
+
+template <typename Role, typename... Rest>
+struct Board<Role, Rest...>
+{
+    static_assert(!Board<Rest...>::uses(Role::pin::key),
+                  "pin claimed by more than one role");
+
+    static constexpr bool uses(uint16_t key)
+    {
+        return Role::pin::key == key || Board<Rest...>::uses(key);
+    }
+
+    static void check() { Board<Rest...>::check(); }
+};
+
+} /* namespace hal */
+
+#endif /* __HAL_HPP */
@@ -22,28 +22,22 @@
  ****************************************************************************/
 
 #include <avr/io.h>
+#include <avr/eeprom.h>
 #include <avr/interrupt.h>
+#include <avr/pgmspace.h>
 #include <avr/sleep.h>
 #include <util/delay.h>
 
 #include <inttypes.h>
 #include <stdbool.h>
 
+#include "calib.h"
+#include "device.h"
+
 /****************************************************************************
  * Pre-processor Definitions
  ****************************************************************************/
 
-/* ((64/1200000 * 256 * 73) + (64/1200000 * 135))) = 1s
- * 
- * This is close enough to 1s. The error for 24h is only 2.82s.
- * I can live with that.
- */
-
-// /8
-//#define TIMER_OVERFLOW_TICK  587
-//#define TIMER_REMAINDER_TICK 255
-// o ia inainte cu ~1s / ora 
-
 #define PUMP_ON()  (PORTB |= (1 << PB0))
 #define PUMP_OFF() (PORTB &= ~(1 << PB0))
 
@@ -59,33 +53,216 @@
 
 #define SOLAR_PANEL_THRESHOLD 553
 
-// /1 works really well after 1h
-// 1s in urma la 1h
-//#define TIMER_OVERFLOW_TICK  4709
-//#define TIMER_REMAINDER_TICK 196
+#ifdef CONFIG_SOLAR_WINDOW
+/* Above this threshold (17V, about the maximum power point of the panel)
+ * for SOLAR_SURPLUS_SAMPLES samples in a row, the panel gives more than
+ * the battery takes: a windowed watering starts right away.
+ */
+
+#  define SOLAR_SURPLUS_THRESHOLD 610
+#  define SOLAR_SURPLUS_SAMPLES   4
+
+/* Window of a watering event, in the top bits of its EEPROM hour. */
+
+#  define EVENT_WINDOW_SHIFT      5
+#  define EVENT_HOUR_MASK         0x1f
+#  define SECONDS_PER_HOUR        3600
+#endif
+
+/* One second is TIMER_OVERFLOW_TICK * 256 + TIMER_REMAINDER_TICK cycles.
+ * These are only the defaults of the calibration block (see calib.h);
+ * tools/calpatch or the calibration mode replace them for every unit.
+ *
+ * The ATtiny13 defaults come from the reference unit: 4708 overflows 
+ * per second plus 24s per day, i.e. 1205583Hz. The other devices start
+ * from the nominal F_CPU.
+ */
+
+#ifdef DEVICE_TINY13
+#  define TIMER_OVERFLOW_TICK  4709
+#  define TIMER_REMAINDER_TICK 79
+#else
+#  define TIMER_OVERFLOW_TICK  (F_CPU / 256)
+#  define TIMER_REMAINDER_TICK (F_CPU % 256)
+#endif
+
+#define MINUTES_PER_DAY      (24 * 60)
+
+/* System clock prescaler (CLKPR) and Timer0 clock select, set once in
+ * timer_init(). The clock is divided statically: the MCU runs at
+ * F_CPU / 16, including the sleep and the ADC (see adc_init()), and
+ * Timer0 counts F_CPU / 1024 as with clk/1024 at F_CPU.
+ *
+ * F_CPU is the RC oscillator divided by 8 (CKDIV8 fuse, see FUSES in the
+ * Makefile), which is also the CLKPR value at reset.
+ */
+
+#define CLOCK_DIV            7    /* RC / 128 */
+#define TIMER_CS             ((1 << CS01) | (1 << CS00))
+
+/* Calibration mode: hold the water button at power-up, release it and 
+ * feed a CAL_REF_HZ square wave into PB1. Counting CAL_REF_PERIODS 
+ * periods takes exactly one second, so the count is the clock frequency.
+ */
+
+#define CAL_REF_HZ           1000
+#define CAL_REF_PERIODS      1000
+
+/* Give up if PB1 has no rising edge for this many overflows (~54ms). */
 
-// -335 ticks == 277us/s = 1s la ora
-// 1205700Hz 
+#define CAL_TIMEOUT_OVF      255
+
+/* Boot normally if the button is not released within this many 
+ * overflows (~2s): it is stuck, or shorted by water.
+ */
 
-#define TIMER_OVERFLOW_TICK  4708
-#define TIMER_REMAINDER_TICK 116
+#define CAL_RELEASE_OVF      ((uint16_t)(2 * F_CPU / 256))
 
-//#define TIMER_OVERFLOW_TICK  588
-//#define TIMER_REMAINDER_TICK 184
+/* Highest OSCCAL bit searched, within the range of the factory value. */
 
+#define CAL_OSCCAL_MSB       0x40
 
-#define HOURLY_ERROR_SEC     1
-#define FULL_DAY_TICKS       (((uint32_t)3600 + HOURLY_ERROR_SEC) * 24)
+#ifdef CONFIG_ENERGY_PLAN
+/* Energy plan, counted in pump seconds. ENERGY_CAPACITY is the charge 
+ * between a full battery and the cut-off (a 12V 1.2Ah battery to half 
+ * its capacity and a 6W pump), ENERGY_SAMPLE what the panel brings in 
+ * per solar sample above SOLAR_PANEL_THRESHOLD (1.5W of charge over 
+ * SOLAR_PERIOD). Set them for the unit's battery, panel and pump.
+ */
 
-/* This not not precise, it's just an estimation. 
- * Don't use it for precise scheduling. 
+#  ifndef ENERGY_CAPACITY
+#    define ENERGY_CAPACITY    4320
+#  endif
+#  ifndef ENERGY_SAMPLE
+#    define ENERGY_SAMPLE      1
+#  endif
+
+/* Each day's budget is the forecast harvest plus the charge above the 
+ * reserve spread over ENERGY_SPREAD_DAYS; below the reserve it takes 
+ * from the forecast instead, so a dark streak cuts the waterings a bit 
+ * more every day.
  */
 
+#  define ENERGY_RESERVE       (ENERGY_CAPACITY / 4)
+#  define ENERGY_SPREAD_DAYS   4
+
+/* Shortest planned watering, the pot's. Longer than PUMP_LATE_MAX. */
+
+#  define ENERGY_MIN_WATERING  5
+
+/* History entries count 64 pump seconds. */
+
+#  define ENERGY_UNIT_SHIFT    6
+
+/* The forecast is the daily harvest smoothed with a factor of 1/4. */
+
+#  define FORECAST_SHIFT       2
+
+/* No forecast yet: water as set. */
+
+#  define ENERGY_NO_PLAN       0xffff
+#endif
+
+/* Log reasons. */
+
+#define LOG_REASON_SCHEDULE  0
+#define LOG_REASON_BUTTON    1
+#define LOG_REASON_SOLAR     2    /* Windowed, on a solar surplus */
+
+/* EEPROM, see device.h. */
+
+#define EE_CALIB             ((struct calib_s *)EE_CALIB_ADDR)
+#define EE_SCHEDULE          ((uint8_t *)EE_SCHEDULE_ADDR)
+#define EE_LOG_HEAD          ((uint8_t *)EE_LOG_HEAD_ADDR)
+#define EE_LOG               ((struct log_entry_s *)EE_LOG_ADDR)
+#define EE_HISTORY_HEAD      ((uint8_t *)EE_HISTORY_HEAD_ADDR)
+#define EE_HISTORY           ((struct history_entry_s *)EE_HISTORY_ADDR)
+
+/* Time of day of a watering event, counted from power-up. */
+
 #define WATER_EVENT(hour, min, sec) \
-    ((uint32_t)3600 * (hour) + \
-     (uint32_t)60 * (min) + \
-     (sec))
+    { (hour) * 60 + (min), (sec) }
+
+/* Seconds elapsed from tick 'since' to tick 'now'. Correct across the 
+ * wrap of the 16-bit tick counter, as long as less than ~18h passed.
+ */
+
+#define TICKS_SINCE(now, since) ((uint16_t)((now) - (since)))
+
+/* True once tick 'now' reached tick 'due', up to ~9h past it. */
+
+#define TICKS_DUE(now, due)     (TICKS_SINCE(now, due) < 0x8000)
+
+/* Tasks, run by task_run() in this order. A task may wake any task,
+ * the ones after it still run in the same pass.
+ *
+ * The button and the pump are woken for a deadline, kept in RAM. The
+ * others run every g_task_periods[] seconds while ready, at the ticks
+ * which are a multiple of it. Only tasks before them may wake them.
+ */
+
+#define TASK_POT             0    /* Samples the duration potentiometer */
+#define TASK_BUTTON          1    /* Debounces the water button */
+#define TASK_PUMP            2    /* Starts and stops the pump */
+#define TASK_SOLAR           3    /* Samples the solar panel voltage */
+#define TASK_LED             4    /* Blinks the status LED while charging */
+#ifdef CONFIG_LOG
+#  define TASK_LOG           5    /* Writes the watering log */
+#  define TASK_COUNT         6
+#else
+#  define TASK_COUNT         5
+#endif
+
+#define TASK_BIT(task)       (1 << (task))
+
+/* Tasks with a deadline, TASK_BUTTON up to TASK_PUMP. */
+
+#define TASK_TIMED_COUNT     (TASK_PUMP - TASK_BUTTON + 1)
+#define TASK_DUE(task)       g_task_due[(task) - TASK_BUTTON]
+
+/* Tasks scheduled at boot-up, the others wait to be woken. */
+
+#define TASK_BOOT            (TASK_BIT(TASK_POT) | TASK_BIT(TASK_PUMP) | \
+                              TASK_BIT(TASK_SOLAR) | TASK_BIT(TASK_LED))
+
+/* Returned by a task to wait until task_wake() or task_resume(). */
+
+#define TASK_IDLE            0xffff
+
+/* Longest sleep; a task due later simply runs again earlier. Well
+ * within the TICKS_DUE() range.
+ */
+
+#define TASK_MAX_DELAY       0x4000
+
+/* Task periods, seconds, powers of two. The potentiometer only matters
+ * when watering starts, the button task samples it right then.
+ */
+
+#define POT_PERIOD           8
+#define SOLAR_PERIOD         4
+#define LED_PERIOD           1
+#define LOG_PERIOD           1
+
+/* A scheduled watering still starts if the pump task runs up to this
+ * many seconds late. Shorter than the shortest watering, so it does not
+ * start twice.
+ */
+
+#define PUMP_LATE_MAX        2
 
+/* Events queued by the ISRs for the main loop. */
+
+#define EV_NONE              0
+#define EV_TICK              1    /* A second elapsed */
+#define EV_BUTTON            2    /* Falling edge on the water button */
+
+/* Event queue length, a power of two. Holds EVENT_QUEUE_LEN - 1 events. */
+
+#define EVENT_QUEUE_LEN      4
+#define EVENT_QUEUE_MASK     (EVENT_QUEUE_LEN - 1)
+
+#define MIN(a, b)     ((a) < (b) ? (a) : (b))
 #define MAX(a, b)     ((a) > (b) ? (a) : (b))
 #define ARRAY_LEN(a) (sizeof(a) / sizeof(a[0]))
 
@@ -97,6 +274,57 @@
  *   - PB4 (ADC2) - Solar panel voltage
  */
 
+/****************************************************************************
+ * Private Types
+ ****************************************************************************/
+
+struct water_event_s
+{
+    uint16_t minute;    /* Minute of the day */
+    uint8_t  second;
+#ifdef CONFIG_SOLAR_WINDOW
+    uint8_t  window;    /* Hours from the event, 0 for a fixed time */
+#endif
+};
+
+/* Consistent copy of the time kept by the ISR, see time_snapshot(). */
+
+struct time_s
+{
+    uint16_t ticks;
+    uint16_t minute;    /* Minute of the day */
+    uint8_t  second;
+#ifdef CONFIG_LOG
+    uint16_t day;
+#endif
+};
+
+/* A task runs with the current time and returns the seconds until its
+ * next run, or TASK_IDLE.
+ */
+
+typedef uint16_t (*task_fn_t)(const struct time_s *now);
+
+#ifdef CONFIG_LOG
+struct log_entry_s
+{
+    uint16_t day;       /* Days since boot-up */
+    uint16_t minute;    /* Minute of the day */
+    uint8_t  duration;  /* Seconds */
+    uint8_t  reason;    /* LOG_REASON_* */
+};
+#endif
+
+#ifdef CONFIG_ENERGY_PLAN
+/* A day, in units of 1 << ENERGY_UNIT_SHIFT pump seconds. */
+
+struct history_entry_s
+{
+    uint8_t  harvest;   /* Charge the panel brought in */
+    uint8_t  charge;    /* Battery charge at the end of the day */
+};
+#endif
+
 /****************************************************************************
  * Private Function Prototypes
  ****************************************************************************/
@@ -104,6 +332,38 @@
 static inline void pump_init(void);
 static inline void water_button_init(void);
 static inline void status_led_init(void);
+static bool cal_requested(void);
+static uint32_t cal_measure(void);
+static void cal_set_osccal(uint8_t target);
+static void cal_run(void);
+static inline void calib_init(void);
+static inline void schedule_init(void);
+#ifdef CONFIG_LOG
+static void log_write(uint8_t reason, const struct time_s *now);
+#endif
+#ifdef CONFIG_ENERGY_PLAN
+static void energy_forecast(uint16_t harvest);
+static void energy_plan(void);
+static inline void energy_init(void);
+static void energy_day(const struct time_s *now);
+static uint8_t energy_share(const struct time_s *now);
+#endif
+static inline void event_push(uint8_t ev);
+static uint8_t event_pop(void);
+static void time_snapshot(struct time_s *now);
+static void task_wake(uint8_t task, uint16_t due);
+static void task_resume(uint8_t task);
+static uint16_t task_run(const struct time_s *now);
+static uint16_t button_task(const struct time_s *now);
+static uint16_t pot_task(const struct time_s *now);
+static int16_t event_delay(const struct time_s *now,
+                           const struct water_event_s *event);
+static uint16_t pump_task(const struct time_s *now);
+static uint16_t solar_task(const struct time_s *now);
+static uint16_t led_task(const struct time_s *now);
+#ifdef CONFIG_LOG
+static uint16_t log_task(const struct time_s *now);
+#endif
 static inline void timer_init(void);
 static inline void adc_init(void);
 static uint16_t adc_read(uint8_t channel);
@@ -112,128 +372,305 @@ static uint16_t adc_read(uint8_t channel);
  * Private Data
  ****************************************************************************/
 
+/* Calibration block, patched per unit in main.hex. */
+
+static const struct calib_s g_calib CALIB_SECTION =
+{
+    .version    = CALIB_VERSION,
+    .osccal     = CALIB_OSCCAL_FACTORY,
+    .ppm        = 0,
+    .overflows  = TIMER_OVERFLOW_TICK,
+    .remainder  = TIMER_REMAINDER_TICK,
+    .adc_offset = { 0, 0 },
+};
+
 /* Counts TIMER0 overflows. */
 
-static volatile uint16_t g_overflows;
+static volatile uint8_t g_overflows;
+
+/* Length of one second in Timer0 ticks (1024 cycles), derived from the
+ * calibration block: overflows, remainder and 1/256 fraction of a tick.
+ */
+
+static uint8_t g_second_overflows;
+static uint8_t g_second_remainder;
+static uint8_t g_second_fraction;
+
+/* Seconds since boot-up. Monotonic, wraps every ~18h: compare ticks
+ * only with TICKS_SINCE().
+ */
+
+static volatile uint16_t g_ticks;
+
+/* Time of day, derived separately so the ISR stays on 8/16-bit math. */
+
+static volatile uint16_t g_tod_minute;
+static volatile uint8_t g_tod_second;
+
+#ifdef CONFIG_LOG
+/* Days since boot-up. */
+
+static volatile uint16_t g_days;
+#endif
+
+/* Bumped by the ISR after every update of the time above. */
+
+static volatile uint8_t g_time_seq;
+
+/* Event queue, ISRs to main loop. The ISRs only move the head and the
+ * main loop only moves the tail. Both are single bytes, so neither side
+ * needs to disable the interrupts.
+ */
+
+static volatile uint8_t g_events[EVENT_QUEUE_LEN];
+static volatile uint8_t g_event_head;
+static volatile uint8_t g_event_tail;
+
+/* Tick at which the ISR queues the next EV_TICK, written by the main
+ * loop with the interrupts disabled.
+ */
+
+static volatile uint16_t g_wake_tick;
+
+/* Scheduler: the tasks, their periods (0 for a deadline), the next run
+ * of the ones with a deadline, and which of them are ready.
+ */
 
-/* Multiples of 16s since boot-up. */
+static const task_fn_t g_tasks[TASK_COUNT] PROGMEM =
+{
+    pot_task,
+    button_task,
+    pump_task,
+    solar_task,
+    led_task,
+#ifdef CONFIG_LOG
+    log_task,
+#endif
+};
+
+static const uint8_t g_task_periods[TASK_COUNT] PROGMEM =
+{
+    POT_PERIOD,
+    0,
+    0,
+    SOLAR_PERIOD,
+    LED_PERIOD,
+#ifdef CONFIG_LOG
+    LOG_PERIOD,
+#endif
+};
+
+static uint16_t g_task_due[TASK_TIMED_COUNT];
+static uint8_t g_task_ready = TASK_BOOT;
+
+/* Main loop only, shared between the tasks. */
+
+static bool g_led_lock;
+static bool g_charging;
+static bool g_water_request;
+#ifdef CONFIG_SOLAR_WINDOW
+static bool g_surplus;
+#endif
 
-static volatile uint32_t g_ticks;
+static uint8_t g_duration = 5;
 
-/* Set to true from ISR when it's time 
- * to pump some water.
+/* Length of the current watering. */
+
+static uint8_t g_pump_duration;
+
+#ifdef CONFIG_ENERGY_PLAN
+/* Estimated battery charge, harvest of the day so far, smoothed daily 
+ * harvest and what is left of the day's budget, in pump seconds.
  */
 
-static volatile bool g_water_plant;
-static volatile bool g_water_button;
-static volatile bool g_led_lock;
+static uint16_t g_charge = ENERGY_CAPACITY / 2;
+static uint16_t g_harvest;
+static uint16_t g_forecast = ENERGY_NO_PLAN;
+static uint16_t g_budget = ENERGY_NO_PLAN;
+
+/* Day the budget is for. */
+
+static uint16_t g_plan_day;
+#endif
 
-static volatile uint8_t g_duration = 5;
+#ifdef CONFIG_LOG
+/* LOG_REASON_* + 1 of the watering to log. */
+
+static uint8_t g_log_pending;
+#endif
 
 /* Add as many "water plant" events as you wish. 
- * Note that the timing is not perfect, it's an estimation, since 
- * the "systick" has a period of 16s.
+ * The time of day starts at 00:00:00 on power-up.
  */
 
-static const uint32_t g_daily_events[] =
+static const struct water_event_s g_default_events[] PROGMEM =
 {
-    /* WATER_EVENT(hour, minute, second).
-     * Important limitation:
-     *   If 24h wrap around happens when the pump is on, the pump
-     *   will not be stopped. To avoid this, do not add an event 
-     *   near the end of the day. 
-     */
+    /* WATER_EVENT(hour, minute, second). */
 
     WATER_EVENT(0, 0, 5),  /* First event: 5s */
     WATER_EVENT(7, 0, 0),  /* Second event: 7h */
 };
 
+#ifdef CONFIG_SCHEDULE_EEPROM
+/* Loaded from EEPROM at boot-up, see schedule_init(). */
+
+static struct water_event_s g_daily_events[CONFIG_SCHEDULE_MAX];
+static uint8_t g_event_count;
+#else
+#  define g_daily_events g_default_events
+#  define g_event_count  ARRAY_LEN(g_default_events)
+#endif
+
+/* Time of a watering event, in RAM or still in flash. */
+
+#ifdef CONFIG_SCHEDULE_EEPROM
+#  define EVENT_MINUTE(event) ((event)->minute)
+#  define EVENT_SECOND(event) ((event)->second)
+#else
+#  define EVENT_MINUTE(event) pgm_read_word(&(event)->minute)
+#  define EVENT_SECOND(event) pgm_read_byte(&(event)->second)
+#endif
+
 /****************************************************************************
  * Private Functions
  ****************************************************************************/
 
 /****************************************************************************
- * Name: pump_init
+ * Name: cal_requested
  *
  * Description:
- *   Initializes the pump. 
+ *   Checks whether the water button is held at power-up. 
+ *   Must be called after water_button_init().
  *
  * Input Parameters:
  *   None. 
  *
  * Returned Value:
- *   None.
+ *   True to enter the calibration mode.
  *
  ****************************************************************************/
 
-static inline void pump_init(void)
+static bool cal_requested(void)
 {
-    /* Output pin:
-     *   0: pump off
-     *   1: pump on
-     */
+    /* Let the pull-up charge the line. */
 
-    DDRB |= (1 << PB0);
-    PORTB &= ~(1 << PB0);
+    _delay_ms(1);
+
+    return (PINB & (1 << PB1)) == 0;
 }
 
 /****************************************************************************
- * Name: water_button_init
+ * Name: cal_measure
  *
  * Description:
- *   Configures the water button: interrupt on falling edge, internal 
- *   pull-up resistor enabled.
+ *   Counts the CPU cycles of CAL_REF_PERIODS periods of the reference 
+ *   signal on PB1. Timer0 must run with prescaler 1 and interrupts must 
+ *   be disabled.
  *
  * Input Parameters:
  *   None. 
  *
  * Returned Value:
- *   None.
+ *   The cycle count, i.e. the CPU frequency, or 0 if the reference 
+ *   signal is missing.
  *
  ****************************************************************************/
 
-static inline void water_button_init(void)
+static uint32_t cal_measure(void)
 {
-    /* Configure INT0 for this button. 
-     *   - input pin
-     *   - internal pull-up resistor
-     */
+    uint16_t overflows = 0;
+    uint16_t periods = CAL_REF_PERIODS + 1;
+    uint8_t idle = 0;
+    uint8_t prev = PINB & (1 << PB1);
+    uint8_t level;
+    uint8_t count;
+
+    while (periods)
+    {
+        if (TIFR0 & (1 << TOV0))
+        {
+            TIFR0 = (1 << TOV0);
+            overflows++;
 
-    DDRB &= ~(1 << PB1);
-    PORTB |= (1 << PB1);
+            if (++idle == CAL_TIMEOUT_OVF)
+            {
+                return 0;
+            }
+        }
 
-    /* Falling edge interrupt. */
+        level = PINB & (1 << PB1);
 
-    MCUCR |= (2 << ISC00);
-    GIMSK |= (1 << INT0);
+        if (level && !prev)
+        {
+            /* The first rising edge starts the count. */
+
+            if (periods == CAL_REF_PERIODS + 1)
+            {
+                TCNT0 = 0;
+                TIFR0 = (1 << TOV0);
+                overflows = 0;
+            }
+
+            periods--;
+            idle = 0;
+        }
+
+        prev = level;
+    }
+
+    count = TCNT0;
+
+    /* An overflow may be pending right after the last edge. */
+
+    if ((TIFR0 & (1 << TOV0)) && count < 0x80)
+    {
+        overflows++;
+    }
+
+    return ((uint32_t)overflows << 8) | count;
 }
 
 /****************************************************************************
- * Name: INT0_vect
+ * Name: cal_set_osccal
  *
  * Description:
- *   ISR for INT0 - Water button. It is configured to trigger on the 
- *   falling edge. It sets the 'g_water_button' flag to schedule an 
- *   immediate event.
+ *   Moves OSCCAL to 'target' one step at a time. Large jumps of the 
+ *   RC oscillator frequency can upset the CPU.
  *
  * Input Parameters:
- *   None. 
+ *   target - The new OSCCAL value.
  *
  * Returned Value:
  *   None.
  *
  ****************************************************************************/
 
-ISR(INT0_vect)
+static void cal_set_osccal(uint8_t target)
 {
-    g_water_button = true;
+    while (OSCCAL != target)
+    {
+        if (OSCCAL < target)
+        {
+            OSCCAL++;
+        }
+        else
+        {
+            OSCCAL--;
+        }
+    }
 }
 
 /****************************************************************************
- * Name: status_led_init
+ * Name: cal_run
  *
  * Description:
- *   Initializes the status LED. 
+ *   Calibration mode. Binary-searches OSCCAL for the frequency closest 
+ *   to F_CPU, measured against the reference signal on PB1, and stores 
+ *   the result in EEPROM. The status LED is on while calibrating.
+ *
+ *   The result replaces the clock fields of the flash calibration block 
+ *   from the next calib_init() on. If the button is not released or the 
+ *   reference signal is missing, nothing is stored.
  *
  * Input Parameters:
  *   None. 
@@ -243,23 +680,113 @@ ISR(INT0_vect)
  *
  ****************************************************************************/
 
-static inline void status_led_init(void)
+static void cal_run(void)
 {
-    /* Output pin; default off.
-     * 
-     * Configure and light the status LED 
-     * for few seconds.
+    const uint8_t factory = OSCCAL;
+    struct calib_s cal;
+    uint32_t count;
+    uint32_t best;
+    uint8_t osccal = factory & DEVICE_OSCCAL_RANGE;
+    uint16_t overflows = 0;
+
+    STATUS_LED_ON();
+    TCCR0B = (1 << CS00);
+
+    /* Wait for the button to be released. */
+
+    while ((PINB & (1 << PB1)) == 0)
+    {
+        if (TIFR0 & (1 << TOV0))
+        {
+            TIFR0 = (1 << TOV0);
+
+            if (++overflows == CAL_RELEASE_OVF)
+            {
+                goto out;
+            }
+        }
+    }
+
+    /* Successive approximation: the largest OSCCAL that is 
+     * not faster than F_CPU.
      */
 
-    DDRB |= (1 << PB2);
+    for (uint8_t bit = CAL_OSCCAL_MSB; bit; bit >>= 1)
+    {
+        cal_set_osccal(osccal | bit);
+        count = cal_measure();
+
+        if (count == 0)
+        {
+            goto abort;
+        }
+
+        if (count <= F_CPU)
+        {
+            osccal |= bit;
+        }
+    }
+
+    /* Either this one or the next step up is the closest. */
+
+    cal_set_osccal(osccal);
+    best = cal_measure();
+
+    if ((osccal & ~DEVICE_OSCCAL_RANGE) < 2 * CAL_OSCCAL_MSB - 1)
+    {
+        cal_set_osccal(osccal + 1);
+        count = cal_measure();
+
+        if (count != 0 && count - F_CPU < F_CPU - best)
+        {
+            osccal++;
+            best = count;
+        }
+        else
+        {
+            cal_set_osccal(osccal);
+        }
+    }
+
+    if (best == 0)
+    {
+        goto abort;
+    }
+
+    cal = (struct calib_s)
+    {
+        .version    = CALIB_VERSION,
+        .osccal     = osccal,
+        .ppm        = CALIB_PPM_UNKNOWN,
+        .overflows  = best >> 8,
+        .remainder  = best & 0xff,
+        .adc_offset = { 0, 0 },
+        .reserved   = 0xff,
+    };
+
+    eeprom_update_block(&cal, EE_CALIB, sizeof(cal));
+    goto out;
+
+abort:
+    cal_set_osccal(factory);
+
+out:
+    TCCR0B = 0;
+
+    /* The reference left INT0 pending. */
+
+    GIFR = (1 << INTF0);
+
+    STATUS_LED_OFF();
 }
 
 /****************************************************************************
- * Name: timer_init
+ * Name: calib_init
  *
  * Description:
- *   Initializes Timer0 to generate both overflow and match interrupts 
- *   which are used to schedule the water events, 2 per day.
+ *   Applies the calibration: OSCCAL and the length of one second, from 
+ *   the calibration mode result if there is one, otherwise from the 
+ *   flash block. Must be called before timer_init().
  *
  * Input Parameters:
  *   None. 
@@ -269,27 +796,44 @@ static inline void status_led_init(void)
  *
  ****************************************************************************/
 
-static inline void timer_init(void)
+static inline void calib_init(void)
 {
-    /* 16s period:
-     *   - 61 overflows
-     *   - 9 remainder ticks
-     *   - prescaler 1024
-     *   - F_CPU 1MHz
+    uint8_t osccal = pgm_read_byte(&g_calib.osccal);
+    uint16_t overflows = pgm_read_word(&g_calib.overflows);
+    uint8_t remainder = pgm_read_byte(&g_calib.remainder);
+
+    if (eeprom_read_byte(&EE_CALIB->version) == CALIB_VERSION)
+    {
+        osccal = eeprom_read_byte(&EE_CALIB->osccal);
+        overflows = eeprom_read_word(&EE_CALIB->overflows);
+        remainder = eeprom_read_byte(&EE_CALIB->remainder);
+    }
+
+    if (osccal != CALIB_OSCCAL_FACTORY)
+    {
+        cal_set_osccal(osccal);
+    }
+
+    /* The block counts cycles, 'overflows * 256 + remainder'. One 
+     * Timer0 tick is 1024 cycles, so 1/256 of a tick is 4 cycles: the 
+     * second is the cycle count shifted right by 2, split in bytes.
+     * Kept in 16 bits: 'low' is at most 0xffff.
      */
 
-    TCNT0 = 0;
-    OCR0A = TIMER_REMAINDER_TICK;
-    TIMSK0 |= (1 << TOIE0); 
-    TCCR0B |= (1 << CS00);
+    uint16_t low = ((overflows & 0x3ff) << 6) | (remainder >> 2);
+
+    g_second_overflows = overflows >> 10;
+    g_second_remainder = low >> 8;
+    g_second_fraction = low & 0xff;
 }
 
 /****************************************************************************
- * Name: TIM0_OVF_vect
+ * Name: schedule_init
  *
  * Description:
- *   Timer0 is free running and this is the ISR for overflow (when it 
- *   reaches 0xFF).
+ *   Loads the watering events from EEPROM, or the defaults if the EEPROM
+ *   holds no schedule. Invalid events are skipped, the window of the
+ *   others is in the top bits of their hour (see device.h).
  *
  * Input Parameters:
  *   None. 
@@ -299,203 +843,1316 @@ static inline void timer_init(void)
  *
  ****************************************************************************/
 
-ISR(TIM0_OVF_vect)
+static inline void schedule_init(void)
 {
-    g_overflows++;
+#ifdef CONFIG_SCHEDULE_EEPROM
+    const uint8_t *ee = EE_SCHEDULE;
+    uint8_t count = eeprom_read_byte(ee++);
 
-    if (g_overflows == TIMER_OVERFLOW_TICK)
+    if (count > CONFIG_SCHEDULE_MAX)
     {
-        TIMSK0 |= (1 << OCIE0A);
-        g_overflows = 0;
+        /* Erased or garbage: use the defaults. */
+
+        memcpy_P(g_daily_events, g_default_events, sizeof(g_default_events));
+        g_event_count = ARRAY_LEN(g_default_events);
+        return;
     }
-}
 
-/****************************************************************************
+    g_event_count = 0;
+
+    while (count--)
+    {
+        uint8_t hour = eeprom_read_byte(ee++);
+        uint8_t min = eeprom_read_byte(ee++);
+        uint8_t sec = eeprom_read_byte(ee++);
+
+#ifdef CONFIG_SOLAR_WINDOW
+        g_daily_events[g_event_count].window = hour >> EVENT_WINDOW_SHIFT;
+        hour &= EVENT_HOUR_MASK;
+#endif
+
+        if (hour < 24 && min < 60 && sec < 60)
+        {
+            g_daily_events[g_event_count].minute = hour * 60 + min;
+            g_daily_events[g_event_count].second = sec;
+            g_event_count++;
+        }
+    }
+#endif
+}
+
+#ifdef CONFIG_LOG
+/****************************************************************************
+ * Name: log_write
+ *
+ * Description:
+ *   Appends a watering to the EEPROM log ring.
+ *
+ * Input Parameters:
+ *   reason - LOG_REASON_*.
+ *   now    - Time of the watering.
+ *
+ * Returned Value:
+ *   None.
+ *
+ ****************************************************************************/
+
+static void log_write(uint8_t reason, const struct time_s *now)
+{
+    struct log_entry_s entry;
+    uint8_t head = eeprom_read_byte(EE_LOG_HEAD);
+
+    if (head >= CONFIG_LOG_ENTRIES)
+    {
+        head = 0;
+    }
+
+    entry.day = now->day;
+    entry.minute = now->minute;
+    entry.duration = g_pump_duration;
+    entry.reason = reason;
+
+    eeprom_update_block(&entry, &EE_LOG[head], sizeof(entry));
+    eeprom_update_byte(EE_LOG_HEAD, (head + 1) % CONFIG_LOG_ENTRIES);
+}
+#endif
+
+#ifdef CONFIG_ENERGY_PLAN
+/****************************************************************************
+ * Name: energy_forecast
+ *
+ * Description:
+ *   Adds a day's harvest to the forecast, by exponential smoothing. The 
+ *   first day seeds it.
+ *
+ * Input Parameters:
+ *   harvest - The day's harvest, pump seconds.
+ *
+ * Returned Value:
+ *   None.
+ *
+ ****************************************************************************/
+
+static void energy_forecast(uint16_t harvest)
+{
+    if (g_forecast == ENERGY_NO_PLAN)
+    {
+        g_forecast = harvest;
+        return;
+    }
+
+    g_forecast += (int16_t)(harvest - g_forecast) >> FORECAST_SHIFT;
+}
+
+/****************************************************************************
+ * Name: energy_plan
+ *
+ * Description:
+ *   Sets the budget of the day's scheduled waterings: the forecast 
+ *   harvest, plus or minus the charge off the reserve spread over 
+ *   ENERGY_SPREAD_DAYS. Nothing is planned without a forecast.
+ *
+ * Input Parameters:
+ *   None. 
+ *
+ * Returned Value:
+ *   None.
+ *
+ ****************************************************************************/
+
+static void energy_plan(void)
+{
+    int16_t budget;
+
+    if (g_forecast == ENERGY_NO_PLAN)
+    {
+        return;
+    }
+
+    budget = g_forecast +
+             ((int16_t)g_charge - ENERGY_RESERVE) / ENERGY_SPREAD_DAYS;
+
+    g_budget = MAX(budget, 0);
+}
+
+/****************************************************************************
+ * Name: energy_init
+ *
+ * Description:
+ *   Replays the EEPROM history, oldest day first, into the forecast, 
+ *   takes the battery charge from the last day and plans the first day.
+ *
+ * Input Parameters:
+ *   None. 
+ *
+ * Returned Value:
+ *   None.
+ *
+ ****************************************************************************/
+
+static inline void energy_init(void)
+{
+    uint8_t head = eeprom_read_byte(EE_HISTORY_HEAD);
+    struct history_entry_s entry;
+
+    if (head >= CONFIG_HISTORY_DAYS)
+    {
+        /* No history yet. */
+
+        return;
+    }
+
+    for (uint8_t i = 0; i < CONFIG_HISTORY_DAYS; i++)
+    {
+        eeprom_read_block(&entry, &EE_HISTORY[head], sizeof(entry));
+
+        /* Skip the erased entries, the ring is not full yet. */
+
+        if (entry.harvest != 0xff || entry.charge != 0xff)
+        {
+            energy_forecast((uint16_t)entry.harvest << ENERGY_UNIT_SHIFT);
+            g_charge = MIN((uint16_t)entry.charge << ENERGY_UNIT_SHIFT,
+                           ENERGY_CAPACITY);
+        }
+
+        if (++head == CONFIG_HISTORY_DAYS)
+        {
+            head = 0;
+        }
+    }
+
+    energy_plan();
+}
+
+/****************************************************************************
+ * Name: energy_day
+ *
+ * Description:
+ *   Once a day: appends the day that ended to the EEPROM history ring, 
+ *   updates the forecast and plans the new day. Called by the tasks 
+ *   before they use the day's figures.
+ *
+ * Input Parameters:
+ *   now - Current time.
+ *
+ * Returned Value:
+ *   None.
+ *
+ ****************************************************************************/
+
+static void energy_day(const struct time_s *now)
+{
+    struct history_entry_s entry;
+    uint8_t head;
+
+    if (now->day == g_plan_day)
+    {
+        return;
+    }
+
+    g_plan_day = now->day;
+
+    head = eeprom_read_byte(EE_HISTORY_HEAD);
+
+    if (head >= CONFIG_HISTORY_DAYS)
+    {
+        head = 0;
+    }
+
+    entry.harvest = MIN(g_harvest >> ENERGY_UNIT_SHIFT, 0xfe);
+    entry.charge = g_charge >> ENERGY_UNIT_SHIFT;
+
+    eeprom_update_block(&entry, &EE_HISTORY[head], sizeof(entry));
+    eeprom_update_byte(EE_HISTORY_HEAD, (head + 1) % CONFIG_HISTORY_DAYS);
+
+    energy_forecast(g_harvest);
+    g_harvest = 0;
+
+    energy_plan();
+}
+
+/****************************************************************************
+ * Name: energy_share
+ *
+ * Description:
+ *   Length of a scheduled watering starting now: the budget left, shared
+ *   by the events left in the day, at most 'g_duration'. A share shorter
+ *   than ENERGY_MIN_WATERING stays in the budget for the later events.
+ *
+ * Input Parameters:
+ *   now - Current time.
+ *
+ * Returned Value:
+ *   Seconds, 0 to skip the watering.
+ *
+ ****************************************************************************/
+
+static uint8_t energy_share(const struct time_s *now)
+{
+    uint8_t left = 1;
+    uint16_t share;
+
+    if (g_budget == ENERGY_NO_PLAN)
+    {
+        return g_duration;
+    }
+
+    /* This one is due, up to PUMP_LATE_MAX ago. */
+
+    for (uint8_t i = 0; i < g_event_count; i++)
+    {
+        if (g_daily_events[i].minute > now->minute)
+        {
+            left++;
+        }
+    }
+
+    share = MIN(g_budget / left, g_duration);
+
+    if (share < ENERGY_MIN_WATERING)
+    {
+        return 0;
+    }
+
+    g_budget -= share;
+
+    return share;
+}
+#endif
+
+/****************************************************************************
+ * Name: event_push
+ *
+ * Description:
+ *   Queues an event for the main loop. ISR context only: the ISRs do 
+ *   not nest, so they act as the single producer. The event is dropped 
+ *   if the queue is full; the main loop handles at most one of each 
+ *   kind per wake anyway.
+ *
+ * Input Parameters:
+ *   ev - EV_*.
+ *
+ * Returned Value:
+ *   None.
+ *
+ ****************************************************************************/
+
+static inline void event_push(uint8_t ev)
+{
+    uint8_t head = g_event_head;
+    uint8_t next = (head + 1) & EVENT_QUEUE_MASK;
+
+    if (next != g_event_tail)
+    {
+        g_events[head] = ev;
+
+        /* Publish the slot only after it was written. */
+
+        g_event_head = next;
+    }
+}
+
+/****************************************************************************
+ * Name: event_pop
+ *
+ * Description:
+ *   Takes the oldest event from the queue. Main loop only.
+ *
+ * Input Parameters:
+ *   None. 
+ *
+ * Returned Value:
+ *   EV_*, EV_NONE if the queue is empty.
+ *
+ ****************************************************************************/
+
+static uint8_t event_pop(void)
+{
+    uint8_t tail = g_event_tail;
+    uint8_t ev;
+
+    if (tail == g_event_head)
+    {
+        return EV_NONE;
+    }
+
+    ev = g_events[tail];
+
+    /* Free the slot only after it was read. */
+
+    g_event_tail = (tail + 1) & EVENT_QUEUE_MASK;
+    return ev;
+}
+
+/****************************************************************************
+ * Name: time_snapshot
+ *
+ * Description:
+ *   Copies the time kept by the Timer0 ISR. The copy is retried when the 
+ *   ISR ran in between, so the multi-byte values are never torn and all 
+ *   fields belong to the same second. 
+ *
+ * Input Parameters:
+ *   now - Filled with the current time.
+ *
+ * Returned Value:
+ *   None.
+ *
+ ****************************************************************************/
+
+static void time_snapshot(struct time_s *now)
+{
+    uint8_t seq;
+
+    do
+    {
+        seq = g_time_seq;
+
+        now->ticks = g_ticks;
+        now->minute = g_tod_minute;
+        now->second = g_tod_second;
+#ifdef CONFIG_LOG
+        now->day = g_days;
+#endif
+    }
+    while (seq != g_time_seq);
+}
+
+/****************************************************************************
+ * Name: pump_init
+ *
+ * Description:
+ *   Initializes the pump. 
+ *
+ * Input Parameters:
+ *   None. 
+ *
+ * Returned Value:
+ *   None.
+ *
+ ****************************************************************************/
+
+static inline void pump_init(void)
+{
+    /* Output pin:
+     *   0: pump off
+     *   1: pump on
+     */
+
+    DDRB |= (1 << PB0);
+    PORTB &= ~(1 << PB0);
+}
+
+/****************************************************************************
+ * Name: water_button_init
+ *
+ * Description:
+ *   Configures the water button: interrupt on falling edge, internal 
+ *   pull-up resistor enabled.
+ *
+ * Input Parameters:
+ *   None. 
+ *
+ * Returned Value:
+ *   None.
+ *
+ ****************************************************************************/
+
+static inline void water_button_init(void)
+{
+    /* Configure INT0 for this button. 
+     *   - input pin
+     *   - internal pull-up resistor
+     */
+
+    DDRB &= ~(1 << PB1);
+    PORTB |= (1 << PB1);
+
+    /* Falling edge interrupt. */
+
+    MCUCR |= (2 << ISC00);
+    GIMSK |= (1 << INT0);
+}
+
+/****************************************************************************
+ * Name: INT0_vect
+ *
+ * Description:
+ *   ISR for INT0 - Water button. It is configured to trigger on the 
+ *   falling edge. It queues EV_BUTTON; the main loop debounces it and 
+ *   schedules an immediate watering.
+ *
+ * Input Parameters:
+ *   None. 
+ *
+ * Returned Value:
+ *   None.
+ *
+ ****************************************************************************/
+
+ISR(INT0_vect)
+{
+    event_push(EV_BUTTON);
+}
+
+/****************************************************************************
+ * Name: status_led_init
+ *
+ * Description:
+ *   Initializes the status LED. 
+ *
+ * Input Parameters:
+ *   None. 
+ *
+ * Returned Value:
+ *   None.
+ *
+ ****************************************************************************/
+
+static inline void status_led_init(void)
+{
+    /* Output pin; default off.
+     * 
+     * Configure and light the status LED 
+     * for few seconds.
+     */
+
+    DDRB |= (1 << PB2);
+}
+
+/****************************************************************************
+ * Name: timer_init
+ *
+ * Description:
+ *   Initializes Timer0 to generate both overflow and match interrupts 
+ *   which are used to count the seconds, and divides the system clock.
+ *
+ * Input Parameters:
+ *   None. 
+ *
+ * Returned Value:
+ *   None.
+ *
+ ****************************************************************************/
+
+static inline void timer_init(void)
+{
+    /* ATtiny13 defaults, 1205583Hz, Timer0 at F_CPU / 1024:
+     *   - 4 overflows per second
+     *   - 153 remainder ticks
+     *   - 83/256 fraction of a tick
+     */
+
+    TCNT0 = 0;
+    OCR0A = g_second_remainder;
+    TIMSK0 |= (1 << TOIE0); 
+
+    /* Interrupts are still off: the second write must follow within 4
+     * cycles.
+     */
+
+    CLKPR = (1 << CLKPCE);
+    CLKPR = CLOCK_DIV;
+    TCCR0B = TIMER_CS;
+}
+
+/****************************************************************************
+ * Name: TIM0_OVF_vect
+ *
+ * Description:
+ *   Timer0 is free running and this is the ISR for overflow (when it 
+ *   reaches 0xFF).
+ *
+ * Input Parameters:
+ *   None. 
+ *
+ * Returned Value:
+ *   None.
+ *
+ ****************************************************************************/
+
+ISR(TIM0_OVF_vect)
+{
+    g_overflows++;
+
+    if (g_overflows == g_second_overflows)
+    {
+        /* Drop the match left pending from the previous lap,
+         * otherwise the compare ISR fires right away.
+         */
+
+        TIFR0 = (1 << OCF0A);
+        TIMSK0 |= (1 << OCIE0A);
+        g_overflows = 0;
+    }
+}
+
+/****************************************************************************
  * Name: TIM0_COMPA_vect
  *
  * Description:
- *   ISR for Timer0 Output Compare A match interrupt. 
- *   It is used to count the time since boot-up. 
+ *   ISR for Timer0 Output Compare A match interrupt. 
+ *   It is used to count the time since boot-up and queues EV_TICK 
+ *   when the next task is due.
+ *
+ * Input Parameters:
+ *   None. 
+ *
+ * Returned Value:
+ *   None.
+ *
+ ****************************************************************************/
+
+ISR(TIM0_COMPA_vect)
+{
+    /* This interrupt will be enabled again by the 
+     * overflow ISR, at the proper time. This way we 
+     * don't waste CPU cycles (and power).
+     *
+     * This function is called every second.
+     */
+
+    TIMSK0 &= ~(1 << OCIE0A);
+    g_ticks++;
+
+    /* Move the match point by the remainder and the fraction, so 
+     * one second is exactly the calibrated length on average. 
+     * On carry, the next second needs one more overflow.
+     */
+
+    static uint8_t fraction;
+    uint16_t phase = OCR0A + g_second_remainder;
+
+    fraction += g_second_fraction;
+
+    if (fraction < g_second_fraction)
+    {
+        phase++;
+    }
+
+    if (phase > 0xff)
+    {
+        g_overflows--;
+    }
+
+    OCR0A = phase;
+
+    /* Time of day. */
+
+    if (++g_tod_second == 60)
+    {
+        g_tod_second = 0;
+
+        if (++g_tod_minute == MINUTES_PER_DAY)
+        {
+            g_tod_minute = 0;
+
+#ifdef CONFIG_LOG
+            g_days++;
+#endif
+        }
+    }
+
+    g_time_seq++;
+
+    /* Wake the main loop only when a task is due. */
+
+    if (g_ticks == g_wake_tick)
+    {
+        event_push(EV_TICK);
+    }
+}
+
+/****************************************************************************
+ * Name: adc_init
+ *
+ * Description:
+ *   Initializes the ADC and disables the digital block for the 
+ *   analog pins. 
+ *
+ * Input Parameters:
+ *   None. 
+ *
+ * Returned Value:
+ *   None.
+ *
+ ****************************************************************************/
+
+static inline void adc_init(void)
+{
+    DDRB &= ~((1 << PB3) | (1 << PB4));
+    
+    /* ADC prescaler 8 at F_CPU / 16, the same ADC clock as prescaler
+     * 128 at F_CPU, which the calibration offsets assume.
+     */
+
+    ADCSRA |= (3 << ADPS0);
+
+    /* Disable digital block for pins PB3 (ADC3) and PB4 (ADC2). */
+
+    DIDR0 |= (1 << ADC2D) | (1 << ADC3D);
+}
+
+/****************************************************************************
+ * Name: adc_read
+ *
+ * Description:
+ *   Sample the request ADC channel. 
+ *
+ * Input Parameters:
+ *   channel - The ADC channel to read.
+ *
+ * Returned Value:
+ *   The ADC value in range [0, 1023], corrected by the calibration 
+ *   offset of the channel.
+ *
+ ****************************************************************************/
+
+static uint16_t adc_read(uint8_t channel)
+{
+    const uint8_t channel_mask = (1 << MUX1) | (1 << MUX0);
+    int16_t val = 0;
+
+    /* Clear the MUX0 and MUX 1 bits. */
+    
+    ADMUX &= ~channel_mask;
+    ADMUX |= channel & channel_mask;
+
+    /* Turn on the ADC. */
+
+    ADCSRA |= (1 << ADEN);
+
+    /* Start the conversion. */
+
+    ADCSRA |= (1 << ADSC);
+
+    /* Wait for the conversion to end. */
+    
+    while ((ADCSRA & (1 << ADSC)));
+    val = ADC; 
+
+    /* Turn off the ADC. */
+    
+    ADCSRA &= ~(1 << ADEN);
+
+    val += (int8_t)pgm_read_byte(
+        &g_calib.adc_offset[channel - CALIB_ADC_FIRST]);
+
+    if (val < 0)
+    {
+        val = 0;
+    }
+    else if (val > 1023)
+    {
+        val = 1023;
+    }
+
+    return val;
+}
+
+/****************************************************************************
+ * Name: task_wake
+ *
+ * Description:
+ *   Schedules a task with a deadline, also one waiting in TASK_IDLE. Due
+ *   now or in the past runs it in the current pass if it comes after the
+ *   caller.
+ *
+ * Input Parameters:
+ *   task - TASK_BUTTON or TASK_PUMP.
+ *   due  - Tick to run it at.
+ *
+ * Returned Value:
+ *   None.
+ *
+ ****************************************************************************/
+
+static void task_wake(uint8_t task, uint16_t due)
+{
+    TASK_DUE(task) = due;
+    g_task_ready |= TASK_BIT(task);
+}
+
+/****************************************************************************
+ * Name: task_resume
+ *
+ * Description:
+ *   Makes a periodic task ready again. It runs from its next period on,
+ *   in the current pass if the tick is a multiple of the period and it 
+ *   comes after the caller.
+ *
+ * Input Parameters:
+ *   task - TASK_*, one without a deadline.
+ *
+ * Returned Value:
+ *   None.
+ *
+ ****************************************************************************/
+
+static void task_resume(uint8_t task)
+{
+    g_task_ready |= TASK_BIT(task);
+}
+
+/****************************************************************************
+ * Name: task_run
+ *
+ * Description:
+ *   Runs the tasks which are due, in TASK_* order. A task with a deadline
+ *   is rescheduled with the delay it returns, a periodic one keeps its 
+ *   period unless it returns TASK_IDLE.
+ *
+ * Input Parameters:
+ *   now - Current time.
+ *
+ * Returned Value:
+ *   The tick the earliest task is due at. Already reached if a task 
+ *   woke one before it in the table.
+ *
+ ****************************************************************************/
+
+static uint16_t task_run(const struct time_s *now)
+{
+    uint16_t wake = now->ticks + TASK_MAX_DELAY;
+
+    for (uint8_t i = 0; i < TASK_COUNT; i++)
+    {
+        uint8_t bit = TASK_BIT(i);
+        uint8_t period = pgm_read_byte(&g_task_periods[i]);
+        bool due;
+
+        if (!(g_task_ready & bit))
+        {
+            continue;
+        }
+
+        if (period)
+        {
+            due = (now->ticks & (period - 1)) == 0;
+        }
+        else
+        {
+            due = TICKS_DUE(now->ticks, TASK_DUE(i));
+        }
+
+        if (due)
+        {
+            task_fn_t fn = (task_fn_t)pgm_read_word(&g_tasks[i]);
+            uint16_t delay = fn(now);
+
+            if (delay == TASK_IDLE)
+            {
+                g_task_ready &= ~bit;
+            }
+            else if (!period)
+            {
+                TASK_DUE(i) = now->ticks + MIN(delay, TASK_MAX_DELAY);
+            }
+        }
+    }
+
+    /* Earliest deadline, a second loop since tasks wake each other. A 
+     * periodic task is next due at the following multiple of its period.
+     */
+
+    for (uint8_t i = 0; i < TASK_COUNT; i++)
+    {
+        uint8_t period = pgm_read_byte(&g_task_periods[i]);
+        uint16_t due;
+
+        if (!(g_task_ready & TASK_BIT(i)))
+        {
+            continue;
+        }
+
+        if (period)
+        {
+            due = (now->ticks | (period - 1)) + 1;
+        }
+        else
+        {
+            due = TASK_DUE(i);
+        }
+
+        if ((int16_t)(due - wake) < 0)
+        {
+            wake = due;
+        }
+    }
+
+    return wake;
+}
+
+/****************************************************************************
+ * Name: button_task
+ *
+ * Description:
+ *   Runs one second after a falling edge on the water button. If it is 
+ *   still pressed, requests a watering with a fresh duration.
  *
  * Input Parameters:
- *   None. 
+ *   now - Current time.
  *
  * Returned Value:
- *   None.
+ *   TASK_IDLE, EV_BUTTON wakes it again.
  *
  ****************************************************************************/
 
+static uint16_t button_task(const struct time_s *now)
+{
+    if ((PINB & (1 << PB1)) == 0)
+    {
+        g_water_request = true;
+
+        pot_task(now);
+        task_wake(TASK_PUMP, now->ticks);
+    }
 
-ISR(TIM0_COMPA_vect)
+    return TASK_IDLE;
+}
+
+/****************************************************************************
+ * Name: pot_task
+ *
+ * Description:
+ *   Reads the duration adjustment potentiometer into 'g_duration'.
+ *
+ * Input Parameters:
+ *   now - Current time.
+ *
+ * Returned Value:
+ *   POT_PERIOD.
+ *
+ ****************************************************************************/
+
+static uint16_t pot_task(const struct time_s *now)
 {
-    static volatile uint32_t pump_start_ticks = 0;
-   
-    /* This interrupt will be enabled again by the 
-     * overflow ISR, at the proper time. This way we 
-     * don't waste CPU cycles (and power).
+    uint16_t duration = adc_read(3);
+
+    /* y = ax + b
+     *   x = 0 (0V)    => y = 5 sec  => b = 5
+     *   x = 1023 (5V) => y = 60 sec
      *
-     * This function is called every second.
+     *  => a = 55 / 1023
+     *  => y = 55 / 1023 * x + 5;
+     *
+     * Dividing by 1024 instead, with rounding, gives the same 
+     * end points and needs no 32-bit division.
      */
 
-    TIMSK0 &= ~(1 << OCIE0A);
-    g_ticks++;
+    g_duration = ((duration * 55 + 512) >> 10) + 5;
+
+    return POT_PERIOD;
+}
+
+/****************************************************************************
+ * Name: event_delay
+ *
+ * Description:
+ *   Seconds from now to the next occurrence of a watering event.
+ *
+ * Input Parameters:
+ *   now   - Current time.
+ *   event - The watering event.
+ *
+ * Returned Value:
+ *   Seconds to the event, at most TASK_MAX_DELAY. Negative if it passed 
+ *   less than a minute ago.
+ *
+ ****************************************************************************/
+
+static int16_t event_delay(const struct time_s *now,
+                           const struct water_event_s *event)
+{
+    int16_t minutes = EVENT_MINUTE(event) - now->minute;
+
+    if (minutes == MINUTES_PER_DAY - 1)
+    {
+        minutes = -1;
+    }
+    else if (minutes < -1)
+    {
+        minutes += MINUTES_PER_DAY;
+    }
+
+    if (minutes > TASK_MAX_DELAY / 60)
+    {
+        return TASK_MAX_DELAY;
+    }
+
+    return minutes * 60 + EVENT_SECOND(event) - now->second;
+}
+
+/****************************************************************************
+ * Name: pump_task
+ *
+ * Description:
+ *   Starts the pump on request or at a scheduled event and stops it 
+ *   after 'g_duration' seconds. A request during a watering starts 
+ *   another one after it.
+ *
+ *   An event with a window opens it instead. The watering then starts 
+ *   on the first solar surplus, so the pump runs mostly off the panel 
+ *   rather than the battery, or at the end of the window if the sun 
+ *   never comes. Overlapping windows make one watering, by the earliest
+ *   end. Other waterings leave the window open.
+ *
+ *   With the energy plan, scheduled waterings off the battery share the 
+ *   day's budget and are skipped once it is spent. Waterings on a solar 
+ *   surplus and on request always run for 'g_duration'.
+ *
+ * Input Parameters:
+ *   now - Current time.
+ *
+ * Returned Value:
+ *   Seconds to the end of the watering, or to the next event.
+ *
+ ****************************************************************************/
+
+static uint16_t pump_task(const struct time_s *now)
+{
+    static bool pumping;
+    static bool booted;
+    static uint16_t pump_start_ticks;
+#ifdef CONFIG_SOLAR_WINDOW
+    static bool window_open;
+    static uint16_t window_end;
+#endif
+    uint16_t delay = TASK_MAX_DELAY;
+    int8_t late_max = booted ? PUMP_LATE_MAX : 0;
+    bool start = false;
+#ifdef CONFIG_ENERGY_PLAN
+    bool manual = false;
+#endif
 
     /* Make sure there is no pumping in progress.
-     * We wouldn't want to flood the plants.
+     * We wouldn't want to flood the plants. A request made meanwhile 
+     * stays pending and waters once this one is over.
      */
-    
-    if (pump_start_ticks == 0)
+
+    if (pumping)
     {
-        if (g_water_plant)
+        uint16_t elapsed = TICKS_SINCE(now->ticks, pump_start_ticks);
+
+        if (elapsed < g_pump_duration)
         {
-            /* Water was manually requested. */
+            return g_pump_duration - elapsed;
+        }
 
-            g_water_plant = false;
+        /* Stop the pump. */
 
-            /* Start pumping now. */
+        PUMP_OFF();
+        STATUS_LED_OFF();
+        STATUS_LED_UNLOCK();
+        task_resume(TASK_LED);
 
-            pump_start_ticks = g_ticks;
-        }
-        else 
-        {
-            /* Was water scheduled at this time? */
+        pumping = false;
+    }
+
+    if (g_water_request)
+    {
+        /* Water was manually requested. */
+
+        g_water_request = false;
+        start = true;
+#ifdef CONFIG_ENERGY_PLAN
+        manual = true;
+#endif
+
+#ifdef CONFIG_LOG
+        g_log_pending = LOG_REASON_BUTTON + 1;
+#endif
+    }
+
+    /* Was water scheduled at this time? Otherwise sleep until the 
+     * next event. The first run is at power-up, 00:00:00, so nothing 
+     * before it was missed: events late by wrapping back to 23:59 are 
+     * not.
+     */
+
+    booted = true;
 
-            for (int i = 0; i < ARRAY_LEN(g_daily_events); i++)
+    for (uint8_t i = 0; i < g_event_count; i++)
+    {
+        int16_t d = event_delay(now, &g_daily_events[i]);
+
+        if (d <= 0 && d >= -late_max)
+        {
+#ifdef CONFIG_SOLAR_WINDOW
+            if (g_daily_events[i].window)
             {
-                if (g_ticks == g_daily_events[i])
-                {
-                    /* Start pumping now. */
+                uint16_t end = now->ticks + d +
+                    g_daily_events[i].window * SECONDS_PER_HOUR;
 
-                    pump_start_ticks = g_ticks;
-                    break;
+                /* Seen again while less than PUMP_LATE_MAX late. */
+
+                if (!window_open || (int16_t)(end - window_end) < 0)
+                {
+                    window_end = end;
                 }
+
+                window_open = true;
+                continue;
+            }
+#endif
+
+            if (!start)
+            {
+                start = true;
+
+#ifdef CONFIG_LOG
+                g_log_pending = LOG_REASON_SCHEDULE + 1;
+#endif
             }
         }
+        else if (d > 0 && (uint16_t)d < delay)
+        {
+            delay = d;
+        }
     }
 
-    if (pump_start_ticks == g_ticks)
+#ifdef CONFIG_SOLAR_WINDOW
+    if (window_open && !start)
     {
-        /* Start the pump. */
-        
-        PUMP_ON();
-        STATUS_LED_LOCK();
-        STATUS_LED_ON();
+        if (g_surplus || TICKS_DUE(now->ticks, window_end))
+        {
+            window_open = false;
+            start = true;
+
+#ifdef CONFIG_LOG
+            g_log_pending = (g_surplus ? LOG_REASON_SOLAR :
+                             LOG_REASON_SCHEDULE) + 1;
+#endif
+        }
+        else
+        {
+            /* The solar task wakes it earlier on a surplus. */
+
+            delay = MIN(delay, TICKS_SINCE(window_end, now->ticks));
+        }
     }
+#endif
 
-    if (pump_start_ticks != 0)
-    {
-        /* Pumping in progress. */
+    g_pump_duration = g_duration;
 
-        if (g_ticks >= pump_start_ticks + g_duration)
-        {
-            /* Stop the pump. */
+#ifdef CONFIG_ENERGY_PLAN
+    energy_day(now);
 
-            PUMP_OFF();
-            STATUS_LED_OFF();
-            STATUS_LED_UNLOCK();
+    if (start && !manual && !g_surplus)
+    {
+        g_pump_duration = energy_share(now);
 
-            /* Pumping no longer in progress. */
+        if (g_pump_duration == 0)
+        {
+            /* Out of budget, skip it. */
 
-            pump_start_ticks = 0;
+            start = false;
+            g_log_pending = 0;
         }
     }
 
-    /* 1 day wrap around to avoid overflows. */
+    if (start && !g_surplus)
+    {
+        g_charge -= MIN(g_charge, g_pump_duration);
+    }
+#endif
+
+    if (start)
+    {
+        /* Start the pump. */
+
+        pumping = true;
+        pump_start_ticks = now->ticks;
+
+        PUMP_ON();
+        STATUS_LED_LOCK();
+        STATUS_LED_ON();
+
+#ifdef CONFIG_LOG
+        task_resume(TASK_LOG);
+#endif
+
+        return g_pump_duration;
+    }
 
-    g_ticks = g_ticks % FULL_DAY_TICKS;
+    return delay;
 }
 
 /****************************************************************************
- * Name: adc_init
+ * Name: solar_task
  *
  * Description:
- *   Initializes the ADC and disables the digital block for the 
- *   analog pins. 
+ *   Reads the solar panel voltage and wakes the LED task when the 
+ *   charging state changes, and the pump task when a surplus starts. 
+ *   Samples above SOLAR_PANEL_THRESHOLD count towards the harvest.
  *
  * Input Parameters:
- *   None. 
+ *   now - Current time.
  *
  * Returned Value:
- *   None.
+ *   SOLAR_PERIOD.
  *
  ****************************************************************************/
 
-static inline void adc_init(void)
+static uint16_t solar_task(const struct time_s *now)
 {
-    DDRB &= ~((1 << PB3) | (1 << PB4));
-    
-    /* ADC prescaler 128. */
+    /* R1 = 47K, R2 = 10K.
+     *
+     * Vref = R2 / (R1 + R2) * Vin
+     *
+     * Example:
+     *   a) Vin = 23V   => Vref = 4.03V (charging)
+     *   b) Vin = 15.4V => Vref = 2.70V (charging) 
+     *   c) Vin = 15V   => Vref = 2.63V (battery not charging)
+     *   d) Vin = 14V   => Vref = 2.45V (battery not charging)
+     *
+     * ADC has a resolution of 10 bits:
+     *  2.70V ... X
+     *  5V    ... 1023
+     *  => X = 2.70V * 1023 / 5 = 553
+     *
+     */
 
-    ADCSRA |= (7 << ADPS0);
+    uint16_t panel = adc_read(2);
+    bool charging = panel >= SOLAR_PANEL_THRESHOLD;
 
-    /* Disable digital block for pins PB3 (ADC3) and PB4 (ADC2). */
+    if (charging != g_charging)
+    {
+        g_charging = charging;
+        task_resume(TASK_LED);
+    }
 
-    DIDR0 |= (1 << ADC2D) | (1 << ADC3D);
+#ifdef CONFIG_ENERGY_PLAN
+    energy_day(now);
+
+    if (charging)
+    {
+        g_harvest += ENERGY_SAMPLE;
+        g_charge = MIN(g_charge + ENERGY_SAMPLE, ENERGY_CAPACITY);
+    }
+#endif
+
+#ifdef CONFIG_SOLAR_WINDOW
+    static uint8_t surplus_samples;
+
+    if (panel < SOLAR_SURPLUS_THRESHOLD)
+    {
+        surplus_samples = 0;
+        g_surplus = false;
+    }
+    else if (surplus_samples < SOLAR_SURPLUS_SAMPLES &&
+             ++surplus_samples == SOLAR_SURPLUS_SAMPLES)
+    {
+        g_surplus = true;
+        task_wake(TASK_PUMP, now->ticks);
+    }
+#endif
+
+    return SOLAR_PERIOD;
 }
 
 /****************************************************************************
- * Name: adc_read
+ * Name: led_task
  *
  * Description:
- *   Sample the request ADC channel. 
+ *   The status LED is used for two purposes:
+ *    a) 1s ON, 1s OFF, 1s ON... - during battery charging
+ *    b) 'duration' seconds ON   - when pump is on
+ *
+ *   The pump has priority, it locks the LED while on.
  *
  * Input Parameters:
- *   channel - The ADC channel to read.
+ *   now - Current time.
  *
  * Returned Value:
- *   The ADC value in range [0, 1023].
+ *   LED_PERIOD while charging, otherwise TASK_IDLE until the pump or the
+ *   solar task wakes it.
  *
  ****************************************************************************/
 
-static uint16_t adc_read(uint8_t channel)
+static uint16_t led_task(const struct time_s *now)
 {
-    const uint8_t channel_mask = (1 << MUX1) | (1 << MUX0);
-    uint16_t val = 0;
-
-    /* Clear the MUX0 and MUX 1 bits. */
-    
-    ADMUX &= ~channel_mask;
-    ADMUX |= channel & channel_mask;
-
-    /* Turn on the ADC. */
+    if (STATUS_LED_LOCKED())
+    {
+        return TASK_IDLE;
+    }
 
-    ADCSRA |= (1 << ADEN);
+    if (g_charging)
+    {
+        /* Toggle the status LED while charging. */
 
-    /* Start the conversion. */
+        STATUS_LED_TOGGLE();
+        return LED_PERIOD;
+    }
 
-    ADCSRA |= (1 << ADSC);
+    STATUS_LED_OFF();
+    return TASK_IDLE;
+}
 
-    /* Wait for the conversion to end. */
-    
-    while ((ADCSRA & (1 << ADSC)));
-    val = ADC; 
+#ifdef CONFIG_LOG
+/****************************************************************************
+ * Name: log_task
+ *
+ * Description:
+ *   Writes the watering started by the pump task to the EEPROM log.
+ *
+ * Input Parameters:
+ *   now - Current time.
+ *
+ * Returned Value:
+ *   TASK_IDLE, the pump task wakes it.
+ *
+ ****************************************************************************/
 
-    /* Turn off the ADC. */
-    
-    ADCSRA &= ~(1 << ADEN);
+static uint16_t log_task(const struct time_s *now)
+{
+    if (g_log_pending)
+    {
+        log_write(g_log_pending - 1, now);
+        g_log_pending = 0;
+    }
 
-    return val;
+    return TASK_IDLE;
 }
+#endif
 
 /****************************************************************************
  * Public Functions
  ****************************************************************************/
 
+/* main() never returns, so it saves no registers on the small stack. */
+
+int main(void) __attribute__((OS_main));
+
 int main(void)
 {
-    uint32_t prev_tick = 0;
+    struct time_s now;
+    bool run = true;
 
     /* Initialize all subsystems. */
 
     pump_init();
+
+    status_led_init();
     
     water_button_init();
+
+    if (cal_requested())
+    {
+        cal_run();
+    }
+
+    calib_init();
+
+    schedule_init();
+
+#ifdef CONFIG_ENERGY_PLAN
+    energy_init();
+#endif
     
     adc_init();
     
     timer_init();
-
-    status_led_init();
         
     /* Enable MCU sleep (idle). */
 
@@ -507,83 +2164,60 @@ int main(void)
 
     while (true)
     {
-        if (g_ticks != prev_tick)
-        {
-            prev_tick = g_ticks;
+        bool button = false;
+        uint8_t ev;
 
-            /* Debounce water button. */
+        /* Drain the queue. */
+
+        while ((ev = event_pop()) != EV_NONE)
+        {
+            run = true;
 
-            if (g_water_button && 
-                (PINB & (1 << PB1)) == 0)
+            if (ev == EV_BUTTON)
             {
-                g_water_plant = true;
-                g_water_button = false;
+                button = true;
             }
+        }
+
+        if (run)
+        {
+            time_snapshot(&now);
+
+            /* Debounce water button: still pressed one tick after 
+             * the edge.
+             */
 
-            /* Read the duration adjustment potentiometer. */
+            if (button)
+            {
+                task_wake(TASK_BUTTON, now.ticks + 1);
+            }
 
-            uint32_t duration = adc_read(3);
+            uint16_t wake = task_run(&now);
 
-            /* y = ax + b
-             *   x = 0 (0V)    => y = 5 sec  => b = 5
-             *   x = 1023 (5V) => y = 60 sec
-             *
-             *  => a = 55 / 1023
-             *  => y = 55 / 1023 * x + 5;
+            /* Ask the ISR for EV_TICK at the earliest deadline, or run 
+             * again right away if it already passed.
              */
 
-            duration = 55 * duration / 1023 + 5;
-            
             cli();
-            g_duration = duration;
+            g_wake_tick = wake;
+            run = TICKS_DUE(g_ticks, wake);
             sei();
-
-            /* Read the solar panel voltage. */
-
-            uint32_t solar_panel = adc_read(2);
-
-            /* R1 = 47K, R2 = 10K.
-             *
-             * Vref = R2 / (R1 + R2) * Vin
-             *
-             * Example:
-             *   a) Vin = 23V   => Vref = 4.03V (charging)
-             *   b) Vin = 15.4V => Vref = 2.70V (charging) 
-             *   c) Vin = 15V   => Vref = 2.63V (battery not charging)
-             *   d) Vin = 14V   => Vref = 2.45V (battery not charging)
-             *
-             * ADC has a resolution of 10 bits:
-             *  2.70V ... X
-             *  5V    ... 1023
-             *  => X = 2.70V * 1023 / 5 = 553
-             *
-             */
-            
-            if (!STATUS_LED_LOCKED())
-            {
-                /* The status LED is used for two purposes:
-                 *  a) 1s ON, 1s OFF, 1s ON... - during battery charging
-                 *  b) 'duration' seconds ON   - when pump is on
-                 *  
-                 * Duration adjustment has priority.
-                 */
-
-                if (solar_panel >= SOLAR_PANEL_THRESHOLD)
-                {
-                    /* Toggle the status LED while charging. */
-                    
-                    STATUS_LED_TOGGLE();
-                }
-                else 
-                {
-                    STATUS_LED_OFF();
-                }
-            }
         }
 
-        /* Save some power. */
+        /* Save some power. Sleep only if no event came in since the 
+         * queue was drained: sei() takes effect after sleep_cpu(), so 
+         * an interrupt in between still wakes the MCU up.
+         */
+
+        cli();
+
+        if (!run && g_event_tail == g_event_head)
+        {
+            sei();
+            sleep_cpu();
+        }
 
-        sleep_cpu();
+        sei();
     }
 
     return 0;
@@ -0,0 +1,131 @@
+/****************************************************************************
+ * size_check/macros.c
+ * Tomatotificatorul
+ *
+ * Copyright 2021 Iulian-Razvan Matesica <iulian.matesica@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ****************************************************************************/
+
+/* The pin and peripheral operations of main.c, written with the macros.
+ * templates.cpp does the same with hal.hpp; 'make size-compare' checks 
+ * that no function there is bigger than its namesake here. Both use the
+ * same register sequences (one ADMUX update, the toggle through PINB),
+ * so each pair compares the abstraction and nothing else.
+ */
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <avr/io.h>
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+#define PUMP_ON()  (PORTB |= (1 << PB0))
+#define PUMP_OFF() (PORTB &= ~(1 << PB0))
+
+#define STATUS_LED_ON()     (PORTB |= (1 << PB2))
+#define STATUS_LED_OFF()    (PORTB &= ~(1 << PB2))
+#define STATUS_LED_TOGGLE() (PINB = (1 << PB2))
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+void size_pump_init(void)
+{
+    DDRB |= (1 << PB0);
+    PORTB &= ~(1 << PB0);
+}
+
+void size_button_init(void)
+{
+    DDRB &= ~(1 << PB1);
+    PORTB |= (1 << PB1);
+}
+
+void size_led_init(void)
+{
+    DDRB |= (1 << PB2);
+}
+
+void size_adc_init(void)
+{
+    ADCSRA |= (7 << ADPS0);
+
+    DDRB &= ~(1 << PB3);
+    DIDR0 |= (1 << ADC3D);
+
+    DDRB &= ~(1 << PB4);
+    DIDR0 |= (1 << ADC2D);
+}
+
+void size_timer_init(void)
+{
+    TCNT0 = 0;
+    TCCR0B |= (1 << CS00);
+    TIMSK0 |= (1 << TOIE0);
+}
+
+void size_pump_on(void)
+{
+    PUMP_ON();
+}
+
+void size_pump_off(void)
+{
+    PUMP_OFF();
+}
+
+void size_led_on(void)
+{
+    STATUS_LED_ON();
+}
+
+void size_led_off(void)
+{
+    STATUS_LED_OFF();
+}
+
+void size_led_toggle(void)
+{
+    STATUS_LED_TOGGLE();
+}
+
+bool size_button_pressed(void)
+{
+    return (PINB & (1 << PB1)) == 0;
+}
+
+uint16_t size_adc_read(void)
+{
+    const uint8_t channel_mask = (1 << MUX1) | (1 << MUX0);
+    uint16_t val;
+
+    ADMUX = (ADMUX & ~channel_mask) | 3;
+    ADCSRA |= (1 << ADEN);
+    ADCSRA |= (1 << ADSC);
+
+    while ((ADCSRA & (1 << ADSC)));
+    val = ADC;
+
+    ADCSRA &= ~(1 << ADEN);
+
+    return val;
+}
@@ -0,0 +1,113 @@
+/****************************************************************************
+ * size_check/templates.cpp
+ * Tomatotificatorul
+ *
+ * Copyright 2021 Iulian-Razvan Matesica <iulian.matesica@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ****************************************************************************/
+
+/* Same operations as macros.c, written with hal.hpp. */
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include "hal.hpp"
+
+/****************************************************************************
+ * Private Types
+ ****************************************************************************/
+
+/* Pin mapping of the board, see main.c. */
+
+typedef hal::Gpio<hal::Pin<hal::PortB, 0> >        pump;
+typedef hal::PullupInput<hal::Pin<hal::PortB, 1> > water_button;
+typedef hal::Gpio<hal::Pin<hal::PortB, 2> >        status_led;
+typedef hal::AdcChannel<3>                         duration_pot;
+typedef hal::AdcChannel<2>                         solar_panel;
+typedef hal::Timer0Normal<hal::TIMER_DIV1>         systick;
+
+typedef hal::Board<pump, water_button, status_led, 
+                   duration_pot, solar_panel>      board;
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+extern "C" void size_pump_init(void)
+{
+    board::check();
+
+    pump::output();
+    pump::clear();
+}
+
+extern "C" void size_button_init(void)
+{
+    water_button::init();
+}
+
+extern "C" void size_led_init(void)
+{
+    status_led::output();
+}
+
+extern "C" void size_adc_init(void)
+{
+    hal::Adc<hal::ADC_DIV128>::init();
+
+    duration_pot::init();
+    solar_panel::init();
+}
+
+extern "C" void size_timer_init(void)
+{
+    systick::init();
+    systick::enable_overflow();
+}
+
+extern "C" void size_pump_on(void)
+{
+    pump::set();
+}
+
+extern "C" void size_pump_off(void)
+{
+    pump::clear();
+}
+
+extern "C" void size_led_on(void)
+{
+    status_led::set();
+}
+
+extern "C" void size_led_off(void)
+{
+    status_led::clear();
+}
+
+extern "C" void size_led_toggle(void)
+{
+    status_led::toggle();
+}
+
+extern "C" bool size_button_pressed(void)
+{
+    return !water_button::read();
+}
+
+extern "C" uint16_t size_adc_read(void)
+{
+    return duration_pot::read();
+}
@@ -0,0 +1,351 @@
+/****************************************************************************
+ * tools/calpatch/calpatch.cpp
+ * Tomatotificatorul
+ *
+ * Copyright 2021 Iulian-Razvan Matesica <iulian.matesica@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ****************************************************************************/
+
+/* Patches the calibration block (see source_code/calib.h) of a main.hex,
+ * fixing the record checksums. One build, then one fast patch per unit:
+ *
+ *   calpatch --osccal 0x52 --ppm -180 --adc3 2 -o unit07.hex main.hex
+ */
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include "calib.h"
+#include "ihex.hpp"
+#include "cli.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+/* Nominal clock, the CLOCK of source_code/Makefile. */
+
+#define DEFAULT_CLOCK 1204508
+
+/****************************************************************************
+ * Private Types
+ ****************************************************************************/
+
+struct device
+{
+    const char *name;
+    uint32_t flash_size;
+    double clock;         /* CLOCK of source_code/Makefile */
+};
+
+struct options
+{
+    std::string input;
+    std::string output;
+    uint32_t addr = CALIB_ADDR;
+    double clock = DEFAULT_CLOCK;
+    bool show = false;
+
+    bool set_osccal = false;
+    int osccal = 0;
+
+    bool set_ppm = false;
+    double ppm = 0;
+
+    bool set_adc[CALIB_ADC_COUNT] = {};
+    int adc[CALIB_ADC_COUNT] = {};
+};
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+static const device g_devices[] =
+{
+    { "attiny13", 1024, DEFAULT_CLOCK },
+    { "attiny25", 2048, 1000000 },
+    { "attiny45", 4096, 1000000 },
+    { "attiny85", 8192, 1000000 },
+};
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+static void usage(void)
+{
+    fprintf(stderr,
+        "usage: calpatch [options] [-o OUT.hex] IN.hex\n"
+        "  --device NAME   attiny13 (default), attiny25, attiny45, attiny85\n"
+        "  --addr ADDR     calibration block address (default 0x%x)\n"
+        "  --clock HZ      nominal clock the ppm refers to (default %d)\n"
+        "  --osccal N      OSCCAL value, or 'factory'\n"
+        "  --ppm P         measured clock error, positive = fast\n"
+        "  --adc2 N        offset added to ADC2 (solar panel)\n"
+        "  --adc3 N        offset added to ADC3 (duration pot)\n"
+        "  --show          print the calibration block\n",
+        CALIB_ADDR, DEFAULT_CLOCK);
+    exit(2);
+}
+
+static options parse_args(int argc, char **argv)
+{
+    options opt;
+    const device *dev = nullptr;
+    bool set_addr = false;
+    bool set_clock = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool has_val = i + 1 < argc;
+
+        if (arg == "--show")
+        {
+            opt.show = true;
+        }
+        else if (arg == "-o" && has_val)
+        {
+            opt.output = argv[++i];
+        }
+        else if (arg == "--device" && has_val)
+        {
+            i++;
+
+            for (const device &d : g_devices)
+            {
+                if (strcmp(argv[i], d.name) == 0)
+                {
+                    dev = &d;
+                }
+            }
+
+            if (dev == nullptr)
+            {
+                throw std::runtime_error(std::string("unknown device ") +
+                                         argv[i]);
+            }
+        }
+        else if (arg == "--addr" && has_val)
+        {
+            opt.addr = cli::parse_int(argv[++i], 0, 0xffffff);
+            set_addr = true;
+        }
+        else if (arg == "--clock" && has_val)
+        {
+            opt.clock = cli::parse_int(argv[++i], 1, 30000000);
+            set_clock = true;
+        }
+        else if (arg == "--osccal" && has_val)
+        {
+            i++;
+            opt.set_osccal = true;
+            opt.osccal = strcmp(argv[i], "factory") == 0 ?
+                         CALIB_OSCCAL_FACTORY :
+                         cli::parse_int(argv[i], 0, 0xff);
+        }
+        else if (arg == "--ppm" && has_val)
+        {
+            opt.set_ppm = true;
+            opt.ppm = cli::parse_int(argv[++i], -32768, 32767);
+        }
+        else if ((arg == "--adc2" || arg == "--adc3") && has_val)
+        {
+            int ch = arg[5] - '0' - CALIB_ADC_FIRST;
+
+            opt.set_adc[ch] = true;
+            opt.adc[ch] = cli::parse_int(argv[++i], -128, 127);
+        }
+        else if (arg[0] != '-' && opt.input.empty())
+        {
+            opt.input = arg;
+        }
+        else
+        {
+            usage();
+        }
+    }
+
+    if (opt.input.empty() || (opt.output.empty() && !opt.show))
+    {
+        usage();
+    }
+
+    if (dev != nullptr)
+    {
+        if (!set_addr)
+        {
+            opt.addr = dev->flash_size - CALIB_SIZE;
+        }
+
+        if (!set_clock)
+        {
+            opt.clock = dev->clock;
+        }
+    }
+
+    return opt;
+}
+
+static calib_s read_block(const ihex::file &hex, uint32_t addr)
+{
+    uint8_t raw[CALIB_SIZE];
+    calib_s cal;
+
+    for (int i = 0; i < CALIB_SIZE; i++)
+    {
+        if (!hex.get(addr + i, raw[i]))
+        {
+            char msg[96];
+
+            snprintf(msg, sizeof(msg), "no calibration block at 0x%x "
+                     "(firmware built without it?)", addr);
+            throw std::runtime_error(msg);
+        }
+    }
+
+    /* The block is little endian on the AVR. */
+
+    cal.version = raw[0];
+    cal.osccal = raw[1];
+    cal.ppm = (int16_t)(raw[2] | raw[3] << 8);
+    cal.overflows = (uint16_t)(raw[4] | raw[5] << 8);
+    cal.remainder = raw[6];
+    cal.adc_offset[0] = (int8_t)raw[7];
+    cal.adc_offset[1] = (int8_t)raw[8];
+    cal.reserved = raw[9];
+
+    if (cal.version != CALIB_VERSION)
+    {
+        throw std::runtime_error("unsupported calibration block version " +
+                                 std::to_string(cal.version));
+    }
+
+    return cal;
+}
+
+static void write_block(ihex::file &hex, uint32_t addr, const calib_s &cal)
+{
+    const uint8_t raw[CALIB_SIZE] =
+    {
+        cal.version,
+        cal.osccal,
+        (uint8_t)(cal.ppm & 0xff),
+        (uint8_t)((uint16_t)cal.ppm >> 8),
+        (uint8_t)(cal.overflows & 0xff),
+        (uint8_t)(cal.overflows >> 8),
+        cal.remainder,
+        (uint8_t)cal.adc_offset[0],
+        (uint8_t)cal.adc_offset[1],
+        cal.reserved,
+    };
+
+    for (int i = 0; i < CALIB_SIZE; i++)
+    {
+        hex.set(addr + i, raw[i]);
+    }
+}
+
+static void print_block(const calib_s &cal)
+{
+    uint32_t cycles = (uint32_t)cal.overflows * 256 + cal.remainder;
+
+    if (cal.osccal == CALIB_OSCCAL_FACTORY)
+    {
+        printf("osccal     factory\n");
+    }
+    else
+    {
+        printf("osccal     0x%02x\n", cal.osccal);
+    }
+
+    printf("ppm        %d\n", cal.ppm);
+    printf("second     %u overflows + %u ticks = %lu cycles\n",
+           cal.overflows, cal.remainder, (unsigned long)cycles);
+    printf("adc2       %+d\n", cal.adc_offset[0]);
+    printf("adc3       %+d\n", cal.adc_offset[1]);
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+int main(int argc, char **argv)
+{
+    static_assert(sizeof(calib_s) == CALIB_SIZE, "calib_s layout");
+
+    try
+    {
+        options opt = parse_args(argc, argv);
+        ihex::file hex = ihex::file::load(opt.input);
+        calib_s cal = read_block(hex, opt.addr);
+
+        if (opt.set_osccal)
+        {
+            cal.osccal = opt.osccal;
+        }
+
+        if (opt.set_ppm)
+        {
+            /* The timer counts cycles of the real clock, so a fast unit
+             * needs more of them per second.
+             */
+
+            double cycles = std::round(opt.clock * (1.0 + opt.ppm / 1e6));
+
+            if (cycles < 256 || cycles >= 65536.0 * 256)
+            {
+                throw std::runtime_error("clock out of range");
+            }
+
+            cal.ppm = (int16_t)opt.ppm;
+            cal.overflows = (uint16_t)((uint32_t)cycles / 256);
+            cal.remainder = (uint8_t)((uint32_t)cycles % 256);
+        }
+
+        for (int i = 0; i < CALIB_ADC_COUNT; i++)
+        {
+            if (opt.set_adc[i])
+            {
+                cal.adc_offset[i] = (int8_t)opt.adc[i];
+            }
+        }
+
+        if (!opt.output.empty())
+        {
+            write_block(hex, opt.addr, cal);
+            hex.save(opt.output);
+        }
+
+        if (opt.show)
+        {
+            print_block(cal);
+        }
+    }
+    catch (const std::exception &e)
+    {
+        fprintf(stderr, "calpatch: %s\n", e.what());
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,93 @@
+/****************************************************************************
+ * tools/common/cli.hpp
+ * Tomatotificatorul
+ *
+ * Copyright 2021 Iulian-Razvan Matesica <iulian.matesica@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ****************************************************************************/
+
+#ifndef __TOOLS_COMMON_CLI_HPP
+#define __TOOLS_COMMON_CLI_HPP
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+
+/****************************************************************************
+ * Inline Functions
+ ****************************************************************************/
+
+/* Command line helpers shared by the tools. */
+
+namespace cli
+{
+
+/* Wall time since 'start', for the timings the tools print. */
+
+inline double elapsed_ms(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - start).count();
+}
+
+/* An option value, as a whole string, from 'min' to 'max'. Integers take
+ * the C prefixes (0x, 0). Throws std::runtime_error otherwise.
+ */
+
+inline long parse_int(const char *s, long min, long max)
+{
+    char *end;
+    long val = strtol(s, &end, 0);
+
+    if (*s == '\0' || *end != '\0' || val < min || val > max)
+    {
+        throw std::runtime_error(std::string("value out of range: ") + s);
+    }
+
+    return val;
+}
+
+/* Most real values are durations, voltages and the like: the range
+ * defaults to the non-negative numbers.
+ */
+
+inline double parse_num(const char *s, double min = 0,
+                        double max = HUGE_VAL)
+{
+    char *end;
+    double val = strtod(s, &end);
+
+    if (*s == '\0' || *end != '\0' || !(val >= min && val <= max))
+    {
+        throw std::runtime_error(std::string("value out of range: ") + s);
+    }
+
+    return val;
+}
+
+inline double parse_num(const std::string &s, double min = 0,
+                        double max = HUGE_VAL)
+{
+    return parse_num(s.c_str(), min, max);
+}
+
+} /* namespace cli */
+
+#endif /* __TOOLS_COMMON_CLI_HPP */
@@ -0,0 +1,275 @@
+/****************************************************************************
+ * tools/common/ihex.cpp
+ * Tomatotificatorul
+ *
+ * Copyright 2021 Iulian-Razvan Matesica <iulian.matesica@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ****************************************************************************/
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include "ihex.hpp"
+
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+namespace
+{
+
+int hex_digit(char c)
+{
+    if (c >= '0' && c <= '9')
+    {
+        return c - '0';
+    }
+
+    if (c >= 'A' && c <= 'F')
+    {
+        return c - 'A' + 10;
+    }
+
+    if (c >= 'a' && c <= 'f')
+    {
+        return c - 'a' + 10;
+    }
+
+    return -1;
+}
+
+std::vector<uint8_t> parse_bytes(const std::string &line, int lineno)
+{
+    std::vector<uint8_t> bytes;
+
+    if (line.empty() || line[0] != ':' || (line.size() - 1) % 2 != 0)
+    {
+        throw std::runtime_error("line " + std::to_string(lineno) +
+                                 ": malformed record");
+    }
+
+    for (size_t i = 1; i < line.size(); i += 2)
+    {
+        int hi = hex_digit(line[i]);
+        int lo = hex_digit(line[i + 1]);
+
+        if (hi < 0 || lo < 0)
+        {
+            throw std::runtime_error("line " + std::to_string(lineno) +
+                                     ": bad hex digit");
+        }
+
+        bytes.push_back((uint8_t)(hi << 4 | lo));
+    }
+
+    return bytes;
+}
+
+} /* namespace */
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+namespace ihex
+{
+
+uint8_t checksum(const record &rec)
+{
+    uint8_t sum = (uint8_t)rec.data.size();
+
+    sum += rec.offset >> 8;
+    sum += rec.offset & 0xff;
+    sum += rec.type;
+
+    for (uint8_t b : rec.data)
+    {
+        sum += b;
+    }
+
+    return (uint8_t)-sum;
+}
+
+file file::load(const std::string &path)
+{
+    std::ifstream in(path);
+    file hex;
+    std::string line;
+    uint32_t base = 0;
+    int lineno = 0;
+
+    if (!in)
+    {
+        throw std::runtime_error("cannot open " + path);
+    }
+
+    while (std::getline(in, line))
+    {
+        lineno++;
+
+        while (!line.empty() && (line.back() == '\r' || line.back() == ' '))
+        {
+            line.pop_back();
+        }
+
+        if (line.empty())
+        {
+            continue;
+        }
+
+        std::vector<uint8_t> bytes = parse_bytes(line, lineno);
+
+        if (bytes.size() < 5 || bytes.size() != bytes[0] + 5u)
+        {
+            throw std::runtime_error("line " + std::to_string(lineno) +
+                                     ": bad record length");
+        }
+
+        record rec;
+
+        rec.offset = (uint16_t)(bytes[1] << 8 | bytes[2]);
+        rec.type = bytes[3];
+        rec.data.assign(bytes.begin() + 4, bytes.end() - 1);
+
+        if (checksum(rec) != bytes.back())
+        {
+            throw std::runtime_error("line " + std::to_string(lineno) +
+                                     ": checksum mismatch");
+        }
+
+        if (rec.type == REC_EXT_SEGMENT && rec.data.size() == 2)
+        {
+            base = (uint32_t)(rec.data[0] << 8 | rec.data[1]) << 4;
+        }
+        else if (rec.type == REC_EXT_LINEAR && rec.data.size() == 2)
+        {
+            base = (uint32_t)(rec.data[0] << 8 | rec.data[1]) << 16;
+        }
+
+        rec.base = base;
+        hex.records.push_back(rec);
+
+        if (rec.type == REC_EOF)
+        {
+            break;
+        }
+    }
+
+    return hex;
+}
+
+void file::save(const std::string &path) const
+{
+    FILE *out = fopen(path.c_str(), "w");
+
+    if (out == nullptr)
+    {
+        throw std::runtime_error("cannot create " + path);
+    }
+
+    for (const record &rec : records)
+    {
+        fprintf(out, ":%02X%04X%02X", (unsigned)rec.data.size(),
+                rec.offset, rec.type);
+
+        for (uint8_t b : rec.data)
+        {
+            fprintf(out, "%02X", b);
+        }
+
+        fprintf(out, "%02X\n", checksum(rec));
+    }
+
+    if (fclose(out) != 0)
+    {
+        throw std::runtime_error("cannot write " + path);
+    }
+}
+
+const record *file::find(uint32_t addr, size_t &index) const
+{
+    for (const record &rec : records)
+    {
+        uint32_t start = rec.base + rec.offset;
+
+        if (rec.type == REC_DATA &&
+            addr >= start && addr < start + rec.data.size())
+        {
+            index = addr - start;
+            return &rec;
+        }
+    }
+
+    return nullptr;
+}
+
+bool file::get(uint32_t addr, uint8_t &val) const
+{
+    size_t index;
+    const record *rec = find(addr, index);
+
+    if (rec == nullptr)
+    {
+        return false;
+    }
+
+    val = rec->data[index];
+    return true;
+}
+
+bool file::set(uint32_t addr, uint8_t val)
+{
+    size_t index;
+    record *rec = const_cast<record *>(find(addr, index));
+
+    if (rec == nullptr)
+    {
+        return false;
+    }
+
+    rec->data[index] = val;
+    return true;
+}
+
+std::vector<uint8_t> file::image(uint32_t size) const
+{
+    std::vector<uint8_t> img(size, 0xff);
+
+    for (const record &rec : records)
+    {
+        if (rec.type != REC_DATA)
+        {
+            continue;
+        }
+
+        for (size_t i = 0; i < rec.data.size(); i++)
+        {
+            uint32_t addr = rec.base + rec.offset + i;
+
+            if (addr < size)
+            {
+                img[addr] = rec.data[i];
+            }
+        }
+    }
+
+    return img;
+}
+
+} /* namespace ihex */
@@ -0,0 +1,89 @@
+/****************************************************************************
+ * tools/common/ihex.hpp
+ * Tomatotificatorul
+ *
+ * Copyright 2021 Iulian-Razvan Matesica <iulian.matesica@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ****************************************************************************/
+
+#ifndef __TOOLS_COMMON_IHEX_HPP
+#define __TOOLS_COMMON_IHEX_HPP
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/****************************************************************************
+ * Public Types
+ ****************************************************************************/
+
+namespace ihex
+{
+
+enum record_type : uint8_t
+{
+    REC_DATA         = 0x00,
+    REC_EOF          = 0x01,
+    REC_EXT_SEGMENT  = 0x02,
+    REC_START_SEG    = 0x03,
+    REC_EXT_LINEAR   = 0x04,
+    REC_START_LINEAR = 0x05,
+};
+
+struct record
+{
+    uint8_t type;
+    uint16_t offset;           /* Address field of the record */
+    uint32_t base;             /* From the last extended address record */
+    std::vector<uint8_t> data;
+};
+
+/* An Intel HEX file kept record by record, so it can be written back 
+ * with the very same layout after patching some bytes.
+ */
+
+class file
+{
+public:
+    /* Throws std::runtime_error on I/O, syntax or checksum errors. */
+
+    static file load(const std::string &path);
+    void save(const std::string &path) const;
+
+    /* Byte access by absolute address. get() returns false when the 
+     * address is not covered by any data record.
+     */
+
+    bool get(uint32_t addr, uint8_t &val) const;
+    bool set(uint32_t addr, uint8_t val);
+
+    /* Flattens all data records into an image, unused bytes are 0xff. */
+
+    std::vector<uint8_t> image(uint32_t size) const;
+
+    std::vector<record> records;
+
+private:
+    const record *find(uint32_t addr, size_t &index) const;
+};
+
+uint8_t checksum(const record &rec);
+
+} /* namespace ihex */
+
+#endif /* __TOOLS_COMMON_IHEX_HPP */
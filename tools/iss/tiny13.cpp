@@ -0,0 +1,2105 @@
+/****************************************************************************
+ * tools/iss/tiny13.cpp
+ * Tomatotificatorul
+ *
+ * Copyright 2021 Iulian-Razvan Matesica <iulian.matesica@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ****************************************************************************/
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include "tiny13.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+#define BIT(n)              (1 << (n))
+
+/* Program counter, in words. */
+
+#define PC_MASK             (TINY13_FLASH / 2 - 1)
+
+/* I/O registers, by I/O address; data space address is 0x20 higher. */
+
+#define IO_ADCSRB           0x03
+#define IO_ADCL             0x04
+#define IO_ADCH             0x05
+#define IO_ADCSRA           0x06
+#define IO_ADMUX            0x07
+#define IO_PINB             0x16
+#define IO_DDRB             0x17
+#define IO_PORTB            0x18
+#define IO_EECR             0x1c
+#define IO_EEDR             0x1d
+#define IO_EEARL            0x1e
+#define IO_WDTCR            0x21
+#define IO_CLKPR            0x26
+#define IO_GTCCR            0x28
+#define IO_OCR0B            0x29
+#define IO_TCCR0A           0x2f
+#define IO_OSCCAL           0x31
+#define IO_TCNT0            0x32
+#define IO_TCCR0B           0x33
+#define IO_MCUSR            0x34
+#define IO_MCUCR            0x35
+#define IO_OCR0A            0x36
+#define IO_TIFR0            0x38
+#define IO_TIMSK0           0x39
+#define IO_GIFR             0x3a
+#define IO_GIMSK            0x3b
+#define IO_SPL              0x3d
+#define IO_SREG             0x3f
+
+#define REG(io)             m_data[0x20 + (io)]
+
+/* Bits. */
+
+#define SREG_C              0
+#define SREG_Z              1
+#define SREG_T              6
+#define SREG_I              7
+#define MCUCR_SE            5
+#define MCUSR_PORF          0
+#define MCUSR_WDRF          3
+#define GIMSK_INT0          6
+#define GIFR_INTF0          6
+#define TIMSK_TOIE0         1
+#define TIMSK_OCIE0A        2
+#define TIMSK_OCIE0B        3
+#define TIFR_TOV0           1
+#define TIFR_OCF0A          2
+#define TIFR_OCF0B          3
+#define GTCCR_PSR10         0
+#define CLKPR_CLKPCE        7
+#define WDTCR_WDE           3
+#define WDTCR_WDCE          4
+#define WDTCR_WDP3          5
+#define WDTCR_WDTIE         6
+#define WDTCR_WDTIF         7
+#define EECR_EERE           0
+#define EECR_EEPE           1
+#define EECR_EEMPE          2
+#define EECR_EERIE          3
+#define EECR_EEPM0          4
+#define ADMUX_ADLAR         5
+#define ADMUX_REFS0         6
+#define ADCSRA_ADIE         3
+#define ADCSRA_ADIF         4
+#define ADCSRA_ADATE        5
+#define ADCSRA_ADSC         6
+#define ADCSRA_ADEN         7
+
+#define PIN_BUTTON          1
+
+/* Vectors. */
+
+#define VEC_INT0            1
+#define VEC_TIM0_OVF        3
+#define VEC_EE_RDY          4
+#define VEC_TIM0_COMPA      6
+#define VEC_TIM0_COMPB      7
+#define VEC_WDT             8
+#define VEC_ADC             9
+
+/* Sleep modes of MCUCR SM1:0, and awake. */
+
+#define SLEEP_IDLE          0
+#define SLEEP_ADC           1
+#define SLEEP_POWER_DOWN    2
+#define AWAKE               -1
+
+/* Reset values: CKDIV8 programmed, the SRAM top in SPL. */
+
+#define CLKPR_RESET         3
+#define SPL_RESET           0x9f
+#define OSCCAL_RESET        0x5a
+
+/* Cycles: interrupt response, the extra ones out of sleep, the CPU halt
+ * of an EEPROM read and of the start of a write.
+ */
+
+#define IRQ_CYCLES          4
+#define WAKE_CYCLES         4
+#define EE_READ_CYCLES      4
+#define EE_WRITE_CYCLES     2
+
+/* Timed sequences stay open this many cycles. */
+
+#define TIMED_CYCLES        4
+
+/* EEPROM programming times (erase and write, erase or write only) and
+ * the watchdog oscillator.
+ */
+
+#define EE_ATOMIC_S         3.4e-3
+#define EE_SPLIT_S          1.8e-3
+#define WDT_HZ              128000.0
+
+/* Handlers of the run loop. */
+
+#define ISS_OPS(X) \
+    X(NOP) X(MOVW) X(CPC) X(SBC) X(ADD) X(CPSE) X(CP) X(SUB) X(ADC) \
+    X(AND) X(EOR) X(OR) X(MOV) X(CPI) X(SBCI) X(SUBI) X(ORI) X(ANDI) \
+    X(LDI) X(LDD_Y) X(LDD_Z) X(STD_Y) X(STD_Z) X(LDS) X(STS) \
+    X(LD_ZP) X(LD_MZ) X(LD_YP) X(LD_MY) X(LD_X) X(LD_XP) X(LD_MX) \
+    X(ST_ZP) X(ST_MZ) X(ST_YP) X(ST_MY) X(ST_X) X(ST_XP) X(ST_MX) \
+    X(LPM) X(LPM_ZP) X(LPM_R0) X(PUSH) X(POP) \
+    X(COM) X(NEG) X(SWAP) X(INC) X(ASR) X(LSR) X(ROR) X(DEC) \
+    X(ADIW) X(SBIW) X(BSET) X(BCLR) X(BLD) X(BST) \
+    X(RJMP) X(RCALL) X(IJMP) X(ICALL) X(RET) X(RETI) \
+    X(BRBS) X(BRBC) X(SBRC) X(SBRS) X(SBIC) X(SBIS) X(CBI) X(SBI) \
+    X(IN) X(OUT) X(SLEEP) X(WDR) X(ILLEGAL)
+
+/****************************************************************************
+ * Private Types
+ ****************************************************************************/
+
+namespace
+{
+
+#define ISS_ENUM(name) OP_##name,
+
+enum op : uint8_t
+{
+    ISS_OPS(ISS_ENUM)
+};
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+/* I/O registers that do more than hold a value. */
+
+const uint64_t g_read_hooks = 1ull << IO_PINB | 1ull << IO_TCNT0 |
+                              1ull << IO_TIFR0;
+
+const uint64_t g_write_hooks =
+    1ull << IO_ADCL | 1ull << IO_ADCH | 1ull << IO_ADCSRA |
+    1ull << IO_PINB | 1ull << IO_DDRB | 1ull << IO_PORTB |
+    1ull << IO_EECR | 1ull << IO_WDTCR | 1ull << IO_CLKPR |
+    1ull << IO_GTCCR | 1ull << IO_OCR0B | 1ull << IO_TCCR0A |
+    1ull << IO_TCNT0 | 1ull << IO_TCCR0B | 1ull << IO_MCUSR |
+    1ull << IO_MCUCR | 1ull << IO_OCR0A | 1ull << IO_TIFR0 |
+    1ull << IO_TIMSK0 | 1ull << IO_GIFR | 1ull << IO_GIMSK |
+    1ull << IO_SREG | 1ull << IO_SPL;
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+/* Flags of an 8-bit result: Z, N, V as given, S. */
+
+inline uint8_t flags_nzs(uint8_t r, uint8_t v)
+{
+    uint8_t n = r >> 7;
+
+    return (r == 0) << 1 | n << 2 | v << 3 | (n ^ v) << 4;
+}
+
+inline uint8_t flags_add(uint8_t d, uint8_t r, uint8_t res)
+{
+    uint8_t carry = (d & r) | (r & ~res) | (~res & d);
+    uint8_t v = ((d & r & ~res) | (~d & ~r & res)) >> 7;
+
+    return (carry >> 7) | ((carry >> 3) & 1) << 5 | flags_nzs(res, v & 1);
+}
+
+inline uint8_t flags_sub(uint8_t d, uint8_t r, uint8_t res)
+{
+    uint8_t borrow = (~d & r) | (r & res) | (res & ~d);
+    uint8_t v = ((d & ~r & ~res) | (~d & r & res)) >> 7;
+
+    return (borrow >> 7) | ((borrow >> 3) & 1) << 5 | flags_nzs(res, v & 1);
+}
+
+/* SREG bits an instruction changes. */
+
+const uint8_t ARITH_FLAGS = 0x3f;   /* H S V N Z C */
+const uint8_t LOGIC_FLAGS = 0x1e;   /* S V N Z */
+const uint8_t SHIFT_FLAGS = 0x1f;   /* S V N Z C */
+const uint8_t WORD_FLAGS = 0x1f;
+
+inline bool two_words(uint16_t op)
+{
+    return (op & 0xfc0f) == 0x9000 || (op & 0xfe0c) == 0x940c;
+}
+
+inline int sign_extend(int value, int bits)
+{
+    int m = 1 << (bits - 1);
+
+    return (value ^ m) - m;
+}
+
+} /* namespace */
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+namespace iss
+{
+
+tiny13::tiny13(const std::vector<uint8_t> &flash, double clock)
+    : eeprom(TINY13_EEPROM, 0xff),
+      m_flash(TINY13_FLASH / 2, 0xffff),
+      m_rc(clock * 8)
+{
+    if (flash.size() > TINY13_FLASH)
+    {
+        for (size_t i = TINY13_FLASH; i < flash.size(); i++)
+        {
+            if (flash[i] != 0xff)
+            {
+                throw std::runtime_error("the image is larger than the "
+                                         "flash");
+            }
+        }
+    }
+
+    for (size_t i = 0; i < std::min<size_t>(flash.size(), TINY13_FLASH);
+         i++)
+    {
+        uint16_t &w = m_flash[i / 2];
+
+        w = i & 1 ? (w & 0x00ff) | flash[i] << 8
+                  : (w & 0xff00) | flash[i];
+    }
+
+    decode();
+    reset(BIT(MCUSR_PORF));
+}
+
+void tiny13::press(double start, double end)
+{
+    m_edges.emplace_back(ticks(start), true);
+    m_edges.emplace_back(ticks(end), false);
+    std::stable_sort(m_edges.begin() + m_edge_next, m_edges.end(),
+                     [](const auto &a, const auto &b)
+                     {
+                         return a.first < b.first;
+                     });
+}
+
+double tiny13::time() const
+{
+    return now() / m_rc;
+}
+
+unsigned tiny13::stack_main() const
+{
+    uint8_t low = m_active.empty() ? m_sp_low : m_active.front().sp_low;
+
+    return SPL_RESET - std::min<uint8_t>(std::min(low, m_sp_main),
+                                         SPL_RESET);
+}
+
+unsigned tiny13::stack() const
+{
+    return SPL_RESET - std::min<uint8_t>(m_sp_min, SPL_RESET);
+}
+
+/* The interpreter: each handler does its instruction, adds its cycles
+ * and jumps to the handler of the next one. Anything that needs a look
+ * from the outside (timer flags, conversions, button edges, interrupts,
+ * the end of the run) brings m_next down, which sends the loop through
+ * service() between two instructions.
+ */
+
+void tiny13::run(double seconds)
+{
+#define ISS_LABEL(name) &&op_##name,
+
+    static const void *const labels[] =
+    {
+        ISS_OPS(ISS_LABEL)
+    };
+
+    for (slot &s : m_code)
+    {
+        s.handler = labels[s.op];
+    }
+
+    m_end = ticks(seconds);
+    m_stop = false;
+    m_next = 0;
+
+    uint8_t *const R = m_data;
+    uint16_t pc = m_pc;
+    uint64_t cyc = m_cycles;
+    uint64_t count = m_instructions;
+    const slot *s;
+    uint8_t t8;
+    uint16_t t16;
+
+#define SR               m_data[0x20 + IO_SREG]
+#define SET_FLAGS(m, f)  (SR = (SR & ~(m)) | (f))
+#define WORD(n)          ((uint16_t)(R[n] | R[(n) + 1] << 8))
+#define SET_WORD(n, v)   (R[n] = (uint8_t)(v), R[(n) + 1] = (v) >> 8)
+
+#define JUMP(target, n) \
+    do \
+    { \
+        pc = (target) & PC_MASK; \
+        cyc += (n); \
+        count++; \
+        if (cyc >= m_next) \
+        { \
+            goto slow; \
+        } \
+        s = &m_code[pc]; \
+        goto *s->handler; \
+    } \
+    while (0)
+
+#define NEXT(n)          JUMP(pc + 1, n)
+
+    /* Accesses that may reach registers with side effects. */
+
+#define SYNC()           (m_cycles = cyc, m_pc = pc)
+#define LOAD(addr, out) \
+    do \
+    { \
+        uint16_t a_ = (addr); \
+        if ((uint16_t)(a_ - 0x60) < 0x40) \
+        { \
+            out = R[a_]; \
+        } \
+        else \
+        { \
+            SYNC(); \
+            out = data_read(a_); \
+            cyc = m_cycles; \
+        } \
+    } \
+    while (0)
+
+#define STORE(addr, val) \
+    do \
+    { \
+        uint16_t a_ = (addr); \
+        if ((uint16_t)(a_ - 0x60) < 0x40) \
+        { \
+            R[a_] = (val); \
+        } \
+        else \
+        { \
+            SYNC(); \
+            data_write(a_, (val)); \
+            cyc = m_cycles; \
+        } \
+    } \
+    while (0)
+
+#define PUSH8(val) \
+    do \
+    { \
+        uint8_t sp_ = REG(IO_SPL); \
+        STORE(sp_, (val)); \
+        REG(IO_SPL) = sp_ - 1; \
+        m_sp_low = std::min<uint8_t>(m_sp_low, sp_ - 1); \
+        m_sp_min = std::min(m_sp_min, m_sp_low); \
+    } \
+    while (0)
+
+#define POP8(out) \
+    do \
+    { \
+        uint8_t sp_ = REG(IO_SPL) + 1; \
+        REG(IO_SPL) = sp_; \
+        LOAD(sp_, out); \
+    } \
+    while (0)
+
+#define SKIP_NEXT() \
+    do \
+    { \
+        uint8_t n_ = m_code[(pc + 1) & PC_MASK].skip; \
+        pc += n_; \
+        cyc += n_; \
+    } \
+    while (0)
+
+    s = &m_code[pc];
+
+    if (cyc >= m_next)
+    {
+        goto slow;
+    }
+
+    goto *s->handler;
+
+op_NOP:
+    NEXT(1);
+
+op_MOVW:
+    R[s->d] = R[s->r];
+    R[s->d + 1] = R[s->r + 1];
+    NEXT(1);
+
+op_ADD:
+    t8 = R[s->d] + R[s->r];
+    SET_FLAGS(ARITH_FLAGS, flags_add(R[s->d], R[s->r], t8));
+    R[s->d] = t8;
+    NEXT(1);
+
+op_ADC:
+    t8 = R[s->d] + R[s->r] + (SR & 1);
+    SET_FLAGS(ARITH_FLAGS, flags_add(R[s->d], R[s->r], t8));
+    R[s->d] = t8;
+    NEXT(1);
+
+op_SUB:
+    t8 = R[s->d] - R[s->r];
+    SET_FLAGS(ARITH_FLAGS, flags_sub(R[s->d], R[s->r], t8));
+    R[s->d] = t8;
+    NEXT(1);
+
+op_SBC:
+    t8 = R[s->d] - R[s->r] - (SR & 1);
+    SET_FLAGS(ARITH_FLAGS, (flags_sub(R[s->d], R[s->r], t8) &
+                            ~BIT(SREG_Z)) |
+                           (t8 ? 0 : SR & BIT(SREG_Z)));
+    R[s->d] = t8;
+    NEXT(1);
+
+op_CP:
+    t8 = R[s->d] - R[s->r];
+    SET_FLAGS(ARITH_FLAGS, flags_sub(R[s->d], R[s->r], t8));
+    NEXT(1);
+
+op_CPC:
+    t8 = R[s->d] - R[s->r] - (SR & 1);
+    SET_FLAGS(ARITH_FLAGS, (flags_sub(R[s->d], R[s->r], t8) &
+                            ~BIT(SREG_Z)) |
+                           (t8 ? 0 : SR & BIT(SREG_Z)));
+    NEXT(1);
+
+op_CPSE:
+    if (R[s->d] == R[s->r])
+    {
+        SKIP_NEXT();
+    }
+
+    NEXT(1);
+
+op_AND:
+    R[s->d] &= R[s->r];
+    SET_FLAGS(LOGIC_FLAGS, flags_nzs(R[s->d], 0));
+    NEXT(1);
+
+op_EOR:
+    R[s->d] ^= R[s->r];
+    SET_FLAGS(LOGIC_FLAGS, flags_nzs(R[s->d], 0));
+    NEXT(1);
+
+op_OR:
+    R[s->d] |= R[s->r];
+    SET_FLAGS(LOGIC_FLAGS, flags_nzs(R[s->d], 0));
+    NEXT(1);
+
+op_MOV:
+    R[s->d] = R[s->r];
+    NEXT(1);
+
+op_CPI:
+    t8 = R[s->d] - (uint8_t)s->k;
+    SET_FLAGS(ARITH_FLAGS, flags_sub(R[s->d], (uint8_t)s->k, t8));
+    NEXT(1);
+
+op_SUBI:
+    t8 = R[s->d] - (uint8_t)s->k;
+    SET_FLAGS(ARITH_FLAGS, flags_sub(R[s->d], (uint8_t)s->k, t8));
+    R[s->d] = t8;
+    NEXT(1);
+
+op_SBCI:
+    t8 = R[s->d] - (uint8_t)s->k - (SR & 1);
+    SET_FLAGS(ARITH_FLAGS, (flags_sub(R[s->d], (uint8_t)s->k, t8) &
+                            ~BIT(SREG_Z)) |
+                           (t8 ? 0 : SR & BIT(SREG_Z)));
+    R[s->d] = t8;
+    NEXT(1);
+
+op_ORI:
+    R[s->d] |= (uint8_t)s->k;
+    SET_FLAGS(LOGIC_FLAGS, flags_nzs(R[s->d], 0));
+    NEXT(1);
+
+op_ANDI:
+    R[s->d] &= (uint8_t)s->k;
+    SET_FLAGS(LOGIC_FLAGS, flags_nzs(R[s->d], 0));
+    NEXT(1);
+
+op_LDI:
+    R[s->d] = (uint8_t)s->k;
+    NEXT(1);
+
+op_LDD_Y:
+    LOAD(WORD(28) + s->r, t8);
+    R[s->d] = t8;
+    NEXT(2);
+
+op_LDD_Z:
+    LOAD(WORD(30) + s->r, t8);
+    R[s->d] = t8;
+    NEXT(2);
+
+op_STD_Y:
+    STORE(WORD(28) + s->r, R[s->d]);
+    NEXT(2);
+
+op_STD_Z:
+    STORE(WORD(30) + s->r, R[s->d]);
+    NEXT(2);
+
+op_LDS:
+    LOAD((uint16_t)s->k, t8);
+    R[s->d] = t8;
+    JUMP(pc + 2, 2);
+
+op_STS:
+    STORE((uint16_t)s->k, R[s->d]);
+    JUMP(pc + 2, 2);
+
+op_LD_ZP:
+    t16 = WORD(30);
+    LOAD(t16, t8);
+    R[s->d] = t8;
+    SET_WORD(30, t16 + 1);
+    NEXT(2);
+
+op_LD_MZ:
+    t16 = WORD(30) - 1;
+    SET_WORD(30, t16);
+    LOAD(t16, t8);
+    R[s->d] = t8;
+    NEXT(2);
+
+op_LD_YP:
+    t16 = WORD(28);
+    LOAD(t16, t8);
+    R[s->d] = t8;
+    SET_WORD(28, t16 + 1);
+    NEXT(2);
+
+op_LD_MY:
+    t16 = WORD(28) - 1;
+    SET_WORD(28, t16);
+    LOAD(t16, t8);
+    R[s->d] = t8;
+    NEXT(2);
+
+op_LD_X:
+    LOAD(WORD(26), t8);
+    R[s->d] = t8;
+    NEXT(2);
+
+op_LD_XP:
+    t16 = WORD(26);
+    LOAD(t16, t8);
+    R[s->d] = t8;
+    SET_WORD(26, t16 + 1);
+    NEXT(2);
+
+op_LD_MX:
+    t16 = WORD(26) - 1;
+    SET_WORD(26, t16);
+    LOAD(t16, t8);
+    R[s->d] = t8;
+    NEXT(2);
+
+op_ST_ZP:
+    t16 = WORD(30);
+    STORE(t16, R[s->d]);
+    SET_WORD(30, t16 + 1);
+    NEXT(2);
+
+op_ST_MZ:
+    t16 = WORD(30) - 1;
+    SET_WORD(30, t16);
+    STORE(t16, R[s->d]);
+    NEXT(2);
+
+op_ST_YP:
+    t16 = WORD(28);
+    STORE(t16, R[s->d]);
+    SET_WORD(28, t16 + 1);
+    NEXT(2);
+
+op_ST_MY:
+    t16 = WORD(28) - 1;
+    SET_WORD(28, t16);
+    STORE(t16, R[s->d]);
+    NEXT(2);
+
+op_ST_X:
+    STORE(WORD(26), R[s->d]);
+    NEXT(2);
+
+op_ST_XP:
+    t16 = WORD(26);
+    STORE(t16, R[s->d]);
+    SET_WORD(26, t16 + 1);
+    NEXT(2);
+
+op_ST_MX:
+    t16 = WORD(26) - 1;
+    SET_WORD(26, t16);
+    STORE(t16, R[s->d]);
+    NEXT(2);
+
+op_LPM:
+    t16 = WORD(30) & (TINY13_FLASH - 1);
+    R[s->d] = m_flash[t16 >> 1] >> (t16 & 1) * 8;
+    NEXT(3);
+
+op_LPM_ZP:
+    t16 = WORD(30);
+    R[s->d] = m_flash[(t16 & (TINY13_FLASH - 1)) >> 1] >> (t16 & 1) * 8;
+    SET_WORD(30, t16 + 1);
+    NEXT(3);
+
+op_LPM_R0:
+    t16 = WORD(30) & (TINY13_FLASH - 1);
+    R[0] = m_flash[t16 >> 1] >> (t16 & 1) * 8;
+    NEXT(3);
+
+op_PUSH:
+    PUSH8(R[s->d]);
+    NEXT(2);
+
+op_POP:
+    POP8(t8);
+    R[s->d] = t8;
+    NEXT(2);
+
+op_COM:
+    R[s->d] = ~R[s->d];
+    SET_FLAGS(SHIFT_FLAGS, flags_nzs(R[s->d], 0) | BIT(SREG_C));
+    NEXT(1);
+
+op_NEG:
+    t8 = R[s->d];
+    R[s->d] = -t8;
+    SET_FLAGS(ARITH_FLAGS, flags_sub(0, t8, R[s->d]));
+    NEXT(1);
+
+op_SWAP:
+    R[s->d] = R[s->d] << 4 | R[s->d] >> 4;
+    NEXT(1);
+
+op_INC:
+    t8 = ++R[s->d];
+    SET_FLAGS(LOGIC_FLAGS, flags_nzs(t8, t8 == 0x80));
+    NEXT(1);
+
+op_DEC:
+    t8 = --R[s->d];
+    SET_FLAGS(LOGIC_FLAGS, flags_nzs(t8, t8 == 0x7f));
+    NEXT(1);
+
+op_ASR:
+    t8 = R[s->d];
+    R[s->d] = (t8 >> 1) | (t8 & 0x80);
+    SET_FLAGS(SHIFT_FLAGS, flags_nzs(R[s->d], (R[s->d] >> 7) ^ (t8 & 1)) |
+                           (t8 & 1));
+    NEXT(1);
+
+op_LSR:
+    t8 = R[s->d];
+    R[s->d] = t8 >> 1;
+    SET_FLAGS(SHIFT_FLAGS, flags_nzs(R[s->d], t8 & 1) | (t8 & 1));
+    NEXT(1);
+
+op_ROR:
+    t8 = R[s->d];
+    R[s->d] = (t8 >> 1) | (SR & 1) << 7;
+    SET_FLAGS(SHIFT_FLAGS, flags_nzs(R[s->d], (R[s->d] >> 7) ^ (t8 & 1)) |
+                           (t8 & 1));
+    NEXT(1);
+
+op_ADIW:
+    t16 = WORD(s->d) + s->k;
+    SET_FLAGS(WORD_FLAGS, (t16 == 0) << 1 | (t16 >> 15) << 2 |
+                          ((~R[s->d + 1] & t16 >> 8) >> 7) << 3 |
+                          (((t16 >> 15) ^ ((~R[s->d + 1] & t16 >> 8) >> 7))
+                           & 1) << 4 |
+                          ((R[s->d + 1] & ~(t16 >> 8)) >> 7 & 1));
+    SET_WORD(s->d, t16);
+    NEXT(2);
+
+op_SBIW:
+    t16 = WORD(s->d) - s->k;
+    SET_FLAGS(WORD_FLAGS, (t16 == 0) << 1 | (t16 >> 15) << 2 |
+                          ((R[s->d + 1] & ~(t16 >> 8)) >> 7 & 1) << 3 |
+                          (((t16 >> 15) ^ ((R[s->d + 1] & ~(t16 >> 8)) >> 7))
+                           & 1) << 4 |
+                          ((t16 >> 8 & ~R[s->d + 1]) >> 7 & 1));
+    SET_WORD(s->d, t16);
+    NEXT(2);
+
+op_BSET:
+    SR |= BIT(s->r);
+
+    if (s->r == SREG_I)
+    {
+        /* The next instruction runs before any interrupt. */
+
+        m_shadow = true;
+        m_next = 0;
+    }
+
+    NEXT(1);
+
+op_BCLR:
+    SR &= ~BIT(s->r);
+    NEXT(1);
+
+op_BLD:
+    R[s->d] = (R[s->d] & ~BIT(s->r)) | ((SR >> SREG_T) & 1) << s->r;
+    NEXT(1);
+
+op_BST:
+    SR = (SR & ~BIT(SREG_T)) | ((R[s->d] >> s->r) & 1) << SREG_T;
+    NEXT(1);
+
+op_RJMP:
+    JUMP(pc + 1 + s->k, 2);
+
+op_RCALL:
+    t16 = pc + 1;
+    PUSH8(t16 & 0xff);
+    PUSH8(t16 >> 8);
+    JUMP(pc + 1 + s->k, 3);
+
+op_IJMP:
+    JUMP(WORD(30), 2);
+
+op_ICALL:
+    t16 = pc + 1;
+    PUSH8(t16 & 0xff);
+    PUSH8(t16 >> 8);
+    JUMP(WORD(30), 3);
+
+op_RET:
+    POP8(t8);
+    t16 = t8 << 8;
+    POP8(t8);
+    JUMP(t16 | t8, 4);
+
+op_RETI:
+    POP8(t8);
+    t16 = t8 << 8;
+    POP8(t8);
+    t16 |= t8;
+    SR |= BIT(SREG_I);
+    cyc += 4;
+    m_cycles = cyc;
+    ret_from();
+    m_shadow = true;
+    m_next = 0;
+    JUMP(t16, 0);
+
+op_BRBS:
+    if (SR & BIT(s->r))
+    {
+        JUMP(pc + 1 + s->k, 2);
+    }
+
+    NEXT(1);
+
+op_BRBC:
+    if (!(SR & BIT(s->r)))
+    {
+        JUMP(pc + 1 + s->k, 2);
+    }
+
+    NEXT(1);
+
+op_SBRC:
+    if (!(R[s->d] & BIT(s->r)))
+    {
+        SKIP_NEXT();
+    }
+
+    NEXT(1);
+
+op_SBRS:
+    if (R[s->d] & BIT(s->r))
+    {
+        SKIP_NEXT();
+    }
+
+    NEXT(1);
+
+op_SBIC:
+    SYNC();
+    t8 = g_read_hooks >> s->d & 1 ? io_read(s->d) : REG(s->d);
+
+    if (!(t8 & BIT(s->r)))
+    {
+        SKIP_NEXT();
+    }
+
+    NEXT(1);
+
+op_SBIS:
+    SYNC();
+    t8 = g_read_hooks >> s->d & 1 ? io_read(s->d) : REG(s->d);
+
+    if (t8 & BIT(s->r))
+    {
+        SKIP_NEXT();
+    }
+
+    NEXT(1);
+
+op_CBI:
+    SYNC();
+    t8 = g_read_hooks >> s->d & 1 ? io_read(s->d) : REG(s->d);
+    io_write(s->d, s->d == IO_PINB ? 0 : t8 & ~BIT(s->r));
+    cyc = m_cycles;
+    NEXT(2);
+
+op_SBI:
+    SYNC();
+    t8 = g_read_hooks >> s->d & 1 ? io_read(s->d) : REG(s->d);
+
+    /* On PINB only the addressed bit toggles. */
+
+    io_write(s->d, s->d == IO_PINB ? BIT(s->r) : t8 | BIT(s->r));
+    cyc = m_cycles;
+    NEXT(2);
+
+op_IN:
+    if (g_read_hooks >> s->r & 1)
+    {
+        SYNC();
+        R[s->d] = io_read(s->r);
+    }
+    else
+    {
+        R[s->d] = REG(s->r);
+    }
+
+    NEXT(1);
+
+op_OUT:
+    if (g_write_hooks >> s->r & 1)
+    {
+        SYNC();
+        io_write(s->r, R[s->d]);
+        cyc = m_cycles;
+    }
+    else
+    {
+        REG(s->r) = R[s->d];
+    }
+
+    NEXT(1);
+
+op_WDR:
+    SYNC();
+    wdt_restart();
+    schedule();
+    NEXT(1);
+
+op_SLEEP:
+    m_cycles = cyc + 1;
+    m_pc = (pc + 1) & PC_MASK;
+    count++;
+    sleep();
+    pc = m_pc;
+    cyc = m_cycles;
+    goto slow;
+
+op_ILLEGAL:
+    fault("illegal opcode", pc);
+
+slow:
+    m_cycles = cyc;
+    m_pc = pc;
+    m_instructions = count;
+
+    if (!service())
+    {
+        return;
+    }
+
+    pc = m_pc;
+    cyc = m_cycles;
+    s = &m_code[pc];
+    goto *s->handler;
+
+#undef SR
+#undef SET_FLAGS
+#undef WORD
+#undef SET_WORD
+#undef JUMP
+#undef NEXT
+#undef SYNC
+#undef LOAD
+#undef STORE
+#undef PUSH8
+#undef POP8
+#undef SKIP_NEXT
+}
+
+/****************************************************************************
+ * Decoder, time and data space
+ ****************************************************************************/
+
+void tiny13::decode()
+{
+    m_code.assign(TINY13_FLASH / 2, slot{});
+
+    for (size_t i = 0; i < m_code.size(); i++)
+    {
+        uint16_t op = m_flash[i];
+        uint16_t next = m_flash[(i + 1) & PC_MASK];
+        slot &s = m_code[i];
+        uint8_t d5 = (op >> 4) & 0x1f;
+        uint8_t r5 = (op & 0xf) | ((op >> 5) & 0x10);
+
+        s.op = OP_ILLEGAL;
+        s.skip = two_words(op) ? 2 : 1;
+
+        if (op == 0x0000 || op == 0x9598)
+        {
+            s.op = OP_NOP;    /* BREAK without debugWIRE too */
+        }
+        else if ((op & 0xff00) == 0x0100)
+        {
+            s.op = OP_MOVW;
+            s.d = ((op >> 4) & 0xf) * 2;
+            s.r = (op & 0xf) * 2;
+        }
+        else if (op >= 0x0400 && op < 0x3000)
+        {
+            static const uint8_t ops[] =
+            {
+                OP_CPC, OP_SBC, OP_ADD, OP_CPSE, OP_CP, OP_SUB, OP_ADC,
+                OP_AND, OP_EOR, OP_OR, OP_MOV,
+            };
+
+            s.op = ops[(op >> 10) - 1];
+            s.d = d5;
+            s.r = r5;
+        }
+        else if ((op & 0xf000) >= 0x3000 && (op & 0xf000) <= 0x7000)
+        {
+            static const uint8_t ops[] =
+            {
+                OP_CPI, OP_SBCI, OP_SUBI, OP_ORI, OP_ANDI,
+            };
+
+            s.op = ops[(op >> 12) - 3];
+            s.d = 16 + ((op >> 4) & 0xf);
+            s.k = (op & 0xf) | ((op >> 4) & 0xf0);
+        }
+        else if ((op & 0xf000) == 0xe000)
+        {
+            s.op = OP_LDI;
+            s.d = 16 + ((op >> 4) & 0xf);
+            s.k = (op & 0xf) | ((op >> 4) & 0xf0);
+        }
+        else if ((op & 0xd000) == 0x8000)
+        {
+            bool store = op & 0x0200, y = op & 0x0008;
+
+            s.op = store ? (y ? OP_STD_Y : OP_STD_Z)
+                         : (y ? OP_LDD_Y : OP_LDD_Z);
+            s.d = d5;
+            s.r = (op & 7) | ((op >> 7) & 0x18) | ((op >> 8) & 0x20);
+        }
+        else if ((op & 0xfc00) == 0x9000)
+        {
+            static const int8_t loads[16] =
+            {
+                OP_LDS, OP_LD_ZP, OP_LD_MZ, -1, OP_LPM, OP_LPM_ZP, -1, -1,
+                -1, OP_LD_YP, OP_LD_MY, -1, OP_LD_X, OP_LD_XP, OP_LD_MX,
+                OP_POP,
+            };
+
+            static const int8_t stores[16] =
+            {
+                OP_STS, OP_ST_ZP, OP_ST_MZ, -1, -1, -1, -1, -1,
+                -1, OP_ST_YP, OP_ST_MY, -1, OP_ST_X, OP_ST_XP, OP_ST_MX,
+                OP_PUSH,
+            };
+
+            int8_t o = (op & 0x0200 ? stores : loads)[op & 0xf];
+
+            if (o >= 0)
+            {
+                s.op = o;
+                s.d = d5;
+                s.k = next;
+            }
+        }
+        else if ((op & 0xff8f) == 0x9408 || (op & 0xff8f) == 0x9488)
+        {
+            s.op = op & 0x0080 ? OP_BCLR : OP_BSET;
+            s.r = (op >> 4) & 7;
+        }
+        else if (op == 0x9508)
+        {
+            s.op = OP_RET;
+        }
+        else if (op == 0x9518)
+        {
+            s.op = OP_RETI;
+        }
+        else if (op == 0x9588)
+        {
+            s.op = OP_SLEEP;
+        }
+        else if (op == 0x95a8)
+        {
+            s.op = OP_WDR;
+        }
+        else if (op == 0x95c8)
+        {
+            s.op = OP_LPM_R0;
+        }
+        else if (op == 0x9409)
+        {
+            s.op = OP_IJMP;
+        }
+        else if (op == 0x9509)
+        {
+            s.op = OP_ICALL;
+        }
+        else if ((op & 0xfe00) == 0x9400)
+        {
+            static const int8_t ops[16] =
+            {
+                OP_COM, OP_NEG, OP_SWAP, OP_INC, -1, OP_ASR, OP_LSR,
+                OP_ROR, -1, -1, OP_DEC, -1, -1, -1, -1, -1,
+            };
+
+            if (ops[op & 0xf] >= 0)
+            {
+                s.op = ops[op & 0xf];
+                s.d = d5;
+            }
+        }
+        else if ((op & 0xfe00) == 0x9600)
+        {
+            s.op = op & 0x0100 ? OP_SBIW : OP_ADIW;
+            s.d = 24 + ((op >> 4) & 3) * 2;
+            s.k = (op & 0xf) | ((op >> 2) & 0x30);
+        }
+        else if ((op & 0xfc00) == 0x9800)
+        {
+            static const uint8_t ops[] = { OP_CBI, OP_SBIC, OP_SBI, OP_SBIS };
+
+            s.op = ops[(op >> 8) & 3];
+            s.d = (op >> 3) & 0x1f;
+            s.r = op & 7;
+        }
+        else if ((op & 0xf000) == 0xb000)
+        {
+            s.op = op & 0x0800 ? OP_OUT : OP_IN;
+            s.d = d5;
+            s.r = (op & 0xf) | ((op >> 5) & 0x30);
+        }
+        else if ((op & 0xe000) == 0xc000)
+        {
+            s.op = op & 0x1000 ? OP_RCALL : OP_RJMP;
+            s.k = sign_extend(op & 0xfff, 12);
+        }
+        else if ((op & 0xf800) == 0xf000)
+        {
+            s.op = op & 0x0400 ? OP_BRBC : OP_BRBS;
+            s.r = op & 7;
+            s.k = sign_extend((op >> 3) & 0x7f, 7);
+        }
+        else if ((op & 0xf808) == 0xf800)
+        {
+            static const uint8_t ops[] =
+            {
+                OP_BLD, OP_BST, OP_SBRC, OP_SBRS,
+            };
+
+            s.op = ops[(op >> 9) & 3];
+            s.d = d5;
+            s.r = op & 7;
+        }
+    }
+}
+
+void tiny13::reset(uint8_t cause)
+{
+    uint8_t mcusr = REG(IO_MCUSR) | cause;
+
+    if (!(cause & BIT(MCUSR_PORF)))
+    {
+        m_resets++;
+    }
+
+    timer_sync();
+    rebase();
+    memset(&m_data[0x20], 0, 0x40);
+
+    REG(IO_MCUSR) = mcusr;
+    REG(IO_SPL) = SPL_RESET;
+    REG(IO_CLKPR) = CLKPR_RESET;
+    REG(IO_OSCCAL) = OSCCAL_RESET;
+    m_shift = CLKPR_RESET;
+
+    /* WDRF keeps the watchdog on, at its shortest time-out. */
+
+    if (mcusr & BIT(MCUSR_WDRF))
+    {
+        REG(IO_WDTCR) = BIT(WDTCR_WDE);
+    }
+
+    if (m_ee_due != UINT64_MAX)
+    {
+        REG(IO_EECR) = BIT(EECR_EEPE);
+    }
+
+    m_pc = 0;
+    m_presc_base = m_cycles;
+    m_t0_last = m_cycles;
+    m_t0_blocked = false;
+    m_adc_done = UINT64_MAX;
+    m_adc_first = true;
+    m_clkpr_until = m_wdce_until = m_eempe_until = 0;
+    m_shadow = m_woke = false;
+    m_sleep_mode = AWAKE;
+    m_sp_main = SPL_RESET - stack_main();
+    m_sp_low = SPL_RESET;
+    m_active.clear();
+
+    wdt_restart();
+    pins_changed();
+    m_next = 0;
+}
+
+uint64_t tiny13::now() const
+{
+    return m_tick_base + ((m_cycles - m_cycle_base) << m_shift);
+}
+
+/* First cycle at or after RC oscillator tick 'tick'. */
+
+uint64_t tiny13::cycle_at(uint64_t tick) const
+{
+    uint64_t t = now();
+
+    if (tick == UINT64_MAX)
+    {
+        return UINT64_MAX;
+    }
+
+    if (tick <= t)
+    {
+        return m_cycles;
+    }
+
+    return m_cycles + ((tick - t + (1ull << m_shift) - 1) >> m_shift);
+}
+
+uint64_t tiny13::ticks(double seconds) const
+{
+    return (uint64_t)std::llround(seconds * m_rc);
+}
+
+void tiny13::rebase()
+{
+    m_tick_base = now();
+    m_cycle_base = m_cycles;
+}
+
+uint8_t tiny13::io_read(uint8_t a)
+{
+    switch (a)
+    {
+        case IO_PINB:
+        {
+            uint8_t ddr = REG(IO_DDRB);
+
+            /* Inputs read high (pull-up or idle line) except a pressed
+             * button; outputs read back PORTB.
+             */
+
+            return (~ddr & 0x3f & ~(m_pb1_low ? BIT(PIN_BUTTON) : 0)) |
+                   (REG(IO_PORTB) & ddr);
+        }
+
+        case IO_TCNT0:
+        case IO_TIFR0:
+            timer_sync();
+            return REG(a);
+
+        default:
+            return REG(a);
+    }
+}
+
+void tiny13::io_write(uint8_t a, uint8_t v)
+{
+    uint8_t old = REG(a);
+
+    switch (a)
+    {
+        case IO_ADCL:
+        case IO_ADCH:
+            break;
+
+        case IO_ADCSRA:
+            REG(a) = (v & ~BIT(ADCSRA_ADIF) & ~BIT(ADCSRA_ADSC)) |
+                     (old & BIT(ADCSRA_ADIF) & ~v) |
+                     (old & BIT(ADCSRA_ADSC));
+
+            if (!(v & BIT(ADCSRA_ADEN)))
+            {
+                REG(a) &= ~BIT(ADCSRA_ADSC);
+                m_adc_done = UINT64_MAX;
+                m_adc_first = true;
+            }
+            else
+            {
+                if (!(old & BIT(ADCSRA_ADEN)))
+                {
+                    m_adc_base = m_cycles;
+                }
+
+                if ((v & BIT(ADCSRA_ADSC)) && m_adc_done == UINT64_MAX)
+                {
+                    adc_start();
+                }
+            }
+            break;
+
+        case IO_PINB:
+            REG(IO_PORTB) ^= v;
+            pins_changed();
+            break;
+
+        case IO_PORTB:
+        case IO_DDRB:
+            REG(a) = v;
+            pins_changed();
+            break;
+
+        case IO_EECR:
+        {
+            bool busy = old & BIT(EECR_EEPE);
+
+            REG(a) = (v & BIT(EECR_EERIE)) | (old & BIT(EECR_EEPE)) |
+                     ((busy ? old : v) & (3 << EECR_EEPM0));
+
+            if (v & BIT(EECR_EEMPE))
+            {
+                m_eempe_until = m_cycles + TIMED_CYCLES;
+            }
+            else if ((v & BIT(EECR_EEPE)) && !busy &&
+                     m_cycles < m_eempe_until)
+            {
+                uint8_t mode = (REG(a) >> EECR_EEPM0) & 3;
+                uint8_t &cell = eeprom[REG(IO_EEARL) & (TINY13_EEPROM - 1)];
+
+                cell = mode == 0 ? REG(IO_EEDR) :
+                       mode == 1 ? 0xff : cell & REG(IO_EEDR);
+                m_ee_due = now() + ticks(mode == 0 ? EE_ATOMIC_S
+                                                   : EE_SPLIT_S);
+                m_eempe_until = 0;
+                m_eeprom_writes++;
+                REG(a) |= BIT(EECR_EEPE);
+                m_cycles += EE_WRITE_CYCLES;
+            }
+
+            if ((v & BIT(EECR_EERE)) && !busy)
+            {
+                REG(IO_EEDR) = eeprom[REG(IO_EEARL) & (TINY13_EEPROM - 1)];
+                m_cycles += EE_READ_CYCLES;
+            }
+            break;
+        }
+
+        case IO_WDTCR:
+        {
+            bool timed = m_cycles < m_wdce_until;
+            uint8_t wdp = BIT(WDTCR_WDP3) | 7;
+            uint8_t val = (old & BIT(WDTCR_WDTIF) & ~v) |
+                          (v & BIT(WDTCR_WDTIE));
+
+            if (timed || !(old & BIT(WDTCR_WDE)))
+            {
+                val |= v & wdp;
+            }
+            else
+            {
+                val |= old & wdp;
+            }
+
+            /* WDE can only be cleared in the timed sequence, and not
+             * while WDRF is set.
+             */
+
+            if ((v & BIT(WDTCR_WDE)) ||
+                ((old & BIT(WDTCR_WDE)) &&
+                 (!timed || (REG(IO_MCUSR) & BIT(MCUSR_WDRF)))))
+            {
+                val |= BIT(WDTCR_WDE);
+            }
+
+            m_wdce_until = (v & BIT(WDTCR_WDCE)) && (v & BIT(WDTCR_WDE)) ?
+                           m_cycles + TIMED_CYCLES : 0;
+            REG(a) = val;
+
+            if ((val ^ old) & (wdp | BIT(WDTCR_WDE) | BIT(WDTCR_WDTIE)))
+            {
+                wdt_restart();
+            }
+            break;
+        }
+
+        case IO_CLKPR:
+            if (v == BIT(CLKPR_CLKPCE))
+            {
+                m_clkpr_until = m_cycles + TIMED_CYCLES;
+            }
+            else if (!(v & BIT(CLKPR_CLKPCE)) && m_cycles < m_clkpr_until)
+            {
+                rebase();
+                REG(a) = v & 0x0f;
+                m_shift = std::min(v & 0x0f, 8);
+                m_clkpr_until = 0;
+            }
+            break;
+
+        case IO_GTCCR:
+            timer_sync();
+
+            if (v & BIT(GTCCR_PSR10))
+            {
+                m_presc_base = m_cycles;
+            }
+
+            REG(a) = v & ~BIT(GTCCR_PSR10);
+            break;
+
+        case IO_TCNT0:
+            timer_sync();
+            REG(a) = v;
+            m_t0_blocked = true;
+            break;
+
+        case IO_TCCR0A:
+        case IO_TCCR0B:
+        case IO_OCR0A:
+        case IO_OCR0B:
+        {
+            timer_sync();
+            REG(a) = a == IO_TCCR0B ? v & 0x0f : v;
+
+            uint8_t wgm = (REG(IO_TCCR0A) & 3) |
+                          ((REG(IO_TCCR0B) >> 1) & 4);
+
+            if (wgm == 1 || wgm == 5)
+            {
+                fault("Timer0 phase correct PWM is not modelled", m_pc);
+            }
+            break;
+        }
+
+        case IO_TIFR0:
+            timer_sync();
+            REG(a) &= ~v;
+            break;
+
+        case IO_GIFR:
+            REG(a) &= ~v;
+            break;
+
+        case IO_MCUSR:
+            REG(a) &= v;
+            break;
+
+        case IO_TIMSK0:
+            timer_sync();
+            REG(a) = v;
+            break;
+
+        case IO_SPL:
+            REG(a) = v;
+            m_sp_low = std::min(m_sp_low, v);
+            m_sp_min = std::min(m_sp_min, v);
+            break;
+
+        default:
+            REG(a) = v;
+            break;
+    }
+
+    schedule();
+}
+
+uint8_t tiny13::data_read(uint16_t addr)
+{
+    if (addr < 0x20)
+    {
+        return m_data[addr];
+    }
+
+    if (addr < 0x60)
+    {
+        return io_read(addr - 0x20);
+    }
+
+    if (addr < sizeof(m_data))
+    {
+        return m_data[addr];
+    }
+
+    fault("read out of the data space", m_pc);
+}
+
+void tiny13::data_write(uint16_t addr, uint8_t v)
+{
+    if (addr < 0x20)
+    {
+        m_data[addr] = v;
+    }
+    else if (addr < 0x60)
+    {
+        io_write(addr - 0x20, v);
+    }
+    else if (addr < sizeof(m_data))
+    {
+        m_data[addr] = v;
+    }
+    else
+    {
+        fault("write out of the data space", m_pc);
+    }
+}
+
+void tiny13::pins_changed()
+{
+    uint8_t out = REG(IO_PORTB) & REG(IO_DDRB) & 0x3f;
+
+    if (out != m_outputs)
+    {
+        m_outputs = out;
+
+        if (on_pins)
+        {
+            on_pins(time(), out);
+        }
+    }
+}
+
+/****************************************************************************
+ * Timer0
+ ****************************************************************************/
+
+uint16_t tiny13::timer_prescaler() const
+{
+    static const uint16_t prescalers[8] = { 0, 1, 8, 64, 256, 1024, 0, 0 };
+
+    /* External clocks on T0 are not modelled: stopped. */
+
+    return prescalers[REG(IO_TCCR0B) & 7];
+}
+
+uint8_t tiny13::timer_top() const
+{
+    uint8_t wgm = (REG(IO_TCCR0A) & 3) | ((REG(IO_TCCR0B) >> 1) & 4);
+
+    return wgm == 2 || wgm == 7 ? REG(IO_OCR0A) : 0xff;
+}
+
+/* Timer clocks until TCNT0 reads 'value', UINT64_MAX if never. Above
+ * TOP (after a write) it counts up to 0xff first.
+ */
+
+uint64_t tiny13::timer_steps(uint8_t value) const
+{
+    uint8_t c = REG(IO_TCNT0), top = timer_top();
+
+    if (c > top)
+    {
+        if (value >= c)
+        {
+            return value - c;
+        }
+
+        return value <= top ? 256 - c + value : UINT64_MAX;
+    }
+
+    if (value > top)
+    {
+        return UINT64_MAX;
+    }
+
+    return value >= c ? value - c : top + 1 - c + value;
+}
+
+/* Brings TCNT0 and the flags up to now. A flag is set by the timer clock
+ * that moves the counter off its value: TOV0 off MAX (TOP in fast PWM),
+ * OCF0x off OCR0x, where CTC and fast PWM on OCR0A also clear it.
+ */
+
+void tiny13::timer_sync()
+{
+    uint16_t n = timer_prescaler();
+
+    if (m_sleep_mode != AWAKE && m_sleep_mode != SLEEP_IDLE)
+    {
+        return;
+    }
+
+    if (n != 0 && m_cycles > m_t0_last)
+    {
+        uint64_t ticks = (m_cycles - m_presc_base) / n -
+                         (m_t0_last - m_presc_base) / n;
+
+        if (ticks > 0)
+        {
+            uint8_t c = REG(IO_TCNT0), top = timer_top();
+            uint8_t wgm = (REG(IO_TCCR0A) & 3) |
+                          ((REG(IO_TCCR0B) >> 1) & 4);
+            uint8_t tov = wgm == 3 || wgm == 7 ? top : 0xff;
+            uint64_t period = (uint64_t)top + 1;
+            uint64_t a = timer_steps(REG(IO_OCR0A));
+            uint64_t b = timer_steps(REG(IO_OCR0B));
+
+            /* A write to TCNT0 blocks the match on the next clock. */
+
+            if (m_t0_blocked)
+            {
+                a = a == 0 ? period : a;
+                b = b == 0 ? period : b;
+                m_t0_blocked = false;
+            }
+
+            if (timer_steps(tov) < ticks)
+            {
+                REG(IO_TIFR0) |= BIT(TIFR_TOV0);
+            }
+
+            if (a < ticks)
+            {
+                REG(IO_TIFR0) |= BIT(TIFR_OCF0A);
+            }
+
+            if (b < ticks)
+            {
+                REG(IO_TIFR0) |= BIT(TIFR_OCF0B);
+            }
+
+            if (c > top)
+            {
+                uint64_t first = 256 - c;
+
+                c = ticks < first ? c + ticks : (ticks - first) % period;
+            }
+            else
+            {
+                c = (c + ticks) % period;
+            }
+
+            REG(IO_TCNT0) = c;
+        }
+    }
+
+    m_t0_last = m_cycles;
+}
+
+/* Cycle the flag of 'value' gets set, the timer must be in sync. */
+
+uint64_t tiny13::timer_flag_cycle(uint8_t value, bool compare) const
+{
+    uint16_t n = timer_prescaler();
+    uint64_t k = timer_steps(value);
+
+    if (n == 0 || k == UINT64_MAX)
+    {
+        return UINT64_MAX;
+    }
+
+    if (compare && m_t0_blocked && k == 0)
+    {
+        k = (uint64_t)timer_top() + 1;
+    }
+
+    return m_presc_base + ((m_t0_last - m_presc_base) / n + k + 1) * n;
+}
+
+/****************************************************************************
+ * ADC, watchdog, EEPROM and INT0
+ ****************************************************************************/
+
+/* The conversion starts on the next edge of the ADC clock, which runs
+ * from ADEN, and takes 13 of its cycles, 25 for the first one.
+ */
+
+void tiny13::adc_start()
+{
+    uint8_t adps = REG(IO_ADCSRA) & 7;
+    uint64_t div = adps ? 1u << adps : 2;
+    uint64_t start = m_adc_base +
+                     (m_cycles - m_adc_base + div - 1) / div * div;
+
+    m_adc_done = start + (m_adc_first ? 25 : 13) * div;
+    m_adc_first = false;
+    REG(IO_ADCSRA) |= BIT(ADCSRA_ADSC);
+}
+
+void tiny13::adc_complete()
+{
+    uint8_t mux = REG(IO_ADMUX);
+    double ref = mux & BIT(ADMUX_REFS0) ? 1.1 : 5.0;
+    double volts = adc_input ? adc_input(time(), mux & 3) : 0;
+    long raw = std::lround(volts / ref * 1024);
+    uint16_t val = (uint16_t)std::clamp(raw, 0L, 1023L);
+
+    if (mux & BIT(ADMUX_ADLAR))
+    {
+        val <<= 6;
+    }
+
+    REG(IO_ADCL) = val & 0xff;
+    REG(IO_ADCH) = val >> 8;
+    REG(IO_ADCSRA) &= ~BIT(ADCSRA_ADSC);
+    REG(IO_ADCSRA) |= BIT(ADCSRA_ADIF);
+    m_adc_done = UINT64_MAX;
+
+    /* Free running, the only trigger of ADCSRB modelled. */
+
+    if ((REG(IO_ADCSRA) & BIT(ADCSRA_ADATE)) && (REG(IO_ADCSRB) & 7) == 0)
+    {
+        adc_start();
+    }
+}
+
+void tiny13::wdt_restart()
+{
+    uint8_t wdtcr = REG(IO_WDTCR);
+    int wdp = (wdtcr & 7) | ((wdtcr >> 2) & 8);
+
+    if (!(wdtcr & (BIT(WDTCR_WDE) | BIT(WDTCR_WDTIE))))
+    {
+        m_wdt_due = UINT64_MAX;
+        return;
+    }
+
+    m_wdt_due = now() + ticks((2048 << std::min(wdp, 9)) / WDT_HZ);
+}
+
+/* Interrupt first if enabled; the reset comes when WDE is set and the
+ * interrupt (which clears WDTIE) was served.
+ */
+
+void tiny13::wdt_timeout()
+{
+    uint8_t wdtcr = REG(IO_WDTCR);
+
+    if (wdtcr & BIT(WDTCR_WDTIE))
+    {
+        REG(IO_WDTCR) |= BIT(WDTCR_WDTIF);
+        wdt_restart();
+    }
+    else
+    {
+        m_wdt_due = UINT64_MAX;
+        reset(BIT(MCUSR_WDRF));
+    }
+}
+
+void tiny13::eeprom_done()
+{
+    REG(IO_EECR) &= ~BIT(EECR_EEPE);
+    m_ee_due = UINT64_MAX;
+}
+
+void tiny13::button_edge(bool low)
+{
+    uint8_t isc = REG(IO_MCUCR) & 3;
+
+    if (low == m_pb1_low)
+    {
+        return;
+    }
+
+    m_pb1_low = low;
+
+    /* Edges need the I/O clock; in power-down only the level wakes. */
+
+    if (m_sleep_mode == SLEEP_POWER_DOWN)
+    {
+        return;
+    }
+
+    if ((isc == 1) || (isc == 2 && low) || (isc == 3 && !low))
+    {
+        REG(IO_GIFR) |= BIT(GIFR_INTF0);
+    }
+}
+
+/****************************************************************************
+ * Interrupts and sleep
+ ****************************************************************************/
+
+/* Pending and enabled interrupts, one bit per vector. */
+
+uint16_t tiny13::pending() const
+{
+    uint8_t tifr = REG(IO_TIFR0) & REG(IO_TIMSK0);
+    uint16_t p = 0;
+
+    if ((REG(IO_GIMSK) & BIT(GIMSK_INT0)) &&
+        ((REG(IO_GIFR) & BIT(GIFR_INTF0)) ||
+         ((REG(IO_MCUCR) & 3) == 0 && m_pb1_low)))
+    {
+        p |= BIT(VEC_INT0);
+    }
+
+    if (tifr & BIT(TIFR_TOV0))
+    {
+        p |= BIT(VEC_TIM0_OVF);
+    }
+
+    if ((REG(IO_EECR) & BIT(EECR_EERIE)) &&
+        !(REG(IO_EECR) & BIT(EECR_EEPE)))
+    {
+        p |= BIT(VEC_EE_RDY);
+    }
+
+    if (tifr & BIT(TIFR_OCF0A))
+    {
+        p |= BIT(VEC_TIM0_COMPA);
+    }
+
+    if (tifr & BIT(TIFR_OCF0B))
+    {
+        p |= BIT(VEC_TIM0_COMPB);
+    }
+
+    if ((REG(IO_WDTCR) & BIT(WDTCR_WDTIE)) &&
+        (REG(IO_WDTCR) & BIT(WDTCR_WDTIF)))
+    {
+        p |= BIT(VEC_WDT);
+    }
+
+    if ((REG(IO_ADCSRA) & BIT(ADCSRA_ADIE)) &&
+        (REG(IO_ADCSRA) & BIT(ADCSRA_ADIF)))
+    {
+        p |= BIT(VEC_ADC);
+    }
+
+    return p;
+}
+
+/* Handles what fell due up to now. */
+
+void tiny13::events()
+{
+    for (;;)
+    {
+        uint64_t t = now();
+
+        if (m_edge_next < m_edges.size() && m_edges[m_edge_next].first <= t)
+        {
+            button_edge(m_edges[m_edge_next++].second);
+        }
+        else if (m_wdt_due <= t)
+        {
+            wdt_timeout();
+        }
+        else if (m_ee_due <= t)
+        {
+            eeprom_done();
+        }
+        else
+        {
+            break;
+        }
+    }
+
+    if (m_adc_done <= m_cycles && m_sleep_mode != SLEEP_POWER_DOWN)
+    {
+        adc_complete();
+    }
+
+    timer_sync();
+
+    if (now() >= m_end)
+    {
+        m_stop = true;
+    }
+}
+
+/* Sets m_next to the first cycle that needs service(): now if an
+ * interrupt can be taken, else the next flag or event.
+ */
+
+void tiny13::schedule()
+{
+    uint64_t t = cycle_at(m_end);
+    bool timer = m_sleep_mode == AWAKE || m_sleep_mode == SLEEP_IDLE;
+
+    if ((REG(IO_SREG) & BIT(SREG_I)) && pending())
+    {
+        m_next = m_shadow ? 0 : m_cycles;
+        return;
+    }
+
+    if (timer)
+    {
+        uint8_t mask = REG(IO_TIMSK0) & ~REG(IO_TIFR0);
+
+        if (mask & BIT(TIMSK_TOIE0))
+        {
+            uint8_t wgm = (REG(IO_TCCR0A) & 3) |
+                          ((REG(IO_TCCR0B) >> 1) & 4);
+
+            t = std::min(t, timer_flag_cycle(wgm == 3 || wgm == 7 ?
+                                             timer_top() : 0xff, false));
+        }
+
+        if (mask & BIT(TIMSK_OCIE0A))
+        {
+            t = std::min(t, timer_flag_cycle(REG(IO_OCR0A), true));
+        }
+
+        if (mask & BIT(TIMSK_OCIE0B))
+        {
+            t = std::min(t, timer_flag_cycle(REG(IO_OCR0B), true));
+        }
+    }
+
+    if (m_sleep_mode != SLEEP_POWER_DOWN)
+    {
+        t = std::min(t, m_adc_done);
+    }
+
+    if (m_edge_next < m_edges.size())
+    {
+        t = std::min(t, cycle_at(m_edges[m_edge_next].first));
+    }
+
+    t = std::min({ t, cycle_at(m_wdt_due), cycle_at(m_ee_due) });
+    m_next = m_shadow ? 0 : t;
+}
+
+/* Between two instructions: events, then an interrupt if one can be
+ * taken. False at the end of the run.
+ */
+
+bool tiny13::service()
+{
+    events();
+
+    if (m_stop)
+    {
+        return false;
+    }
+
+    if (m_shadow)
+    {
+        /* Come back after the next instruction. */
+
+        m_shadow = false;
+        m_next = 0;
+        return true;
+    }
+
+    uint16_t p = pending();
+
+    if ((REG(IO_SREG) & BIT(SREG_I)) && p)
+    {
+        interrupt(__builtin_ctz(p));
+    }
+
+    m_woke = false;
+    schedule();
+    return true;
+}
+
+void tiny13::interrupt(int v)
+{
+    uint8_t sp = REG(IO_SPL);
+
+    switch (v)
+    {
+        case VEC_INT0:
+            REG(IO_GIFR) &= ~BIT(GIFR_INTF0);
+            break;
+
+        case VEC_TIM0_OVF:
+            REG(IO_TIFR0) &= ~BIT(TIFR_TOV0);
+            break;
+
+        case VEC_TIM0_COMPA:
+            REG(IO_TIFR0) &= ~BIT(TIFR_OCF0A);
+            break;
+
+        case VEC_TIM0_COMPB:
+            REG(IO_TIFR0) &= ~BIT(TIFR_OCF0B);
+            break;
+
+        case VEC_WDT:
+            REG(IO_WDTCR) &= ~BIT(WDTCR_WDTIF);
+
+            if (REG(IO_WDTCR) & BIT(WDTCR_WDE))
+            {
+                REG(IO_WDTCR) &= ~BIT(WDTCR_WDTIE);
+            }
+            break;
+
+        case VEC_ADC:
+            REG(IO_ADCSRA) &= ~BIT(ADCSRA_ADIF);
+            break;
+
+        default:
+            break;
+    }
+
+    m_active.push_back({ v, m_cycles, sp, m_sp_low });
+    data_write(sp, m_pc & 0xff);
+    data_write((uint8_t)(sp - 1), m_pc >> 8);
+    REG(IO_SPL) = sp - 2;
+    m_sp_low = sp - 2;
+    m_sp_min = std::min(m_sp_min, m_sp_low);
+    REG(IO_SREG) &= ~BIT(SREG_I);
+    m_cycles += IRQ_CYCLES + (m_woke ? WAKE_CYCLES : 0);
+    m_pc = v;
+}
+
+void tiny13::ret_from()
+{
+    if (m_active.empty())
+    {
+        return;
+    }
+
+    const active &a = m_active.back();
+    vector_stats &st = m_vectors[a.vector];
+    uint64_t cycles = m_cycles - a.start;
+
+    st.count++;
+    st.total += cycles;
+    st.max = std::max(st.max, cycles);
+    st.stack = std::max<unsigned>(st.stack, (uint8_t)(a.sp - m_sp_low));
+
+    /* Back to the interrupted code, and its own lowest SP. */
+
+    m_sp_low = a.sp_low;
+    m_active.pop_back();
+}
+
+/* SLEEP: jumps from one event to the next until an interrupt can be
+ * taken, or steps cycle by cycle with step_sleep. Timer0 stops outside
+ * idle and the ADC in power-down; their clocks are shifted by the time
+ * slept, as if it never passed for them.
+ */
+
+void tiny13::sleep()
+{
+    uint8_t mcucr = REG(IO_MCUCR);
+
+    if (!(mcucr & BIT(MCUCR_SE)))
+    {
+        return;
+    }
+
+    timer_sync();
+    m_sleep_mode = (mcucr >> 3) & 3;
+
+    if (m_sleep_mode == 3)
+    {
+        m_sleep_mode = SLEEP_IDLE;    /* Reserved */
+    }
+
+    if (m_sleep_mode == SLEEP_ADC &&
+        (REG(IO_ADCSRA) & BIT(ADCSRA_ADEN)) && m_adc_done == UINT64_MAX)
+    {
+        adc_start();
+    }
+
+    int mode = m_sleep_mode;
+    uint64_t start = m_cycles;
+
+    for (;;)
+    {
+        events();
+
+        /* A watchdog reset wakes it up too. */
+
+        if (m_stop || m_sleep_mode == AWAKE)
+        {
+            break;
+        }
+
+        if ((REG(IO_SREG) & BIT(SREG_I)) && pending())
+        {
+            m_woke = true;
+            break;
+        }
+
+        schedule();
+        m_cycles = step_sleep ? m_cycles + 1
+                              : std::max(m_next, m_cycles + 1);
+    }
+
+    uint64_t slept = m_cycles - start;
+
+    m_sleep_cycles += slept;
+
+    if (m_sleep_mode != AWAKE)
+    {
+        if (mode != SLEEP_IDLE)
+        {
+            m_presc_base += slept;
+            m_t0_last += slept;
+        }
+
+        if (mode == SLEEP_POWER_DOWN && m_adc_done != UINT64_MAX)
+        {
+            m_adc_done += slept;
+            m_adc_base += slept;
+        }
+    }
+
+    m_sleep_mode = AWAKE;
+    m_next = 0;
+}
+
+void tiny13::fault(const char *what, uint16_t pc) const
+{
+    char buf[128];
+
+    snprintf(buf, sizeof(buf), "%s at 0x%04x (opcode 0x%04x), %.6f s",
+             what, pc * 2, m_flash[pc & PC_MASK], time());
+    throw std::runtime_error(buf);
+}
+
+} /* namespace iss */
@@ -0,0 +1,261 @@
+/****************************************************************************
+ * tools/iss/tiny13.hpp
+ * Tomatotificatorul
+ *
+ * Copyright 2021 Iulian-Razvan Matesica <iulian.matesica@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ****************************************************************************/
+
+#ifndef __TOOLS_ISS_TINY13_HPP
+#define __TOOLS_ISS_TINY13_HPP
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <cstdint>
+#include <functional>
+#include <utility>
+#include <vector>
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+#define TINY13_FLASH      1024
+#define TINY13_EEPROM     64
+#define TINY13_VECTORS    10
+
+/****************************************************************************
+ * Public Types
+ ****************************************************************************/
+
+namespace iss
+{
+
+/* Cycles from the vector to the end of its RETI, as simavr counts them
+ * for tools/simavr/isrcycles.c, and the deepest stack the ISR used,
+ * return address included.
+ */
+
+struct vector_stats
+{
+    uint64_t count = 0;
+    uint64_t max = 0;
+    uint64_t total = 0;
+    unsigned stack = 0;
+};
+
+/* Instruction set simulator of the ATtiny13 running main.hex, with the
+ * peripherals the firmware uses: Timer0 (normal, CTC and fast PWM, no
+ * output pins), the ADC, INT0 on PB1, the watchdog, the EEPROM, CLKPR
+ * and the sleep modes. PCINT0, the analog comparator, OSCCAL tuning and
+ * self-programming are not modelled.
+ *
+ * The program is decoded once into handlers that jump straight to each
+ * other (threaded code). Instructions take their cycles from the
+ * datasheet; interrupts are taken between instructions, in 4 cycles
+ * plus 4 when waking up, and never right after SEI or RETI. Asleep, the
+ * core jumps straight to the next thing that can wake it up: a timer
+ * flag, the end of a conversion, a button edge, the watchdog or the
+ * EEPROM. Time is counted in cycles of the 9.6MHz RC oscillator, so
+ * CLKPR changes are exact too.
+ */
+
+class tiny13
+{
+public:
+    /* 'flash' is the program image, 'clock' the CPU clock at reset
+     * (CKDIV8 programmed, as by the fuses of source_code/Makefile).
+     * Throws std::runtime_error if the image does not fit.
+     */
+
+    tiny13(const std::vector<uint8_t> &flash, double clock);
+
+    /* Inputs, set before run(). Times in seconds since power-up. */
+
+    /* Voltage on an ADC channel, VCC is 5V. */
+
+    std::function<double(double t, uint8_t channel)> adc_input;
+
+    /* Called when the driven level of the PORTB outputs changes. */
+
+    std::function<void(double t, uint8_t outputs)> on_pins;
+
+    /* Water button held (PB1 low) from 'start' to 'end'. */
+
+    void press(double start, double end);
+
+    /* Step every cycle of a sleep instead of jumping over it, as general
+     * simulators do. Only for checking the jumps.
+     */
+
+    bool step_sleep = false;
+
+    /* Runs until 'seconds' since power-up. Throws std::runtime_error on
+     * an opcode the ATtiny13 does not have or an access out of the data
+     * space, with the PC.
+     */
+
+    void run(double seconds);
+
+    double time() const;
+    uint64_t cycles() const { return m_cycles; }
+    uint64_t sleep_cycles() const { return m_sleep_cycles; }
+    uint64_t instructions() const { return m_instructions; }
+    uint32_t resets() const { return m_resets; }
+    uint32_t eeprom_writes() const { return m_eeprom_writes; }
+    const vector_stats &vector(int v) const { return m_vectors[v]; }
+
+    /* Deepest stack seen, in bytes below RAMEND: of the main program
+     * alone, and overall with the ISRs on top of it.
+     */
+
+    unsigned stack_main() const;
+    unsigned stack() const;
+
+    std::vector<uint8_t> eeprom;
+
+private:
+    struct slot
+    {
+        const void *handler;    /* Label in run() */
+        uint8_t op;
+        uint8_t d;              /* Destination register, I/O address */
+        uint8_t r;              /* Source register, bit, displacement */
+        uint8_t skip;           /* Cycles to skip this instruction */
+        int16_t k;              /* Constant, address or branch offset */
+    };
+
+    void decode();
+    void reset(uint8_t cause);
+
+    /* Time. 'm_cycles' are CPU cycles, which also clock Timer0 and the
+     * ADC; the RC oscillator ticks m_tick_base + (cycles - m_cycle_base)
+     * << m_shift are the time of the external events.
+     */
+
+    uint64_t now() const;
+    uint64_t cycle_at(uint64_t tick) const;
+    uint64_t ticks(double seconds) const;
+    void rebase();
+
+    uint8_t io_read(uint8_t a);
+    void io_write(uint8_t a, uint8_t v);
+    uint8_t data_read(uint16_t addr);
+    void data_write(uint16_t addr, uint8_t v);
+    void pins_changed();
+
+    void timer_sync();
+    uint16_t timer_prescaler() const;
+    uint8_t timer_top() const;
+    uint64_t timer_steps(uint8_t value) const;
+    uint64_t timer_flag_cycle(uint8_t value, bool compare) const;
+
+    void adc_start();
+    void adc_complete();
+    void wdt_restart();
+    void wdt_timeout();
+    void eeprom_done();
+    void button_edge(bool low);
+
+    uint16_t pending() const;
+    void events();
+    void schedule();
+    bool service();
+    void interrupt(int v);
+    void sleep();
+    void ret_from();
+
+    [[noreturn]] void fault(const char *what, uint16_t pc) const;
+
+    std::vector<uint16_t> m_flash;
+    std::vector<slot> m_code;
+    double m_rc;                     /* RC oscillator, 8 * clock */
+
+    uint8_t m_data[0xa0] = {};       /* Registers, I/O, SRAM */
+    uint16_t m_pc = 0;
+
+    uint64_t m_cycles = 0;
+    uint64_t m_cycle_base = 0;
+    uint64_t m_tick_base = 0;
+    unsigned m_shift = 3;
+    uint64_t m_end = 0;
+
+    /* The run loop leaves its fast path once m_cycles reaches m_next. */
+
+    uint64_t m_next = 0;
+    bool m_shadow = false;           /* After SEI or RETI */
+    bool m_woke = false;
+    bool m_stop = false;
+    int m_sleep_mode = -1;           /* MCUCR SM1:0 while asleep */
+
+    uint64_t m_sleep_cycles = 0;
+    uint64_t m_instructions = 0;
+    uint32_t m_resets = 0;
+    uint32_t m_eeprom_writes = 0;
+
+    /* Timed sequences: CLKPR, WDTCR and EECR, open until this cycle. */
+
+    uint64_t m_clkpr_until = 0;
+    uint64_t m_wdce_until = 0;
+    uint64_t m_eempe_until = 0;
+
+    /* Timer0: prescaler reset at m_presc_base, synced at m_t0_last. */
+
+    uint64_t m_presc_base = 0;
+    uint64_t m_t0_last = 0;
+    bool m_t0_blocked = false;
+
+    uint64_t m_adc_base = 0;
+    uint64_t m_adc_done = UINT64_MAX;
+    bool m_adc_first = true;
+
+    uint64_t m_wdt_due = UINT64_MAX; /* Ticks */
+    uint64_t m_ee_due = UINT64_MAX;  /* Ticks */
+
+    /* PB1 edges: (tick, low), sorted. */
+
+    std::vector<std::pair<uint64_t, bool>> m_edges;
+    size_t m_edge_next = 0;
+    bool m_pb1_low = false;
+    uint8_t m_outputs = 0;
+
+    /* Lowest SP of the code running now since it started, of the main
+     * program before the last reset, and of everything.
+     */
+
+    uint8_t m_sp_low = UINT8_MAX;
+    uint8_t m_sp_main = UINT8_MAX;
+    uint8_t m_sp_min = UINT8_MAX;
+
+    /* Vectors being served, innermost last, with their start, the SP on
+     * entry and the lowest SP of the code they interrupted.
+     */
+
+    struct active
+    {
+        int vector;
+        uint64_t start;
+        uint8_t sp;
+        uint8_t sp_low;
+    };
+
+    std::vector<active> m_active;
+    vector_stats m_vectors[TINY13_VECTORS];
+};
+
+} /* namespace iss */
+
+#endif /* __TOOLS_ISS_TINY13_HPP */
@@ -0,0 +1,405 @@
+/****************************************************************************
+ * tools/iss/tinyiss.cpp
+ * Tomatotificatorul
+ *
+ * Copyright 2021 Iulian-Razvan Matesica <iulian.matesica@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ****************************************************************************/
+
+/* Runs the real ATtiny13 build (main.hex or main.elf) on the
+ * instruction set simulator of tiny13.hpp and prints what isrcycles
+ * prints, plus the waterings, how fast it went and the deepest stack:
+ * of the main program, overall, and of each ISR after its cycles. The
+ * 'make stack' target of source_code checks it. The speed line gives
+ * the rate of the image at hand: it depends mostly on how often the
+ * firmware wakes up.
+ *
+ *   tinyiss ../source_code/main.hex          an hour
+ *   tinyiss -d 1 ../source_code/main.hex     a day
+ *   tinyiss -t 30 -b 10 main.elf             isrcycles' 30 seconds
+ *   tinyiss -t 600 --step-sleep main.hex     the same, stepping sleeps
+ *
+ * Scenario: the duration pot at 2.5V, the solar panel following a clear
+ * day from 07:00 to 19:00 as in faultsim, time of day 00:00 at the start.
+ */
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include "tiny13.hpp"
+#include "ihex.hpp"
+#include "cli.hpp"
+
+#include <elf.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+#define SECONDS_PER_HOUR 3600.0
+#define SECONDS_PER_DAY  86400.0
+
+/* CLOCK of source_code/Makefile. */
+
+#define DEFAULT_CLOCK    1204508.0
+
+/* Panel divider of the board and the open circuit voltage at noon, as
+ * in sim/faultsim.cpp.
+ */
+
+#define SOLAR_DIVIDER    (10.0 / 57.0)
+#define SUNRISE_H        7.0
+#define SUNSET_H         19.0
+
+#define PRESS_S          0.2
+#define PUMP_PIN         0
+
+/* EEPROM section of avr-gcc ELF files. */
+
+#define ELF_EEPROM       0x810000
+
+/****************************************************************************
+ * Private Types
+ ****************************************************************************/
+
+struct options
+{
+    std::string firmware;
+    std::string eeprom;
+    double clock = DEFAULT_CLOCK;
+    double seconds = SECONDS_PER_HOUR;
+    double pot = 2.5;
+    double panel = 21;
+    std::vector<double> presses;
+    bool step_sleep = false;
+};
+
+struct image
+{
+    std::vector<uint8_t> flash;
+    std::vector<uint8_t> eeprom;
+};
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+static const char *const g_vectors[TINY13_VECTORS] =
+{
+    "RESET", "INT0", "PCINT0", "TIM0_OVF", "EE_RDY", "ANA_COMP",
+    "TIM0_COMPA", "TIM0_COMPB", "WDT", "ADC",
+};
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+static void usage(void)
+{
+    fprintf(stderr,
+        "usage: tinyiss [options] main.hex|main.elf\n"
+        "  -f HZ                CPU clock (default 1204508)\n"
+        "  -t SECONDS           seconds to run (default 3600)\n"
+        "  -d DAYS              days to run instead\n"
+        "  -b SECONDS           press the water button then, for 0.2s "
+        "(repeatable)\n"
+        "  -e EEPROM.hex        initial EEPROM contents\n"
+        "  --pot V              duration pot voltage (default 2.5)\n"
+        "  --panel V            panel open circuit voltage at noon "
+        "(default 21)\n"
+        "  --step-sleep         step every sleeping cycle, for checking\n");
+    exit(2);
+}
+
+static options parse_args(int argc, char **argv)
+{
+    options opt;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool has_val = i + 1 < argc;
+
+        if (arg == "--step-sleep")
+        {
+            opt.step_sleep = true;
+        }
+        else if (arg[0] != '-')
+        {
+            if (!opt.firmware.empty())
+            {
+                usage();
+            }
+
+            opt.firmware = arg;
+        }
+        else if (!has_val)
+        {
+            usage();
+        }
+        else if (arg == "-f")
+        {
+            opt.clock = cli::parse_num(argv[++i]);
+        }
+        else if (arg == "-d")
+        {
+            opt.seconds = cli::parse_num(argv[++i]) * SECONDS_PER_DAY;
+        }
+        else if (arg == "-t")
+        {
+            opt.seconds = cli::parse_num(argv[++i]);
+        }
+        else if (arg == "-b")
+        {
+            opt.presses.push_back(cli::parse_num(argv[++i]));
+        }
+        else if (arg == "-e")
+        {
+            opt.eeprom = argv[++i];
+        }
+        else if (arg == "--pot")
+        {
+            opt.pot = cli::parse_num(argv[++i]);
+        }
+        else if (arg == "--panel")
+        {
+            opt.panel = cli::parse_num(argv[++i]);
+        }
+        else
+        {
+            usage();
+        }
+    }
+
+    if (opt.firmware.empty() || opt.clock == 0)
+    {
+        usage();
+    }
+
+    return opt;
+}
+
+/* The PT_LOAD segments of an avr-gcc ELF file: flash from 0, EEPROM
+ * from 0x810000.
+ */
+
+static image load_elf(const std::vector<uint8_t> &data)
+{
+    image img;
+    Elf32_Ehdr eh;
+
+    if (data.size() < sizeof(eh))
+    {
+        throw std::runtime_error("truncated ELF file");
+    }
+
+    memcpy(&eh, data.data(), sizeof(eh));
+
+    if (eh.e_ident[EI_CLASS] != ELFCLASS32 || eh.e_machine != EM_AVR)
+    {
+        throw std::runtime_error("not an AVR ELF file");
+    }
+
+    for (unsigned i = 0; i < eh.e_phnum; i++)
+    {
+        Elf32_Phdr ph;
+        size_t off = eh.e_phoff + (size_t)i * eh.e_phentsize;
+
+        if (off + sizeof(ph) > data.size())
+        {
+            throw std::runtime_error("truncated ELF file");
+        }
+
+        memcpy(&ph, &data[off], sizeof(ph));
+
+        if (ph.p_type != PT_LOAD || ph.p_filesz == 0)
+        {
+            continue;
+        }
+
+        if ((size_t)ph.p_offset + ph.p_filesz > data.size())
+        {
+            throw std::runtime_error("truncated ELF file");
+        }
+
+        bool ee = ph.p_paddr >= ELF_EEPROM;
+        std::vector<uint8_t> &mem = ee ? img.eeprom : img.flash;
+        uint32_t addr = ee ? ph.p_paddr - ELF_EEPROM : ph.p_paddr;
+
+        if (ph.p_paddr >= 0x800000 && !ee)
+        {
+            continue;    /* .data in SRAM, loaded from flash by crt */
+        }
+
+        if (mem.size() < addr + ph.p_filesz)
+        {
+            mem.resize(addr + ph.p_filesz, 0xff);
+        }
+
+        memcpy(&mem[addr], &data[ph.p_offset], ph.p_filesz);
+    }
+
+    return img;
+}
+
+static image load(const std::string &path)
+{
+    std::ifstream in(path, std::ios::binary);
+    std::vector<uint8_t> data((std::istreambuf_iterator<char>(in)),
+                              std::istreambuf_iterator<char>());
+
+    if (!in && !in.eof())
+    {
+        throw std::runtime_error("cannot read " + path);
+    }
+
+    if (data.size() >= 4 && memcmp(data.data(), ELFMAG, SELFMAG) == 0)
+    {
+        return load_elf(data);
+    }
+
+    return { ihex::file::load(path).image(TINY13_FLASH), {} };
+}
+
+/* Panel voltage on ADC2 over a clear day, time of day 00:00 at t = 0. */
+
+static double solar_volts(double t, double peak)
+{
+    double h = fmod(t, SECONDS_PER_DAY) / 3600;
+
+    if (h <= SUNRISE_H || h >= SUNSET_H)
+    {
+        return 0;
+    }
+
+    return peak * SOLAR_DIVIDER *
+           sin(M_PI * (h - SUNRISE_H) / (SUNSET_H - SUNRISE_H));
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+int main(int argc, char **argv)
+{
+    try
+    {
+        options opt = parse_args(argc, argv);
+        image img = load(opt.firmware);
+        iss::tiny13 mcu(img.flash, opt.clock);
+        unsigned waterings = 0;
+        double pump_since = -1;
+        double pump_s = 0;
+
+        if (!opt.eeprom.empty())
+        {
+            img.eeprom = ihex::file::load(opt.eeprom).image(TINY13_EEPROM);
+        }
+
+        for (size_t i = 0; i < img.eeprom.size() && i < TINY13_EEPROM; i++)
+        {
+            mcu.eeprom[i] = img.eeprom[i];
+        }
+
+        mcu.adc_input = [&](double t, uint8_t channel)
+        {
+            return channel == 3 ? opt.pot : solar_volts(t, opt.panel);
+        };
+
+        mcu.on_pins = [&](double t, uint8_t outputs)
+        {
+            bool on = outputs & (1 << PUMP_PIN);
+
+            if (on && pump_since < 0)
+            {
+                pump_since = t;
+                waterings++;
+            }
+            else if (!on && pump_since >= 0)
+            {
+                pump_s += t - pump_since;
+                pump_since = -1;
+            }
+        };
+
+        for (double t : opt.presses)
+        {
+            mcu.press(t, t + PRESS_S);
+        }
+
+        mcu.step_sleep = opt.step_sleep;
+
+        auto start = std::chrono::steady_clock::now();
+
+        mcu.run(opt.seconds);
+
+        double wall = std::chrono::duration<double>(
+                          std::chrono::steady_clock::now() - start).count();
+
+        if (pump_since >= 0)
+        {
+            pump_s += mcu.time() - pump_since;
+        }
+
+        printf("cycles %llu\n", (unsigned long long)mcu.cycles());
+        printf("active %llu\n",
+               (unsigned long long)(mcu.cycles() - mcu.sleep_cycles()));
+        printf("instructions %llu\n",
+               (unsigned long long)mcu.instructions());
+        printf("simulated %.0f s\n", mcu.time());
+        printf("wall %.3f s\n", wall);
+        printf("speed %.3g x real time, %.1f MIPS\n", mcu.time() / wall,
+               mcu.instructions() / wall / 1e6);
+        printf("resets %u\n", mcu.resets());
+        printf("eeprom_writes %u\n", mcu.eeprom_writes());
+        printf("waterings %u\n", waterings);
+        printf("pump %.1f s\n", pump_s);
+        printf("stack_main %u bytes\n", mcu.stack_main());
+        printf("stack %u bytes\n", mcu.stack());
+
+        for (int v = 1; v < TINY13_VECTORS; v++)
+        {
+            const iss::vector_stats &st = mcu.vector(v);
+
+            if (st.count == 0)
+            {
+                continue;
+            }
+
+            printf("vector %d %s %llu %llu %llu %u\n", v, g_vectors[v],
+                   (unsigned long long)st.count,
+                   (unsigned long long)st.max,
+                   (unsigned long long)st.total, st.stack);
+        }
+    }
+    catch (const std::exception &e)
+    {
+        fprintf(stderr, "tinyiss: %s\n", e.what());
+        return 1;
+    }
+
+    return 0;
+}
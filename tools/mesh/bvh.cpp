@@ -0,0 +1,994 @@
+/****************************************************************************
+ * tools/mesh/bvh.cpp
+ * Tomatotificatorul
+ *
+ * Copyright 2021 Iulian-Razvan Matesica <iulian.matesica@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ****************************************************************************/
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include "bvh.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <utility>
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+#define SAH_BINS        16
+#define LEAF_SIZE       4
+#define STACK_SIZE      64
+
+/* Cost of a node visit against a triangle test, for the SAH. */
+
+#define SAH_TRAVERSAL   1.0
+
+#define GJK_ITERATIONS  64
+
+/****************************************************************************
+ * Private Types
+ ****************************************************************************/
+
+namespace mesh
+{
+
+struct bvh::build_item
+{
+    float min[3];
+    float max[3];
+    float center[3];
+    uint32_t tri;
+};
+
+} /* namespace mesh */
+
+namespace
+{
+
+using mesh::vec3d;
+
+struct bounds
+{
+    float min[3] = { HUGE_VALF, HUGE_VALF, HUGE_VALF };
+    float max[3] = { -HUGE_VALF, -HUGE_VALF, -HUGE_VALF };
+
+    void grow(const float lo[3], const float hi[3])
+    {
+        for (int a = 0; a < 3; a++)
+        {
+            min[a] = std::min(min[a], lo[a]);
+            max[a] = std::max(max[a], hi[a]);
+        }
+    }
+
+    double area() const
+    {
+        double d[3];
+
+        for (int a = 0; a < 3; a++)
+        {
+            d[a] = std::max(0.0f, max[a] - min[a]);
+        }
+
+        return 2 * (d[0] * d[1] + d[1] * d[2] + d[2] * d[0]);
+    }
+};
+
+/* A point of the GJK simplex: w = a - b, a on the first hull, b on the
+ * second.
+ */
+
+struct support_pt
+{
+    vec3d w;
+    vec3d b;
+};
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+vec3d operator+(vec3d a, vec3d b)
+{
+    return { a.x + b.x, a.y + b.y, a.z + b.z };
+}
+
+vec3d operator-(vec3d a, vec3d b)
+{
+    return { a.x - b.x, a.y - b.y, a.z - b.z };
+}
+
+vec3d operator*(vec3d a, double s)
+{
+    return { a.x * s, a.y * s, a.z * s };
+}
+
+vec3d operator-(vec3d a)
+{
+    return { -a.x, -a.y, -a.z };
+}
+
+double dot(vec3d a, vec3d b)
+{
+    return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+vec3d cross(vec3d a, vec3d b)
+{
+    return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z,
+             a.x * b.y - a.y * b.x };
+}
+
+const vec3d &farthest(const vec3d *p, int n, vec3d dir)
+{
+    int best = 0;
+    double best_d = dot(p[0], dir);
+
+    for (int i = 1; i < n; i++)
+    {
+        double d = dot(p[i], dir);
+
+        if (d > best_d)
+        {
+            best = i;
+            best_d = d;
+        }
+    }
+
+    return p[best];
+}
+
+/* Squared distance between two boxes given by their corners, 0 if they
+ * overlap.
+ */
+
+double box_distance2(const vec3d &lo1, const vec3d &hi1, const float lo2[3],
+                     const float hi2[3])
+{
+    double d[3] =
+    {
+        std::max({ 0.0, lo2[0] - hi1.x, lo1.x - hi2[0] }),
+        std::max({ 0.0, lo2[1] - hi1.y, lo1.y - hi2[1] }),
+        std::max({ 0.0, lo2[2] - hi1.z, lo1.z - hi2[2] }),
+    };
+
+    return d[0] * d[0] + d[1] * d[1] + d[2] * d[2];
+}
+
+/* Closest point to the origin on the simplex 's' (1 to 3 points), as
+ * weights; drops the points with weight 0. Ericson, Real-Time Collision
+ * Detection, 5.1.2 and 5.1.5, with the query point at the origin.
+ */
+
+void closest_segment(support_pt *s, int &n, double *lambda)
+{
+    vec3d ab = s[1].w - s[0].w;
+    double den = dot(ab, ab);
+    double t = den > 0 ? -dot(s[0].w, ab) / den : 0;
+
+    if (t <= 0)
+    {
+        n = 1;
+        lambda[0] = 1;
+    }
+    else if (t >= 1)
+    {
+        s[0] = s[1];
+        n = 1;
+        lambda[0] = 1;
+    }
+    else
+    {
+        lambda[0] = 1 - t;
+        lambda[1] = t;
+    }
+}
+
+void closest_triangle(support_pt *s, int &n, double *lambda)
+{
+    vec3d a = s[0].w, b = s[1].w, c = s[2].w;
+    vec3d ab = b - a, ac = c - a, ap = -a;
+    double d1 = dot(ab, ap), d2 = dot(ac, ap);
+
+    if (d1 <= 0 && d2 <= 0)
+    {
+        n = 1;
+        lambda[0] = 1;
+        return;
+    }
+
+    vec3d bp = -b;
+    double d3 = dot(ab, bp), d4 = dot(ac, bp);
+
+    if (d3 >= 0 && d4 <= d3)
+    {
+        s[0] = s[1];
+        n = 1;
+        lambda[0] = 1;
+        return;
+    }
+
+    double vc = d1 * d4 - d3 * d2;
+
+    if (vc <= 0 && d1 >= 0 && d3 <= 0)
+    {
+        double v = d1 / (d1 - d3);
+
+        n = 2;
+        lambda[0] = 1 - v;
+        lambda[1] = v;
+        return;
+    }
+
+    vec3d cp = -c;
+    double d5 = dot(ab, cp), d6 = dot(ac, cp);
+
+    if (d6 >= 0 && d5 <= d6)
+    {
+        s[0] = s[2];
+        n = 1;
+        lambda[0] = 1;
+        return;
+    }
+
+    double vb = d5 * d2 - d1 * d6;
+
+    if (vb <= 0 && d2 >= 0 && d6 <= 0)
+    {
+        double w = d2 / (d2 - d6);
+
+        s[1] = s[2];
+        n = 2;
+        lambda[0] = 1 - w;
+        lambda[1] = w;
+        return;
+    }
+
+    double va = d3 * d6 - d5 * d4;
+
+    if (va <= 0 && (d4 - d3) >= 0 && (d5 - d6) >= 0)
+    {
+        double w = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+
+        s[0] = s[1];
+        s[1] = s[2];
+        n = 2;
+        lambda[0] = 1 - w;
+        lambda[1] = w;
+        return;
+    }
+
+    double den = 1 / (va + vb + vc);
+
+    lambda[1] = vb * den;
+    lambda[2] = vc * den;
+    lambda[0] = 1 - lambda[1] - lambda[2];
+}
+
+/* Tetrahedron: 0 points left if the origin is inside, else the closest
+ * face it is outside of. A flat one (thin boxes, coplanar facets) has no
+ * inside: the closest of all faces.
+ */
+
+void closest_tetrahedron(support_pt *s, int &n, double *lambda)
+{
+    static const int faces[4][4] =
+    {
+        { 0, 1, 2, 3 }, { 0, 2, 3, 1 }, { 0, 3, 1, 2 }, { 1, 3, 2, 0 },
+    };
+
+    vec3d ab = s[1].w - s[0].w, ac = s[2].w - s[0].w, ad = s[3].w - s[0].w;
+    double volume = dot(cross(ab, ac), ad);
+    bool flat = volume * volume <=
+                1e-16 * dot(ab, ab) * dot(ac, ac) * dot(ad, ad);
+    double best = HUGE_VAL;
+    support_pt best_s[3];
+    double best_l[3];
+    int best_n = 0;
+
+    for (const int *f : faces)
+    {
+        vec3d a = s[f[0]].w, b = s[f[1]].w, c = s[f[2]].w, d = s[f[3]].w;
+        vec3d nrm = cross(b - a, c - a);
+        double side_o = dot(nrm, -a);
+        double side_d = dot(nrm, d - a);
+
+        /* The origin is on the other side of this face than the fourth
+         * point.
+         */
+
+        if (!flat && side_o * side_d >= 0)
+        {
+            continue;
+        }
+
+        support_pt t[3] = { s[f[0]], s[f[1]], s[f[2]] };
+        double l[3];
+        int tn = 3;
+
+        closest_triangle(t, tn, l);
+
+        vec3d v = { 0, 0, 0 };
+
+        for (int i = 0; i < tn; i++)
+        {
+            v = v + t[i].w * l[i];
+        }
+
+        if (dot(v, v) < best)
+        {
+            best = dot(v, v);
+            best_n = tn;
+
+            for (int i = 0; i < tn; i++)
+            {
+                best_s[i] = t[i];
+                best_l[i] = l[i];
+            }
+        }
+    }
+
+    n = best_n;
+
+    for (int i = 0; i < n; i++)
+    {
+        s[i] = best_s[i];
+        lambda[i] = best_l[i];
+    }
+}
+
+/* Closest point of a triangle to 'p' (Ericson 5.1.5), faster than GJK
+ * for point queries.
+ */
+
+vec3d closest_on_triangle(const vec3d &p, const mesh::triangle &t)
+{
+    const vec3d &a = t.v[0], &b = t.v[1], &c = t.v[2];
+    vec3d ab = b - a, ac = c - a, ap = p - a;
+    double d1 = dot(ab, ap), d2 = dot(ac, ap);
+
+    if (d1 <= 0 && d2 <= 0)
+    {
+        return a;
+    }
+
+    vec3d bp = p - b;
+    double d3 = dot(ab, bp), d4 = dot(ac, bp);
+
+    if (d3 >= 0 && d4 <= d3)
+    {
+        return b;
+    }
+
+    double vc = d1 * d4 - d3 * d2;
+
+    if (vc <= 0 && d1 >= 0 && d3 <= 0)
+    {
+        return a + ab * (d1 / (d1 - d3));
+    }
+
+    vec3d cp = p - c;
+    double d5 = dot(ab, cp), d6 = dot(ac, cp);
+
+    if (d6 >= 0 && d5 <= d6)
+    {
+        return c;
+    }
+
+    double vb = d5 * d2 - d1 * d6;
+
+    if (vb <= 0 && d2 >= 0 && d6 <= 0)
+    {
+        return a + ac * (d2 / (d2 - d6));
+    }
+
+    double va = d3 * d6 - d5 * d4;
+
+    if (va <= 0 && (d4 - d3) >= 0 && (d5 - d6) >= 0)
+    {
+        return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+    }
+
+    double den = 1 / (va + vb + vc);
+
+    return a + ab * (vb * den) + ac * (vc * den);
+}
+
+/* Ray / triangle, Moller-Trumbore, hits in front of the origin only. */
+
+bool ray_hits(const vec3d &o, const vec3d &d, const mesh::triangle &t)
+{
+    vec3d e1 = t.v[1] - t.v[0], e2 = t.v[2] - t.v[0];
+    vec3d p = cross(d, e2);
+    double det = dot(e1, p);
+
+    if (std::fabs(det) < 1e-18)
+    {
+        return false;
+    }
+
+    vec3d s = o - t.v[0];
+    double u = dot(s, p) / det;
+
+    if (u < 0 || u > 1)
+    {
+        return false;
+    }
+
+    vec3d q = cross(s, e1);
+    double v = dot(d, q) / det;
+
+    return v >= 0 && u + v <= 1 && dot(e2, q) / det > 0;
+}
+
+bool ray_box(const vec3d &o, const vec3d &inv, const float lo[3],
+             const float hi[3])
+{
+    double t0 = 0, t1 = HUGE_VAL;
+    const double org[3] = { o.x, o.y, o.z };
+    const double id[3] = { inv.x, inv.y, inv.z };
+
+    for (int a = 0; a < 3; a++)
+    {
+        double ta = (lo[a] - org[a]) * id[a];
+        double tb = (hi[a] - org[a]) * id[a];
+
+        t0 = std::max(t0, std::min(ta, tb));
+        t1 = std::min(t1, std::max(ta, tb));
+    }
+
+    return t0 <= t1;
+}
+
+} /* namespace */
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+namespace mesh
+{
+
+obb obb::make(vec3d center, vec3d size, double rz_deg)
+{
+    double r = rz_deg * M_PI / 180;
+    obb b;
+
+    b.center = center;
+    b.half = size * 0.5;
+    b.axis[0] = { std::cos(r), std::sin(r), 0 };
+    b.axis[1] = { -std::sin(r), std::cos(r), 0 };
+    b.axis[2] = { 0, 0, 1 };
+    return b;
+}
+
+void obb::corners(vec3d out[8]) const
+{
+    for (int i = 0; i < 8; i++)
+    {
+        out[i] = center + axis[0] * (i & 1 ? half.x : -half.x) +
+                 axis[1] * (i & 2 ? half.y : -half.y) +
+                 axis[2] * (i & 4 ? half.z : -half.z);
+    }
+}
+
+double gjk_distance(const vec3d *a, int na, const vec3d *b, int nb,
+                    vec3d *on_b)
+{
+    support_pt s[4];
+    double lambda[4] = { 1 };
+    int n = 1;
+
+    s[0].w = a[0] - b[0];
+    s[0].b = b[0];
+
+    vec3d v = s[0].w;
+
+    for (int iter = 0; iter < GJK_ITERATIONS; iter++)
+    {
+        double vv = dot(v, v);
+
+        if (vv < 1e-24)
+        {
+            break;
+        }
+
+        /* Support point of A - B against v. */
+
+        support_pt p;
+        const vec3d &pa = farthest(a, na, -v);
+
+        p.b = farthest(b, nb, v);
+        p.w = pa - p.b;
+
+        if (vv - dot(v, p.w) <= 1e-12 * vv + 1e-18)
+        {
+            break;
+        }
+
+        /* Already in the simplex: no progress possible. */
+
+        bool seen = false;
+
+        for (int i = 0; i < n; i++)
+        {
+            seen |= s[i].w.x == p.w.x && s[i].w.y == p.w.y &&
+                    s[i].w.z == p.w.z;
+        }
+
+        if (seen)
+        {
+            break;
+        }
+
+        s[n++] = p;
+
+        switch (n)
+        {
+            case 2:
+                closest_segment(s, n, lambda);
+                break;
+
+            case 3:
+                closest_triangle(s, n, lambda);
+                break;
+
+            case 4:
+                closest_tetrahedron(s, n, lambda);
+                break;
+        }
+
+        if (n == 0)
+        {
+            /* Origin inside: the hulls overlap. */
+
+            if (on_b != nullptr)
+            {
+                *on_b = p.b;
+            }
+
+            return 0;
+        }
+
+        v = { 0, 0, 0 };
+
+        for (int i = 0; i < n; i++)
+        {
+            v = v + s[i].w * lambda[i];
+        }
+    }
+
+    if (on_b != nullptr)
+    {
+        vec3d q = { 0, 0, 0 };
+
+        for (int i = 0; i < n; i++)
+        {
+            q = q + s[i].b * lambda[i];
+        }
+
+        *on_b = q;
+    }
+
+    return std::sqrt(dot(v, v));
+}
+
+vec3d closest_point(const vec3d &p, const triangle &t)
+{
+    return closest_on_triangle(p, t);
+}
+
+bvh::bvh(const stl &file)
+{
+    m_tris.resize(file.size());
+
+    for (size_t i = 0; i < file.size(); i++)
+    {
+        for (int k = 0; k < 3; k++)
+        {
+            vec3 v = file.vertex(i, k);
+
+            m_tris[i].v[k] = { v.x, v.y, v.z };
+        }
+    }
+
+    init();
+}
+
+bvh::bvh(std::vector<triangle> tris)
+    : m_tris(std::move(tris))
+{
+    init();
+}
+
+void bvh::init()
+{
+    std::vector<build_item> items(m_tris.size());
+
+    for (size_t i = 0; i < m_tris.size(); i++)
+    {
+        build_item &it = items[i];
+
+        for (int a = 0; a < 3; a++)
+        {
+            it.min[a] = HUGE_VALF;
+            it.max[a] = -HUGE_VALF;
+        }
+
+        for (const vec3d &v : m_tris[i].v)
+        {
+            const double c[3] = { v.x, v.y, v.z };
+
+            /* Rounded outwards, the boxes must hold the triangle. */
+
+            for (int a = 0; a < 3; a++)
+            {
+                float lo = (float)c[a], hi = lo;
+
+                if (lo > c[a])
+                {
+                    lo = std::nextafter(lo, -HUGE_VALF);
+                }
+
+                if (hi < c[a])
+                {
+                    hi = std::nextafter(hi, HUGE_VALF);
+                }
+
+                it.min[a] = std::min(it.min[a], lo);
+                it.max[a] = std::max(it.max[a], hi);
+            }
+        }
+
+        for (int a = 0; a < 3; a++)
+        {
+            it.center[a] = (it.min[a] + it.max[a]) / 2;
+        }
+
+        it.tri = (uint32_t)i;
+    }
+
+    m_nodes.reserve(2 * items.size() / LEAF_SIZE + 1);
+    m_nodes.push_back(node());
+
+    if (!items.empty())
+    {
+        build(0, items, 0, (uint32_t)items.size(), 1);
+    }
+
+    /* Leaves index the triangles in build order. */
+
+    std::vector<triangle> sorted(m_tris.size());
+
+    m_ids.resize(items.size());
+
+    for (size_t i = 0; i < items.size(); i++)
+    {
+        sorted[i] = m_tris[items[i].tri];
+        m_ids[i] = items[i].tri;
+    }
+
+    m_tris.swap(sorted);
+}
+
+void bvh::build(uint32_t self, std::vector<build_item> &items,
+                uint32_t begin, uint32_t end, int depth)
+{
+    bounds box, cbox;
+
+    m_depth = std::max(m_depth, depth);
+
+    for (uint32_t i = begin; i < end; i++)
+    {
+        box.grow(items[i].min, items[i].max);
+        cbox.grow(items[i].center, items[i].center);
+    }
+
+    std::copy(box.min, box.min + 3, m_nodes[self].min);
+    std::copy(box.max, box.max + 3, m_nodes[self].max);
+    m_nodes[self].index = begin;
+    m_nodes[self].count = end - begin;
+
+    if (end - begin <= LEAF_SIZE)
+    {
+        return;
+    }
+
+    /* Binned SAH: the cheapest of the bin boundaries on every axis. */
+
+    double best_cost = HUGE_VAL;
+    int best_axis = -1;
+    int best_split = 0;
+
+    for (int a = 0; a < 3; a++)
+    {
+        double extent = cbox.max[a] - cbox.min[a];
+
+        if (extent <= 0)
+        {
+            continue;
+        }
+
+        bounds bin[SAH_BINS];
+        uint32_t count[SAH_BINS] = {};
+        double scale = SAH_BINS / extent;
+
+        for (uint32_t i = begin; i < end; i++)
+        {
+            int b = std::min(SAH_BINS - 1,
+                (int)((items[i].center[a] - cbox.min[a]) * scale));
+
+            bin[b].grow(items[i].min, items[i].max);
+            count[b]++;
+        }
+
+        double right_area[SAH_BINS];
+        uint32_t right_count[SAH_BINS];
+        bounds acc;
+        uint32_t n = 0;
+
+        for (int b = SAH_BINS - 1; b > 0; b--)
+        {
+            acc.grow(bin[b].min, bin[b].max);
+            n += count[b];
+            right_area[b] = acc.area();
+            right_count[b] = n;
+        }
+
+        acc = bounds();
+        n = 0;
+
+        for (int b = 0; b < SAH_BINS - 1; b++)
+        {
+            acc.grow(bin[b].min, bin[b].max);
+            n += count[b];
+
+            if (n == 0 || right_count[b + 1] == 0)
+            {
+                continue;
+            }
+
+            double cost = acc.area() * n +
+                          right_area[b + 1] * right_count[b + 1];
+
+            if (cost < best_cost)
+            {
+                best_cost = cost;
+                best_axis = a;
+                best_split = b + 1;
+            }
+        }
+    }
+
+    uint32_t mid;
+
+    if (best_axis < 0)
+    {
+        /* All centers equal, halve the list. */
+
+        mid = begin + (end - begin) / 2;
+    }
+    else
+    {
+        double leaf_cost = box.area() * (end - begin);
+
+        best_cost = SAH_TRAVERSAL * box.area() + best_cost;
+
+        if (best_cost >= leaf_cost && end - begin <= 4 * LEAF_SIZE)
+        {
+            return;
+        }
+
+        double lo = cbox.min[best_axis];
+        double scale = SAH_BINS / (cbox.max[best_axis] - lo);
+
+        mid = (uint32_t)(std::partition(items.begin() + begin,
+            items.begin() + end,
+            [&](const build_item &it)
+            {
+                return std::min(SAH_BINS - 1,
+                    (int)((it.center[best_axis] - lo) * scale)) < best_split;
+            }) - items.begin());
+    }
+
+    uint32_t left = (uint32_t)m_nodes.size();
+
+    m_nodes[self].index = left;
+    m_nodes[self].count = 0;
+    m_nodes.resize(left + 2);
+    build(left, items, begin, mid, depth + 1);
+    build(left + 1, items, mid, end, depth + 1);
+}
+
+closest bvh::nearest_hull(const vec3d *p, int n, double max_dist) const
+{
+    closest best = { max_dist, { 0, 0, 0 }, UINT32_MAX };
+    double best2 = max_dist * max_dist;
+    uint32_t stack[STACK_SIZE];
+    int top = 0;
+    vec3d lo = p[0], hi = p[0];
+
+    if (m_tris.empty())
+    {
+        return best;
+    }
+
+    for (int i = 1; i < n; i++)
+    {
+        lo = { std::min(lo.x, p[i].x), std::min(lo.y, p[i].y),
+               std::min(lo.z, p[i].z) };
+        hi = { std::max(hi.x, p[i].x), std::max(hi.y, p[i].y),
+               std::max(hi.z, p[i].z) };
+    }
+
+    /* Boxes give a lower bound: skip every node farther than the best so
+     * far, and visit the nearer child first.
+     */
+
+    stack[top++] = 0;
+
+    while (top > 0)
+    {
+        const node &nd = m_nodes[stack[--top]];
+
+        if (box_distance2(lo, hi, nd.min, nd.max) >= best2)
+        {
+            continue;
+        }
+
+        if (nd.count > 0)
+        {
+            for (uint32_t i = nd.index; i < nd.index + nd.count; i++)
+            {
+                vec3d on;
+                double d;
+
+                if (n == 1)
+                {
+                    on = closest_on_triangle(p[0], m_tris[i]);
+                    d = dot(on - p[0], on - p[0]);
+                }
+                else
+                {
+                    d = gjk_distance(p, n, m_tris[i].v, 3, &on);
+                    d *= d;
+                }
+
+                if (d < best2)
+                {
+                    best2 = d;
+                    best.point = on;
+                    best.triangle = i;
+                }
+            }
+
+            continue;
+        }
+
+        const node &l = m_nodes[nd.index];
+        const node &r = m_nodes[nd.index + 1];
+        double dl = box_distance2(lo, hi, l.min, l.max);
+        double dr = box_distance2(lo, hi, r.min, r.max);
+
+        if (top + 2 > STACK_SIZE)
+        {
+            throw std::runtime_error("bvh deeper than the query stack");
+        }
+
+        if (dl < dr)
+        {
+            stack[top++] = nd.index + 1;
+            stack[top++] = nd.index;
+        }
+        else
+        {
+            stack[top++] = nd.index;
+            stack[top++] = nd.index + 1;
+        }
+    }
+
+    if (best.triangle != UINT32_MAX)
+    {
+        best.distance = std::sqrt(best2);
+    }
+
+    return best;
+}
+
+closest bvh::nearest(const obb &box, double max_dist) const
+{
+    vec3d c[8];
+
+    box.corners(c);
+    return nearest_hull(c, 8, max_dist);
+}
+
+closest bvh::nearest(const triangle &t, double max_dist) const
+{
+    return nearest_hull(t.v, 3, max_dist);
+}
+
+closest bvh::nearest(const vec3d &p, double max_dist) const
+{
+    return nearest_hull(&p, 1, max_dist);
+}
+
+bool bvh::inside(const vec3d &p) const
+{
+    /* Off every axis and unlikely to graze an edge of a printed part. */
+
+    const vec3d dir = { 0.5773, 0.5781, 0.5766 };
+    const vec3d inv = { 1 / dir.x, 1 / dir.y, 1 / dir.z };
+    uint32_t stack[STACK_SIZE];
+    int top = 0;
+    unsigned crossings = 0;
+
+    if (m_tris.empty())
+    {
+        return false;
+    }
+
+    stack[top++] = 0;
+
+    while (top > 0)
+    {
+        const node &nd = m_nodes[stack[--top]];
+
+        if (!ray_box(p, inv, nd.min, nd.max))
+        {
+            continue;
+        }
+
+        if (nd.count > 0)
+        {
+            for (uint32_t i = nd.index; i < nd.index + nd.count; i++)
+            {
+                crossings += ray_hits(p, dir, m_tris[i]);
+            }
+        }
+        else if (top + 2 <= STACK_SIZE)
+        {
+            stack[top++] = nd.index;
+            stack[top++] = nd.index + 1;
+        }
+        else
+        {
+            throw std::runtime_error("bvh deeper than the query stack");
+        }
+    }
+
+    return crossings & 1;
+}
+
+vec3d bvh::min() const
+{
+    const node &root = m_nodes[0];
+
+    return { root.min[0], root.min[1], root.min[2] };
+}
+
+vec3d bvh::max() const
+{
+    const node &root = m_nodes[0];
+
+    return { root.max[0], root.max[1], root.max[2] };
+}
+
+} /* namespace mesh */
@@ -0,0 +1,150 @@
+/****************************************************************************
+ * tools/mesh/bvh.hpp
+ * Tomatotificatorul
+ *
+ * Copyright 2021 Iulian-Razvan Matesica <iulian.matesica@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ****************************************************************************/
+
+#ifndef __TOOLS_MESH_BVH_HPP
+#define __TOOLS_MESH_BVH_HPP
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <cstdint>
+#include <vector>
+
+#include "stl.hpp"
+
+/****************************************************************************
+ * Public Types
+ ****************************************************************************/
+
+namespace mesh
+{
+
+struct vec3d
+{
+    double x, y, z;
+};
+
+struct triangle
+{
+    vec3d v[3];
+};
+
+/* An oriented box: center, half sizes along its axes, and the axes. */
+
+struct obb
+{
+    vec3d center;
+    vec3d half;
+    vec3d axis[3];
+
+    /* Axis aligned, turned by 'rz_deg' about Z. */
+
+    static obb make(vec3d center, vec3d size, double rz_deg = 0);
+    void corners(vec3d out[8]) const;
+};
+
+struct closest
+{
+    double distance;           /* 0 when the shapes touch or overlap */
+    vec3d point;               /* On the mesh */
+    uint32_t triangle;
+};
+
+/* Bounding volume hierarchy over the triangles of a mesh, split by the
+ * surface area heuristic over 16 bins per axis. Nodes are 32 bytes,
+ * children stored next to each other, leaves hold up to 4 triangles.
+ */
+
+class bvh
+{
+public:
+    explicit bvh(const stl &file);
+    explicit bvh(std::vector<triangle> tris);
+
+    size_t size() const { return m_tris.size(); }
+    size_t nodes() const { return m_nodes.size(); }
+    int depth() const { return m_depth; }
+    const triangle &tri(uint32_t i) const { return m_tris[i]; }
+
+    /* Facet of the STL that triangle 'i' came from. */
+
+    uint32_t facet(uint32_t i) const { return m_ids[i]; }
+
+    /* Closest triangle to 'box', searching no further than 'max_dist'.
+     * distance is max_dist (and triangle UINT32_MAX) if none is closer.
+     */
+
+    closest nearest(const obb &box, double max_dist) const;
+
+    /* Closest triangle to a triangle of another mesh, or to a point. */
+
+    closest nearest(const triangle &t, double max_dist) const;
+    closest nearest(const vec3d &p, double max_dist) const;
+
+    /* Whether 'p' is inside the closed surface: crossings of a ray. */
+
+    bool inside(const vec3d &p) const;
+
+    /* Bounds of the whole mesh. */
+
+    vec3d min() const;
+    vec3d max() const;
+
+private:
+    struct node
+    {
+        float min[3];
+        float max[3];
+        uint32_t index;        /* First triangle, or the left child */
+        uint32_t count;        /* Triangles, 0 for an inner node */
+    };
+
+    struct build_item;
+
+    void init();
+    void build(uint32_t self, std::vector<build_item> &items,
+               uint32_t begin, uint32_t end, int depth);
+
+    closest nearest_hull(const vec3d *p, int n, double max_dist) const;
+
+    std::vector<node> m_nodes;
+    std::vector<triangle> m_tris;
+    std::vector<uint32_t> m_ids;
+    int m_depth = 0;
+};
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/* Distance between the convex hulls of two point sets (GJK). Sets
+ * 'on_b' to the closest point of hull 'b'. 0 if they overlap.
+ */
+
+double gjk_distance(const vec3d *a, int na, const vec3d *b, int nb,
+                    vec3d *on_b);
+
+/* Point of triangle 't' closest to 'p'. */
+
+vec3d closest_point(const vec3d &p, const triangle &t);
+
+} /* namespace mesh */
+
+#endif /* __TOOLS_MESH_BVH_HPP */
@@ -0,0 +1,180 @@
+/****************************************************************************
+ * tools/mesh/check.cpp
+ * Tomatotificatorul
+ *
+ * Copyright 2021 Iulian-Razvan Matesica <iulian.matesica@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ****************************************************************************/
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include "check.hpp"
+#include "parallel.hpp"
+#include "radix.hpp"
+
+#include <algorithm>
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+/* Half-edges of collapsed triangles carry this, they are left out. */
+
+#define NO_EDGE   UINT64_MAX
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+namespace
+{
+
+bool collapsed(const uint32_t *v)
+{
+    return v[0] == v[1] || v[1] == v[2] || v[2] == v[0];
+}
+
+/* Half-edge 3 * t + k runs from corner k of triangle t to corner k + 1. */
+
+uint32_t edge_from(const mesh::indexed &m, uint32_t half)
+{
+    return m.indices[half];
+}
+
+} /* namespace */
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+namespace mesh
+{
+
+long check_report::euler() const
+{
+    return (long)vertices - (long)edges + (long)triangles;
+}
+
+check_report check_mesh(const stl &file, const indexed &mesh,
+                        unsigned threads)
+{
+    size_t halves = mesh.indices.size();
+    std::vector<uint64_t> keys(halves);
+    std::vector<uint32_t> owner(halves);
+    std::vector<uint8_t> degenerate(mesh.triangles());
+    std::vector<uint8_t> bad_normal(mesh.triangles());
+    check_report r;
+
+    r.vertices = mesh.vertices.size();
+    r.triangles = mesh.triangles();
+
+    /* Half-edges keyed on their vertices (low, high), and the facets. */
+
+    parallel_for(mesh.triangles(), threads,
+        [&](size_t begin, size_t end, unsigned)
+        {
+            for (size_t t = begin; t < end; t++)
+            {
+                const uint32_t *v = &mesh.indices[3 * t];
+                vec3 p[3], n = file.normal(t);
+                double e1[3], e2[3], c[3];
+
+                for (int k = 0; k < 3; k++)
+                {
+                    p[k] = mesh.vertices[v[k]];
+                }
+
+                e1[0] = (double)p[1].x - p[0].x;
+                e1[1] = (double)p[1].y - p[0].y;
+                e1[2] = (double)p[1].z - p[0].z;
+                e2[0] = (double)p[2].x - p[0].x;
+                e2[1] = (double)p[2].y - p[0].y;
+                e2[2] = (double)p[2].z - p[0].z;
+                c[0] = e1[1] * e2[2] - e1[2] * e2[1];
+                c[1] = e1[2] * e2[0] - e1[0] * e2[2];
+                c[2] = e1[0] * e2[1] - e1[1] * e2[0];
+
+                bool flat = c[0] == 0 && c[1] == 0 && c[2] == 0;
+
+                degenerate[t] = flat || collapsed(v);
+                bad_normal[t] = !flat &&
+                                c[0] * n.x + c[1] * n.y + c[2] * n.z < 0;
+
+                for (int k = 0; k < 3; k++)
+                {
+                    uint32_t a = v[k];
+                    uint32_t b = v[(k + 1) % 3];
+
+                    keys[3 * t + k] = collapsed(v) ? NO_EDGE :
+                        (uint64_t)std::min(a, b) << 32 | std::max(a, b);
+                    owner[3 * t + k] = (uint32_t)(3 * t + k);
+                }
+            }
+        });
+
+    radix_sort(keys, owner, threads);
+
+    /* Equal keys are the half-edges of one edge: one is a boundary, two
+     * must run opposite ways, more is non-manifold.
+     */
+
+    for (size_t i = 0; i < halves && keys[i] != NO_EDGE; )
+    {
+        size_t j = i + 1;
+
+        while (j < halves && keys[j] == keys[i])
+        {
+            j++;
+        }
+
+        edge e = { (uint32_t)(keys[i] >> 32), (uint32_t)keys[i],
+                   (uint32_t)(j - i) };
+
+        r.edges++;
+
+        if (e.faces == 1)
+        {
+            r.boundary.push_back(e);
+        }
+        else if (e.faces > 2)
+        {
+            r.non_manifold.push_back(e);
+        }
+        else if (edge_from(mesh, owner[i]) == edge_from(mesh, owner[i + 1]))
+        {
+            r.flipped.push_back(e);
+        }
+
+        i = j;
+    }
+
+    for (size_t t = 0; t < mesh.triangles(); t++)
+    {
+        if (degenerate[t])
+        {
+            r.degenerate.push_back((uint32_t)t);
+        }
+
+        if (bad_normal[t])
+        {
+            r.bad_normal.push_back((uint32_t)t);
+        }
+    }
+
+    return r;
+}
+
+} /* namespace mesh */
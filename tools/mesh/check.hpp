@@ -0,0 +1,100 @@
+/****************************************************************************
+ * tools/mesh/check.hpp
+ * Tomatotificatorul
+ *
+ * Copyright 2021 Iulian-Razvan Matesica <iulian.matesica@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ****************************************************************************/
+
+#ifndef __TOOLS_MESH_CHECK_HPP
+#define __TOOLS_MESH_CHECK_HPP
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <cstdint>
+#include <vector>
+
+#include "indexed.hpp"
+#include "stl.hpp"
+
+/****************************************************************************
+ * Public Types
+ ****************************************************************************/
+
+namespace mesh
+{
+
+/* An edge between vertices 'a' < 'b', used by 'faces' triangles. */
+
+struct edge
+{
+    uint32_t a, b;
+    uint32_t faces;
+};
+
+struct check_report
+{
+    size_t edges = 0;
+
+    /* Used by one triangle: a hole or a crack in the surface. */
+
+    std::vector<edge> boundary;
+
+    /* Used by more than two triangles. */
+
+    std::vector<edge> non_manifold;
+
+    /* Two triangles that run the edge the same way, so one of them is
+     * wound (and faces) the other way.
+     */
+
+    std::vector<edge> flipped;
+
+    /* Triangles with zero area or with corners welded together. */
+
+    std::vector<uint32_t> degenerate;
+
+    /* Triangles whose STL normal points against their winding. */
+
+    std::vector<uint32_t> bad_normal;
+
+    /* V - E + F, 2 per closed surface of genus 0. */
+
+    long euler() const;
+    bool watertight() const
+    {
+        return boundary.empty() && non_manifold.empty() && flipped.empty();
+    }
+
+    size_t vertices = 0;
+    size_t triangles = 0;
+};
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/* Checks the welded 'mesh' of 'file' with 'threads' workers (0 = all
+ * cores). The edges are sorted with radix_sort(), so the issues come out
+ * in vertex order.
+ */
+
+check_report check_mesh(const stl &file, const indexed &mesh,
+                        unsigned threads);
+
+} /* namespace mesh */
+
+#endif /* __TOOLS_MESH_CHECK_HPP */
@@ -0,0 +1,631 @@
+/****************************************************************************
+ * tools/mesh/decimate.cpp
+ * Tomatotificatorul
+ *
+ * Copyright 2021 Iulian-Razvan Matesica <iulian.matesica@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ****************************************************************************/
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include "decimate.hpp"
+#include "parallel.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <queue>
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+/* A facet may turn by up to ~78 degrees in a collapse. */
+
+#define MIN_NORMAL_DOT  0.2
+
+/* Hausdorff samples farther than this are not looked for. */
+
+#define HAUSDORFF_REACH 1e3
+
+/****************************************************************************
+ * Private Types
+ ****************************************************************************/
+
+namespace
+{
+
+using mesh::vec3d;
+
+/* Symmetric 4x4 matrix: the sum of the squared distances to a set of
+ * planes is v' Q v, v = (x, y, z, 1).
+ */
+
+struct quadric
+{
+    double q[10] = {};
+
+    static quadric plane(const vec3d &n, double d)
+    {
+        quadric r;
+
+        r.q[0] = n.x * n.x;
+        r.q[1] = n.x * n.y;
+        r.q[2] = n.x * n.z;
+        r.q[3] = n.x * d;
+        r.q[4] = n.y * n.y;
+        r.q[5] = n.y * n.z;
+        r.q[6] = n.y * d;
+        r.q[7] = n.z * n.z;
+        r.q[8] = n.z * d;
+        r.q[9] = d * d;
+        return r;
+    }
+
+    quadric &operator+=(const quadric &o)
+    {
+        for (int i = 0; i < 10; i++)
+        {
+            q[i] += o.q[i];
+        }
+
+        return *this;
+    }
+
+    double error(const vec3d &v) const
+    {
+        return v.x * (q[0] * v.x + 2 * (q[1] * v.y + q[2] * v.z + q[3])) +
+               v.y * (q[4] * v.y + 2 * (q[5] * v.z + q[6])) +
+               v.z * (q[7] * v.z + 2 * q[8]) + q[9];
+    }
+};
+
+struct candidate
+{
+    double cost;
+    vec3d target;
+    uint32_t keep, gone;
+    uint32_t keep_version, gone_version;
+
+    bool operator>(const candidate &o) const { return cost > o.cost; }
+};
+
+class decimator
+{
+public:
+    decimator(const mesh::indexed &mesh, double tolerance);
+
+    void run(mesh::decimate_report &report);
+    mesh::indexed result() const;
+
+private:
+    bool alive(const candidate &c) const;
+    void push(uint32_t a, uint32_t b);
+    bool valid(const candidate &c);
+    void collapse(const candidate &c);
+    void neighbours(uint32_t v, std::vector<uint32_t> &out) const;
+
+    double m_limit;            /* tolerance^2 */
+    std::vector<vec3d> m_pos;
+    std::vector<quadric> m_quadric;
+    std::vector<uint32_t> m_version;
+    std::vector<std::array<uint32_t, 3>> m_faces;
+    std::vector<uint8_t> m_dead_face;
+    std::vector<std::vector<uint32_t>> m_vertex_faces;
+    std::priority_queue<candidate, std::vector<candidate>,
+                        std::greater<candidate>> m_heap;
+    std::vector<uint32_t> m_ring_a, m_ring_b;
+};
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+vec3d operator+(vec3d a, vec3d b)
+{
+    return { a.x + b.x, a.y + b.y, a.z + b.z };
+}
+
+vec3d operator-(vec3d a, vec3d b)
+{
+    return { a.x - b.x, a.y - b.y, a.z - b.z };
+}
+
+vec3d operator*(vec3d a, double s)
+{
+    return { a.x * s, a.y * s, a.z * s };
+}
+
+double dot(vec3d a, vec3d b)
+{
+    return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+vec3d cross(vec3d a, vec3d b)
+{
+    return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z,
+             a.x * b.y - a.y * b.x };
+}
+
+vec3d to_double(const mesh::vec3 &v)
+{
+    return { v.x, v.y, v.z };
+}
+
+/* The point minimizing v' Q v, if Q is well conditioned. */
+
+bool optimum(const quadric &Q, vec3d &out)
+{
+    const double *q = Q.q;
+    double c00 = q[4] * q[7] - q[5] * q[5];
+    double c01 = q[2] * q[5] - q[1] * q[7];
+    double c02 = q[1] * q[5] - q[2] * q[4];
+    double det = q[0] * c00 + q[1] * c01 + q[2] * c02;
+    double scale = q[0] + q[4] + q[7];
+
+    if (std::fabs(det) <= 1e-9 * scale * scale * scale)
+    {
+        return false;
+    }
+
+    double c11 = q[0] * q[7] - q[2] * q[2];
+    double c12 = q[1] * q[2] - q[0] * q[5];
+    double c22 = q[0] * q[4] - q[1] * q[1];
+    vec3d b = { -q[3], -q[6], -q[8] };
+
+    out.x = (c00 * b.x + c01 * b.y + c02 * b.z) / det;
+    out.y = (c01 * b.x + c11 * b.y + c12 * b.z) / det;
+    out.z = (c02 * b.x + c12 * b.y + c22 * b.z) / det;
+    return true;
+}
+
+decimator::decimator(const mesh::indexed &mesh, double tolerance)
+    : m_limit(tolerance * tolerance),
+      m_quadric(mesh.vertices.size()),
+      m_version(mesh.vertices.size()),
+      m_vertex_faces(mesh.vertices.size())
+{
+    m_pos.reserve(mesh.vertices.size());
+
+    for (const mesh::vec3 &v : mesh.vertices)
+    {
+        m_pos.push_back(to_double(v));
+    }
+
+    /* Unweighted planes, so that the error is a sum of squared
+     * distances in mm^2.
+     */
+
+    for (size_t t = 0; t < mesh.triangles(); t++)
+    {
+        const uint32_t *v = &mesh.indices[3 * t];
+
+        if (v[0] == v[1] || v[1] == v[2] || v[2] == v[0])
+        {
+            continue;
+        }
+
+        vec3d n = cross(m_pos[v[1]] - m_pos[v[0]], m_pos[v[2]] - m_pos[v[0]]);
+        double len = std::sqrt(dot(n, n));
+        uint32_t f = (uint32_t)m_faces.size();
+
+        m_faces.push_back({ v[0], v[1], v[2] });
+
+        for (int k = 0; k < 3; k++)
+        {
+            m_vertex_faces[v[k]].push_back(f);
+        }
+
+        if (len > 0)
+        {
+            n = n * (1 / len);
+
+            quadric p = quadric::plane(n, -dot(n, m_pos[v[0]]));
+
+            for (int k = 0; k < 3; k++)
+            {
+                m_quadric[v[k]] += p;
+            }
+        }
+    }
+
+    m_dead_face.resize(m_faces.size());
+
+    /* Every edge once, from the facet where it runs upwards. A watertight
+     * mesh has both directions, a boundary edge may have either.
+     */
+
+    std::vector<uint64_t> edges;
+
+    edges.reserve(3 * m_faces.size());
+
+    for (const auto &f : m_faces)
+    {
+        for (int k = 0; k < 3; k++)
+        {
+            uint32_t a = f[k], b = f[(k + 1) % 3];
+
+            edges.push_back((uint64_t)std::min(a, b) << 32 |
+                            std::max(a, b));
+        }
+    }
+
+    std::sort(edges.begin(), edges.end());
+    edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+
+    for (uint64_t e : edges)
+    {
+        push((uint32_t)(e >> 32), (uint32_t)e);
+    }
+}
+
+/* Queues the collapse of edge a-b at its cheapest point: the optimum of
+ * the summed quadric, or the better end or midpoint when the quadric is
+ * flat or the optimum lies away from the edge.
+ */
+
+void decimator::push(uint32_t a, uint32_t b)
+{
+    quadric Q = m_quadric[a];
+    candidate c;
+
+    Q += m_quadric[b];
+
+    vec3d mid = (m_pos[a] + m_pos[b]) * 0.5;
+    vec3d ab = m_pos[b] - m_pos[a];
+    vec3d best;
+
+    if (optimum(Q, best) && dot(best - mid, best - mid) <= dot(ab, ab))
+    {
+        c.cost = Q.error(best);
+        c.target = best;
+    }
+    else
+    {
+        c.cost = HUGE_VAL;
+
+        for (const vec3d &p : { m_pos[a], m_pos[b], mid })
+        {
+            double e = Q.error(p);
+
+            if (e < c.cost)
+            {
+                c.cost = e;
+                c.target = p;
+            }
+        }
+    }
+
+    c.cost = std::max(c.cost, 0.0);
+
+    if (c.cost > m_limit)
+    {
+        return;
+    }
+
+    /* The vertex with more facets stays, fewer lists to move. */
+
+    if (m_vertex_faces[a].size() < m_vertex_faces[b].size())
+    {
+        std::swap(a, b);
+    }
+
+    c.keep = a;
+    c.gone = b;
+    c.keep_version = m_version[a];
+    c.gone_version = m_version[b];
+    m_heap.push(c);
+}
+
+bool decimator::alive(const candidate &c) const
+{
+    return m_version[c.keep] == c.keep_version &&
+           m_version[c.gone] == c.gone_version &&
+           !m_vertex_faces[c.gone].empty();
+}
+
+void decimator::neighbours(uint32_t v, std::vector<uint32_t> &out) const
+{
+    out.clear();
+
+    for (uint32_t f : m_vertex_faces[v])
+    {
+        for (uint32_t w : m_faces[f])
+        {
+            if (w != v)
+            {
+                out.push_back(w);
+            }
+        }
+    }
+
+    std::sort(out.begin(), out.end());
+    out.erase(std::unique(out.begin(), out.end()), out.end());
+}
+
+bool decimator::valid(const candidate &c)
+{
+    /* Link condition: the ends may only share the third corners of the
+     * facets on the edge, or the surface pinches into a non-manifold
+     * edge.
+     */
+
+    size_t shared_faces = 0, shared_vertices = 0;
+
+    for (uint32_t f : m_vertex_faces[c.keep])
+    {
+        const auto &v = m_faces[f];
+
+        shared_faces += v[0] == c.gone || v[1] == c.gone || v[2] == c.gone;
+    }
+
+    neighbours(c.keep, m_ring_a);
+    neighbours(c.gone, m_ring_b);
+
+    for (size_t i = 0, j = 0; i < m_ring_a.size() && j < m_ring_b.size(); )
+    {
+        if (m_ring_a[i] < m_ring_b[j])
+        {
+            i++;
+        }
+        else if (m_ring_a[i] > m_ring_b[j])
+        {
+            j++;
+        }
+        else
+        {
+            shared_vertices++;
+            i++;
+            j++;
+        }
+    }
+
+    if (shared_vertices != shared_faces)
+    {
+        return false;
+    }
+
+    /* No facet that stays may turn over or collapse. */
+
+    for (uint32_t v : { c.keep, c.gone })
+    {
+        for (uint32_t f : m_vertex_faces[v])
+        {
+            const auto &idx = m_faces[f];
+            vec3d p[3], q[3];
+            bool on_edge = false;
+
+            for (int k = 0; k < 3; k++)
+            {
+                p[k] = m_pos[idx[k]];
+                q[k] = idx[k] == c.keep || idx[k] == c.gone ? c.target : p[k];
+                on_edge |= idx[k] == (v == c.keep ? c.gone : c.keep);
+            }
+
+            if (on_edge)
+            {
+                continue;
+            }
+
+            vec3d n0 = cross(p[1] - p[0], p[2] - p[0]);
+            vec3d n1 = cross(q[1] - q[0], q[2] - q[0]);
+            double l0 = dot(n0, n0), l1 = dot(n1, n1);
+
+            if (l1 <= 1e-24 ||
+                (l0 > 0 && dot(n0, n1) < MIN_NORMAL_DOT * std::sqrt(l0 * l1)))
+            {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+void decimator::collapse(const candidate &c)
+{
+    std::vector<uint32_t> &keep_faces = m_vertex_faces[c.keep];
+
+    for (uint32_t f : m_vertex_faces[c.gone])
+    {
+        auto &idx = m_faces[f];
+
+        if (idx[0] == c.keep || idx[1] == c.keep || idx[2] == c.keep)
+        {
+            /* On the edge: gone, along with its place in the lists. */
+
+            m_dead_face[f] = 1;
+
+            for (uint32_t w : idx)
+            {
+                if (w != c.gone)
+                {
+                    auto &list = m_vertex_faces[w];
+
+                    list.erase(std::find(list.begin(), list.end(), f));
+                }
+            }
+        }
+        else
+        {
+            std::replace(idx.begin(), idx.end(), c.gone, c.keep);
+            keep_faces.push_back(f);
+        }
+    }
+
+    m_vertex_faces[c.gone].clear();
+    m_vertex_faces[c.gone].shrink_to_fit();
+    m_pos[c.keep] = c.target;
+    m_quadric[c.keep] += m_quadric[c.gone];
+    m_version[c.keep]++;
+    m_version[c.gone]++;
+
+    /* Every edge around the moved vertex has a new cost. */
+
+    neighbours(c.keep, m_ring_a);
+
+    std::vector<uint32_t> ring = m_ring_a;
+
+    for (uint32_t w : ring)
+    {
+        push(c.keep, w);
+    }
+}
+
+void decimator::run(mesh::decimate_report &report)
+{
+    while (!m_heap.empty())
+    {
+        candidate c = m_heap.top();
+
+        m_heap.pop();
+
+        if (!alive(c))
+        {
+            continue;
+        }
+
+        if (!valid(c))
+        {
+            report.refused++;
+            continue;
+        }
+
+        collapse(c);
+        report.collapses++;
+        report.bound = std::max(report.bound, c.cost);
+    }
+
+    report.bound = std::sqrt(report.bound);
+}
+
+mesh::indexed decimator::result() const
+{
+    std::vector<uint32_t> remap(m_pos.size(), UINT32_MAX);
+    mesh::indexed out;
+
+    for (size_t f = 0; f < m_faces.size(); f++)
+    {
+        if (m_dead_face[f])
+        {
+            continue;
+        }
+
+        for (uint32_t v : m_faces[f])
+        {
+            if (remap[v] == UINT32_MAX)
+            {
+                remap[v] = (uint32_t)out.vertices.size();
+                out.vertices.push_back({ (float)m_pos[v].x, (float)m_pos[v].y,
+                                         (float)m_pos[v].z });
+            }
+
+            out.indices.push_back(remap[v]);
+        }
+    }
+
+    return out;
+}
+
+/* Largest distance from the vertices and facet centroids of 'from' to
+ * the surface in 'to'.
+ */
+
+double one_sided(const mesh::indexed &from, const mesh::bvh &to,
+                 unsigned threads)
+{
+    size_t nv = from.vertices.size();
+    std::vector<double> worst(mesh::thread_count(threads));
+
+    mesh::parallel_for(nv + from.triangles(), threads,
+        [&](size_t begin, size_t end, unsigned worker)
+        {
+            double w = 0;
+
+            for (size_t i = begin; i < end; i++)
+            {
+                vec3d p;
+
+                if (i < nv)
+                {
+                    p = to_double(from.vertices[i]);
+                }
+                else
+                {
+                    const uint32_t *v = &from.indices[3 * (i - nv)];
+
+                    p = (to_double(from.vertices[v[0]]) +
+                         to_double(from.vertices[v[1]]) +
+                         to_double(from.vertices[v[2]])) * (1.0 / 3);
+                }
+
+                w = std::max(w, to.nearest(p, HAUSDORFF_REACH).distance);
+            }
+
+            worst[worker] = w;
+        }, 1024);
+
+    return *std::max_element(worst.begin(), worst.end());
+}
+
+} /* namespace */
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+namespace mesh
+{
+
+indexed decimate(const indexed &mesh, double tolerance,
+                 decimate_report *report)
+{
+    decimate_report r;
+    decimator d(mesh, tolerance);
+
+    d.run(r);
+
+    if (report != nullptr)
+    {
+        *report = r;
+    }
+
+    return d.result();
+}
+
+std::vector<triangle> triangles(const indexed &mesh)
+{
+    std::vector<triangle> out(mesh.triangles());
+
+    for (size_t t = 0; t < out.size(); t++)
+    {
+        for (int k = 0; k < 3; k++)
+        {
+            out[t].v[k] = to_double(mesh.vertices[mesh.indices[3 * t + k]]);
+        }
+    }
+
+    return out;
+}
+
+double hausdorff(const indexed &a, const indexed &b, unsigned threads)
+{
+    bvh ta(triangles(a)), tb(triangles(b));
+
+    return std::max(one_sided(a, tb, threads), one_sided(b, ta, threads));
+}
+
+} /* namespace mesh */
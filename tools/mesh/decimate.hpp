@@ -0,0 +1,83 @@
+/****************************************************************************
+ * tools/mesh/decimate.hpp
+ * Tomatotificatorul
+ *
+ * Copyright 2021 Iulian-Razvan Matesica <iulian.matesica@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ****************************************************************************/
+
+#ifndef __TOOLS_MESH_DECIMATE_HPP
+#define __TOOLS_MESH_DECIMATE_HPP
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <cstddef>
+#include <vector>
+
+#include "bvh.hpp"
+#include "indexed.hpp"
+
+/****************************************************************************
+ * Public Types
+ ****************************************************************************/
+
+namespace mesh
+{
+
+struct decimate_report
+{
+    size_t collapses = 0;
+
+    /* Collapses refused: they would pinch the surface (the ends of the
+     * edge share more neighbours than its two facets) or turn a facet
+     * over.
+     */
+
+    size_t refused = 0;
+
+    /* Largest distance of a moved vertex to the planes of the facets it
+     * stands for, mm.
+     */
+
+    double bound = 0;
+};
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/* Collapses edges, cheapest first by the quadric error metric (Garland
+ * and Heckbert), while the new vertex stays within 'tolerance' mm of the
+ * planes of all the original facets merged into it. Facets whose corners
+ * were welded together are dropped.
+ */
+
+indexed decimate(const indexed &mesh, double tolerance,
+                 decimate_report *report);
+
+/* The triangles of 'mesh', for a bvh. */
+
+std::vector<triangle> triangles(const indexed &mesh);
+
+/* Two-sided Hausdorff distance, sampled at the vertices and the facet
+ * centroids of each mesh against the surface of the other one.
+ */
+
+double hausdorff(const indexed &a, const indexed &b, unsigned threads);
+
+} /* namespace mesh */
+
+#endif /* __TOOLS_MESH_DECIMATE_HPP */
@@ -0,0 +1,241 @@
+/****************************************************************************
+ * tools/mesh/diff.cpp
+ * Tomatotificatorul
+ *
+ * Copyright 2021 Iulian-Razvan Matesica <iulian.matesica@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ****************************************************************************/
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include "diff.hpp"
+#include "parallel.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+/* Vertices per worker chunk: most are a few node visits from a facet
+ * they lie on.
+ */
+
+#define VERTEX_GRAIN   1024
+
+/* Materialise facet color: 5 bits each of red, green and blue from bit
+ * 0; bit 15 set leaves the facet the file color.
+ */
+
+#define COLOR_DEFAULT  0x8000
+#define COLOR(r, g, b) ((uint16_t)((r) | (g) << 5 | (b) << 10))
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+namespace
+{
+
+using mesh::vec3d;
+
+vec3d sub(vec3d a, vec3d b)
+{
+    return { a.x - b.x, a.y - b.y, a.z - b.z };
+}
+
+vec3d cross(vec3d a, vec3d b)
+{
+    return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z,
+             a.x * b.y - a.y * b.x };
+}
+
+double dot(vec3d a, vec3d b)
+{
+    return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+uint32_t root(std::vector<uint32_t> &parent, uint32_t v)
+{
+    while (parent[v] != v)
+    {
+        parent[v] = parent[parent[v]];
+        v = parent[v];
+    }
+
+    return v;
+}
+
+} /* namespace */
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+namespace mesh
+{
+
+std::vector<float> deviation(const indexed &from, const bvh &to,
+                             double reach, unsigned threads)
+{
+    std::vector<float> dev(from.vertices.size());
+
+    parallel_for(dev.size(), threads,
+        [&](size_t begin, size_t end, unsigned)
+        {
+            for (size_t i = begin; i < end; i++)
+            {
+                const vec3 &v = from.vertices[i];
+                vec3d p = { v.x, v.y, v.z };
+                closest c = to.nearest(p, reach);
+
+                if (c.triangle == UINT32_MAX || c.distance == 0)
+                {
+                    dev[i] = (float)c.distance;
+                    continue;
+                }
+
+                const triangle &t = to.tri(c.triangle);
+                vec3d n = cross(sub(t.v[1], t.v[0]), sub(t.v[2], t.v[0]));
+
+                dev[i] = (float)(dot(sub(p, c.point), n) < 0 ?
+                                 -c.distance : c.distance);
+            }
+        }, VERTEX_GRAIN);
+
+    return dev;
+}
+
+std::vector<cluster> clusters(const indexed &mesh,
+                              const std::vector<float> &dev,
+                              double threshold)
+{
+    size_t nv = mesh.vertices.size();
+    std::vector<uint32_t> parent(nv);
+
+    for (size_t v = 0; v < nv; v++)
+    {
+        parent[v] = (uint32_t)v;
+    }
+
+    for (size_t t = 0; t < mesh.triangles(); t++)
+    {
+        const uint32_t *v = &mesh.indices[3 * t];
+
+        for (int k = 0; k < 3; k++)
+        {
+            uint32_t a = v[k], b = v[(k + 1) % 3];
+
+            if (std::fabs(dev[a]) > threshold &&
+                std::fabs(dev[b]) > threshold)
+            {
+                parent[root(parent, a)] = root(parent, b);
+            }
+        }
+    }
+
+    /* One cluster per root, in the order of their first vertex. */
+
+    std::vector<uint32_t> index(nv, UINT32_MAX);
+    std::vector<cluster> out;
+
+    for (size_t v = 0; v < nv; v++)
+    {
+        double d = std::fabs(dev[v]);
+
+        if (!(d > threshold))
+        {
+            continue;
+        }
+
+        uint32_t r = root(parent, (uint32_t)v);
+        const vec3 &p = mesh.vertices[v];
+
+        if (index[r] == UINT32_MAX)
+        {
+            index[r] = (uint32_t)out.size();
+            out.push_back({ 0, 0, 0, 0, p, p, p });
+        }
+
+        cluster &c = out[index[r]];
+
+        c.vertices++;
+        c.mean += d;
+        c.outward += dev[v];
+        c.lo = { std::min(c.lo.x, p.x), std::min(c.lo.y, p.y),
+                 std::min(c.lo.z, p.z) };
+        c.hi = { std::max(c.hi.x, p.x), std::max(c.hi.y, p.y),
+                 std::max(c.hi.z, p.z) };
+
+        if (d > c.max)
+        {
+            c.max = d;
+            c.at = p;
+        }
+    }
+
+    for (cluster &c : out)
+    {
+        c.mean /= c.vertices;
+        c.outward /= c.vertices;
+    }
+
+    std::stable_sort(out.begin(), out.end(),
+                     [](const cluster &a, const cluster &b)
+                     {
+                         return a.max > b.max;
+                     });
+    return out;
+}
+
+std::vector<uint16_t> heat_map(const indexed &mesh,
+                               const std::vector<float> &dev,
+                               double threshold, double scale)
+{
+    std::vector<uint16_t> colors(mesh.triangles());
+
+    for (size_t t = 0; t < mesh.triangles(); t++)
+    {
+        const uint32_t *v = &mesh.indices[3 * t];
+        float d = dev[v[0]];
+
+        for (int k = 1; k < 3; k++)
+        {
+            if (std::fabs(dev[v[k]]) > std::fabs(d))
+            {
+                d = dev[v[k]];
+            }
+        }
+
+        if (!(std::fabs(d) > threshold))
+        {
+            colors[t] = COLOR_DEFAULT;
+            continue;
+        }
+
+        /* Green fades out towards 'scale'. */
+
+        double f = scale > 0 ? std::min(1.0, std::fabs(d) / scale) : 1;
+        int fade = (int)std::lround(31 * (1 - f));
+
+        colors[t] = d > 0 ? COLOR(31, fade, 0) : COLOR(0, fade, 31);
+    }
+
+    return colors;
+}
+
+} /* namespace mesh */
@@ -0,0 +1,84 @@
+/****************************************************************************
+ * tools/mesh/diff.hpp
+ * Tomatotificatorul
+ *
+ * Copyright 2021 Iulian-Razvan Matesica <iulian.matesica@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ****************************************************************************/
+
+#ifndef __TOOLS_MESH_DIFF_HPP
+#define __TOOLS_MESH_DIFF_HPP
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "bvh.hpp"
+#include "indexed.hpp"
+
+/****************************************************************************
+ * Public Types
+ ****************************************************************************/
+
+namespace mesh
+{
+
+/* Vertices next to each other that moved by more than the threshold. */
+
+struct cluster
+{
+    size_t vertices;
+    double max;                /* Largest deviation, mm */
+    double mean;               /* Of the deviations, mm */
+    double outward;            /* Mean signed deviation, > 0 if grown */
+    vec3 at;                   /* Vertex of the largest deviation */
+    vec3 lo, hi;               /* Bounds */
+};
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/* Signed distance of each vertex of 'from' to the surface in 'to', with
+ * 'threads' workers (0 = all cores): positive outside, by the facing of
+ * the closest triangle. Distances are cut at 'reach' mm.
+ */
+
+std::vector<float> deviation(const indexed &from, const bvh &to,
+                             double reach, unsigned threads);
+
+/* Groups the vertices of 'mesh' deviating by more than 'threshold' mm
+ * into clusters joined by the mesh edges, largest deviation first.
+ */
+
+std::vector<cluster> clusters(const indexed &mesh,
+                              const std::vector<float> &dev,
+                              double threshold);
+
+/* Materialise facet colors for 'dev': facets with no corner past
+ * 'threshold' keep the file color, the others go from yellow to red as
+ * they grow and from cyan to blue as they shrink, full at 'scale' mm.
+ */
+
+std::vector<uint16_t> heat_map(const indexed &mesh,
+                               const std::vector<float> &dev,
+                               double threshold, double scale);
+
+} /* namespace mesh */
+
+#endif /* __TOOLS_MESH_DIFF_HPP */
@@ -0,0 +1,93 @@
+/****************************************************************************
+ * tools/mesh/indexed.hpp
+ * Tomatotificatorul
+ *
+ * Copyright 2021 Iulian-Razvan Matesica <iulian.matesica@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ****************************************************************************/
+
+#ifndef __TOOLS_MESH_INDEXED_HPP
+#define __TOOLS_MESH_INDEXED_HPP
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "stl.hpp"
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+/* Default weld grid, mm. Coordinates within one cell become one vertex. */
+
+#define WELD_TOLERANCE   0.001f
+
+/****************************************************************************
+ * Public Types
+ ****************************************************************************/
+
+namespace mesh
+{
+
+/* A triangle mesh with shared vertices: triangle t uses the vertices
+ * indices[3 * t .. 3 * t + 2], in the order of the STL.
+ */
+
+struct indexed
+{
+    std::vector<vec3> vertices;
+    std::vector<uint32_t> indices;
+
+    size_t triangles() const { return indices.size() / 3; }
+    size_t bytes() const
+    {
+        return vertices.size() * sizeof(vec3) +
+               indices.size() * sizeof(uint32_t);
+    }
+};
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/* Welds the corners of 'file' that fall in the same 'tolerance' grid
+ * cell, with 'threads' workers (0 = all cores). Vertices are numbered in
+ * the order of their first corner and keep its exact coordinates, so the
+ * result does not depend on the worker count. Throws std::runtime_error
+ * if the mesh does not fit the grid (2^21 cells per axis).
+ */
+
+indexed weld(const stl &file, float tolerance, unsigned threads);
+
+/* Writes a binary little endian PLY. Throws std::runtime_error. */
+
+void save_ply(const indexed &mesh, const std::string &path);
+
+/* Writes a binary STL, normals from the winding, 'header' cut to 80
+ * bytes and the facet attributes from 'attrs' if given, else 0. Throws
+ * std::runtime_error.
+ */
+
+void save_stl(const indexed &mesh, const std::string &path,
+              const std::string &header,
+              const std::vector<uint16_t> *attrs = nullptr);
+
+} /* namespace mesh */
+
+#endif /* __TOOLS_MESH_INDEXED_HPP */
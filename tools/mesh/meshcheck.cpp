@@ -0,0 +1,220 @@
+/****************************************************************************
+ * tools/mesh/meshcheck.cpp
+ * Tomatotificatorul
+ *
+ * Copyright 2021 Iulian-Razvan Matesica <iulian.matesica@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ****************************************************************************/
+
+/* Checks that the enclosure meshes are printable: welds each file, then
+ * reports boundary edges (holes), non-manifold edges, neighbours wound
+ * the other way, degenerate facets and normals against the winding, with
+ * their coordinates. Exits with 1 if any file is not watertight;
+ * degenerate facets are reported only, slicers drop them:
+ *
+ *   meshcheck 3d_objects
+ *   meshcheck -n 100 broken.stl        list up to 100 issues per kind
+ */
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include "check.hpp"
+#include "indexed.hpp"
+#include "parallel.hpp"
+#include "cli.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/****************************************************************************
+ * Private Types
+ ****************************************************************************/
+
+struct options
+{
+    std::vector<std::string> paths;
+    float tolerance = WELD_TOLERANCE;
+    unsigned threads = 0;
+    size_t max_listed = 10;
+};
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+static void usage(void)
+{
+    fprintf(stderr,
+        "usage: meshcheck [options] FILE.stl|DIR ...\n"
+        "  -t MM    weld tolerance (default %g)\n"
+        "  -j N     worker threads (default all cores)\n"
+        "  -n N     issues listed per kind (default 10)\n",
+        WELD_TOLERANCE);
+    exit(2);
+}
+
+static options parse_args(int argc, char **argv)
+{
+    options opt;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool has_val = i + 1 < argc;
+
+        if (arg == "-t" && has_val)
+        {
+            char *end;
+
+            opt.tolerance = strtof(argv[++i], &end);
+
+            if (*end != '\0' || !(opt.tolerance > 0))
+            {
+                throw std::runtime_error("bad tolerance " +
+                                         std::string(argv[i]));
+            }
+        }
+        else if (arg == "-j" && has_val)
+        {
+            opt.threads = cli::parse_int(argv[++i], 1, 256);
+        }
+        else if (arg == "-n" && has_val)
+        {
+            opt.max_listed = cli::parse_int(argv[++i], 0, 1000000);
+        }
+        else if (arg[0] != '-')
+        {
+            opt.paths.push_back(arg);
+        }
+        else
+        {
+            usage();
+        }
+    }
+
+    if (opt.paths.empty())
+    {
+        usage();
+    }
+
+    return opt;
+}
+
+static void print_edges(const char *what, const std::vector<mesh::edge> &v,
+                        const mesh::indexed &m, size_t max_listed)
+{
+    printf("  %-20s %zu\n", what, v.size());
+
+    for (size_t i = 0; i < v.size() && i < max_listed; i++)
+    {
+        const mesh::vec3 &a = m.vertices[v[i].a];
+        const mesh::vec3 &b = m.vertices[v[i].b];
+
+        printf("    (%.3f, %.3f, %.3f) - (%.3f, %.3f, %.3f), %u faces\n",
+               a.x, a.y, a.z, b.x, b.y, b.z, v[i].faces);
+    }
+}
+
+static void print_facets(const char *what, const std::vector<uint32_t> &v,
+                         const mesh::indexed &m, size_t max_listed)
+{
+    printf("  %-20s %zu\n", what, v.size());
+
+    for (size_t i = 0; i < v.size() && i < max_listed; i++)
+    {
+        const uint32_t *idx = &m.indices[3 * v[i]];
+
+        printf("    #%u", v[i]);
+
+        for (int k = 0; k < 3; k++)
+        {
+            const mesh::vec3 &p = m.vertices[idx[k]];
+
+            printf(" (%.3f, %.3f, %.3f)", p.x, p.y, p.z);
+        }
+
+        printf("\n");
+    }
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+int main(int argc, char **argv)
+{
+    int ret = 0;
+
+    try
+    {
+        options opt = parse_args(argc, argv);
+
+        for (const std::string &path : mesh::stl_files(opt.paths))
+        {
+            try
+            {
+                mesh::stl file(path);
+                auto start = std::chrono::steady_clock::now();
+                mesh::indexed m = mesh::weld(file, opt.tolerance,
+                                             opt.threads);
+                double weld_ms = cli::elapsed_ms(start);
+
+                start = std::chrono::steady_clock::now();
+
+                mesh::check_report r = mesh::check_mesh(file, m,
+                                                        opt.threads);
+                double check_ms = cli::elapsed_ms(start);
+
+                printf("%s: %zu triangles, %zu vertices, %zu edges: %s\n",
+                       path.c_str(), r.triangles, r.vertices, r.edges,
+                       r.watertight() ? "watertight" : "NOT watertight");
+                print_edges("boundary edges", r.boundary, m, opt.max_listed);
+                print_edges("non-manifold edges", r.non_manifold, m,
+                            opt.max_listed);
+                print_edges("flipped neighbours", r.flipped, m,
+                            opt.max_listed);
+                print_facets("degenerate facets", r.degenerate, m,
+                             opt.max_listed);
+                print_facets("normals vs winding", r.bad_normal, m,
+                             opt.max_listed);
+                printf("  %-20s %ld\n", "V - E + F", r.euler());
+                printf("  %-20s weld %.2f ms, check %.2f ms\n", "time",
+                       weld_ms, check_ms);
+
+                if (!r.watertight())
+                {
+                    ret = 1;
+                }
+            }
+            catch (const std::exception &e)
+            {
+                fprintf(stderr, "meshcheck: %s\n", e.what());
+                ret = 1;
+            }
+        }
+    }
+    catch (const std::exception &e)
+    {
+        fprintf(stderr, "meshcheck: %s\n", e.what());
+        return 1;
+    }
+
+    return ret;
+}
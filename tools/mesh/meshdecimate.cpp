@@ -0,0 +1,200 @@
+/****************************************************************************
+ * tools/mesh/meshdecimate.cpp
+ * Tomatotificatorul
+ *
+ * Copyright 2021 Iulian-Razvan Matesica <iulian.matesica@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ****************************************************************************/
+
+/* Decimates the enclosure meshes within a tolerance, for slicing and
+ * viewing, and reports how far the result is from the original:
+ *
+ *   meshdecimate 3d_objects
+ *   meshdecimate -t 0.02 -o build/lowpoly 3d_objects/box.stl
+ */
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include "decimate.hpp"
+#include "indexed.hpp"
+#include "parallel.hpp"
+#include "cli.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+/* Well under the 0.1-0.2 mm a nozzle lays down. */
+
+#define DECIMATE_TOLERANCE   0.05
+
+/****************************************************************************
+ * Private Types
+ ****************************************************************************/
+
+struct options
+{
+    std::vector<std::string> paths;
+    std::string out_dir;
+    double tolerance = DECIMATE_TOLERANCE;
+    float weld = WELD_TOLERANCE;
+    unsigned threads = 0;
+};
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+static void usage(void)
+{
+    fprintf(stderr,
+        "usage: meshdecimate [options] FILE.stl|DIR ...\n"
+        "  -t MM    tolerance (default %g)\n"
+        "  -w MM    weld tolerance (default %g)\n"
+        "  -j N     worker threads for the error (default all cores)\n"
+        "  -o DIR   write DIR/<name>.stl\n",
+        DECIMATE_TOLERANCE, WELD_TOLERANCE);
+    exit(2);
+}
+
+static double parse_mm(const char *s)
+{
+    char *end;
+    double val = strtod(s, &end);
+
+    if (*s == '\0' || *end != '\0' || !(val > 0))
+    {
+        throw std::runtime_error(std::string("bad tolerance ") + s);
+    }
+
+    return val;
+}
+
+static options parse_args(int argc, char **argv)
+{
+    options opt;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool has_val = i + 1 < argc;
+
+        if (arg == "-t" && has_val)
+        {
+            opt.tolerance = parse_mm(argv[++i]);
+        }
+        else if (arg == "-w" && has_val)
+        {
+            opt.weld = parse_mm(argv[++i]);
+        }
+        else if (arg == "-j" && has_val)
+        {
+            opt.threads = cli::parse_int(argv[++i], 1, 256);
+        }
+        else if (arg == "-o" && has_val)
+        {
+            opt.out_dir = argv[++i];
+        }
+        else if (arg[0] != '-')
+        {
+            opt.paths.push_back(arg);
+        }
+        else
+        {
+            usage();
+        }
+    }
+
+    if (opt.paths.empty())
+    {
+        usage();
+    }
+
+    return opt;
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+int main(int argc, char **argv)
+{
+    int ret = 0;
+
+    try
+    {
+        options opt = parse_args(argc, argv);
+
+        printf("%-20s %9s %9s %6s %8s %9s %9s %9s\n", "file", "triangles",
+               "decimated", "left", "bound", "hausdorff", "ms", "error ms");
+
+        for (const std::string &path : mesh::stl_files(opt.paths))
+        {
+            try
+            {
+                namespace fs = std::filesystem;
+                mesh::stl file(path);
+                mesh::indexed m = mesh::weld(file, opt.weld, opt.threads);
+                mesh::decimate_report r;
+                auto start = std::chrono::steady_clock::now();
+                mesh::indexed d = mesh::decimate(m, opt.tolerance, &r);
+                double ms = cli::elapsed_ms(start);
+
+                start = std::chrono::steady_clock::now();
+
+                double error = mesh::hausdorff(m, d, opt.threads);
+                double error_ms = cli::elapsed_ms(start);
+
+                printf("%-20s %9zu %9zu %5.1f%% %8.4f %9.4f %9.2f %9.2f\n",
+                       fs::path(path).filename().c_str(), file.size(),
+                       d.triangles(), file.size() ? 100.0 * d.triangles() /
+                       file.size() : 0.0, r.bound, error, ms, error_ms);
+
+                if (!opt.out_dir.empty())
+                {
+                    fs::create_directories(opt.out_dir);
+                    mesh::save_stl(d, (fs::path(opt.out_dir) /
+                        fs::path(path).filename()).string(),
+                        "decimated " + fs::path(path).filename().string());
+                }
+            }
+            catch (const std::exception &e)
+            {
+                fprintf(stderr, "meshdecimate: %s\n", e.what());
+                ret = 1;
+            }
+        }
+
+        printf("tolerance %g mm, bound: distance to the merged planes, "
+               "hausdorff: vertices and centroids, both ways\n",
+               opt.tolerance);
+    }
+    catch (const std::exception &e)
+    {
+        fprintf(stderr, "meshdecimate: %s\n", e.what());
+        return 1;
+    }
+
+    return ret;
+}
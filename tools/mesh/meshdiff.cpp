@@ -0,0 +1,286 @@
+/****************************************************************************
+ * tools/mesh/meshdiff.cpp
+ * Tomatotificatorul
+ *
+ * Copyright 2021 Iulian-Razvan Matesica <iulian.matesica@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ****************************************************************************/
+
+/* Shows what moved between two revisions of a mesh:
+ *
+ *   git show HEAD~1:3d_objects/box.stl > /tmp/old.stl
+ *   meshdiff /tmp/old.stl 3d_objects/box.stl
+ *   meshdiff -o build/box_diff.stl /tmp/old.stl 3d_objects/box.stl
+ *
+ * Every vertex of each revision is measured against the surface of the
+ * other one, so both what was added and what was taken away show up.
+ * Exits 1 if anything moved by more than the threshold, like diff.
+ */
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include "bvh.hpp"
+#include "diff.hpp"
+#include "indexed.hpp"
+#include "parallel.hpp"
+#include "stl.hpp"
+#include "cli.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+/* Ten times what the weld and a re-export leave behind. */
+
+#define DIFF_THRESHOLD   0.01
+
+/* Vertices further than this from the other revision count as this far:
+ * nothing on the box is bigger that can move without being redrawn.
+ */
+
+#define DIFF_REACH       20.0
+
+/* Default color of the heat map, RGBA: light grey. */
+
+#define HEAT_DEFAULT     "\xc0\xc0\xc0\xff"
+
+/****************************************************************************
+ * Private Types
+ ****************************************************************************/
+
+struct options
+{
+    std::string old_path;
+    std::string new_path;
+    std::string out_path;
+    double threshold = DIFF_THRESHOLD;
+    double reach = DIFF_REACH;
+    double scale = 0;          /* 0 = largest deviation */
+    size_t list = 10;
+    unsigned threads = 0;
+};
+
+struct side
+{
+    const char *name;
+    std::vector<float> dev;
+    std::vector<mesh::cluster> clusters;
+};
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+static void usage(void)
+{
+    fprintf(stderr,
+        "usage: meshdiff [options] OLD.stl NEW.stl\n"
+        "  -t MM       smallest move reported (default %g)\n"
+        "  -r MM       farthest distance measured (default %g)\n"
+        "  -n N        clusters listed (default 10, 0 = all)\n"
+        "  -j N        worker threads (default all cores)\n"
+        "  -o FILE     write NEW colored by how far it moved\n"
+        "  --scale MM  full color at this move (default the largest)\n",
+        DIFF_THRESHOLD, DIFF_REACH);
+    exit(2);
+}
+
+static options parse_args(int argc, char **argv)
+{
+    options opt;
+    std::vector<std::string> paths;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool has_val = i + 1 < argc;
+
+        if (arg == "-t" && has_val)
+        {
+            opt.threshold = cli::parse_num(argv[++i], 0, 100);
+        }
+        else if (arg == "-r" && has_val)
+        {
+            opt.reach = cli::parse_num(argv[++i], 0.001, 1e4);
+        }
+        else if (arg == "-n" && has_val)
+        {
+            opt.list = cli::parse_num(argv[++i], 0, 1e6);
+        }
+        else if (arg == "-j" && has_val)
+        {
+            opt.threads = cli::parse_num(argv[++i], 1, 256);
+        }
+        else if (arg == "-o" && has_val)
+        {
+            opt.out_path = argv[++i];
+        }
+        else if (arg == "--scale" && has_val)
+        {
+            opt.scale = cli::parse_num(argv[++i], 0.001, 1e4);
+        }
+        else if (arg[0] != '-')
+        {
+            paths.push_back(arg);
+        }
+        else
+        {
+            usage();
+        }
+    }
+
+    if (paths.size() != 2)
+    {
+        usage();
+    }
+
+    opt.old_path = paths[0];
+    opt.new_path = paths[1];
+    return opt;
+}
+
+static void print_side(const side &s, const options &opt)
+{
+    size_t moved = 0;
+    double worst = 0, sum = 0;
+
+    for (float d : s.dev)
+    {
+        if (std::fabs(d) > opt.threshold)
+        {
+            moved++;
+            sum += std::fabs(d);
+        }
+
+        worst = std::max(worst, (double)std::fabs(d));
+    }
+
+    printf("%s: %zu of %zu vertices moved, max %.4f mm, mean %.4f mm, "
+           "%zu clusters\n", s.name, moved, s.dev.size(), worst,
+           moved ? sum / moved : 0.0, s.clusters.size());
+
+    size_t n = opt.list ? std::min(opt.list, s.clusters.size())
+                        : s.clusters.size();
+
+    if (n == 0)
+    {
+        return;
+    }
+
+    printf("  %8s %8s %8s %8s  %-23s  %s\n", "vertices", "max", "mean",
+           "outward", "at", "bounds");
+
+    for (size_t i = 0; i < n; i++)
+    {
+        const mesh::cluster &c = s.clusters[i];
+
+        printf("  %8zu %8.4f %8.4f %+8.4f  %7.2f %7.2f %7.2f  "
+               "%.2f %.2f %.2f .. %.2f %.2f %.2f\n", c.vertices, c.max,
+               c.mean, c.outward, c.at.x, c.at.y, c.at.z, c.lo.x, c.lo.y,
+               c.lo.z, c.hi.x, c.hi.y, c.hi.z);
+    }
+
+    if (n < s.clusters.size())
+    {
+        printf("  ... %zu more\n", s.clusters.size() - n);
+    }
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+int main(int argc, char **argv)
+{
+    try
+    {
+        options opt = parse_args(argc, argv);
+        mesh::stl old_file(opt.old_path), new_file(opt.new_path);
+        auto start = std::chrono::steady_clock::now();
+        mesh::indexed a = mesh::weld(old_file, WELD_TOLERANCE, opt.threads);
+        mesh::indexed b = mesh::weld(new_file, WELD_TOLERANCE, opt.threads);
+        double weld_ms = cli::elapsed_ms(start);
+
+        start = std::chrono::steady_clock::now();
+
+        mesh::bvh ta(old_file), tb(new_file);
+        double bvh_ms = cli::elapsed_ms(start);
+
+        /* Grown: vertices of the new revision off the old surface, gone:
+         * the other way around.
+         */
+
+        side grown = { "new vs old", {}, {} };
+        side gone = { "old vs new", {}, {} };
+
+        start = std::chrono::steady_clock::now();
+        grown.dev = mesh::deviation(b, ta, opt.reach, opt.threads);
+        gone.dev = mesh::deviation(a, tb, opt.reach, opt.threads);
+
+        double dev_ms = cli::elapsed_ms(start);
+
+        start = std::chrono::steady_clock::now();
+        grown.clusters = mesh::clusters(b, grown.dev, opt.threshold);
+        gone.clusters = mesh::clusters(a, gone.dev, opt.threshold);
+
+        double cluster_ms = cli::elapsed_ms(start);
+
+        print_side(grown, opt);
+        print_side(gone, opt);
+
+        if (!opt.out_path.empty())
+        {
+            double scale = opt.scale;
+
+            if (scale == 0)
+            {
+                for (float d : grown.dev)
+                {
+                    scale = std::max(scale, (double)std::fabs(d));
+                }
+            }
+
+            std::vector<uint16_t> colors =
+                mesh::heat_map(b, grown.dev, opt.threshold, scale);
+
+            mesh::save_stl(b, opt.out_path,
+                           std::string("meshdiff COLOR=") + HEAT_DEFAULT,
+                           &colors);
+            printf("%s: grown yellow to red, shrunk cyan to blue, full at "
+                   "%.4f mm\n", opt.out_path.c_str(), scale);
+        }
+
+        printf("%u threads, weld %.2f ms, bvh %.2f ms, distances %.2f ms, "
+               "clusters %.2f ms\n", mesh::thread_count(opt.threads),
+               weld_ms, bvh_ms, dev_ms, cluster_ms);
+
+        return grown.clusters.empty() && gone.clusters.empty() ? 0 : 1;
+    }
+    catch (const std::exception &e)
+    {
+        fprintf(stderr, "meshdiff: %s\n", e.what());
+        return 2;
+    }
+}
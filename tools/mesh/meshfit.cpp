@@ -0,0 +1,650 @@
+/****************************************************************************
+ * tools/mesh/meshfit.cpp
+ * Tomatotificatorul
+ *
+ * Copyright 2021 Iulian-Razvan Matesica <iulian.matesica@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ****************************************************************************/
+
+/* Checks that the parts fit in the box: each part is a box dropped into
+ * the cavity until it rests on the floor, at the given place or at the
+ * best one of a grid (turned 0 or 90 degrees), and must keep the
+ * clearance from the walls and from the closed lid. Also checks that the
+ * lid sits on the box without going through it:
+ *
+ *   meshfit                            the battery, 97 x 43 x 52 mm
+ *   meshfit --part pump:40x40x95 --part battery:97x43x52@0,20
+ *   meshfit --sweep                    largest part that still fits
+ *
+ * The box and the lid are in their assembled position in the STLs.
+ */
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include "bvh.hpp"
+#include "cli.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+/* Lid triangles farther from the box than this are not part of the mating
+ * surface.
+ */
+
+#define MATE_RANGE      2.0
+
+/* Lid corners this deep in the box walls interfere. */
+
+#define MATE_DEPTH      0.01
+
+/* The drop ends this close to the floor, with a probe this thick, or
+ * after so many steps: next to a wall it crawls down by the gap.
+ */
+
+#define DROP_EPSILON    0.001
+#define DROP_STEPS      100
+#define SLAB            0.1
+
+/* Clearances are measured with the part shrunk by this on every side, so
+ * they read down to -SHRINK when the part goes into a wall. Parts rest on
+ * the floor: the bottom FLOOR_SKIP mm are left out of the wall
+ * clearance, which reads at most FLOOR_SKIP.
+ */
+
+#define SHRINK          2.0
+#define FLOOR_SKIP      5.0
+
+/* The smallest placement search step, and the rounding of the fit. */
+
+#define REFINE_STEP     0.005
+#define FIT_TOLERANCE   0.005
+
+/****************************************************************************
+ * Private Types
+ ****************************************************************************/
+
+struct part
+{
+    std::string name;
+    mesh::vec3d size;
+    bool placed = false;       /* At x, y, rz, else searched */
+    bool raised = false;       /* Bottom at z, else dropped */
+    double x = 0, y = 0, rz = 0, z = 0;
+};
+
+struct options
+{
+    std::string box = "3d_objects/box.stl";
+    std::string lid = "3d_objects/box_lid.stl";
+    std::vector<part> parts;
+    double clearance = 0;
+    double step = 2.0;
+    bool sweep = false;
+};
+
+struct placement
+{
+    bool inside = false;       /* Rests on something inside the box */
+    bool fits = false;
+    double x = 0, y = 0, z = 0, rz = 0;     /* z of the bottom */
+    double wall = 0;           /* Clearance above the floor */
+    double lid = 0;
+};
+
+struct world
+{
+    const mesh::bvh &box;
+    const mesh::bvh &lid;
+    double clearance;
+    unsigned long queries;
+};
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+static void usage(void)
+{
+    fprintf(stderr,
+        "usage: meshfit [options]\n"
+        "  --box FILE   box mesh (default 3d_objects/box.stl)\n"
+        "  --lid FILE   lid mesh (default 3d_objects/box_lid.stl)\n"
+        "  --part NAME:LxWxH[@X,Y[,RZ[,Z]]]\n"
+        "               a part, placed at X, Y turned RZ degrees and\n"
+        "               dropped or at height Z, else searched (default\n"
+        "               battery:97x43x52)\n"
+        "  -c MM        clearance needed (default 0)\n"
+        "  -s MM        placement search step (default 2)\n"
+        "  --sweep      largest length, width and height that fit\n"
+        "               at the place of the part\n");
+    exit(2);
+}
+
+static double parse_mm(const char *s, double min)
+{
+    char *end;
+    double val = strtod(s, &end);
+
+    if (*s == '\0' || *end != '\0' || !(val >= min))
+    {
+        throw std::runtime_error(std::string("bad value ") + s);
+    }
+
+    return val;
+}
+
+static part parse_part(const std::string &spec)
+{
+    part p;
+    size_t colon = spec.find(':');
+    double v[7];
+    int n;
+    char x1, x2;
+
+    if (colon == std::string::npos || colon == 0)
+    {
+        throw std::runtime_error("bad part " + spec);
+    }
+
+    p.name = spec.substr(0, colon);
+
+    std::string rest = spec.substr(colon + 1);
+
+    if (sscanf(rest.c_str(), "%lf%c%lf%c%lf%n", &v[0], &x1, &v[1], &x2,
+               &v[2], &n) != 5 || x1 != 'x' || x2 != 'x' ||
+        !(v[0] > 0 && v[1] > 0 && v[2] > 0))
+    {
+        throw std::runtime_error("bad part size " + spec);
+    }
+
+    p.size = { v[0], v[1], v[2] };
+    rest = rest.substr(n);
+
+    if (!rest.empty())
+    {
+        int fields = sscanf(rest.c_str(), "@%lf,%lf%n,%lf%n,%lf%n", &v[3],
+                            &v[4], &n, &v[5], &n, &v[6], &n);
+
+        if (fields < 2 || (size_t)n != rest.size())
+        {
+            throw std::runtime_error("bad part place " + spec);
+        }
+
+        p.placed = true;
+        p.x = v[3];
+        p.y = v[4];
+        p.rz = fields >= 3 ? v[5] : 0;
+        p.raised = fields == 4;
+        p.z = fields == 4 ? v[6] : 0;
+    }
+
+    return p;
+}
+
+static options parse_args(int argc, char **argv)
+{
+    options opt;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool has_val = i + 1 < argc;
+
+        if (arg == "--box" && has_val)
+        {
+            opt.box = argv[++i];
+        }
+        else if (arg == "--lid" && has_val)
+        {
+            opt.lid = argv[++i];
+        }
+        else if (arg == "--part" && has_val)
+        {
+            opt.parts.push_back(parse_part(argv[++i]));
+        }
+        else if (arg == "-c" && has_val)
+        {
+            opt.clearance = parse_mm(argv[++i], 0);
+        }
+        else if (arg == "-s" && has_val)
+        {
+            opt.step = parse_mm(argv[++i], 0.1);
+        }
+        else if (arg == "--sweep")
+        {
+            opt.sweep = true;
+        }
+        else
+        {
+            usage();
+        }
+    }
+
+    /* The README battery without its terminals, which make it 58 mm
+     * high: check them as parts on top of it, e.g.
+     * --part terminal:6x4x6@39,38.5,0,52.
+     */
+
+    if (opt.parts.empty())
+    {
+        opt.parts.push_back(parse_part("battery:97x43x52"));
+    }
+
+    return opt;
+}
+
+/* The part shrunk by 'shrink' on every side and its bottom raised by
+ * 'skip', so that the distance less 'shrink' is the clearance, or how
+ * far in it goes up to 'shrink'.
+ */
+
+static mesh::obb part_box(const mesh::vec3d &size, const placement &p,
+                          double skip, double shrink)
+{
+    mesh::vec3d in = { size.x - 2 * shrink, size.y - 2 * shrink,
+                       size.z - skip - 2 * shrink };
+
+    return mesh::obb::make({ p.x, p.y, p.z + skip + shrink + in.z / 2 },
+                           in, p.rz);
+}
+
+static double shrink_for(const mesh::vec3d &size)
+{
+    return std::min(SHRINK, 0.45 * std::min({ size.x, size.y, size.z }));
+}
+
+/* Clearance from the walls, less the bottom 'skip' mm on the floor, and
+ * from the lid.
+ */
+
+static void measure(world &w, const mesh::vec3d &size, double skip,
+                    placement &p)
+{
+    double m = shrink_for(size);
+    double reach = w.box.max().z - w.box.min().z;
+
+    p.wall = w.box.nearest(part_box(size, p, skip, m), reach).distance - m;
+    p.lid = w.lid.nearest(part_box(size, p, 0, m), reach).distance - m;
+    p.fits = std::min(p.wall, p.lid) >= w.clearance - FIT_TOLERANCE;
+    w.queries += 2;
+}
+
+/* Lowers the part from above the box onto whatever is under it. The
+ * probe is a thin slab of the bottom, 1 mm in from the sides so that
+ * walls right next to it do not hold it up; each step moves it by its
+ * distance to the box, which cannot go through anything. Not inside if
+ * it fell past the box, wedged if it takes too many steps.
+ */
+
+static placement drop(world &w, const mesh::vec3d &size, double x, double y,
+                      double rz)
+{
+    mesh::vec3d lo = w.box.min(), hi = w.box.max();
+    mesh::vec3d slab = { std::max(size.x - 2, 0.1),
+                         std::max(size.y - 2, 0.1), SLAB };
+    placement p;
+
+    p.x = x;
+    p.y = y;
+    p.rz = rz;
+    p.z = hi.z + 1;
+
+    for (int i = 0; i < DROP_STEPS && p.z > lo.z; i++)
+    {
+        mesh::obb probe = mesh::obb::make({ x, y, p.z + slab.z / 2 }, slab,
+                                          rz);
+        mesh::closest c = w.box.nearest(probe, hi.z - lo.z);
+
+        w.queries++;
+
+        if (c.distance < DROP_EPSILON || i == DROP_STEPS - 1)
+        {
+            p.inside = true;
+            measure(w, size, std::min(FLOOR_SKIP, size.z / 4), p);
+            break;
+        }
+
+        p.z -= c.distance;
+    }
+
+    return p;
+}
+
+static double score(const placement &p)
+{
+    return p.inside ? std::min(p.wall, p.lid) : -HUGE_VAL;
+}
+
+/* Moves the part around 'p' in shrinking steps while the clearance grows,
+ * to the fitting place with the most clearance, else the least bad one.
+ */
+
+static placement refine(world &w, const mesh::vec3d &size, placement p,
+                        double step)
+{
+    static const int dirs[4][2] = { { 1, 0 }, { -1, 0 }, { 0, 1 },
+                                    { 0, -1 } };
+
+    for (double d = step / 2; d >= REFINE_STEP; d /= 2)
+    {
+        bool moved = true;
+
+        while (moved)
+        {
+            moved = false;
+
+            for (const int *dir : dirs)
+            {
+                placement q = drop(w, size, p.x + dir[0] * d,
+                                   p.y + dir[1] * d, p.rz);
+
+                if (score(q) > score(p))
+                {
+                    p = q;
+                    moved = true;
+                }
+            }
+        }
+    }
+
+    return p;
+}
+
+/* How far the part moves along 'dx', 'dy' and keeps clearance 'keep'. */
+
+static double play(world &w, const mesh::vec3d &size, const placement &p,
+                   double dx, double dy, double keep, double step)
+{
+    double ok = 0, bad = step;
+
+    while (bad < 2 * (w.box.max().x - w.box.min().x) &&
+           score(drop(w, size, p.x + dx * bad, p.y + dy * bad, p.rz)) >=
+           keep)
+    {
+        ok = bad;
+        bad *= 2;
+    }
+
+    while (bad - ok > REFINE_STEP)
+    {
+        double mid = (ok + bad) / 2;
+
+        (score(drop(w, size, p.x + dx * mid, p.y + dy * mid, p.rz)) >= keep ?
+            ok : bad) = mid;
+    }
+
+    return ok;
+}
+
+/* Centers the part between whatever limits its clearance along X and Y,
+ * so that the room left is the same on both sides.
+ */
+
+static placement center(world &w, const mesh::vec3d &size, placement p,
+                        double step)
+{
+    double keep = score(p) - FIT_TOLERANCE;
+
+    for (int axis = 0; axis < 2; axis++)
+    {
+        double dx = axis == 0, dy = axis == 1;
+        double shift = (play(w, size, p, dx, dy, keep, step) -
+                        play(w, size, p, -dx, -dy, keep, step)) / 2;
+
+        p = drop(w, size, p.x + dx * shift, p.y + dy * shift, p.rz);
+    }
+
+    return p;
+}
+
+static placement search(world &w, const mesh::vec3d &size, double step)
+{
+    mesh::vec3d lo = w.box.min(), hi = w.box.max();
+    placement best;
+
+    for (double rz : { 0.0, 90.0 })
+    {
+        for (double y = lo.y; y <= hi.y; y += step)
+        {
+            for (double x = lo.x; x <= hi.x; x += step)
+            {
+                placement p = drop(w, size, x, y, rz);
+
+                if (score(p) > score(best))
+                {
+                    best = p;
+                }
+            }
+        }
+    }
+
+    return best.inside ? center(w, size, refine(w, size, best, step), step) :
+                         best;
+}
+
+static placement place(world &w, const part &pt, const mesh::vec3d &size,
+                       double step)
+{
+    if (pt.raised)
+    {
+        placement p;
+
+        p.inside = true;
+        p.x = pt.x;
+        p.y = pt.y;
+        p.z = pt.z;
+        p.rz = pt.rz;
+        measure(w, size, 0, p);
+        return p;
+    }
+
+    return pt.placed ? drop(w, size, pt.x, pt.y, pt.rz) :
+                       search(w, size, step);
+}
+
+static void print_placement(const char *name, const mesh::vec3d &size,
+                            const placement &p)
+{
+    printf("%-10s %5.1f x %5.1f x %5.1f  ", name, size.x, size.y, size.z);
+
+    if (!p.inside)
+    {
+        printf("does not rest inside the box\n");
+        return;
+    }
+
+    printf("at (%.2f, %.2f, %.2f) rz %3.0f  walls %5.2f  lid %5.2f  %s\n",
+           p.x, p.y, p.z, p.rz, p.wall, p.lid, p.fits ? "fits" : "NO FIT");
+}
+
+/* Largest size along 'axis' that still fits at the place of the part,
+ * to 'resolution'.
+ */
+
+static double sweep_axis(world &w, const part &pt, const placement &at,
+                         int axis, double resolution)
+{
+    mesh::vec3d size = pt.size;
+    double *dim[3] = { &size.x, &size.y, &size.z };
+    double ok = 0, bad = *dim[axis];
+    part fixed = pt;
+
+    fixed.placed = true;
+    fixed.x = at.x;
+    fixed.y = at.y;
+    fixed.rz = at.rz;
+
+    auto fits = [&]()
+    {
+        return place(w, fixed, size, 0).fits;
+    };
+
+    if (!at.fits)
+    {
+        return 0;
+    }
+
+    /* Grow until it no longer fits, then bisect. */
+
+    while (fits())
+    {
+        ok = bad;
+        bad += 16;
+        *dim[axis] = bad;
+    }
+
+    while (bad - ok > resolution)
+    {
+        *dim[axis] = (ok + bad) / 2;
+        (fits() ? ok : bad) = *dim[axis];
+    }
+
+    return ok;
+}
+
+/* The lid triangles near the box: the smallest gap, how many touch it,
+ * and how many lid corners are inside the box walls, deeper than the
+ * printer resolution.
+ */
+
+static bool check_lid(const mesh::bvh &box, const mesh::bvh &lid)
+{
+    size_t near = 0, touching = 0, inside = 0;
+    double gap = MATE_RANGE;
+    auto start = std::chrono::steady_clock::now();
+
+    for (uint32_t i = 0; i < lid.size(); i++)
+    {
+        const mesh::triangle &t = lid.tri(i);
+        mesh::closest c = box.nearest(t, MATE_RANGE);
+
+        if (c.triangle == UINT32_MAX)
+        {
+            continue;
+        }
+
+        near++;
+        gap = std::min(gap, c.distance);
+
+        if (c.distance > 0)
+        {
+            continue;
+        }
+
+        touching++;
+
+        for (const mesh::vec3d &v : t.v)
+        {
+            mesh::triangle point = { { v, v, v } };
+
+            inside += box.inside(v) &&
+                      box.nearest(point, MATE_DEPTH).distance >= MATE_DEPTH;
+        }
+    }
+
+    double ms = cli::elapsed_ms(start);
+
+    printf("lid: %zu triangles within %.0f mm of the box, gap %.3f mm, "
+           "%zu touching, %zu corners inside the walls: %s\n", near,
+           MATE_RANGE, gap, touching, inside,
+           near == 0 ? "NOT ON THE BOX" : inside ? "INTERFERES" : "ok");
+    printf("lid: %.2f ms, %.2f us per triangle\n", ms,
+           lid.size() ? 1e3 * ms / lid.size() : 0.0);
+    return near > 0 && inside == 0;
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+int main(int argc, char **argv)
+{
+    int ret = 0;
+
+    try
+    {
+        options opt = parse_args(argc, argv);
+        mesh::stl box_file(opt.box), lid_file(opt.lid);
+        auto start = std::chrono::steady_clock::now();
+        mesh::bvh box(box_file), lid(lid_file);
+
+        printf("bvh: %zu + %zu triangles, %zu + %zu nodes, depth %d + %d, "
+               "%.2f ms\n", box.size(), lid.size(), box.nodes(),
+               lid.nodes(), box.depth(), lid.depth(), cli::elapsed_ms(start));
+
+        if (!check_lid(box, lid))
+        {
+            ret = 1;
+        }
+
+        world w = { box, lid, opt.clearance, 0 };
+
+        for (const part &pt : opt.parts)
+        {
+            start = std::chrono::steady_clock::now();
+            w.queries = 0;
+
+            placement p = place(w, pt, pt.size, opt.step);
+            double ms = cli::elapsed_ms(start);
+
+            print_placement(pt.name.c_str(), pt.size, p);
+            printf("%-10s %lu queries, %.2f ms, %.2f us per query\n", "",
+                   w.queries, ms, w.queries ? 1e3 * ms / w.queries : 0.0);
+
+            if (!p.fits)
+            {
+                ret = 1;
+            }
+
+            if (opt.sweep)
+            {
+                static const char *names[3] = { "length", "width", "height" };
+
+                for (int a = 0; a < 3; a++)
+                {
+                    start = std::chrono::steady_clock::now();
+                    w.queries = 0;
+
+                    double max = sweep_axis(w, pt, p, a, 0.25);
+
+                    printf("%-10s max %-6s %6.1f mm, %lu queries, %.2f ms\n",
+                           "", names[a], max, w.queries,
+                           cli::elapsed_ms(start));
+                }
+            }
+        }
+
+        printf("clearance %.2f mm, search step %.1f mm\n", opt.clearance,
+               opt.step);
+    }
+    catch (const std::exception &e)
+    {
+        fprintf(stderr, "meshfit: %s\n", e.what());
+        return 1;
+    }
+
+    return ret;
+}
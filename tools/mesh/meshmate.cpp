@@ -0,0 +1,593 @@
+/****************************************************************************
+ * tools/mesh/meshmate.cpp
+ * Tomatotificatorul
+ *
+ * Copyright 2021 Iulian-Razvan Matesica <iulian.matesica@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ****************************************************************************/
+
+/* Checks how the lid closes on the box all along the rim, where water
+ * gets in when it does not:
+ *
+ *   meshmate
+ *   meshmate -r 0.05 --tolerance 0.15 --bin 1
+ *
+ * Both parts get a signed distance field where they come close, in
+ * sparse bricks (sdf.hpp). The surface of each part near the rim is
+ * sampled every voxel and looked up in the field of the other one; the
+ * smallest gap across the rim, per stretch of its length, is the path
+ * water has to take there. Stretches where the parts go into each other
+ * or leave a gap wider than the print tolerance are listed, and make the
+ * tool exit 1. The parts are in their assembled position in the STLs.
+ */
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include "bvh.hpp"
+#include "parallel.hpp"
+#include "sdf.hpp"
+#include "stl.hpp"
+#include "cli.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+/* What a 0.4 mm nozzle holds; wider gaps let water through. */
+
+#define PRINT_TOLERANCE   0.2
+
+/* Below this, in grid spacings, the parts only touch: trilinear lookups
+ * cut convex edges of the field by up to a quarter of the grid.
+ */
+
+#define INTERFERENCE      0.5
+
+/****************************************************************************
+ * Private Types
+ ****************************************************************************/
+
+struct options
+{
+    std::string box = "3d_objects/box.stl";
+    std::string lid = "3d_objects/box_lid.stl";
+    double voxel = 0.1;
+    double band = 0.5;
+    double tolerance = PRINT_TOLERANCE;
+    double interference = -1;
+    double bin = 2;
+    double rim = 2;
+    size_t max_mb = 256;
+    unsigned threads = 0;
+};
+
+/* The outline of the box seen from above, walked counter-clockwise from
+ * its front left corner.
+ */
+
+struct outline
+{
+    double x0, y0, x1, y1;
+
+    double length() const { return 2 * (x1 - x0 + y1 - y0); }
+
+    /* How far 'p' is inside the outline, < 0 outside. */
+
+    double inset(double x, double y) const
+    {
+        return std::min({ x - x0, x1 - x, y - y0, y1 - y });
+    }
+
+    /* Distance along the outline to where the ray from its center
+     * through 'p' leaves it. Unlike the nearest point, this walks round
+     * corners: a rounded rim near one still lands in the corner stretch.
+     */
+
+    double along(double x, double y) const
+    {
+        double w = x1 - x0, h = y1 - y0;
+        double dx = x - (x0 + x1) / 2, dy = y - (y0 + y1) / 2;
+        double s = std::max(std::fabs(dx) / (w / 2), std::fabs(dy) / (h / 2));
+
+        if (s == 0)
+        {
+            return 0;
+        }
+
+        x = (x0 + x1) / 2 + dx / s;
+        y = (y0 + y1) / 2 + dy / s;
+
+        if (std::fabs(dx) / w < std::fabs(dy) / h)
+        {
+            return dy < 0 ? x - x0 : w + h + (x1 - x);
+        }
+
+        return dx > 0 ? w + (y - y0) : 2 * w + h + (y1 - y);
+    }
+
+    /* Side and point at distance 's' along the outline. */
+
+    const char *at(double s, double &x, double &y) const
+    {
+        double w = x1 - x0, h = y1 - y0;
+
+        if (s < w)
+        {
+            x = x0 + s, y = y0;
+            return "front";
+        }
+
+        if (s < w + h)
+        {
+            x = x1, y = y0 + s - w;
+            return "right";
+        }
+
+        if (s < 2 * w + h)
+        {
+            x = x1 - (s - w - h), y = y1;
+            return "back";
+        }
+
+        x = x0, y = y1 - (s - 2 * w - h);
+        return "left";
+    }
+};
+
+/* Smallest gap across the rim along one stretch of it. */
+
+struct stretch
+{
+    double gap = HUGE_VAL;
+    size_t samples = 0;
+};
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+static void usage(void)
+{
+    fprintf(stderr,
+        "usage: meshmate [options]\n"
+        "  --box FILE         box mesh (default 3d_objects/box.stl)\n"
+        "  --lid FILE         lid mesh (default 3d_objects/box_lid.stl)\n"
+        "  -r MM              grid spacing (default 0.1)\n"
+        "  --band MM          field kept this far from the parts "
+        "(default 0.5)\n"
+        "  --tolerance MM     widest gap that still seals (default %g)\n"
+        "  --interference MM  deepest overlap taken as touching "
+        "(default %g grid)\n"
+        "  --bin MM           stretch of the rim per line (default 2)\n"
+        "  --rim MM           width of the rim inside the outline "
+        "(default 2)\n"
+        "  --max-mb N         memory for the fields (default 256)\n"
+        "  -j N               worker threads (default all cores)\n",
+        PRINT_TOLERANCE, INTERFERENCE);
+    exit(2);
+}
+
+static options parse_args(int argc, char **argv)
+{
+    options opt;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool has_val = i + 1 < argc;
+
+        if (arg == "--box" && has_val)
+        {
+            opt.box = argv[++i];
+        }
+        else if (arg == "--lid" && has_val)
+        {
+            opt.lid = argv[++i];
+        }
+        else if (arg == "-r" && has_val)
+        {
+            opt.voxel = cli::parse_num(argv[++i], 0.005, 5);
+        }
+        else if (arg == "--band" && has_val)
+        {
+            opt.band = cli::parse_num(argv[++i], 0.01, 20);
+        }
+        else if (arg == "--tolerance" && has_val)
+        {
+            opt.tolerance = cli::parse_num(argv[++i], 0, 10);
+        }
+        else if (arg == "--interference" && has_val)
+        {
+            opt.interference = cli::parse_num(argv[++i], 0, 10);
+        }
+        else if (arg == "--bin" && has_val)
+        {
+            opt.bin = cli::parse_num(argv[++i], 0.1, 100);
+        }
+        else if (arg == "--rim" && has_val)
+        {
+            opt.rim = cli::parse_num(argv[++i], 0, 100);
+        }
+        else if (arg == "--max-mb" && has_val)
+        {
+            opt.max_mb = cli::parse_num(argv[++i], 1, 1 << 20);
+        }
+        else if (arg == "-j" && has_val)
+        {
+            opt.threads = cli::parse_num(argv[++i], 1, 256);
+        }
+        else
+        {
+            usage();
+        }
+    }
+
+    if (opt.band < opt.tolerance || opt.band < 2 * opt.voxel)
+    {
+        throw std::runtime_error("the band must cover the tolerance and "
+                                 "two voxels");
+    }
+
+    if (opt.interference < 0)
+    {
+        opt.interference = INTERFERENCE * opt.voxel;
+    }
+
+    return opt;
+}
+
+static std::vector<mesh::triangle> triangles(const mesh::stl &file)
+{
+    std::vector<mesh::triangle> tris(file.size());
+
+    for (size_t i = 0; i < file.size(); i++)
+    {
+        for (int k = 0; k < 3; k++)
+        {
+            mesh::vec3 v = file.vertex(i, k);
+
+            tris[i].v[k] = { v.x, v.y, v.z };
+        }
+    }
+
+    return tris;
+}
+
+/* Samples the triangles of one part every voxel near the rim, looks
+ * them up in the field of the other one and keeps the smallest gap per
+ * stretch. Each worker fills its own stretches, merged after.
+ */
+
+static void sample(const std::vector<mesh::triangle> &tris,
+                   const mesh::sdf &other, const mesh::vec3d &lo,
+                   const mesh::vec3d &hi, const outline &rim,
+                   const options &opt, std::vector<stretch> &out,
+                   size_t &count)
+{
+    unsigned workers = mesh::thread_count(opt.threads);
+    std::vector<std::vector<stretch>> part(workers,
+                                           std::vector<stretch>(out.size()));
+    std::vector<size_t> counts(workers);
+
+    mesh::parallel_for(tris.size(), opt.threads,
+        [&](size_t begin, size_t end, unsigned worker)
+        {
+            std::vector<stretch> &mine = part[worker];
+
+            for (size_t i = begin; i < end; i++)
+            {
+                const mesh::triangle &t = tris[i];
+                double edge = 0;
+                bool apart = false;
+
+                for (int a = 0; a < 3; a++)
+                {
+                    double mn = std::min({ (&t.v[0].x)[a], (&t.v[1].x)[a],
+                                           (&t.v[2].x)[a] });
+                    double mx = std::max({ (&t.v[0].x)[a], (&t.v[1].x)[a],
+                                           (&t.v[2].x)[a] });
+
+                    apart |= mx < (&lo.x)[a] || mn > (&hi.x)[a];
+                }
+
+                if (apart)
+                {
+                    continue;
+                }
+
+                /* A grid along the longest edge and across it, so that
+                 * long thin facets get no more samples than their area.
+                 */
+
+                int k0 = 0;
+
+                for (int k = 0; k < 3; k++)
+                {
+                    const mesh::vec3d &a = t.v[k], &b = t.v[(k + 1) % 3];
+                    double len = std::hypot(b.x - a.x, b.y - a.y, b.z - a.z);
+
+                    if (len > edge)
+                    {
+                        edge = len;
+                        k0 = k;
+                    }
+                }
+
+                const mesh::vec3d &o = t.v[k0];
+                mesh::vec3d e1 = { t.v[(k0 + 1) % 3].x - o.x,
+                                   t.v[(k0 + 1) % 3].y - o.y,
+                                   t.v[(k0 + 1) % 3].z - o.z };
+                mesh::vec3d e2 = { t.v[(k0 + 2) % 3].x - o.x,
+                                   t.v[(k0 + 2) % 3].y - o.y,
+                                   t.v[(k0 + 2) % 3].z - o.z };
+                double area2 = std::hypot(e1.y * e2.z - e1.z * e2.y,
+                                          e1.z * e2.x - e1.x * e2.z,
+                                          e1.x * e2.y - e1.y * e2.x);
+                int n1 = std::max(1, (int)std::ceil(edge / opt.voxel));
+                int n2 = edge > 0 ? std::max(1, (int)std::ceil(
+                             area2 / edge / opt.voxel)) : 1;
+
+                for (int u = 0; u <= n1; u++)
+                {
+                    for (int v = 0; v <= n2; v++)
+                    {
+                        double s = (double)u / n1, r = (double)v / n2;
+
+                        if (s + r > 1 + 1e-9)
+                        {
+                            break;
+                        }
+
+                        mesh::vec3d p = { o.x + s * e1.x + r * e2.x,
+                                          o.y + s * e1.y + r * e2.y,
+                                          o.z + s * e1.z + r * e2.z };
+
+                        if (p.z < lo.z || p.z > hi.z ||
+                            rim.inset(p.x, p.y) > opt.rim)
+                        {
+                            continue;
+                        }
+
+                        double gap = other.at(p);
+
+                        if (std::isnan(gap))
+                        {
+                            continue;
+                        }
+
+                        size_t bin = std::min(out.size() - 1,
+                            (size_t)(rim.along(p.x, p.y) / opt.bin));
+
+                        mine[bin].gap = std::min(mine[bin].gap, gap);
+                        mine[bin].samples++;
+                        counts[worker]++;
+                    }
+                }
+            }
+        }, 256);
+
+    for (unsigned w = 0; w < workers; w++)
+    {
+        for (size_t b = 0; b < out.size(); b++)
+        {
+            out[b].gap = std::min(out[b].gap, part[w][b].gap);
+            out[b].samples += part[w][b].samples;
+        }
+
+        count += counts[w];
+    }
+}
+
+static const char *verdict(const stretch &s, const options &opt)
+{
+    if (s.gap < -opt.interference)
+    {
+        return "INTERFERES";
+    }
+
+    return s.samples == 0 || s.gap > opt.tolerance ? "OPEN" : nullptr;
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+int main(int argc, char **argv)
+{
+    try
+    {
+        options opt = parse_args(argc, argv);
+        mesh::stl box_file(opt.box), lid_file(opt.lid);
+        std::vector<mesh::triangle> box = triangles(box_file);
+        std::vector<mesh::triangle> lid = triangles(lid_file);
+        mesh::stats ls = mesh::compute_stats(lid_file, opt.threads);
+
+        /* The outline of the box as high up as the lid comes down: below
+         * it the box may stick out further.
+         */
+
+        outline rim = { HUGE_VAL, HUGE_VAL, -HUGE_VAL, -HUGE_VAL };
+
+        for (const mesh::triangle &t : box)
+        {
+            for (const mesh::vec3d &v : t.v)
+            {
+                if (v.z >= ls.min.z)
+                {
+                    rim.x0 = std::min(rim.x0, v.x);
+                    rim.y0 = std::min(rim.y0, v.y);
+                    rim.x1 = std::max(rim.x1, v.x);
+                    rim.y1 = std::max(rim.y1, v.y);
+                }
+            }
+        }
+
+        if (rim.x0 > rim.x1)
+        {
+            throw std::runtime_error("the lid is below the box");
+        }
+
+        /* A brick is kept twice, as a float per grid point. */
+
+        size_t brick_bytes = 2 * sizeof(float) * SDF_BRICK * SDF_BRICK *
+                             SDF_BRICK;
+        auto start = std::chrono::steady_clock::now();
+        mesh::bricks grid = mesh::meeting_bricks(box, lid, opt.voxel,
+            opt.band, (opt.max_mb << 20) / brick_bytes);
+        double grid_ms = cli::elapsed_ms(start);
+
+        if (grid.size() == 0)
+        {
+            printf("the lid does not come within %.2f mm of the box\n",
+                   opt.band);
+            return 1;
+        }
+
+        start = std::chrono::steady_clock::now();
+
+        mesh::sdf box_field(grid, box, opt.band, opt.threads);
+        double box_ms = cli::elapsed_ms(start);
+
+        start = std::chrono::steady_clock::now();
+
+        mesh::sdf lid_field(grid, lid, opt.band, opt.threads);
+        double lid_ms = cli::elapsed_ms(start);
+
+        /* Where the bricks are, to skip facets far from them. */
+
+        double side = opt.voxel * SDF_BRICK;
+        mesh::vec3d lo = { HUGE_VAL, HUGE_VAL, HUGE_VAL };
+        mesh::vec3d hi = { -HUGE_VAL, -HUGE_VAL, -HUGE_VAL };
+
+        for (uint32_t b = 0; b < grid.size(); b++)
+        {
+            const int32_t *c = grid.coord(b);
+
+            for (int a = 0; a < 3; a++)
+            {
+                (&lo.x)[a] = std::min((&lo.x)[a], c[a] * side);
+                (&hi.x)[a] = std::max((&hi.x)[a], (c[a] + 1) * side);
+            }
+        }
+
+        std::vector<stretch> stretches(
+            std::max(1.0, std::ceil(rim.length() / opt.bin)));
+        size_t samples = 0;
+
+        start = std::chrono::steady_clock::now();
+        sample(lid, box_field, lo, hi, rim, opt, stretches, samples);
+        sample(box, lid_field, lo, hi, rim, opt, stretches, samples);
+
+        double sample_ms = cli::elapsed_ms(start);
+
+        printf("fields: %zu bricks of %d^3, %.1f MB, %.2f mm grid, "
+               "%.2f mm band, %d + %d rounds\n", grid.size(), SDF_BRICK,
+               (box_field.bytes() + lid_field.bytes()) / 1048576.0,
+               opt.voxel, opt.band, box_field.rounds(), lid_field.rounds());
+        printf("time: bricks %.1f ms, box %.1f ms, lid %.1f ms, "
+               "%zu samples %.1f ms, %u threads\n", grid_ms, box_ms, lid_ms,
+               samples, sample_ms, mesh::thread_count(opt.threads));
+
+        /* Smallest gap per stretch, by class. */
+
+        size_t classes[5] = {};
+        double widest = 0;
+
+        for (const stretch &s : stretches)
+        {
+            int c = s.samples == 0 ? 4 : s.gap < -opt.interference ? 0 :
+                    s.gap <= opt.interference ? 1 :
+                    s.gap <= opt.tolerance ? 2 : 3;
+
+            classes[c]++;
+
+            if (s.samples > 0 && s.gap < opt.band)
+            {
+                widest = std::max(widest, s.gap);
+            }
+        }
+
+        printf("rim: %.1f mm in %zu stretches of %.1f mm: %zu interfere, "
+               "%zu touch, %zu within %.2f mm, %zu wider, %zu without "
+               "the lid; widest %.3f mm\n", rim.length(), stretches.size(),
+               opt.bin, classes[0], classes[1], classes[2], opt.tolerance,
+               classes[3], classes[4], widest);
+
+        /* Runs of stretches with the same problem. */
+
+        int ret = 0;
+
+        for (size_t b = 0; b < stretches.size(); )
+        {
+            const char *what = verdict(stretches[b], opt);
+            size_t e = b + 1;
+
+            if (what == nullptr)
+            {
+                b++;
+                continue;
+            }
+
+            double worst = stretches[b].gap;
+
+            while (e < stretches.size() &&
+                   verdict(stretches[e], opt) == what)
+            {
+                worst = what[0] == 'I' ? std::min(worst, stretches[e].gap)
+                                       : std::max(worst, stretches[e].gap);
+                e++;
+            }
+
+            double x, y, s = (b + e) * opt.bin / 2;
+            const char *where = rim.at(s, x, y);
+
+            if (worst >= opt.band)
+            {
+                printf("  %-10s %6.1f .. %6.1f mm, %-5s at %7.2f %7.2f: "
+                       "gap over %.2f mm\n", what, b * opt.bin,
+                       std::min(e * opt.bin, rim.length()), where, x, y,
+                       opt.band);
+            }
+            else
+            {
+                printf("  %-10s %6.1f .. %6.1f mm, %-5s at %7.2f %7.2f: "
+                       "gap %+.3f mm\n", what, b * opt.bin,
+                       std::min(e * opt.bin, rim.length()), where, x, y,
+                       worst);
+            }
+
+            ret = 1;
+            b = e;
+        }
+
+        printf("lid: %s\n", ret ? "LEAKS OR BINDS" : "seals");
+        return ret;
+    }
+    catch (const std::exception &e)
+    {
+        fprintf(stderr, "meshmate: %s\n", e.what());
+        return 1;
+    }
+}
@@ -0,0 +1,267 @@
+/****************************************************************************
+ * tools/mesh/meshpack.cpp
+ * Tomatotificatorul
+ *
+ * Copyright 2021 Iulian-Razvan Matesica <iulian.matesica@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ****************************************************************************/
+
+/* Packs the enclosure meshes into quantized meshes (qmesh.hpp), checks
+ * that they read back within the tolerance and compares their size and
+ * load time with the STLs:
+ *
+ *   meshpack 3d_objects
+ *   meshpack -b 21 -o build/packed 3d_objects/box.stl
+ *   meshpack -d build/packed/box.qmesh box.stl
+ */
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include "indexed.hpp"
+#include "qmesh.hpp"
+#include "stl.hpp"
+#include "cli.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/****************************************************************************
+ * Private Types
+ ****************************************************************************/
+
+struct options
+{
+    std::vector<std::string> paths;
+    std::string out_dir;
+    std::string decode;
+    int bits = QMESH_MIN_BITS;
+    bool attrs = true;
+    unsigned threads = 0;
+};
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+static void usage(void)
+{
+    fprintf(stderr,
+        "usage: meshpack [options] FILE.stl|DIR ...\n"
+        "       meshpack -d FILE.qmesh OUT.stl\n"
+        "  -b BITS      coordinate bits, %d..%d (default %d)\n"
+        "  -j N         worker threads for welding (default all cores)\n"
+        "  -o DIR       keep DIR/<name>.qmesh\n"
+        "  --no-attrs   leave out the facet colors\n"
+        "  -d FILE      write FILE back as a binary STL\n",
+        QMESH_MIN_BITS, QMESH_MAX_BITS, QMESH_MIN_BITS);
+    exit(2);
+}
+
+static options parse_args(int argc, char **argv)
+{
+    options opt;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool has_val = i + 1 < argc;
+
+        if (arg == "-b" && has_val)
+        {
+            opt.bits = cli::parse_int(argv[++i], QMESH_MIN_BITS,
+                                      QMESH_MAX_BITS);
+        }
+        else if (arg == "-j" && has_val)
+        {
+            opt.threads = cli::parse_int(argv[++i], 1, 256);
+        }
+        else if (arg == "-o" && has_val)
+        {
+            opt.out_dir = argv[++i];
+        }
+        else if (arg == "-d" && has_val)
+        {
+            opt.decode = argv[++i];
+        }
+        else if (arg == "--no-attrs")
+        {
+            opt.attrs = false;
+        }
+        else if (arg[0] != '-')
+        {
+            opt.paths.push_back(arg);
+        }
+        else
+        {
+            usage();
+        }
+    }
+
+    if (opt.paths.empty() || (!opt.decode.empty() && opt.paths.size() != 1))
+    {
+        usage();
+    }
+
+    return opt;
+}
+
+/* Largest distance, per axis, of a corner of 'file' from where 'q' puts
+ * it. Throws if the facets or their colors do not match.
+ */
+
+static double max_error(const mesh::stl &file, const mesh::qmesh &q,
+                        bool attrs)
+{
+    if (q.mesh.triangles() != file.size() ||
+        (attrs && q.attrs.size() != file.size()))
+    {
+        throw std::runtime_error(file.path() + ": facets lost");
+    }
+
+    double error = 0;
+
+    for (size_t t = 0; t < file.size(); t++)
+    {
+        if (attrs && q.attrs[t] != file.attr(t))
+        {
+            throw std::runtime_error(file.path() + ": colors differ");
+        }
+
+        for (int k = 0; k < 3; k++)
+        {
+            mesh::vec3 a = file.vertex(t, k);
+            const mesh::vec3 &b = q.mesh.vertices[q.mesh.indices[3 * t + k]];
+
+            error = std::max({ error, std::fabs((double)a.x - b.x),
+                               std::fabs((double)a.y - b.y),
+                               std::fabs((double)a.z - b.z) });
+        }
+    }
+
+    return error;
+}
+
+static void unpack(const options &opt)
+{
+    mesh::qmesh q = mesh::load_qmesh(opt.decode);
+
+    mesh::save_stl(q.mesh, opt.paths[0], q.header,
+                   q.attrs.empty() ? nullptr : &q.attrs);
+    printf("%s: %zu triangles, %zu vertices, within %.4f mm\n",
+           opt.paths[0].c_str(), q.mesh.triangles(), q.mesh.vertices.size(),
+           q.tolerance());
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+int main(int argc, char **argv)
+{
+    int ret = 0;
+
+    try
+    {
+        options opt = parse_args(argc, argv);
+
+        if (!opt.decode.empty())
+        {
+            unpack(opt);
+            return 0;
+        }
+
+        printf("%-20s %9s %8s %8s %6s %8s %8s %8s %8s %8s\n", "file",
+               "triangles", "stl kB", "qmesh kB", "ratio", "pack ms",
+               "load ms", "stl ms", "error", "bound");
+
+        for (const std::string &path : mesh::stl_files(opt.paths))
+        {
+            try
+            {
+                namespace fs = std::filesystem;
+                fs::path dir = opt.out_dir.empty() ?
+                    fs::temp_directory_path() : fs::path(opt.out_dir);
+                std::string out = (dir / fs::path(path).stem()).string() +
+                                  ".qmesh";
+
+                /* Reading the STL into an indexed mesh is what loading
+                 * the packed file replaces.
+                 */
+
+                auto start = std::chrono::steady_clock::now();
+                mesh::stl file(path);
+                mesh::indexed m = mesh::weld(file, WELD_TOLERANCE,
+                                             opt.threads);
+                double stl_ms = cli::elapsed_ms(start);
+
+                fs::create_directories(dir);
+                start = std::chrono::steady_clock::now();
+                mesh::save_qmesh(file, m, opt.bits, opt.attrs, out);
+
+                double pack_ms = cli::elapsed_ms(start);
+
+                start = std::chrono::steady_clock::now();
+
+                mesh::qmesh q = mesh::load_qmesh(out);
+                double load_ms = cli::elapsed_ms(start);
+                double error = max_error(file, q, opt.attrs);
+                double bound = q.tolerance() + WELD_TOLERANCE + 1e-5;
+                double stl_size = fs::file_size(path);
+                double size = fs::file_size(out);
+
+                printf("%-20s %9zu %8.1f %8.1f %5.1fx %8.2f %8.2f %8.2f "
+                       "%8.5f %8.5f\n", fs::path(path).filename().c_str(),
+                       file.size(), stl_size / 1024, size / 1024,
+                       stl_size / size, pack_ms, load_ms, stl_ms, error,
+                       bound);
+
+                if (opt.out_dir.empty())
+                {
+                    fs::remove(out);
+                }
+
+                if (error > bound)
+                {
+                    fprintf(stderr, "meshpack: %s: off by %.5f mm\n",
+                            path.c_str(), error);
+                    ret = 1;
+                }
+            }
+            catch (const std::exception &e)
+            {
+                fprintf(stderr, "meshpack: %s\n", e.what());
+                ret = 1;
+            }
+        }
+
+        printf("%d bits, error: largest corner move, bound: half a step "
+               "plus the weld tolerance\n", opt.bits);
+    }
+    catch (const std::exception &e)
+    {
+        fprintf(stderr, "meshpack: %s\n", e.what());
+        return 1;
+    }
+
+    return ret;
+}
@@ -0,0 +1,247 @@
+/****************************************************************************
+ * tools/mesh/meshrender.cpp
+ * Tomatotificatorul
+ *
+ * Copyright 2021 Iulian-Razvan Matesica <iulian.matesica@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ****************************************************************************/
+
+/* Renders thumbnails of the enclosure meshes on the CPU, for reviews on
+ * machines without CAD software or a GPU:
+ *
+ *   meshrender -o build/thumbs 3d_objects
+ *   meshrender -s 512 --views iso,top --ppm -o build/thumbs box.stl
+ *
+ * Writes DIR/<name>-<view>.png for each view.
+ */
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include "parallel.hpp"
+#include "raster.hpp"
+#include "stl.hpp"
+#include "cli.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+static const mesh::view g_views[] =
+{
+    { "iso",   -35, 30 },
+    { "front",   0,  0 },
+    { "right",  90,  0 },
+    { "back",  180,  0 },
+    { "left",  270,  0 },
+    { "top",     0, 90 },
+    { "bottom",  0, -90 },
+};
+
+/****************************************************************************
+ * Private Types
+ ****************************************************************************/
+
+struct options
+{
+    std::vector<std::string> paths;
+    std::vector<mesh::view> views;
+    std::string out_dir = ".";
+    int size = 256;
+    int samples = 2;
+    bool ppm = false;
+    unsigned threads = 0;
+};
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+static void usage(void)
+{
+    fprintf(stderr,
+        "usage: meshrender [options] FILE.stl|DIR ...\n"
+        "  -s PX          image side (default 256)\n"
+        "  -a N           samples per pixel side (default 2)\n"
+        "  -j N           worker threads (default all cores)\n"
+        "  -o DIR         output directory (default .)\n"
+        "  --views LIST   of iso,front,right,back,left,top,bottom\n"
+        "                 (default iso,front,right,top)\n"
+        "  --ppm          write PPM instead of PNG\n");
+    exit(2);
+}
+
+static std::vector<mesh::view> parse_views(const std::string &list)
+{
+    std::vector<mesh::view> views;
+    std::istringstream in(list);
+    std::string name;
+
+    while (std::getline(in, name, ','))
+    {
+        bool found = false;
+
+        for (const mesh::view &v : g_views)
+        {
+            if (name == v.name)
+            {
+                views.push_back(v);
+                found = true;
+            }
+        }
+
+        if (!found)
+        {
+            throw std::runtime_error("unknown view " + name);
+        }
+    }
+
+    return views;
+}
+
+static options parse_args(int argc, char **argv)
+{
+    options opt;
+
+    opt.views = parse_views("iso,front,right,top");
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool has_val = i + 1 < argc;
+
+        if (arg == "-s" && has_val)
+        {
+            opt.size = cli::parse_int(argv[++i], 16, 4096);
+        }
+        else if (arg == "-a" && has_val)
+        {
+            opt.samples = cli::parse_int(argv[++i], 1, 4);
+        }
+        else if (arg == "-j" && has_val)
+        {
+            opt.threads = cli::parse_int(argv[++i], 1, 256);
+        }
+        else if (arg == "-o" && has_val)
+        {
+            opt.out_dir = argv[++i];
+        }
+        else if (arg == "--views" && has_val)
+        {
+            opt.views = parse_views(argv[++i]);
+        }
+        else if (arg == "--ppm")
+        {
+            opt.ppm = true;
+        }
+        else if (arg[0] != '-')
+        {
+            opt.paths.push_back(arg);
+        }
+        else
+        {
+            usage();
+        }
+    }
+
+    if (opt.paths.empty() || opt.views.empty())
+    {
+        usage();
+    }
+
+    return opt;
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+int main(int argc, char **argv)
+{
+    int ret = 0;
+
+    try
+    {
+        namespace fs = std::filesystem;
+        options opt = parse_args(argc, argv);
+
+        fs::create_directories(opt.out_dir);
+        printf("%-20s %9s %6s %10s %9s\n", "file", "triangles", "views",
+               "render ms", "write ms");
+
+        for (const std::string &path : mesh::stl_files(opt.paths))
+        {
+            try
+            {
+                mesh::stl file(path);
+                double render_ms = 0, write_ms = 0;
+
+                for (const mesh::view &v : opt.views)
+                {
+                    auto start = std::chrono::steady_clock::now();
+                    mesh::image img = mesh::render(file, v, opt.size,
+                                                   opt.samples, opt.threads);
+
+                    render_ms += cli::elapsed_ms(start);
+                    start = std::chrono::steady_clock::now();
+
+                    std::string out = (fs::path(opt.out_dir) /
+                        fs::path(path).stem()).string() + "-" + v.name;
+
+                    if (opt.ppm)
+                    {
+                        mesh::save_ppm(img, out + ".ppm");
+                    }
+                    else
+                    {
+                        mesh::save_png(img, out + ".png");
+                    }
+
+                    write_ms += cli::elapsed_ms(start);
+                }
+
+                printf("%-20s %9zu %6zu %10.2f %9.2f\n",
+                       fs::path(path).filename().c_str(), file.size(),
+                       opt.views.size(), render_ms / opt.views.size(),
+                       write_ms / opt.views.size());
+            }
+            catch (const std::exception &e)
+            {
+                fprintf(stderr, "meshrender: %s\n", e.what());
+                ret = 1;
+            }
+        }
+
+        printf("%u threads, %d px, %dx%d samples, times per view\n",
+               mesh::thread_count(opt.threads), opt.size, opt.samples,
+               opt.samples);
+    }
+    catch (const std::exception &e)
+    {
+        fprintf(stderr, "meshrender: %s\n", e.what());
+        return 1;
+    }
+
+    return ret;
+}
@@ -0,0 +1,296 @@
+/****************************************************************************
+ * tools/mesh/meshslice.cpp
+ * Tomatotificatorul
+ *
+ * Copyright 2021 Iulian-Razvan Matesica <iulian.matesica@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ****************************************************************************/
+
+/* Slices the enclosure meshes into layers and estimates the filament and
+ * the print time, without a slicer:
+ *
+ *   meshslice 3d_objects
+ *   meshslice -l 0.28 --infill 0.15 -o build/layers 3d_objects/box.stl
+ *
+ * The estimate lays 'walls' perimeters along every contour and fills the
+ * rest of the cross section at 'infill', at one speed; top and bottom
+ * skins, travel and acceleration are left out, so real prints take
+ * longer.
+ */
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include "indexed.hpp"
+#include "parallel.hpp"
+#include "slice.hpp"
+#include "stl.hpp"
+#include "cli.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/****************************************************************************
+ * Private Types
+ ****************************************************************************/
+
+struct options
+{
+    std::vector<std::string> paths;
+    std::string out_dir;
+    double height = 0.2;
+    int walls = 2;
+    double infill = 0.2;
+    double width = 0.45;       /* Extrusion width, mm */
+    double speed = 50;         /* mm/s */
+    double density = 1.24;     /* PLA, g/cm^3 */
+    unsigned threads = 0;
+};
+
+struct estimate
+{
+    double volume;             /* Of the solid, mm^3 */
+    double plastic;            /* Printed, mm^3 */
+    double path;               /* Extruded, mm */
+    size_t contours;
+    size_t open;
+};
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+static void usage(void)
+{
+    fprintf(stderr,
+        "usage: meshslice [options] FILE.stl|DIR ...\n"
+        "  -l MM          layer height (default 0.2)\n"
+        "  -j N           worker threads (default all cores)\n"
+        "  -o DIR         write DIR/<name>.layers\n"
+        "  --walls N      perimeters (default 2)\n"
+        "  --infill F     infill fraction (default 0.2)\n"
+        "  --width MM     extrusion width (default 0.45)\n"
+        "  --speed MM/S   print speed (default 50)\n"
+        "  --density G    filament g/cm^3 (default 1.24, PLA)\n");
+    exit(2);
+}
+
+static options parse_args(int argc, char **argv)
+{
+    options opt;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool has_val = i + 1 < argc;
+
+        if (arg == "-l" && has_val)
+        {
+            opt.height = cli::parse_num(argv[++i], 0.01, 10);
+        }
+        else if (arg == "-j" && has_val)
+        {
+            opt.threads = cli::parse_num(argv[++i], 1, 256);
+        }
+        else if (arg == "-o" && has_val)
+        {
+            opt.out_dir = argv[++i];
+        }
+        else if (arg == "--walls" && has_val)
+        {
+            opt.walls = cli::parse_num(argv[++i], 0, 20);
+        }
+        else if (arg == "--infill" && has_val)
+        {
+            opt.infill = cli::parse_num(argv[++i], 0, 1);
+        }
+        else if (arg == "--width" && has_val)
+        {
+            opt.width = cli::parse_num(argv[++i], 0.05, 5);
+        }
+        else if (arg == "--speed" && has_val)
+        {
+            opt.speed = cli::parse_num(argv[++i], 1, 1000);
+        }
+        else if (arg == "--density" && has_val)
+        {
+            opt.density = cli::parse_num(argv[++i], 0.1, 20);
+        }
+        else if (arg[0] != '-')
+        {
+            opt.paths.push_back(arg);
+        }
+        else
+        {
+            usage();
+        }
+    }
+
+    if (opt.paths.empty())
+    {
+        usage();
+    }
+
+    return opt;
+}
+
+/* Walls take 'walls' widths along each contour, up to the whole cross
+ * section; infill fills a fraction of what is left.
+ */
+
+static estimate estimate_print(const std::vector<mesh::layer> &layers,
+                               const options &opt)
+{
+    estimate e = {};
+
+    for (const mesh::layer &l : layers)
+    {
+        double perimeter = 0;
+
+        for (const mesh::contour &c : l.contours)
+        {
+            perimeter += c.length;
+            e.contours++;
+            e.open += !c.closed;
+        }
+
+        double area = std::max(l.area, 0.0);
+        double wall_area = std::min(area, opt.walls * opt.width * perimeter);
+        double fill_area = (area - wall_area) * opt.infill;
+
+        e.volume += area * opt.height;
+        e.plastic += (wall_area + fill_area) * opt.height;
+        e.path += (wall_area + fill_area) / opt.width;
+    }
+
+    return e;
+}
+
+static void save_layers(const std::vector<mesh::layer> &layers,
+                        const std::string &path)
+{
+    FILE *f = fopen(path.c_str(), "w");
+
+    if (f == nullptr)
+    {
+        throw std::runtime_error("cannot create " + path);
+    }
+
+    fprintf(f, "# layer z area contours, then per contour: closed area "
+               "points x y ...\n");
+
+    for (size_t i = 0; i < layers.size(); i++)
+    {
+        const mesh::layer &l = layers[i];
+
+        fprintf(f, "layer %zu %.4f %.3f %zu\n", i, l.z, l.area,
+                l.contours.size());
+
+        for (const mesh::contour &c : l.contours)
+        {
+            fprintf(f, "%d %.3f %zu", c.closed, c.area, c.points.size());
+
+            for (const mesh::vec2 &p : c.points)
+            {
+                fprintf(f, " %.4f %.4f", p.x, p.y);
+            }
+
+            fprintf(f, "\n");
+        }
+    }
+
+    if (ferror(f) | fclose(f))
+    {
+        throw std::runtime_error("cannot write " + path);
+    }
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+int main(int argc, char **argv)
+{
+    int ret = 0;
+
+    try
+    {
+        options opt = parse_args(argc, argv);
+
+        printf("%-20s %6s %8s %5s %9s %9s %8s %7s %8s\n", "file", "layers",
+               "contours", "open", "slice ms", "vol cm3", "mesh cm3",
+               "grams", "time");
+
+        for (const std::string &path : mesh::stl_files(opt.paths))
+        {
+            try
+            {
+                namespace fs = std::filesystem;
+                mesh::stl file(path);
+                mesh::indexed m = mesh::weld(file, WELD_TOLERANCE,
+                                             opt.threads);
+                auto start = std::chrono::steady_clock::now();
+                std::vector<mesh::layer> layers =
+                    mesh::slice(m, opt.height, opt.threads);
+                double ms = cli::elapsed_ms(start);
+                estimate e = estimate_print(layers, opt);
+                mesh::stats s = mesh::compute_stats(file, opt.threads);
+                long minutes = std::lround(e.path / opt.speed / 60);
+
+                printf("%-20s %6zu %8zu %5zu %9.2f %9.2f %8.2f %7.1f "
+                       "%4ld:%02ld\n", fs::path(path).filename().c_str(),
+                       layers.size(), e.contours, e.open, ms,
+                       e.volume / 1e3, s.volume / 1e3,
+                       e.plastic / 1e3 * opt.density, minutes / 60,
+                       minutes % 60);
+
+                if (e.open > 0)
+                {
+                    ret = 1;
+                }
+
+                if (!opt.out_dir.empty())
+                {
+                    fs::create_directories(opt.out_dir);
+                    save_layers(layers, (fs::path(opt.out_dir) /
+                        fs::path(path).stem()).string() + ".layers");
+                }
+            }
+            catch (const std::exception &e)
+            {
+                fprintf(stderr, "meshslice: %s\n", e.what());
+                ret = 1;
+            }
+        }
+
+        printf("%u threads, %.2f mm layers, %d walls, %.0f%% infill, "
+               "%.0f mm/s\n", mesh::thread_count(opt.threads), opt.height,
+               opt.walls, 100 * opt.infill, opt.speed);
+    }
+    catch (const std::exception &e)
+    {
+        fprintf(stderr, "meshslice: %s\n", e.what());
+        return 1;
+    }
+
+    return ret;
+}
@@ -0,0 +1,219 @@
+/****************************************************************************
+ * tools/mesh/meshstat.cpp
+ * Tomatotificatorul
+ *
+ * Copyright 2021 Iulian-Razvan Matesica <iulian.matesica@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ****************************************************************************/
+
+/* Checks the binary STLs of the enclosure and prints their geometry:
+ * bounding box, surface area, enclosed volume and its centroid. Fails if
+ * a file is not a valid binary STL, so it can run on every commit:
+ *
+ *   meshstat 3d_objects
+ *   meshstat -j 4 -r 20 3d_objects/box.stl     timing, best of 20 runs
+ */
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include "stl.hpp"
+#include "parallel.hpp"
+#include "cli.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/****************************************************************************
+ * Private Types
+ ****************************************************************************/
+
+struct options
+{
+    std::vector<std::string> paths;
+    unsigned threads = 0;
+    int repeat = 1;
+};
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+static void usage(void)
+{
+    fprintf(stderr,
+        "usage: meshstat [options] FILE.stl|DIR ...\n"
+        "  -j N    worker threads (default all cores)\n"
+        "  -r N    run N times and report the fastest (default 1)\n");
+    exit(2);
+}
+
+static options parse_args(int argc, char **argv)
+{
+    options opt;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool has_val = i + 1 < argc;
+
+        if (arg == "-j" && has_val)
+        {
+            opt.threads = cli::parse_int(argv[++i], 1, 256);
+        }
+        else if (arg == "-r" && has_val)
+        {
+            opt.repeat = cli::parse_int(argv[++i], 1, 100000);
+        }
+        else if (arg[0] != '-')
+        {
+            opt.paths.push_back(arg);
+        }
+        else
+        {
+            usage();
+        }
+    }
+
+    if (opt.paths.empty())
+    {
+        usage();
+    }
+
+    return opt;
+}
+
+static void print_stats(const mesh::stl &file, const mesh::stats &s)
+{
+    printf("%s: %zu triangles, \"%s\"", file.path().c_str(), file.size(),
+           file.header().c_str());
+
+    if (file.has_color())
+    {
+        const uint8_t *c = file.color();
+
+        printf(" %02x%02x%02x%02x", c[0], c[1], c[2], c[3]);
+    }
+
+    printf("\n");
+    printf("  bbox      %.2f %.2f %.2f .. %.2f %.2f %.2f "
+           "(%.2f x %.2f x %.2f)\n",
+           s.min.x, s.min.y, s.min.z, s.max.x, s.max.y, s.max.z,
+           s.max.x - s.min.x, s.max.y - s.min.y, s.max.z - s.min.z);
+    printf("  area      %.1f\n", s.area);
+    printf("  volume    %.1f\n", s.volume);
+    printf("  centroid  %.2f %.2f %.2f\n",
+           s.centroid[0], s.centroid[1], s.centroid[2]);
+    printf("  facets    %zu degenerate, %zu with own color\n",
+           s.degenerate, s.colored);
+
+    if (s.volume < 0)
+    {
+        printf("  warning   negative volume, normals point inwards\n");
+    }
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+int main(int argc, char **argv)
+{
+    options opt;
+    std::vector<std::string> files;
+    int ret = 0;
+
+    try
+    {
+        opt = parse_args(argc, argv);
+        files = mesh::stl_files(opt.paths);
+    }
+    catch (const std::exception &e)
+    {
+        fprintf(stderr, "meshstat: %s\n", e.what());
+        return 1;
+    }
+
+    /* Timing of the best run: mapping and validation, then the stats. */
+
+    double best_load = HUGE_VAL;
+    double best_stats = HUGE_VAL;
+    size_t loaded = 0;
+    size_t triangles = 0;
+    size_t bytes = 0;
+
+    for (int run = 0; run < opt.repeat; run++)
+    {
+        std::vector<std::unique_ptr<mesh::stl>> meshes;
+        std::vector<mesh::stats> stats;
+        auto start = std::chrono::steady_clock::now();
+
+        for (const std::string &path : files)
+        {
+            try
+            {
+                meshes.push_back(std::make_unique<mesh::stl>(path));
+            }
+            catch (const std::exception &e)
+            {
+                if (run == 0)
+                {
+                    fprintf(stderr, "meshstat: %s\n", e.what());
+                }
+
+                ret = 1;
+            }
+        }
+
+        double load = cli::elapsed_ms(start);
+
+        start = std::chrono::steady_clock::now();
+
+        for (const auto &m : meshes)
+        {
+            stats.push_back(mesh::compute_stats(*m, opt.threads));
+        }
+
+        best_load = std::min(best_load, load);
+        best_stats = std::min(best_stats, cli::elapsed_ms(start));
+
+        if (run > 0)
+        {
+            continue;
+        }
+
+        loaded = meshes.size();
+
+        for (size_t i = 0; i < meshes.size(); i++)
+        {
+            print_stats(*meshes[i], stats[i]);
+            triangles += meshes[i]->size();
+            bytes += STL_DATA_OFFSET + meshes[i]->size() * STL_FACET_SIZE;
+        }
+    }
+
+    printf("%zu files, %zu triangles, %.1f MB: map %.2f ms, stats %.2f ms, "
+           "%u threads\n", loaded, triangles, bytes / 1e6,
+           best_load, best_stats, mesh::thread_count(opt.threads));
+
+    return ret;
+}
@@ -0,0 +1,281 @@
+/****************************************************************************
+ * tools/mesh/meshweld.cpp
+ * Tomatotificatorul
+ *
+ * Copyright 2021 Iulian-Razvan Matesica <iulian.matesica@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ****************************************************************************/
+
+/* Welds binary STLs into indexed meshes and reports the memory saved and
+ * the welding throughput:
+ *
+ *   meshweld 3d_objects
+ *   meshweld -o build/ply --naive 3d_objects/box.stl
+ *
+ * --naive also welds with a std::unordered_map, one thread, checks that
+ * both give the same mesh and prints its time for comparison.
+ */
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include "indexed.hpp"
+#include "parallel.hpp"
+#include "cli.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/****************************************************************************
+ * Private Types
+ ****************************************************************************/
+
+struct options
+{
+    std::vector<std::string> paths;
+    std::string out_dir;
+    float tolerance = WELD_TOLERANCE;
+    unsigned threads = 0;
+    int repeat = 5;
+    bool naive = false;
+};
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+static void usage(void)
+{
+    fprintf(stderr,
+        "usage: meshweld [options] FILE.stl|DIR ...\n"
+        "  -t MM      weld tolerance (default %g)\n"
+        "  -j N       worker threads (default all cores)\n"
+        "  -r N       time the best of N runs (default 5)\n"
+        "  -o DIR     write DIR/<name>.ply\n"
+        "  --naive    compare with a serial std::unordered_map weld\n",
+        WELD_TOLERANCE);
+    exit(2);
+}
+
+static options parse_args(int argc, char **argv)
+{
+    options opt;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool has_val = i + 1 < argc;
+
+        if (arg == "-t" && has_val)
+        {
+            char *end;
+
+            opt.tolerance = strtof(argv[++i], &end);
+
+            if (*end != '\0' || !(opt.tolerance > 0))
+            {
+                throw std::runtime_error("bad tolerance " +
+                                         std::string(argv[i]));
+            }
+        }
+        else if (arg == "-j" && has_val)
+        {
+            opt.threads = cli::parse_int(argv[++i], 1, 256);
+        }
+        else if (arg == "-r" && has_val)
+        {
+            opt.repeat = cli::parse_int(argv[++i], 1, 100000);
+        }
+        else if (arg == "-o" && has_val)
+        {
+            opt.out_dir = argv[++i];
+        }
+        else if (arg == "--naive")
+        {
+            opt.naive = true;
+        }
+        else if (arg[0] != '-')
+        {
+            opt.paths.push_back(arg);
+        }
+        else
+        {
+            usage();
+        }
+    }
+
+    if (opt.paths.empty())
+    {
+        usage();
+    }
+
+    return opt;
+}
+
+/* The straightforward weld, for reference: same grid, same numbering. */
+
+static mesh::indexed weld_naive(const mesh::stl &file, float tolerance)
+{
+    std::unordered_map<uint64_t, uint32_t> ids;
+    mesh::indexed out;
+    double scale = 1.0 / tolerance;
+
+    out.indices.reserve(file.size() * 3);
+
+    for (size_t c = 0; c < file.size() * 3; c++)
+    {
+        mesh::vec3 v = file.vertex(c / 3, c % 3);
+        uint64_t key = 0;
+        const float xyz[3] = { v.x, v.y, v.z };
+
+        for (int a = 0; a < 3; a++)
+        {
+            key = key << 21 |
+                  ((uint64_t)(int64_t)std::floor(xyz[a] * scale) & 0x1fffff);
+        }
+
+        auto it = ids.emplace(key, (uint32_t)out.vertices.size());
+
+        if (it.second)
+        {
+            out.vertices.push_back(v);
+        }
+
+        out.indices.push_back(it.first->second);
+    }
+
+    return out;
+}
+
+static bool same_mesh(const mesh::indexed &a, const mesh::indexed &b)
+{
+    return a.indices == b.indices && a.vertices.size() == b.vertices.size() &&
+           std::equal(a.vertices.begin(), a.vertices.end(),
+                      b.vertices.begin(),
+                      [](const mesh::vec3 &p, const mesh::vec3 &q)
+                      {
+                          return p.x == q.x && p.y == q.y && p.z == q.z;
+                      });
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+int main(int argc, char **argv)
+{
+    int ret = 0;
+
+    try
+    {
+        options opt = parse_args(argc, argv);
+        std::vector<std::string> files = mesh::stl_files(opt.paths);
+
+        printf("%-20s %9s %9s %6s %9s %9s %6s %8s %9s", "file", "triangles",
+               "vertices", "c/v", "STL kB", "indexed", "saved", "weld ms",
+               "Mcorner/s");
+        printf(opt.naive ? " %8s\n" : "\n", "naive ms");
+
+        for (const std::string &path : files)
+        {
+            try
+            {
+                namespace fs = std::filesystem;
+                mesh::stl file(path);
+                mesh::indexed m;
+                double best = HUGE_VAL;
+
+                for (int run = 0; run < opt.repeat; run++)
+                {
+                    auto start = std::chrono::steady_clock::now();
+
+                    m = mesh::weld(file, opt.tolerance, opt.threads);
+                    best = std::min(best, cli::elapsed_ms(start));
+                }
+
+                /* The facets without the header, against the indexed
+                 * mesh; the normals are left out, as they can be
+                 * recomputed from the vertices.
+                 */
+
+                double stl_kb = file.size() * STL_FACET_SIZE / 1e3;
+                double idx_kb = m.bytes() / 1e3;
+
+                printf("%-20s %9zu %9zu %6.2f %9.1f %9.1f %5.1f%% %8.2f "
+                       "%9.1f", fs::path(path).filename().c_str(),
+                       file.size(), m.vertices.size(),
+                       m.vertices.empty() ? 0.0 :
+                       (double)m.indices.size() / m.vertices.size(),
+                       stl_kb, idx_kb,
+                       stl_kb > 0 ? 100 * (1 - idx_kb / stl_kb) : 0.0,
+                       best, m.indices.size() / best / 1e3);
+
+                if (opt.naive)
+                {
+                    double naive = HUGE_VAL;
+                    mesh::indexed ref;
+
+                    for (int run = 0; run < opt.repeat; run++)
+                    {
+                        auto start = std::chrono::steady_clock::now();
+
+                        ref = weld_naive(file, opt.tolerance);
+                        naive = std::min(naive, cli::elapsed_ms(start));
+                    }
+
+                    printf(" %8.2f", naive);
+
+                    if (!same_mesh(m, ref))
+                    {
+                        printf("  MISMATCH");
+                        ret = 1;
+                    }
+                }
+
+                printf("\n");
+
+                if (!opt.out_dir.empty())
+                {
+                    fs::create_directories(opt.out_dir);
+                    mesh::save_ply(m, (fs::path(opt.out_dir) /
+                        fs::path(path).stem()).string() + ".ply");
+                }
+            }
+            catch (const std::exception &e)
+            {
+                fprintf(stderr, "meshweld: %s\n", e.what());
+                ret = 1;
+            }
+        }
+
+        printf("%u threads, tolerance %g mm\n",
+               mesh::thread_count(opt.threads), opt.tolerance);
+    }
+    catch (const std::exception &e)
+    {
+        fprintf(stderr, "meshweld: %s\n", e.what());
+        return 1;
+    }
+
+    return ret;
+}
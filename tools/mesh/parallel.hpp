@@ -0,0 +1,93 @@
+/****************************************************************************
+ * tools/mesh/parallel.hpp
+ * Tomatotificatorul
+ *
+ * Copyright 2021 Iulian-Razvan Matesica <iulian.matesica@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ****************************************************************************/
+
+#ifndef __TOOLS_MESH_PARALLEL_HPP
+#define __TOOLS_MESH_PARALLEL_HPP
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <algorithm>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+namespace mesh
+{
+
+/* Worker count for 'threads' = 0 (all cores). */
+
+inline unsigned thread_count(unsigned threads)
+{
+    if (threads == 0)
+    {
+        threads = std::thread::hardware_concurrency();
+    }
+
+    return threads == 0 ? 1 : threads;
+}
+
+/* Splits [0, n) into one contiguous chunk per worker and calls
+ * fn(begin, end, worker) for each, in parallel. Chunks below 'grain'
+ * items are not worth a thread, so small inputs use fewer workers.
+ * Returns the number of workers used, fn's 'worker' is below it.
+ */
+
+template <typename Fn>
+unsigned parallel_for(size_t n, unsigned threads, Fn fn, size_t grain = 4096)
+{
+    size_t workers = thread_count(threads);
+
+    workers = std::max<size_t>(1, std::min(workers, n / grain));
+
+    if (workers == 1)
+    {
+        fn((size_t)0, n, 0u);
+        return 1;
+    }
+
+    std::vector<std::thread> pool;
+    size_t chunk = (n + workers - 1) / workers;
+
+    for (size_t w = 1; w < workers; w++)
+    {
+        size_t begin = std::min(n, w * chunk);
+        size_t end = std::min(n, begin + chunk);
+
+        pool.emplace_back(fn, begin, end, (unsigned)w);
+    }
+
+    fn((size_t)0, std::min(n, chunk), 0u);
+
+    for (std::thread &t : pool)
+    {
+        t.join();
+    }
+
+    return (unsigned)workers;
+}
+
+} /* namespace mesh */
+
+#endif /* __TOOLS_MESH_PARALLEL_HPP */
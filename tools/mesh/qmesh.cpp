@@ -0,0 +1,403 @@
+/****************************************************************************
+ * tools/mesh/qmesh.cpp
+ * Tomatotificatorul
+ *
+ * Copyright 2021 Iulian-Razvan Matesica <iulian.matesica@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ****************************************************************************/
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include "qmesh.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+#define WRITE_BUFFER   65536
+
+/****************************************************************************
+ * Private Types
+ ****************************************************************************/
+
+namespace
+{
+
+/* Buffered output to a file, flushed as it fills. */
+
+class writer
+{
+public:
+    explicit writer(const std::string &path)
+        : m_path(path), m_file(fopen(path.c_str(), "wb"))
+    {
+        if (m_file == nullptr)
+        {
+            throw std::runtime_error("cannot create " + path + ": " +
+                                     strerror(errno));
+        }
+
+        m_buf.reserve(WRITE_BUFFER);
+    }
+
+    ~writer()
+    {
+        if (m_file != nullptr)
+        {
+            fclose(m_file);
+        }
+    }
+
+    void bytes(const void *p, size_t n)
+    {
+        const uint8_t *b = (const uint8_t *)p;
+
+        m_buf.insert(m_buf.end(), b, b + n);
+        flush_full();
+    }
+
+    void varint(uint64_t v)
+    {
+        while (v >= 0x80)
+        {
+            m_buf.push_back((uint8_t)(v | 0x80));
+            v >>= 7;
+        }
+
+        m_buf.push_back((uint8_t)v);
+        flush_full();
+    }
+
+    void zigzag(int64_t v)
+    {
+        varint((uint64_t)v << 1 ^ (uint64_t)(v >> 63));
+    }
+
+    void close()
+    {
+        fwrite(m_buf.data(), 1, m_buf.size(), m_file);
+
+        bool failed = ferror(m_file) | fclose(m_file);
+
+        m_file = nullptr;
+
+        if (failed)
+        {
+            throw std::runtime_error("cannot write " + m_path);
+        }
+    }
+
+private:
+    void flush_full()
+    {
+        if (m_buf.size() >= WRITE_BUFFER)
+        {
+            fwrite(m_buf.data(), 1, m_buf.size(), m_file);
+            m_buf.clear();
+        }
+    }
+
+    std::string m_path;
+    FILE *m_file;
+    std::vector<uint8_t> m_buf;
+};
+
+/* Bounds checked reading from a mapping. */
+
+class reader
+{
+public:
+    reader(const uint8_t *p, size_t n, const std::string &path)
+        : m_p(p), m_end(p + n), m_path(path)
+    {
+    }
+
+    void bytes(void *out, size_t n)
+    {
+        need(n);
+        memcpy(out, m_p, n);
+        m_p += n;
+    }
+
+    uint64_t varint()
+    {
+        uint64_t v = 0;
+
+        for (int shift = 0; shift < 64; shift += 7)
+        {
+            need(1);
+
+            uint8_t b = *m_p++;
+
+            v |= (uint64_t)(b & 0x7f) << shift;
+
+            if (b < 0x80)
+            {
+                return v;
+            }
+        }
+
+        throw std::runtime_error(m_path + ": bad varint");
+    }
+
+    int64_t zigzag()
+    {
+        uint64_t v = varint();
+
+        return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+    }
+
+    bool done() const { return m_p == m_end; }
+
+private:
+    void need(size_t n)
+    {
+        if ((size_t)(m_end - m_p) < n)
+        {
+            throw std::runtime_error(m_path + ": cut short");
+        }
+    }
+
+    const uint8_t *m_p;
+    const uint8_t *m_end;
+    const std::string &m_path;
+};
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+double step(float lo, float hi, int bits)
+{
+    return ((double)hi - lo) / ((1u << bits) - 1);
+}
+
+} /* namespace */
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+namespace mesh
+{
+
+double qmesh::tolerance() const
+{
+    return std::max({ step(min.x, max.x, bits), step(min.y, max.y, bits),
+                      step(min.z, max.z, bits) }) / 2;
+}
+
+void save_qmesh(const stl &file, const indexed &mesh, int bits, bool attrs,
+                const std::string &path)
+{
+    if (bits < QMESH_MIN_BITS || bits > QMESH_MAX_BITS)
+    {
+        throw std::runtime_error("coordinate bits out of range");
+    }
+
+    vec3 lo = { HUGE_VALF, HUGE_VALF, HUGE_VALF };
+    vec3 hi = { -HUGE_VALF, -HUGE_VALF, -HUGE_VALF };
+
+    for (const vec3 &v : mesh.vertices)
+    {
+        lo = { std::min(lo.x, v.x), std::min(lo.y, v.y),
+               std::min(lo.z, v.z) };
+        hi = { std::max(hi.x, v.x), std::max(hi.y, v.y),
+               std::max(hi.z, v.z) };
+    }
+
+    if (mesh.vertices.empty())
+    {
+        lo = hi = { 0, 0, 0 };
+    }
+
+    writer out(path);
+    uint8_t head[8] = { 'Q', 'M', 'S', 'H', QMESH_VERSION, (uint8_t)bits,
+                        (uint8_t)(attrs ? QMESH_ATTRS : 0), 0 };
+    uint32_t counts[2] = { (uint32_t)mesh.vertices.size(),
+                           (uint32_t)mesh.triangles() };
+
+    out.bytes(head, sizeof(head));
+    out.bytes(file.raw_header(), STL_HEADER_SIZE);
+    out.bytes(&lo, sizeof(lo));
+    out.bytes(&hi, sizeof(hi));
+    out.bytes(counts, sizeof(counts));
+
+    /* Vertices follow the facets they first appear in, so neighbours are
+     * close and the deltas small.
+     */
+
+    const float *min = &lo.x;
+    double scale[3];
+    int64_t prev[3] = {};
+
+    for (int a = 0; a < 3; a++)
+    {
+        double s = step((&lo.x)[a], (&hi.x)[a], bits);
+
+        scale[a] = s > 0 ? 1 / s : 0;
+    }
+
+    for (const vec3 &v : mesh.vertices)
+    {
+        const float *c = &v.x;
+
+        for (int a = 0; a < 3; a++)
+        {
+            int64_t q = std::llround(((double)c[a] - min[a]) * scale[a]);
+
+            out.zigzag(q - prev[a]);
+            prev[a] = q;
+        }
+    }
+
+    int64_t next = 0;
+
+    for (uint32_t idx : mesh.indices)
+    {
+        out.zigzag(next - (int64_t)idx);
+        next = std::max(next, (int64_t)idx + 1);
+    }
+
+    if (attrs && file.size() != mesh.triangles())
+    {
+        throw std::runtime_error("mesh does not match " + file.path());
+    }
+
+    if (attrs)
+    {
+        for (size_t t = 0; t < file.size(); )
+        {
+            size_t run = 1;
+            uint16_t value = file.attr(t);
+
+            while (t + run < file.size() && file.attr(t + run) == value)
+            {
+                run++;
+            }
+
+            out.varint(run);
+            out.bytes(&value, sizeof(value));
+            t += run;
+        }
+    }
+
+    out.close();
+}
+
+qmesh load_qmesh(const std::string &path)
+{
+    mapped_file file(path);
+    reader in(file.data(), file.size(), path);
+    uint8_t head[8];
+    char header[STL_HEADER_SIZE];
+    uint32_t counts[2];
+    qmesh q;
+
+    in.bytes(head, sizeof(head));
+
+    if (memcmp(head, QMESH_MAGIC, 4) != 0 || head[4] != QMESH_VERSION ||
+        head[5] < QMESH_MIN_BITS || head[5] > QMESH_MAX_BITS)
+    {
+        throw std::runtime_error(path + ": not a quantized mesh");
+    }
+
+    q.bits = head[5];
+    in.bytes(header, sizeof(header));
+    q.header.assign(header, sizeof(header));
+    in.bytes(&q.min, sizeof(q.min));
+    in.bytes(&q.max, sizeof(q.max));
+    in.bytes(counts, sizeof(counts));
+
+    /* Every vertex takes at least 3 bytes and every corner 1. */
+
+    if (counts[0] > file.size() / 3 || counts[1] > file.size() / 3)
+    {
+        throw std::runtime_error(path + ": bad counts");
+    }
+
+    const float *min = &q.min.x;
+    double s[3] = { step(q.min.x, q.max.x, q.bits),
+                    step(q.min.y, q.max.y, q.bits),
+                    step(q.min.z, q.max.z, q.bits) };
+    int64_t cur[3] = {};
+
+    q.mesh.vertices.resize(counts[0]);
+
+    for (vec3 &v : q.mesh.vertices)
+    {
+        float *c = &v.x;
+
+        for (int a = 0; a < 3; a++)
+        {
+            cur[a] += in.zigzag();
+            c[a] = (float)(min[a] + cur[a] * s[a]);
+        }
+    }
+
+    int64_t next = 0;
+
+    q.mesh.indices.resize(3 * (size_t)counts[1]);
+
+    for (uint32_t &idx : q.mesh.indices)
+    {
+        int64_t i = next - in.zigzag();
+
+        if (i < 0 || i >= counts[0])
+        {
+            throw std::runtime_error(path + ": bad index");
+        }
+
+        idx = (uint32_t)i;
+        next = std::max(next, i + 1);
+    }
+
+    if (head[6] & QMESH_ATTRS)
+    {
+        q.attrs.reserve(counts[1]);
+
+        while (q.attrs.size() < counts[1])
+        {
+            uint64_t run = in.varint();
+            uint16_t value;
+
+            in.bytes(&value, sizeof(value));
+
+            if (run == 0 || run > counts[1] - q.attrs.size())
+            {
+                throw std::runtime_error(path + ": bad attribute run");
+            }
+
+            q.attrs.insert(q.attrs.end(), run, value);
+        }
+    }
+
+    if (!in.done())
+    {
+        throw std::runtime_error(path + ": trailing bytes");
+    }
+
+    return q;
+}
+
+} /* namespace mesh */
@@ -0,0 +1,101 @@
+/****************************************************************************
+ * tools/mesh/qmesh.hpp
+ * Tomatotificatorul
+ *
+ * Copyright 2021 Iulian-Razvan Matesica <iulian.matesica@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ****************************************************************************/
+
+#ifndef __TOOLS_MESH_QMESH_HPP
+#define __TOOLS_MESH_QMESH_HPP
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "indexed.hpp"
+#include "stl.hpp"
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+/* Quantized mesh file, all little endian:
+ *
+ *   "QMSH", version, coordinate bits (16..21), flags, 0
+ *   the 80 byte STL header, as it was
+ *   float32 min[3], max[3]           bounding box
+ *   uint32 vertices, triangles
+ *   vertices: per axis, zigzag varint of the change of the quantized
+ *             coordinate from the previous vertex
+ *   indices:  per corner, zigzag varint of (vertices used so far - index),
+ *             0 for the next new vertex
+ *   attributes, if QMESH_ATTRS: runs of varint length, uint16 value
+ *
+ * Coordinates are min + q * (max - min) / (2^bits - 1), so they come back
+ * within half a step per axis.
+ */
+
+#define QMESH_MAGIC      "QMSH"
+#define QMESH_VERSION    1
+#define QMESH_MIN_BITS   16
+#define QMESH_MAX_BITS   21
+
+#define QMESH_ATTRS      0x01
+
+/****************************************************************************
+ * Public Types
+ ****************************************************************************/
+
+namespace mesh
+{
+
+struct qmesh
+{
+    indexed mesh;
+    std::vector<uint16_t> attrs;       /* Per triangle, empty if none */
+    std::string header;                /* 80 bytes */
+    vec3 min, max;
+    int bits;
+
+    /* Largest change of a coordinate through quantization, mm. */
+
+    double tolerance() const;
+};
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/* Quantizes 'file' welded into 'mesh' (same triangle order) and writes it
+ * to 'path' as it goes, with the facet attributes if 'attrs'. Throws
+ * std::runtime_error.
+ */
+
+void save_qmesh(const stl &file, const indexed &mesh, int bits, bool attrs,
+                const std::string &path);
+
+/* Reads a file written by save_qmesh(). Throws std::runtime_error when it
+ * is not one or is cut short.
+ */
+
+qmesh load_qmesh(const std::string &path);
+
+} /* namespace mesh */
+
+#endif /* __TOOLS_MESH_QMESH_HPP */
@@ -0,0 +1,145 @@
+/****************************************************************************
+ * tools/mesh/radix.hpp
+ * Tomatotificatorul
+ *
+ * Copyright 2021 Iulian-Razvan Matesica <iulian.matesica@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ****************************************************************************/
+
+#ifndef __TOOLS_MESH_RADIX_HPP
+#define __TOOLS_MESH_RADIX_HPP
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "parallel.hpp"
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+#define RADIX_BITS     8
+#define RADIX_BUCKETS  (1 << RADIX_BITS)
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+namespace mesh
+{
+
+/* Stable LSD radix sort of 'keys', moving 'vals' along, with 'threads'
+ * workers (0 = all cores). Each pass counts the digits per worker chunk,
+ * turns the counts into per worker offsets and scatters; digits that are
+ * the same for every key are skipped, so small keys take fewer passes.
+ */
+
+template <typename Val>
+void radix_sort(std::vector<uint64_t> &keys, std::vector<Val> &vals,
+                unsigned threads)
+{
+    size_t n = keys.size();
+    std::vector<uint64_t> key_tmp(n);
+    std::vector<Val> val_tmp(n);
+    unsigned workers = thread_count(threads);
+    std::vector<size_t> count((size_t)workers * RADIX_BUCKETS);
+    uint64_t diff = 0;
+
+    /* Bits that differ between keys, the other digits need no pass. */
+
+    if (n > 0)
+    {
+        std::vector<uint64_t> diffs(workers);
+
+        parallel_for(n, threads, [&](size_t begin, size_t end, unsigned w)
+        {
+            uint64_t d = 0;
+
+            for (size_t i = begin; i < end; i++)
+            {
+                d |= keys[i] ^ keys[0];
+            }
+
+            diffs[w] = d;
+        });
+
+        for (uint64_t d : diffs)
+        {
+            diff |= d;
+        }
+    }
+
+    for (int shift = 0; shift < 64; shift += RADIX_BITS)
+    {
+        if (((diff >> shift) & (RADIX_BUCKETS - 1)) == 0)
+        {
+            continue;
+        }
+
+        std::fill(count.begin(), count.end(), 0);
+
+        unsigned used = parallel_for(n, threads,
+            [&](size_t begin, size_t end, unsigned w)
+            {
+                size_t *c = &count[(size_t)w * RADIX_BUCKETS];
+
+                for (size_t i = begin; i < end; i++)
+                {
+                    c[(keys[i] >> shift) & (RADIX_BUCKETS - 1)]++;
+                }
+            });
+
+        /* Bucket by bucket, worker by worker: the offsets keep the sort
+         * stable across the chunks.
+         */
+
+        size_t sum = 0;
+
+        for (size_t b = 0; b < RADIX_BUCKETS; b++)
+        {
+            for (unsigned w = 0; w < used; w++)
+            {
+                size_t c = count[(size_t)w * RADIX_BUCKETS + b];
+
+                count[(size_t)w * RADIX_BUCKETS + b] = sum;
+                sum += c;
+            }
+        }
+
+        parallel_for(n, threads, [&](size_t begin, size_t end, unsigned w)
+        {
+            size_t *pos = &count[(size_t)w * RADIX_BUCKETS];
+
+            for (size_t i = begin; i < end; i++)
+            {
+                size_t p = pos[(keys[i] >> shift) & (RADIX_BUCKETS - 1)]++;
+
+                key_tmp[p] = keys[i];
+                val_tmp[p] = vals[i];
+            }
+        });
+
+        keys.swap(key_tmp);
+        vals.swap(val_tmp);
+    }
+}
+
+} /* namespace mesh */
+
+#endif /* __TOOLS_MESH_RADIX_HPP */
@@ -0,0 +1,583 @@
+/****************************************************************************
+ * tools/mesh/raster.cpp
+ * Tomatotificatorul
+ *
+ * Copyright 2021 Iulian-Razvan Matesica <iulian.matesica@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ****************************************************************************/
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include "raster.hpp"
+#include "parallel.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+/* Tile side in samples: a tile's colors and depths stay in L1. */
+
+#define TILE           32
+
+/* Empty border around the part, fraction of the image side. */
+
+#define MARGIN         0.04
+
+/* Light: share from all around, and from above left of the camera. */
+
+#define AMBIENT        0.3
+#define DIFFUSE        0.7
+
+/* Darkening of the farthest surface, so that faces that share a normal
+ * still stand apart, e.g. the floor and the rim seen from above.
+ */
+
+#define DEPTH_CUE      0.4
+
+#define BACKGROUND     0xffffffu
+#define DEFAULT_COLOR  0xa0a0a0u
+
+/* Largest stored deflate block. */
+
+#define STORED_BLOCK   65535
+
+/****************************************************************************
+ * Private Types
+ ****************************************************************************/
+
+namespace
+{
+
+struct vec
+{
+    double x, y, z;
+};
+
+/* A facet on screen: samples across and down, depth along the view. */
+
+struct projected
+{
+    float x[3];
+    float y[3];
+    float z[3];
+};
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+vec sub(vec a, vec b)
+{
+    return { a.x - b.x, a.y - b.y, a.z - b.z };
+}
+
+vec cross(vec a, vec b)
+{
+    return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z,
+             a.x * b.y - a.y * b.x };
+}
+
+double dot(vec a, vec b)
+{
+    return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+vec normalize(vec a)
+{
+    double l = std::sqrt(dot(a, a));
+
+    return l > 0 ? vec{ a.x / l, a.y / l, a.z / l } : vec{ 0, 0, 0 };
+}
+
+vec to_vec(const mesh::vec3 &v)
+{
+    return { v.x, v.y, v.z };
+}
+
+/* Materialise facet color (bit 15 clear, 5 bits of red from bit 0),
+ * else the file's "COLOR=", as 0xRRGGBB.
+ */
+
+uint32_t facet_color(const mesh::stl &file, size_t t)
+{
+    uint16_t a = file.attr(t);
+
+    if (!(a & 0x8000))
+    {
+        uint32_t r = (a & 31) * 255 / 31;
+        uint32_t g = (a >> 5 & 31) * 255 / 31;
+        uint32_t b = (a >> 10 & 31) * 255 / 31;
+
+        return r << 16 | g << 8 | b;
+    }
+
+    if (file.has_color())
+    {
+        const uint8_t *c = file.color();
+
+        return (uint32_t)c[0] << 16 | c[1] << 8 | c[2];
+    }
+
+    return DEFAULT_COLOR;
+}
+
+uint32_t shade(uint32_t color, double light)
+{
+    uint32_t out = 0;
+
+    for (int shift = 0; shift < 24; shift += 8)
+    {
+        double c = (color >> shift & 0xff) * light;
+
+        out |= (uint32_t)std::min(255.0, c + 0.5) << shift;
+    }
+
+    return out;
+}
+
+/* Twice the signed area of a, b, c, > 0 counter-clockwise on screen. */
+
+float edge(float ax, float ay, float bx, float by, float cx, float cy)
+{
+    return (bx - ax) * (cy - ay) - (by - ay) * (cx - ax);
+}
+
+void rasterize(const projected &p, uint32_t color, int x0, int y0, int x1,
+               int y1, int stride, uint32_t *colors, float *depths)
+{
+    float area = edge(p.x[0], p.y[0], p.x[1], p.y[1], p.x[2], p.y[2]);
+    float sign = area < 0 ? -1 : 1;
+
+    if (area == 0)
+    {
+        return;
+    }
+
+    /* Sample centres, clipped to the tile. */
+
+    float fx0 = std::min({ p.x[0], p.x[1], p.x[2] });
+    float fx1 = std::max({ p.x[0], p.x[1], p.x[2] });
+    float fy0 = std::min({ p.y[0], p.y[1], p.y[2] });
+    float fy1 = std::max({ p.y[0], p.y[1], p.y[2] });
+
+    x0 = std::max(x0, (int)std::ceil(fx0 - 0.5f));
+    x1 = std::min(x1, (int)std::floor(fx1 - 0.5f) + 1);
+    y0 = std::max(y0, (int)std::ceil(fy0 - 0.5f));
+    y1 = std::min(y1, (int)std::floor(fy1 - 0.5f) + 1);
+
+    for (int y = y0; y < y1; y++)
+    {
+        float cy = y + 0.5f;
+
+        for (int x = x0; x < x1; x++)
+        {
+            float cx = x + 0.5f;
+            float w0 = sign * edge(p.x[1], p.y[1], p.x[2], p.y[2], cx, cy);
+            float w1 = sign * edge(p.x[2], p.y[2], p.x[0], p.y[0], cx, cy);
+            float w2 = sign * edge(p.x[0], p.y[0], p.x[1], p.y[1], cx, cy);
+
+            if (w0 < 0 || w1 < 0 || w2 < 0)
+            {
+                continue;
+            }
+
+            float z = (w0 * p.z[0] + w1 * p.z[1] + w2 * p.z[2]) /
+                      (sign * area);
+            size_t i = (size_t)y * stride + x;
+
+            if (z < depths[i])
+            {
+                depths[i] = z;
+                colors[i] = color;
+            }
+        }
+    }
+}
+
+/* CRC-32 of PNG chunks, polynomial 0xedb88320. */
+
+uint32_t crc32(uint32_t crc, const uint8_t *p, size_t n)
+{
+    static uint32_t table[256];
+
+    if (table[1] == 0)
+    {
+        for (uint32_t i = 0; i < 256; i++)
+        {
+            uint32_t c = i;
+
+            for (int k = 0; k < 8; k++)
+            {
+                c = c & 1 ? 0xedb88320u ^ c >> 1 : c >> 1;
+            }
+
+            table[i] = c;
+        }
+    }
+
+    crc = ~crc;
+
+    for (size_t i = 0; i < n; i++)
+    {
+        crc = table[(crc ^ p[i]) & 0xff] ^ crc >> 8;
+    }
+
+    return ~crc;
+}
+
+void put_be32(std::vector<uint8_t> &out, uint32_t v)
+{
+    out.push_back(v >> 24);
+    out.push_back(v >> 16);
+    out.push_back(v >> 8);
+    out.push_back(v);
+}
+
+void put_chunk(std::vector<uint8_t> &out, const char *type,
+               const std::vector<uint8_t> &data)
+{
+    put_be32(out, (uint32_t)data.size());
+
+    size_t start = out.size();
+
+    out.insert(out.end(), type, type + 4);
+    out.insert(out.end(), data.begin(), data.end());
+    put_be32(out, crc32(0, &out[start], out.size() - start));
+}
+
+void write_file(const std::string &path, const std::vector<uint8_t> &data)
+{
+    FILE *f = fopen(path.c_str(), "wb");
+
+    if (f == nullptr)
+    {
+        throw std::runtime_error("cannot create " + path + ": " +
+                                 strerror(errno));
+    }
+
+    fwrite(data.data(), 1, data.size(), f);
+
+    if (ferror(f) | fclose(f))
+    {
+        throw std::runtime_error("cannot write " + path);
+    }
+}
+
+} /* namespace */
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+namespace mesh
+{
+
+image render(const stl &file, const view &v, int size, int samples,
+             unsigned threads)
+{
+    if (size < 1 || samples < 1 || size * samples > 16384)
+    {
+        throw std::runtime_error("bad image size");
+    }
+
+    const double deg = M_PI / 180;
+    double az = v.azimuth * deg, el = v.elevation * deg;
+
+    /* Towards the camera, right and up on screen. */
+
+    vec eye = { std::sin(az) * std::cos(el), -std::cos(az) * std::cos(el),
+                std::sin(el) };
+    vec right = { std::cos(az), std::sin(az), 0 };
+    vec up = cross(right, { -eye.x, -eye.y, -eye.z });
+    vec light = normalize({ eye.x + 0.5 * up.x - 0.3 * right.x,
+                            eye.y + 0.5 * up.y - 0.3 * right.y,
+                            eye.z + 0.5 * up.z - 0.3 * right.z });
+
+    size_t n = file.size();
+    std::vector<projected> proj(n);
+    std::vector<uint32_t> colors(n);
+    unsigned workers = thread_count(threads);
+    std::vector<double> bounds(6 * workers);
+
+    /* Onto the view plane, shaded, with the bounds per worker. */
+
+    for (unsigned w = 0; w < workers; w++)
+    {
+        bounds[6 * w] = bounds[6 * w + 1] = bounds[6 * w + 2] = HUGE_VAL;
+        bounds[6 * w + 3] = bounds[6 * w + 4] = bounds[6 * w + 5] = -HUGE_VAL;
+    }
+
+    parallel_for(n, threads,
+        [&](size_t begin, size_t end, unsigned worker)
+        {
+            double *b = &bounds[6 * worker];
+
+            for (size_t t = begin; t < end; t++)
+            {
+                vec p[3];
+
+                for (int k = 0; k < 3; k++)
+                {
+                    p[k] = to_vec(file.vertex(t, k));
+
+                    double x = dot(p[k], right), y = dot(p[k], up);
+                    double z = -dot(p[k], eye);
+
+                    proj[t].x[k] = (float)x;
+                    proj[t].y[k] = (float)y;
+                    proj[t].z[k] = (float)z;
+                    b[0] = std::min(b[0], x);
+                    b[1] = std::min(b[1], y);
+                    b[2] = std::min(b[2], z);
+                    b[3] = std::max(b[3], x);
+                    b[4] = std::max(b[4], y);
+                    b[5] = std::max(b[5], z);
+                }
+
+                /* Facets seen from behind, through a hole, are lit as if
+                 * from the front.
+                 */
+
+                vec nrm = normalize(cross(sub(p[1], p[0]), sub(p[2], p[0])));
+                double facing = dot(nrm, eye) < 0 ? -1 : 1;
+                double lit = AMBIENT + DIFFUSE *
+                             std::max(0.0, facing * dot(nrm, light));
+
+                colors[t] = shade(facet_color(file, t), lit);
+            }
+        });
+
+    double lo[3] = { HUGE_VAL, HUGE_VAL, HUGE_VAL };
+    double hi[3] = { -HUGE_VAL, -HUGE_VAL, -HUGE_VAL };
+
+    for (unsigned w = 0; w < workers; w++)
+    {
+        for (int k = 0; k < 3; k++)
+        {
+            lo[k] = std::min(lo[k], bounds[6 * w + k]);
+            hi[k] = std::max(hi[k], bounds[6 * w + 3 + k]);
+        }
+    }
+
+    /* Into samples, y down, the part centred. */
+
+    int side = size * samples;
+    double extent = std::max(hi[0] - lo[0], hi[1] - lo[1]);
+    double scale = extent > 0 ? side * (1 - 2 * MARGIN) / extent : 1;
+    double mid_x = (lo[0] + hi[0]) / 2, mid_y = (lo[1] + hi[1]) / 2;
+    double cue = hi[2] > lo[2] ? DEPTH_CUE / (hi[2] - lo[2]) : 0;
+
+    for (projected &p : proj)
+    {
+        for (int k = 0; k < 3; k++)
+        {
+            p.x[k] = (float)((p.x[k] - mid_x) * scale + side / 2.0);
+            p.y[k] = (float)(side / 2.0 - (p.y[k] - mid_y) * scale);
+        }
+    }
+
+    /* Facet lists per tile, in one array, as slice() does for layers. */
+
+    int tiles = (side + TILE - 1) / TILE;
+    std::vector<uint32_t> start(tiles * tiles + 1);
+    std::vector<int> range(4 * n);
+
+    for (size_t t = 0; t < n; t++)
+    {
+        const projected &p = proj[t];
+        int *r = &range[4 * t];
+
+        r[0] = std::max(0, (int)std::min({ p.x[0], p.x[1], p.x[2] }) / TILE);
+        r[1] = std::max(0, (int)std::min({ p.y[0], p.y[1], p.y[2] }) / TILE);
+        r[2] = std::min(tiles - 1,
+                        (int)std::max({ p.x[0], p.x[1], p.x[2] }) / TILE);
+        r[3] = std::min(tiles - 1,
+                        (int)std::max({ p.y[0], p.y[1], p.y[2] }) / TILE);
+
+        for (int ty = r[1]; ty <= r[3]; ty++)
+        {
+            for (int tx = r[0]; tx <= r[2]; tx++)
+            {
+                start[ty * tiles + tx + 1]++;
+            }
+        }
+    }
+
+    for (int i = 0; i < tiles * tiles; i++)
+    {
+        start[i + 1] += start[i];
+    }
+
+    std::vector<uint32_t> facets(start.back());
+    std::vector<uint32_t> fill(start.begin(), start.end() - 1);
+
+    for (size_t t = 0; t < n; t++)
+    {
+        const int *r = &range[4 * t];
+
+        for (int ty = r[1]; ty <= r[3]; ty++)
+        {
+            for (int tx = r[0]; tx <= r[2]; tx++)
+            {
+                facets[fill[ty * tiles + tx]++] = (uint32_t)t;
+            }
+        }
+    }
+
+    /* Tiles do not share samples, so workers need no locks. */
+
+    std::vector<uint32_t> pixels((size_t)side * side, BACKGROUND);
+    std::vector<float> depths((size_t)side * side, HUGE_VALF);
+
+    parallel_for(tiles * tiles, threads,
+        [&](size_t begin, size_t end, unsigned)
+        {
+            for (size_t i = begin; i < end; i++)
+            {
+                int x0 = (int)(i % tiles) * TILE;
+                int y0 = (int)(i / tiles) * TILE;
+                int x1 = std::min(side, x0 + TILE);
+                int y1 = std::min(side, y0 + TILE);
+
+                for (uint32_t k = start[i]; k < start[i + 1]; k++)
+                {
+                    rasterize(proj[facets[k]], colors[facets[k]], x0, y0, x1,
+                              y1, side, pixels.data(), depths.data());
+                }
+            }
+        }, 4);
+
+    /* Box filter down to 'size', darker with depth. */
+
+    image img;
+
+    img.width = img.height = size;
+    img.rgb.resize((size_t)size * size * 3);
+
+    for (int y = 0; y < size; y++)
+    {
+        for (int x = 0; x < size; x++)
+        {
+            unsigned sum[3] = {};
+
+            for (int sy = 0; sy < samples; sy++)
+            {
+                for (int sx = 0; sx < samples; sx++)
+                {
+                    size_t i = (size_t)(y * samples + sy) * side +
+                               x * samples + sx;
+                    uint32_t c = pixels[i];
+
+                    if (depths[i] != HUGE_VALF)
+                    {
+                        c = shade(c, 1 - (depths[i] - lo[2]) * cue);
+                    }
+
+                    sum[0] += c >> 16 & 0xff;
+                    sum[1] += c >> 8 & 0xff;
+                    sum[2] += c & 0xff;
+                }
+            }
+
+            for (int k = 0; k < 3; k++)
+            {
+                img.rgb[((size_t)y * size + x) * 3 + k] =
+                    (uint8_t)((sum[k] + samples * samples / 2) /
+                              (samples * samples));
+            }
+        }
+    }
+
+    return img;
+}
+
+void save_png(const image &img, const std::string &path)
+{
+    static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n',
+                                          0x1a, '\n' };
+    std::vector<uint8_t> out(signature, signature + 8);
+    std::vector<uint8_t> ihdr;
+
+    put_be32(ihdr, img.width);
+    put_be32(ihdr, img.height);
+    ihdr.insert(ihdr.end(), { 8, 2, 0, 0, 0 });    /* 8 bit RGB */
+    put_chunk(out, "IHDR", ihdr);
+
+    /* Rows behind filter byte 0, in stored blocks of a zlib stream. */
+
+    size_t row = (size_t)img.width * 3;
+    std::vector<uint8_t> raw;
+    std::vector<uint8_t> z = { 0x78, 0x01 };
+    uint32_t a = 1, b = 0;
+
+    raw.reserve((row + 1) * img.height);
+
+    for (int y = 0; y < img.height; y++)
+    {
+        raw.push_back(0);
+        raw.insert(raw.end(), &img.rgb[y * row], &img.rgb[y * row] + row);
+    }
+
+    for (size_t pos = 0; pos < raw.size() || pos == 0; )
+    {
+        size_t len = std::min<size_t>(STORED_BLOCK, raw.size() - pos);
+        bool last = pos + len == raw.size();
+
+        z.push_back(last);
+        z.push_back(len & 0xff);
+        z.push_back(len >> 8);
+        z.push_back(~len & 0xff);
+        z.push_back(~len >> 8 & 0xff);
+        z.insert(z.end(), raw.begin() + pos, raw.begin() + pos + len);
+        pos += len;
+
+        if (last)
+        {
+            break;
+        }
+    }
+
+    for (uint8_t c : raw)
+    {
+        a = (a + c) % 65521;
+        b = (b + a) % 65521;
+    }
+
+    put_be32(z, b << 16 | a);
+    put_chunk(out, "IDAT", z);
+    put_chunk(out, "IEND", {});
+    write_file(path, out);
+}
+
+void save_ppm(const image &img, const std::string &path)
+{
+    char head[32];
+    int n = snprintf(head, sizeof(head), "P6\n%d %d\n255\n", img.width,
+                     img.height);
+    std::vector<uint8_t> out(head, head + n);
+
+    out.insert(out.end(), img.rgb.begin(), img.rgb.end());
+    write_file(path, out);
+}
+
+} /* namespace mesh */
@@ -0,0 +1,83 @@
+/****************************************************************************
+ * tools/mesh/raster.hpp
+ * Tomatotificatorul
+ *
+ * Copyright 2021 Iulian-Razvan Matesica <iulian.matesica@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ****************************************************************************/
+
+#ifndef __TOOLS_MESH_RASTER_HPP
+#define __TOOLS_MESH_RASTER_HPP
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "stl.hpp"
+
+/****************************************************************************
+ * Public Types
+ ****************************************************************************/
+
+namespace mesh
+{
+
+/* 8 bit RGB, rows from the top. */
+
+struct image
+{
+    int width = 0;
+    int height = 0;
+    std::vector<uint8_t> rgb;
+};
+
+/* Where the camera looks from, degrees: azimuth about Z from the front
+ * (-Y) towards the right (+X), elevation above the XY plane.
+ */
+
+struct view
+{
+    const char *name;
+    double azimuth;
+    double elevation;
+};
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/* Renders 'file' in orthographic projection, fitted to a 'size' pixel
+ * square, with a depth buffer and one flat shade per facet from its
+ * winding, in the facet or file color. The image is cut into tiles that
+ * 'threads' workers (0 = all cores) rasterize on their own, each with
+ * the facets binned to it. 'samples' per pixel side are averaged.
+ */
+
+image render(const stl &file, const view &v, int size, int samples,
+             unsigned threads);
+
+/* Write 'img' as an 8 bit RGB PNG, with stored (uncompressed) deflate
+ * blocks, or as a binary PPM. Throw std::runtime_error.
+ */
+
+void save_png(const image &img, const std::string &path);
+void save_ppm(const image &img, const std::string &path);
+
+} /* namespace mesh */
+
+#endif /* __TOOLS_MESH_RASTER_HPP */
@@ -0,0 +1,681 @@
+/****************************************************************************
+ * tools/mesh/sdf.cpp
+ * Tomatotificatorul
+ *
+ * Copyright 2021 Iulian-Razvan Matesica <iulian.matesica@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ****************************************************************************/
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include "sdf.hpp"
+#include "parallel.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+#define BRICK_POINTS   (SDF_BRICK * SDF_BRICK * SDF_BRICK)
+
+/* Points within this many voxels of a triangle get its exact distance,
+ * the sweeps fill in the rest.
+ */
+
+#define SDF_SHELL      1.5
+
+/* Brick coordinates are kept in 21 bits each. */
+
+#define BRICK_LIMIT    (1 << 20)
+
+/* The band converges in a few rounds; this only bounds the time spent
+ * on a field with bricks cut off from the surface.
+ */
+
+#define MAX_ROUNDS     32
+
+/* Bricks per worker chunk. */
+
+#define BRICK_GRAIN    8
+
+/****************************************************************************
+ * Private Types
+ ****************************************************************************/
+
+namespace
+{
+
+using mesh::vec3d;
+
+/* Brick neighbours across the 6 faces: -x, +x, -y, +y, -z, +z. */
+
+const int g_faces[6][3] =
+{
+    { -1, 0, 0 }, { 1, 0, 0 }, { 0, -1, 0 },
+    { 0, 1, 0 }, { 0, 0, -1 }, { 0, 0, 1 },
+};
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+vec3d sub(vec3d a, vec3d b)
+{
+    return { a.x - b.x, a.y - b.y, a.z - b.z };
+}
+
+vec3d cross(vec3d a, vec3d b)
+{
+    return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z,
+             a.x * b.y - a.y * b.x };
+}
+
+double dot(vec3d a, vec3d b)
+{
+    return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+int64_t floor_div(int64_t a, int64_t b)
+{
+    return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+/* Grid points of the bounds of 't', grown by 'reach' mm. */
+
+void point_range(const mesh::triangle &t, double voxel, double reach,
+                 int64_t lo[3], int64_t hi[3])
+{
+    for (int a = 0; a < 3; a++)
+    {
+        double mn = HUGE_VAL, mx = -HUGE_VAL;
+
+        for (const vec3d &v : t.v)
+        {
+            mn = std::min(mn, (&v.x)[a]);
+            mx = std::max(mx, (&v.x)[a]);
+        }
+
+        lo[a] = (int64_t)std::ceil((mn - reach) / voxel);
+        hi[a] = (int64_t)std::floor((mx + reach) / voxel);
+    }
+}
+
+/* Calls fn(x, y, z) for the bricks of the grid points lo..hi whose
+ * centres are within 'reach' mm of 't', plus the brick half diagonal.
+ */
+
+template <typename Fn>
+void near_bricks(const mesh::triangle &t, double voxel, double reach,
+                 Fn fn)
+{
+    int64_t lo[3], hi[3];
+    double half = std::sqrt(3.0) * (SDF_BRICK - 1) * voxel / 2;
+    double limit = reach + half;
+
+    point_range(t, voxel, reach, lo, hi);
+
+    for (int64_t z = floor_div(lo[2], SDF_BRICK);
+         z <= floor_div(hi[2], SDF_BRICK); z++)
+    {
+        for (int64_t y = floor_div(lo[1], SDF_BRICK);
+             y <= floor_div(hi[1], SDF_BRICK); y++)
+        {
+            for (int64_t x = floor_div(lo[0], SDF_BRICK);
+                 x <= floor_div(hi[0], SDF_BRICK); x++)
+            {
+                vec3d c = { (x * SDF_BRICK + (SDF_BRICK - 1) / 2.0) * voxel,
+                            (y * SDF_BRICK + (SDF_BRICK - 1) / 2.0) * voxel,
+                            (z * SDF_BRICK + (SDF_BRICK - 1) / 2.0) * voxel };
+                vec3d d = sub(mesh::closest_point(c, t), c);
+
+                if (dot(d, d) <= limit * limit)
+                {
+                    fn((int32_t)x, (int32_t)y, (int32_t)z);
+                }
+            }
+        }
+    }
+}
+
+/* Godunov upwind solution of |grad u| = 1 from the smallest neighbour
+ * along each axis, spacing 'h'.
+ */
+
+double eikonal(double a, double b, double c, double h)
+{
+    if (a > b)
+    {
+        std::swap(a, b);
+    }
+
+    if (b > c)
+    {
+        std::swap(b, c);
+    }
+
+    if (a > b)
+    {
+        std::swap(a, b);
+    }
+
+    double u = a + h;
+
+    if (u > b)
+    {
+        u = (a + b + std::sqrt(2 * h * h - (a - b) * (a - b))) / 2;
+
+        if (u > c)
+        {
+            double s = a + b + c;
+
+            u = (s + std::sqrt(s * s - 3 * (a * a + b * b + c * c - h * h)))
+                / 3;
+        }
+    }
+
+    return u;
+}
+
+} /* namespace */
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+namespace mesh
+{
+
+uint32_t bricks::add(int32_t x, int32_t y, int32_t z)
+{
+    if (std::abs(x) >= BRICK_LIMIT || std::abs(y) >= BRICK_LIMIT ||
+        std::abs(z) >= BRICK_LIMIT)
+    {
+        throw std::runtime_error("mesh too far out for the field");
+    }
+
+    uint64_t key = (uint64_t)(x + BRICK_LIMIT) << 42 |
+                   (uint64_t)(y + BRICK_LIMIT) << 21 |
+                   (uint64_t)(z + BRICK_LIMIT);
+    auto it = m_index.emplace(key, (uint32_t)size());
+
+    if (it.second)
+    {
+        m_coords.insert(m_coords.end(), { x, y, z });
+    }
+
+    return it.first->second;
+}
+
+int64_t bricks::find(int32_t x, int32_t y, int32_t z) const
+{
+    if (std::abs(x) >= BRICK_LIMIT || std::abs(y) >= BRICK_LIMIT ||
+        std::abs(z) >= BRICK_LIMIT)
+    {
+        return -1;
+    }
+
+    auto it = m_index.find((uint64_t)(x + BRICK_LIMIT) << 42 |
+                           (uint64_t)(y + BRICK_LIMIT) << 21 |
+                           (uint64_t)(z + BRICK_LIMIT));
+
+    return it == m_index.end() ? -1 : (int64_t)it->second;
+}
+
+bricks meeting_bricks(const std::vector<triangle> &a,
+                      const std::vector<triangle> &b, double voxel,
+                      double band, size_t max_bricks)
+{
+    /* One voxel more, so that points sampled at the band still have all
+     * the grid points around them.
+     */
+
+    double reach = band + voxel;
+    bricks near_a(voxel), out(voxel);
+
+    for (const triangle &t : a)
+    {
+        near_bricks(t, voxel, reach,
+            [&](int32_t x, int32_t y, int32_t z) { near_a.add(x, y, z); });
+    }
+
+    for (const triangle &t : b)
+    {
+        near_bricks(t, voxel, reach,
+            [&](int32_t x, int32_t y, int32_t z)
+            {
+                if (near_a.find(x, y, z) >= 0)
+                {
+                    out.add(x, y, z);
+                }
+            });
+
+        if (out.size() > max_bricks)
+        {
+            throw std::runtime_error("field over its memory limit, try a "
+                                     "coarser grid or a narrower band");
+        }
+    }
+
+    return out;
+}
+
+sdf::sdf(const bricks &grid, const std::vector<triangle> &tris, double band,
+         unsigned threads)
+    : m_grid(grid), m_band(band)
+{
+    const int B = SDF_BRICK;
+    const double h = grid.voxel();
+    const double shell = SDF_SHELL * h;
+    size_t nb = grid.size();
+
+    /* Triangles per brick, in one array. */
+
+    std::vector<uint32_t> start(nb + 1);
+    std::vector<uint32_t> list;
+
+    for (int pass = 0; pass < 2; pass++)
+    {
+        std::vector<uint32_t> fill(start.begin(), start.end() - 1);
+
+        for (uint32_t i = 0; i < tris.size(); i++)
+        {
+            int64_t lo[3], hi[3];
+
+            point_range(tris[i], h, shell, lo, hi);
+
+            for (int64_t z = floor_div(lo[2], B); z <= floor_div(hi[2], B);
+                 z++)
+            {
+                for (int64_t y = floor_div(lo[1], B);
+                     y <= floor_div(hi[1], B); y++)
+                {
+                    for (int64_t x = floor_div(lo[0], B);
+                         x <= floor_div(hi[0], B); x++)
+                    {
+                        int64_t b = grid.find(x, y, z);
+
+                        if (b < 0)
+                        {
+                            continue;
+                        }
+
+                        if (pass == 0)
+                        {
+                            start[b + 1]++;
+                        }
+                        else
+                        {
+                            list[fill[b]++] = i;
+                        }
+                    }
+                }
+            }
+        }
+
+        if (pass == 0)
+        {
+            for (size_t b = 0; b < nb; b++)
+            {
+                start[b + 1] += start[b];
+            }
+
+            list.resize(start[nb]);
+        }
+    }
+
+    /* Neighbours across the faces, UINT32_MAX if not kept. */
+
+    std::vector<uint32_t> next(6 * nb);
+    std::vector<uint32_t> parity[2];
+
+    for (uint32_t b = 0; b < nb; b++)
+    {
+        const int32_t *c = grid.coord(b);
+
+        for (int f = 0; f < 6; f++)
+        {
+            int64_t n = grid.find(c[0] + g_faces[f][0], c[1] + g_faces[f][1],
+                                  c[2] + g_faces[f][2]);
+
+            next[6 * b + f] = n < 0 ? UINT32_MAX : (uint32_t)n;
+        }
+
+        parity[(c[0] + c[1] + c[2]) & 1].push_back(b);
+    }
+
+    /* Unsigned distances while sweeping, the sign beside them. */
+
+    m_phi.assign(nb * BRICK_POINTS, (float)band);
+
+    std::vector<int8_t> sign(nb * BRICK_POINTS, 1);
+    std::vector<uint8_t> fixed(nb * BRICK_POINTS, 0);
+
+    parallel_for(nb, threads,
+        [&](size_t begin, size_t end, unsigned)
+        {
+            double best_cos[BRICK_POINTS];
+
+            for (size_t b = begin; b < end; b++)
+            {
+                const int32_t *c = grid.coord(b);
+                float *phi = &m_phi[b * BRICK_POINTS];
+
+                std::fill(best_cos, best_cos + BRICK_POINTS, 0.0);
+
+                for (uint32_t k = start[b]; k < start[b + 1]; k++)
+                {
+                    const triangle &t = tris[list[k]];
+                    vec3d n = cross(sub(t.v[1], t.v[0]), sub(t.v[2], t.v[0]));
+                    double len = std::sqrt(dot(n, n));
+                    int64_t lo[3], hi[3];
+
+                    point_range(t, h, shell, lo, hi);
+
+                    for (int a = 0; a < 3; a++)
+                    {
+                        lo[a] = std::max<int64_t>(lo[a], c[a] * B) - c[a] * B;
+                        hi[a] = std::min<int64_t>(hi[a], c[a] * B + B - 1) -
+                                c[a] * B;
+                    }
+
+                    for (int64_t z = lo[2]; z <= hi[2]; z++)
+                    {
+                        for (int64_t y = lo[1]; y <= hi[1]; y++)
+                        {
+                            for (int64_t x = lo[0]; x <= hi[0]; x++)
+                            {
+                                vec3d p = { (c[0] * B + x) * h,
+                                            (c[1] * B + y) * h,
+                                            (c[2] * B + z) * h };
+                                vec3d d = sub(p, closest_point(p, t));
+                                double dist = std::sqrt(dot(d, d));
+                                double cs = dist > 0 && len > 0 ?
+                                            dot(d, n) / (dist * len) : 0;
+                                size_t i = (z * B + y) * B + x;
+
+                                /* On a shared edge or corner the facet
+                                 * facing the point best tells the side.
+                                 */
+
+                                if (dist > shell ||
+                                    dist > phi[i] + 1e-6 * h ||
+                                    (dist > phi[i] - 1e-6 * h &&
+                                     std::fabs(cs) <= std::fabs(best_cos[i])))
+                                {
+                                    continue;
+                                }
+
+                                phi[i] = (float)dist;
+                                best_cos[i] = cs;
+                                fixed[b * BRICK_POINTS + i] = 1;
+                                sign[b * BRICK_POINTS + i] = cs < 0 ? -1 : 1;
+                            }
+                        }
+                    }
+                }
+            }
+        }, BRICK_GRAIN);
+
+    /* Sweeps: a brick is copied out with the faces of its neighbours
+     * around it, swept in the 8 orders (Gauss-Seidel) and copied back.
+     */
+
+    const int G = B + 2;
+    const int step[6] = { -1, 1, -G, G, -G * G, G * G };
+
+    auto sweep = [&](uint32_t b) -> bool
+    {
+        float d[G * G * G];
+        int8_t s[G * G * G];
+        bool changed = false;
+
+        std::fill(d, d + G * G * G, HUGE_VALF);
+
+        for (int z = 0; z < B; z++)
+        {
+            for (int y = 0; y < B; y++)
+            {
+                for (int x = 0; x < B; x++)
+                {
+                    size_t i = b * BRICK_POINTS + (z * B + y) * B + x;
+                    int g = ((z + 1) * G + y + 1) * G + x + 1;
+
+                    d[g] = m_phi[i];
+                    s[g] = sign[i];
+                }
+            }
+        }
+
+        for (int f = 0; f < 6; f++)
+        {
+            uint32_t n = next[6 * b + f];
+            int axis = f / 2;
+
+            if (n == UINT32_MAX)
+            {
+                continue;
+            }
+
+            for (int v = 0; v < B; v++)
+            {
+                for (int u = 0; u < B; u++)
+                {
+                    int p[3], q[3];
+
+                    p[axis] = f & 1 ? 0 : B - 1;
+                    p[(axis + 1) % 3] = u;
+                    p[(axis + 2) % 3] = v;
+                    q[axis] = f & 1 ? B + 1 : 0;
+                    q[(axis + 1) % 3] = u + 1;
+                    q[(axis + 2) % 3] = v + 1;
+
+                    size_t i = n * BRICK_POINTS + (p[2] * B + p[1]) * B + p[0];
+                    int g = (q[2] * G + q[1]) * G + q[0];
+
+                    d[g] = m_phi[i];
+                    s[g] = sign[i];
+                }
+            }
+        }
+
+        for (int dir = 0; dir < 8; dir++)
+        {
+            for (int zz = 0; zz < B; zz++)
+            {
+                int z = dir & 4 ? B - 1 - zz : zz;
+
+                for (int yy = 0; yy < B; yy++)
+                {
+                    int y = dir & 2 ? B - 1 - yy : yy;
+
+                    for (int xx = 0; xx < B; xx++)
+                    {
+                        int x = dir & 1 ? B - 1 - xx : xx;
+                        int g = ((z + 1) * G + y + 1) * G + x + 1;
+                        int least = 0;
+
+                        if (fixed[b * BRICK_POINTS + (z * B + y) * B + x])
+                        {
+                            continue;
+                        }
+
+                        for (int k = 1; k < 6; k++)
+                        {
+                            if (d[g + step[k]] < d[g + step[least]])
+                            {
+                                least = k;
+                            }
+                        }
+
+                        if (d[g + step[least]] >= m_band)
+                        {
+                            continue;
+                        }
+
+                        double u = eikonal(std::min(d[g - 1], d[g + 1]),
+                                           std::min(d[g - G], d[g + G]),
+                                           std::min(d[g - G * G],
+                                                    d[g + G * G]), h);
+
+                        if (u < d[g] - 1e-6 * h)
+                        {
+                            d[g] = (float)u;
+                            s[g] = s[g + step[least]];
+                            changed = true;
+                        }
+                    }
+                }
+            }
+        }
+
+        if (!changed)
+        {
+            return false;
+        }
+
+        for (int z = 0; z < B; z++)
+        {
+            for (int y = 0; y < B; y++)
+            {
+                for (int x = 0; x < B; x++)
+                {
+                    size_t i = b * BRICK_POINTS + (z * B + y) * B + x;
+                    int g = ((z + 1) * G + y + 1) * G + x + 1;
+
+                    m_phi[i] = d[g];
+                    sign[i] = s[g];
+                }
+            }
+        }
+
+        return true;
+    };
+
+    /* Rounds over the bricks that changed or next to one that did. */
+
+    std::vector<uint8_t> active(nb, 1), changed(nb);
+    bool any = nb > 0;
+
+    while (any && m_rounds < MAX_ROUNDS)
+    {
+        std::fill(changed.begin(), changed.end(), 0);
+
+        for (const std::vector<uint32_t> &set : parity)
+        {
+            parallel_for(set.size(), threads,
+                [&](size_t begin, size_t end, unsigned)
+                {
+                    for (size_t k = begin; k < end; k++)
+                    {
+                        if (active[set[k]])
+                        {
+                            changed[set[k]] = sweep(set[k]);
+                        }
+                    }
+                }, BRICK_GRAIN);
+        }
+
+        any = false;
+
+        for (uint32_t b = 0; b < nb; b++)
+        {
+            active[b] = changed[b];
+
+            for (int f = 0; f < 6; f++)
+            {
+                active[b] |= next[6 * b + f] != UINT32_MAX &&
+                             changed[next[6 * b + f]];
+            }
+
+            any |= active[b];
+        }
+
+        m_rounds++;
+    }
+
+    for (size_t i = 0; i < m_phi.size(); i++)
+    {
+        m_phi[i] *= sign[i];
+    }
+}
+
+float sdf::point(int64_t i, int64_t j, int64_t k) const
+{
+    int64_t x = floor_div(i, SDF_BRICK), y = floor_div(j, SDF_BRICK);
+    int64_t z = floor_div(k, SDF_BRICK);
+    int64_t b = m_grid.find(x, y, z);
+
+    if (b < 0)
+    {
+        return NAN;
+    }
+
+    return m_phi[b * BRICK_POINTS +
+                 ((k - z * SDF_BRICK) * SDF_BRICK + (j - y * SDF_BRICK)) *
+                 SDF_BRICK + (i - x * SDF_BRICK)];
+}
+
+double sdf::at(const vec3d &p) const
+{
+    double h = m_grid.voxel();
+    double fx = p.x / h, fy = p.y / h, fz = p.z / h;
+    int64_t i = (int64_t)std::floor(fx), j = (int64_t)std::floor(fy);
+    int64_t k = (int64_t)std::floor(fz);
+    double tx = fx - i, ty = fy - j, tz = fz - k;
+    int64_t x = floor_div(i, SDF_BRICK), y = floor_div(j, SDF_BRICK);
+    int64_t z = floor_div(k, SDF_BRICK);
+    int lx = (int)(i - x * SDF_BRICK), ly = (int)(j - y * SDF_BRICK);
+    int lz = (int)(k - z * SDF_BRICK);
+    int64_t b = -1;
+    double sum = 0;
+
+    /* Mostly all 8 points are in one brick. */
+
+    if (lx < SDF_BRICK - 1 && ly < SDF_BRICK - 1 && lz < SDF_BRICK - 1)
+    {
+        b = m_grid.find(x, y, z);
+
+        if (b < 0)
+        {
+            return NAN;
+        }
+    }
+
+    for (int c = 0; c < 8; c++)
+    {
+        int dx = c & 1, dy = c >> 1 & 1, dz = c >> 2 & 1;
+        double w = (dx ? tx : 1 - tx) * (dy ? ty : 1 - ty) *
+                   (dz ? tz : 1 - tz);
+
+        if (b >= 0)
+        {
+            sum += w * m_phi[b * BRICK_POINTS +
+                             ((lz + dz) * SDF_BRICK + ly + dy) * SDF_BRICK +
+                             lx + dx];
+        }
+        else
+        {
+            sum += w * point(i + dx, j + dy, k + dz);
+        }
+    }
+
+    return sum;
+}
+
+} /* namespace mesh */
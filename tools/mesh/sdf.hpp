@@ -0,0 +1,129 @@
+/****************************************************************************
+ * tools/mesh/sdf.hpp
+ * Tomatotificatorul
+ *
+ * Copyright 2021 Iulian-Razvan Matesica <iulian.matesica@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ****************************************************************************/
+
+#ifndef __TOOLS_MESH_SDF_HPP
+#define __TOOLS_MESH_SDF_HPP
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "bvh.hpp"
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+/* Grid points per brick side. */
+
+#define SDF_BRICK   8
+
+/****************************************************************************
+ * Public Types
+ ****************************************************************************/
+
+namespace mesh
+{
+
+/* The bricks a sparse field is kept in. Grid point (i, j, k) is at
+ * (i, j, k) * voxel mm and belongs to brick (i, j, k) / SDF_BRICK,
+ * rounded down.
+ */
+
+class bricks
+{
+public:
+    explicit bricks(double voxel) : m_voxel(voxel) {}
+
+    double voxel() const { return m_voxel; }
+    size_t size() const { return m_coords.size() / 3; }
+    const int32_t *coord(uint32_t b) const { return &m_coords[3 * b]; }
+
+    /* Index of the brick, added if new. Throws std::runtime_error if it
+     * is more than 2^20 bricks from the origin.
+     */
+
+    uint32_t add(int32_t x, int32_t y, int32_t z);
+
+    /* Index of the brick, -1 if there is none. */
+
+    int64_t find(int32_t x, int32_t y, int32_t z) const;
+
+private:
+    double m_voxel;
+    std::unordered_map<uint64_t, uint32_t> m_index;
+    std::vector<int32_t> m_coords;
+};
+
+/* Signed distance to a closed surface, positive outside, sampled on the
+ * grid points of a set of bricks out to 'band' mm; further points hold
+ * +-band.
+ */
+
+class sdf
+{
+public:
+    /* Exact distances to the triangles within 1.5 voxels of each point,
+     * signed by the facing of the closest one, then the fast sweeping
+     * method (Zhao 2005) out to the band: each brick is swept in all 8
+     * orders, bricks of one parity in parallel with 'threads' workers
+     * (0 = all cores), as they only read their neighbours of the other.
+     */
+
+    sdf(const bricks &grid, const std::vector<triangle> &tris, double band,
+        unsigned threads);
+
+    /* Trilinear, NaN where a grid point around 'p' is not kept. */
+
+    double at(const vec3d &p) const;
+
+    /* Rounds of sweeps until nothing changed. */
+
+    int rounds() const { return m_rounds; }
+    size_t bytes() const { return m_phi.size() * sizeof(float); }
+
+private:
+    float point(int64_t i, int64_t j, int64_t k) const;
+
+    const bricks &m_grid;
+    double m_band;
+    std::vector<float> m_phi;  /* SDF_BRICK^3 per brick, x fastest */
+    int m_rounds = 0;
+};
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/* The bricks, 'voxel' mm grid, where both 'a' and 'b' come within 'band'
+ * mm: where two parts meet. Throws std::runtime_error past 'max_bricks'.
+ */
+
+bricks meeting_bricks(const std::vector<triangle> &a,
+                      const std::vector<triangle> &b, double voxel,
+                      double band, size_t max_bricks);
+
+} /* namespace mesh */
+
+#endif /* __TOOLS_MESH_SDF_HPP */
@@ -0,0 +1,338 @@
+/****************************************************************************
+ * tools/mesh/slice.cpp
+ * Tomatotificatorul
+ *
+ * Copyright 2021 Iulian-Razvan Matesica <iulian.matesica@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ****************************************************************************/
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include "slice.hpp"
+#include "parallel.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+/* Layers per worker chunk: a layer is only a few hundred facets. */
+
+#define LAYER_GRAIN   4
+
+/****************************************************************************
+ * Private Types
+ ****************************************************************************/
+
+namespace
+{
+
+/* The cut through one facet, from the edge it enters by to the edge it
+ * leaves by. Edges are keyed on their vertices (low, high), the same in
+ * both facets that share them.
+ */
+
+struct segment
+{
+    uint64_t from;
+    uint64_t to;
+    mesh::vec2 start;
+};
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+uint64_t edge_key(uint32_t a, uint32_t b)
+{
+    return (uint64_t)std::min(a, b) << 32 | std::max(a, b);
+}
+
+/* Where the plane crosses edge a-b, from the low vertex index so that
+ * both facets get the same point.
+ */
+
+mesh::vec2 crossing(const mesh::indexed &m, uint32_t a, uint32_t b,
+                    double z)
+{
+    const mesh::vec3 &p = m.vertices[std::min(a, b)];
+    const mesh::vec3 &q = m.vertices[std::max(a, b)];
+    double t = (z - p.z) / ((double)q.z - p.z);
+
+    return { (float)(p.x + t * ((double)q.x - p.x)),
+             (float)(p.y + t * ((double)q.y - p.y)) };
+}
+
+/* Vertices on the plane count as above it, so every edge is either
+ * crossed or not and the segments of a closed mesh always chain up.
+ */
+
+void cut(const mesh::indexed &m, uint32_t t, double z,
+         std::vector<segment> &out)
+{
+    const uint32_t *v = &m.indices[3 * t];
+    bool above[3];
+    uint64_t enter = 0, leave = 0;
+    uint32_t enter_a = 0, enter_b = 0;
+
+    for (int k = 0; k < 3; k++)
+    {
+        above[k] = m.vertices[v[k]].z >= z;
+    }
+
+    if (above[0] == above[1] && above[1] == above[2])
+    {
+        return;
+    }
+
+    /* Seen from above, with the facet facing out, the solid is left of
+     * the edge going up and right of the one going down.
+     */
+
+    for (int k = 0; k < 3; k++)
+    {
+        uint32_t a = v[k], b = v[(k + 1) % 3];
+
+        if (above[k] && !above[(k + 1) % 3])
+        {
+            enter = edge_key(a, b);
+            enter_a = a;
+            enter_b = b;
+        }
+        else if (!above[k] && above[(k + 1) % 3])
+        {
+            leave = edge_key(a, b);
+        }
+    }
+
+    out.push_back({ enter, leave, crossing(m, enter_a, enter_b, z) });
+}
+
+/* The segment starting at edge 'key', in segments sorted on 'from'. */
+
+std::vector<segment>::const_iterator find(const std::vector<segment> &segs,
+                                          uint64_t key)
+{
+    auto it = std::lower_bound(segs.begin(), segs.end(), key,
+        [](const segment &s, uint64_t k) { return s.from < k; });
+
+    return it != segs.end() && it->from == key ? it : segs.end();
+}
+
+/* Follows the segments from 'first' until back to it or to an edge no
+ * segment starts at. 'used' is 1 for the segments taken.
+ */
+
+mesh::contour chain(const std::vector<segment> &segs,
+                    std::vector<uint8_t> &used, size_t first)
+{
+    mesh::contour c;
+    size_t i = first;
+
+    c.closed = false;
+
+    for (;;)
+    {
+        used[i] = 1;
+        c.points.push_back(segs[i].start);
+
+        auto next = find(segs, segs[i].to);
+
+        if (next == segs.end())
+        {
+            break;
+        }
+
+        i = next - segs.begin();
+
+        if (i == first)
+        {
+            c.closed = true;
+            break;
+        }
+
+        if (used[i] == 1)
+        {
+            break;
+        }
+    }
+
+    double area = 0, length = 0;
+    size_t n = c.points.size();
+
+    for (size_t k = 0; k + 1 < n + c.closed; k++)
+    {
+        const mesh::vec2 &p = c.points[k];
+        const mesh::vec2 &q = c.points[(k + 1) % n];
+
+        area += (double)p.x * q.y - (double)q.x * p.y;
+        length += std::hypot((double)q.x - p.x, (double)q.y - p.y);
+    }
+
+    c.area = c.closed ? area / 2 : 0;
+    c.length = length;
+    return c;
+}
+
+} /* namespace */
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+namespace mesh
+{
+
+std::vector<layer> slice(const indexed &mesh, double height,
+                         unsigned threads)
+{
+    if (!(height > 0))
+    {
+        throw std::runtime_error("bad layer height");
+    }
+
+    if (mesh.triangles() == 0)
+    {
+        return {};
+    }
+
+    float zmin = HUGE_VALF, zmax = -HUGE_VALF;
+
+    for (const vec3 &v : mesh.vertices)
+    {
+        zmin = std::min(zmin, v.z);
+        zmax = std::max(zmax, v.z);
+    }
+
+    size_t n = std::max<size_t>(1, std::ceil((zmax - zmin) / height));
+    std::vector<layer> layers(n);
+
+    for (size_t i = 0; i < n; i++)
+    {
+        layers[i].z = zmin + (i + 0.5) * height;
+    }
+
+    /* Facet lists per layer, in one array: facet t crosses the planes
+     * from its lowest corner to its highest.
+     */
+
+    std::vector<uint32_t> first(mesh.triangles()), last(mesh.triangles());
+    std::vector<uint32_t> start(n + 1);
+
+    for (size_t t = 0; t < mesh.triangles(); t++)
+    {
+        const uint32_t *v = &mesh.indices[3 * t];
+        double lo = std::min({ mesh.vertices[v[0]].z, mesh.vertices[v[1]].z,
+                               mesh.vertices[v[2]].z });
+        double hi = std::max({ mesh.vertices[v[0]].z, mesh.vertices[v[1]].z,
+                               mesh.vertices[v[2]].z });
+        /* One more layer each way against rounding, cut() checks. */
+
+        double a = std::ceil((lo - zmin) / height - 0.5) - 1;
+        double b = std::floor((hi - zmin) / height - 0.5) + 1;
+
+        first[t] = (uint32_t)std::max(a, 0.0);
+        last[t] = (uint32_t)std::min(b, (double)n - 1);
+
+        if (v[0] == v[1] || v[1] == v[2] || v[2] == v[0] || b < a ||
+            b < 0 || a > n - 1.0)
+        {
+            first[t] = 1;
+            last[t] = 0;
+            continue;
+        }
+
+        for (uint32_t i = first[t]; i <= last[t]; i++)
+        {
+            start[i + 1]++;
+        }
+    }
+
+    for (size_t i = 0; i < n; i++)
+    {
+        start[i + 1] += start[i];
+    }
+
+    std::vector<uint32_t> facets(start[n]);
+    std::vector<uint32_t> fill(start.begin(), start.end() - 1);
+
+    for (size_t t = 0; t < mesh.triangles(); t++)
+    {
+        for (uint32_t i = first[t]; i <= last[t]; i++)
+        {
+            facets[fill[i]++] = (uint32_t)t;
+        }
+    }
+
+    parallel_for(n, threads,
+        [&](size_t begin, size_t end, unsigned)
+        {
+            std::vector<segment> segs;
+            std::vector<uint8_t> used;
+
+            for (size_t i = begin; i < end; i++)
+            {
+                layer &l = layers[i];
+
+                segs.clear();
+
+                for (uint32_t k = start[i]; k < start[i + 1]; k++)
+                {
+                    cut(mesh, facets[k], l.z, segs);
+                }
+
+                std::sort(segs.begin(), segs.end(),
+                          [](const segment &a, const segment &b)
+                          {
+                              return a.from < b.from;
+                          });
+                l.area = 0;
+
+                /* Open chains from their first segment, then the loops. */
+
+                used.assign(segs.size(), 0);
+
+                for (const segment &s : segs)
+                {
+                    auto next = find(segs, s.to);
+
+                    if (next != segs.end())
+                    {
+                        used[next - segs.begin()] = 2;
+                    }
+                }
+
+                for (uint8_t pass : { 0, 2 })
+                {
+                    for (size_t s = 0; s < segs.size(); s++)
+                    {
+                        if (used[s] == pass)
+                        {
+                            l.contours.push_back(chain(segs, used, s));
+                            l.area += l.contours.back().area;
+                        }
+                    }
+                }
+            }
+        }, LAYER_GRAIN);
+
+    return layers;
+}
+
+} /* namespace mesh */
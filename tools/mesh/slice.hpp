@@ -0,0 +1,80 @@
+/****************************************************************************
+ * tools/mesh/slice.hpp
+ * Tomatotificatorul
+ *
+ * Copyright 2021 Iulian-Razvan Matesica <iulian.matesica@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ****************************************************************************/
+
+#ifndef __TOOLS_MESH_SLICE_HPP
+#define __TOOLS_MESH_SLICE_HPP
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <cstddef>
+#include <vector>
+
+#include "indexed.hpp"
+
+/****************************************************************************
+ * Public Types
+ ****************************************************************************/
+
+namespace mesh
+{
+
+struct vec2
+{
+    float x, y;
+};
+
+/* A polygon of a layer. Closed ones run counter-clockwise around the
+ * solid seen from above, so holes run clockwise and have a negative area.
+ * Open ones come from holes in the mesh.
+ */
+
+struct contour
+{
+    std::vector<vec2> points;
+    bool closed;
+    double area;               /* Signed, mm^2, 0 if open */
+    double length;             /* mm */
+};
+
+struct layer
+{
+    double z;                  /* Cut plane, the middle of the layer */
+    double area;               /* Cross section, mm^2 */
+    std::vector<contour> contours;
+};
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/* Cuts 'mesh' into layers 'height' mm thick from its lowest point, at
+ * the middle of each layer, with 'threads' workers (0 = all cores). The
+ * facets are bucketed by the layers they cross first, so a layer only
+ * looks at its own; cut segments are chained through the mesh edges
+ * they cross.
+ */
+
+std::vector<layer> slice(const indexed &mesh, double height,
+                         unsigned threads);
+
+} /* namespace mesh */
+
+#endif /* __TOOLS_MESH_SLICE_HPP */
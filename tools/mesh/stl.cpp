@@ -0,0 +1,418 @@
+/****************************************************************************
+ * tools/mesh/stl.cpp
+ * Tomatotificatorul
+ *
+ * Copyright 2021 Iulian-Razvan Matesica <iulian.matesica@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ****************************************************************************/
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include "stl.hpp"
+#include "parallel.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+#include <vector>
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+/* Triangles summed per partial. The partials are added up in order, so
+ * the result is the same for any worker count.
+ */
+
+#define STATS_BLOCK  1024
+
+/* Triangles per SIMD step. */
+
+#define LANES        4
+
+/****************************************************************************
+ * Private Types
+ ****************************************************************************/
+
+namespace
+{
+
+/* GCC vector extension, SSE2/AVX or plain scalar code as the target
+ * allows. Doubles, as the volume terms cancel out a lot.
+ */
+
+typedef double v4d __attribute__((vector_size(LANES * sizeof(double))));
+
+struct partial
+{
+    double min[3];
+    double max[3];
+    double area;
+    double volume;
+    double moment[3];          /* Sum of volume * tetrahedron centroid */
+    size_t degenerate;
+    size_t colored;
+};
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+std::runtime_error sys_error(const std::string &what, const std::string &path)
+{
+    return std::runtime_error(what + " " + path + ": " + strerror(errno));
+}
+
+/* Triangles [first, first + LANES) as structure of arrays: c[k][a] is the
+ * coordinate 'a' (x, y, z) of vertex k in every lane.
+ */
+
+void load_lanes(const mesh::stl &file, size_t first, v4d c[3][3],
+                uint16_t attr[])
+{
+    for (int lane = 0; lane < LANES; lane++)
+    {
+        for (int k = 0; k < 3; k++)
+        {
+            mesh::vec3 v = file.vertex(first + lane, k);
+
+            c[k][0][lane] = v.x;
+            c[k][1][lane] = v.y;
+            c[k][2][lane] = v.z;
+        }
+
+        attr[lane] = file.attr(first + lane);
+    }
+}
+
+void add_lanes(partial &p, v4d c[3][3], const uint16_t attr[], int lanes)
+{
+    /* Edges from vertex 0, their cross product is twice the area along
+     * the normal; v0 . (v1 x v2) is six times the signed volume of the
+     * tetrahedron with the origin.
+     */
+
+    v4d e1[3], e2[3], n[3], x[3];
+
+    for (int a = 0; a < 3; a++)
+    {
+        e1[a] = c[1][a] - c[0][a];
+        e2[a] = c[2][a] - c[0][a];
+    }
+
+    n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+    n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+    n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+
+    x[0] = c[1][1] * c[2][2] - c[1][2] * c[2][1];
+    x[1] = c[1][2] * c[2][0] - c[1][0] * c[2][2];
+    x[2] = c[1][0] * c[2][1] - c[1][1] * c[2][0];
+
+    v4d len2 = n[0] * n[0] + n[1] * n[1] + n[2] * n[2];
+    v4d vol6 = c[0][0] * x[0] + c[0][1] * x[1] + c[0][2] * x[2];
+
+    for (int lane = 0; lane < lanes; lane++)
+    {
+        double vol = vol6[lane] / 6;
+
+        p.area += std::sqrt(len2[lane]) / 2;
+        p.volume += vol;
+
+        for (int a = 0; a < 3; a++)
+        {
+            double lo = std::min({c[0][a][lane], c[1][a][lane],
+                                  c[2][a][lane]});
+            double hi = std::max({c[0][a][lane], c[1][a][lane],
+                                  c[2][a][lane]});
+
+            p.min[a] = std::min(p.min[a], lo);
+            p.max[a] = std::max(p.max[a], hi);
+            p.moment[a] += vol * (c[0][a][lane] + c[1][a][lane] +
+                                  c[2][a][lane]) / 4;
+        }
+
+        if (len2[lane] == 0)
+        {
+            p.degenerate++;
+        }
+
+        /* Materialise color: bit 15 clear means the facet has its own. */
+
+        if (!(attr[lane] & 0x8000))
+        {
+            p.colored++;
+        }
+    }
+}
+
+partial block_stats(const mesh::stl &file, size_t begin, size_t end)
+{
+    partial p = {};
+    v4d c[3][3];
+    uint16_t attr[LANES];
+    size_t i = begin;
+
+    for (int a = 0; a < 3; a++)
+    {
+        p.min[a] = HUGE_VAL;
+        p.max[a] = -HUGE_VAL;
+    }
+
+    for (; i + LANES <= end; i += LANES)
+    {
+        load_lanes(file, i, c, attr);
+        add_lanes(p, c, attr, LANES);
+    }
+
+    if (i < end)
+    {
+        /* Tail: pad with copies of the last triangle, ignored. */
+
+        for (int lane = 0; lane < LANES; lane++)
+        {
+            size_t t = std::min(i + lane, end - 1);
+
+            for (int k = 0; k < 3; k++)
+            {
+                mesh::vec3 v = file.vertex(t, k);
+
+                c[k][0][lane] = v.x;
+                c[k][1][lane] = v.y;
+                c[k][2][lane] = v.z;
+            }
+
+            attr[lane] = file.attr(t);
+        }
+
+        add_lanes(p, c, attr, (int)(end - i));
+    }
+
+    return p;
+}
+
+} /* namespace */
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+namespace mesh
+{
+
+mapped_file::mapped_file(const std::string &path)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    struct stat st;
+
+    if (fd < 0)
+    {
+        throw sys_error("cannot open", path);
+    }
+
+    if (fstat(fd, &st) != 0)
+    {
+        close(fd);
+        throw sys_error("cannot stat", path);
+    }
+
+    m_size = st.st_size;
+
+    if (m_size > 0)
+    {
+        void *p = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+        if (p == MAP_FAILED)
+        {
+            close(fd);
+            throw sys_error("cannot map", path);
+        }
+
+        /* Read ahead, the tools go over the whole file. */
+
+        madvise(p, m_size, MADV_WILLNEED);
+        m_data = (const uint8_t *)p;
+    }
+
+    close(fd);
+}
+
+mapped_file::~mapped_file()
+{
+    if (m_data != nullptr)
+    {
+        munmap((void *)m_data, m_size);
+    }
+}
+
+stl::stl(const std::string &path)
+    : m_path(path), m_file(path)
+{
+    const uint8_t *p = m_file.data();
+    size_t size = m_file.size();
+    uint32_t count;
+
+    if (size >= 5 && memcmp(p, "solid", 5) == 0 &&
+        (size < STL_DATA_OFFSET ||
+         size != STL_DATA_OFFSET + (uint64_t)(p[80] | p[81] << 8 |
+             p[82] << 16 | (uint32_t)p[83] << 24) * STL_FACET_SIZE))
+    {
+        throw std::runtime_error(path + ": ASCII STL, not supported");
+    }
+
+    if (size < STL_DATA_OFFSET)
+    {
+        throw std::runtime_error(path + ": too short for a binary STL");
+    }
+
+    count = (uint32_t)(p[80] | p[81] << 8 | p[82] << 16 |
+                       (uint32_t)p[83] << 24);
+
+    if (size != STL_DATA_OFFSET + (uint64_t)count * STL_FACET_SIZE)
+    {
+        throw std::runtime_error(path + ": " + std::to_string(count) +
+                                 " triangles do not match the size of " +
+                                 std::to_string(size) + " bytes");
+    }
+
+    m_count = count;
+
+    /* Materialise Magics: "COLOR=" then the default color, RGBA. */
+
+    const uint8_t *end = p + STL_HEADER_SIZE;
+    const uint8_t *key = std::search(p, end, "COLOR=", "COLOR=" + 6);
+
+    if (end - key >= 6 + 4)
+    {
+        m_has_color = true;
+        memcpy(m_color, key + 6, 4);
+    }
+}
+
+std::string stl::header() const
+{
+    const char *p = (const char *)m_file.data();
+    size_t n = 0;
+
+    /* Text up to the first NUL or binary byte (the color), no padding. */
+
+    while (n < STL_HEADER_SIZE && p[n] >= ' ' && p[n] <= '~')
+    {
+        n++;
+    }
+
+    while (n > 0 && p[n - 1] == ' ')
+    {
+        n--;
+    }
+
+    return std::string(p, n);
+}
+
+std::vector<std::string> stl_files(const std::vector<std::string> &paths)
+{
+    namespace fs = std::filesystem;
+    std::vector<std::string> files;
+
+    for (const std::string &path : paths)
+    {
+        if (!fs::is_directory(path))
+        {
+            files.push_back(path);
+            continue;
+        }
+
+        std::vector<std::string> dir;
+
+        for (const fs::directory_entry &e : fs::directory_iterator(path))
+        {
+            std::string ext = e.path().extension().string();
+
+            std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+
+            if (e.is_regular_file() && ext == ".stl")
+            {
+                dir.push_back(e.path().string());
+            }
+        }
+
+        std::sort(dir.begin(), dir.end());
+        files.insert(files.end(), dir.begin(), dir.end());
+    }
+
+    return files;
+}
+
+stats compute_stats(const stl &mesh, unsigned threads)
+{
+    size_t blocks = (mesh.size() + STATS_BLOCK - 1) / STATS_BLOCK;
+    std::vector<partial> parts(blocks);
+    stats s;
+
+    parallel_for(blocks, threads,
+        [&](size_t begin, size_t end, unsigned)
+        {
+            for (size_t b = begin; b < end; b++)
+            {
+                parts[b] = block_stats(mesh, b * STATS_BLOCK,
+                    std::min(mesh.size(), (b + 1) * STATS_BLOCK));
+            }
+        }, 4);
+
+    double min[3] = { HUGE_VAL, HUGE_VAL, HUGE_VAL };
+    double max[3] = { -HUGE_VAL, -HUGE_VAL, -HUGE_VAL };
+    double moment[3] = {};
+
+    for (const partial &p : parts)
+    {
+        for (int a = 0; a < 3; a++)
+        {
+            min[a] = std::min(min[a], p.min[a]);
+            max[a] = std::max(max[a], p.max[a]);
+            moment[a] += p.moment[a];
+        }
+
+        s.area += p.area;
+        s.volume += p.volume;
+        s.degenerate += p.degenerate;
+        s.colored += p.colored;
+    }
+
+    if (mesh.size() == 0)
+    {
+        std::fill(min, min + 3, 0.0);
+        std::fill(max, max + 3, 0.0);
+    }
+
+    s.min = { (float)min[0], (float)min[1], (float)min[2] };
+    s.max = { (float)max[0], (float)max[1], (float)max[2] };
+
+    for (int a = 0; a < 3; a++)
+    {
+        s.centroid[a] = s.volume != 0 ? moment[a] / s.volume : 0;
+    }
+
+    return s;
+}
+
+} /* namespace mesh */
@@ -0,0 +1,171 @@
+/****************************************************************************
+ * tools/mesh/stl.hpp
+ * Tomatotificatorul
+ *
+ * Copyright 2021 Iulian-Razvan Matesica <iulian.matesica@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ****************************************************************************/
+
+#ifndef __TOOLS_MESH_STL_HPP
+#define __TOOLS_MESH_STL_HPP
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+/* Binary STL: 80 byte header, uint32 triangle count, then per triangle
+ * the normal and 3 vertices as float32 and a uint16 attribute, all little
+ * endian and packed, so the records are not 4 byte aligned.
+ */
+
+#define STL_HEADER_SIZE   80
+#define STL_DATA_OFFSET   84
+#define STL_FACET_SIZE    50
+#define STL_ATTR_OFFSET   48
+
+/****************************************************************************
+ * Public Types
+ ****************************************************************************/
+
+namespace mesh
+{
+
+struct vec3
+{
+    float x, y, z;
+};
+
+/* A read-only memory mapping of a whole file. */
+
+class mapped_file
+{
+public:
+    /* Throws std::runtime_error on I/O errors. */
+
+    explicit mapped_file(const std::string &path);
+    ~mapped_file();
+
+    mapped_file(const mapped_file &) = delete;
+    mapped_file &operator=(const mapped_file &) = delete;
+
+    const uint8_t *data() const { return m_data; }
+    size_t size() const { return m_size; }
+
+private:
+    const uint8_t *m_data = nullptr;
+    size_t m_size = 0;
+};
+
+/* A binary STL read in place from its mapping, without copying the
+ * facets. Only little endian hosts are supported.
+ */
+
+class stl
+{
+public:
+    /* Throws std::runtime_error when the file cannot be read, is ASCII or
+     * its triangle count does not match its size.
+     */
+
+    explicit stl(const std::string &path);
+
+    const std::string &path() const { return m_path; }
+    size_t size() const { return m_count; }
+    const uint8_t *facets() const { return m_file.data() + STL_DATA_OFFSET; }
+
+    /* The 80 header bytes as they are. */
+
+    const uint8_t *raw_header() const { return m_file.data(); }
+
+    /* The text of the header, e.g. "STLB ATF 9.10.0.1330 COLOR=". */
+
+    std::string header() const;
+
+    /* Materialise 'COLOR=' header: default facet color, RGBA. */
+
+    bool has_color() const { return m_has_color; }
+    const uint8_t *color() const { return m_color; }
+
+    /* Vertex k (0..2) of triangle i. */
+
+    vec3 vertex(size_t i, int k) const
+    {
+        vec3 v;
+
+        memcpy(&v, facets() + i * STL_FACET_SIZE + 12 + k * 12, sizeof(v));
+        return v;
+    }
+
+    vec3 normal(size_t i) const
+    {
+        vec3 v;
+
+        memcpy(&v, facets() + i * STL_FACET_SIZE, sizeof(v));
+        return v;
+    }
+
+    uint16_t attr(size_t i) const
+    {
+        const uint8_t *p = facets() + i * STL_FACET_SIZE + STL_ATTR_OFFSET;
+
+        return (uint16_t)(p[0] | p[1] << 8);
+    }
+
+private:
+    std::string m_path;
+    mapped_file m_file;
+    size_t m_count = 0;
+    bool m_has_color = false;
+    uint8_t m_color[4] = {};
+};
+
+struct stats
+{
+    vec3 min, max;
+    double area = 0;           /* mm^2 for the enclosure files */
+    double volume = 0;         /* Signed, > 0 for outward normals */
+    double centroid[3] = {};   /* Of the enclosed volume */
+    size_t degenerate = 0;     /* Triangles of zero area */
+    size_t colored = 0;        /* Facets with their own color attribute */
+};
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/* The files of 'paths', each directory replaced by its *.stl files in
+ * name order.
+ */
+
+std::vector<std::string> stl_files(const std::vector<std::string> &paths);
+
+/* Computes the statistics of the whole mesh with 'threads' workers (0 =
+ * all cores). The result does not depend on the worker count.
+ */
+
+stats compute_stats(const stl &mesh, unsigned threads);
+
+} /* namespace mesh */
+
+#endif /* __TOOLS_MESH_STL_HPP */
@@ -0,0 +1,440 @@
+/****************************************************************************
+ * tools/mesh/weld.cpp
+ * Tomatotificatorul
+ *
+ * Copyright 2021 Iulian-Razvan Matesica <iulian.matesica@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ****************************************************************************/
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include "indexed.hpp"
+#include "parallel.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+/* Grid coordinates are packed 21 bits per axis into a 63 bit key; bit 63
+ * is always set, so 0 marks a free cell.
+ */
+
+#define KEY_BITS     21
+#define KEY_RANGE    (1 << (KEY_BITS - 1))
+#define KEY_USED     (1ull << 63)
+
+#define NO_CORNER    UINT32_MAX
+
+/****************************************************************************
+ * Private Types
+ ****************************************************************************/
+
+namespace
+{
+
+/* Open addressing with linear probing, one cell per probe and four cells
+ * per cache line. Inserts race through a CAS on the key, the first
+ * corner of a vertex is an atomic minimum.
+ */
+
+struct alignas(16) cell
+{
+    std::atomic<uint64_t> key;
+    std::atomic<uint32_t> first;
+    uint32_t id;
+};
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+/* Grid cell of 'v', 'scale' is 1 / tolerance. Returns 0 if 'v' is off
+ * the grid.
+ */
+
+uint64_t grid_key(const mesh::vec3 &v, double scale)
+{
+    const float c[3] = { v.x, v.y, v.z };
+    uint64_t key = KEY_USED;
+
+    for (int a = 0; a < 3; a++)
+    {
+        double x = c[a] * scale;
+
+        if (!(x >= -KEY_RANGE && x < KEY_RANGE))
+        {
+            return 0;
+        }
+
+        /* floor(), without the libm call of plain x86-64. */
+
+        int64_t q = (int64_t)x;
+
+        q -= x < q;
+        key |= (uint64_t)(q + KEY_RANGE) << (a * KEY_BITS);
+    }
+
+    return key;
+}
+
+/* Fibonacci hashing, the top 'bits' bits of the product. */
+
+size_t hash_key(uint64_t key, int bits)
+{
+    return (size_t)((key * 0x9e3779b97f4a7c15ull) >> (64 - bits));
+}
+
+void atomic_min(std::atomic<uint32_t> &a, uint32_t val)
+{
+    uint32_t cur = a.load(std::memory_order_relaxed);
+
+    while (val < cur &&
+           !a.compare_exchange_weak(cur, val, std::memory_order_relaxed))
+    {
+    }
+}
+
+enum weld_result
+{
+    WELD_OK,
+    WELD_FULL,
+    WELD_OFF_GRID,
+};
+
+/* One weld attempt with a table of 2^bits cells. */
+
+weld_result weld_table(const mesh::stl &file, float tolerance,
+                       unsigned threads, int bits, mesh::indexed &out)
+{
+    size_t corners = file.size() * 3;
+    size_t cap = (size_t)1 << bits;
+    size_t mask = cap - 1;
+    double scale = 1.0 / tolerance;
+    std::unique_ptr<cell[]> table(new cell[cap]);
+    std::vector<uint32_t> slot(corners);
+    std::vector<size_t> firsts(mesh::thread_count(threads));
+    std::atomic<size_t> used(0);
+    std::atomic<bool> off_grid(false);
+    std::atomic<bool> full(false);
+
+    mesh::parallel_for(cap, threads, [&](size_t begin, size_t end, unsigned)
+    {
+        for (size_t i = begin; i < end; i++)
+        {
+            table[i].key.store(0, std::memory_order_relaxed);
+            table[i].first.store(NO_CORNER, std::memory_order_relaxed);
+        }
+    });
+
+    /* 1. Every corner finds or claims the cell of its grid key. */
+
+    mesh::parallel_for(file.size(), threads,
+        [&](size_t begin, size_t end, unsigned)
+        {
+            cell *t = table.get();
+            uint32_t *corner_slot = slot.data();
+
+            for (size_t i = begin; i < end; i++)
+            {
+                for (int k = 0; k < 3; k++)
+                {
+                    uint32_t c = (uint32_t)(3 * i + k);
+                    uint64_t key = grid_key(file.vertex(i, k), scale);
+                    size_t pos = hash_key(key, bits);
+
+                    if (key == 0)
+                    {
+                        off_grid = true;
+                        return;
+                    }
+
+                    for (;;)
+                    {
+                        uint64_t cur = t[pos].key.load(
+                            std::memory_order_relaxed);
+
+                        if (cur == 0 && t[pos].key.compare_exchange_strong(
+                                            cur, key,
+                                            std::memory_order_relaxed))
+                        {
+                            if (used.fetch_add(1, std::memory_order_relaxed)
+                                >= cap / 4 * 3)
+                            {
+                                full = true;
+                                return;
+                            }
+
+                            break;
+                        }
+
+                        if (cur == key)
+                        {
+                            break;
+                        }
+
+                        pos = (pos + 1) & mask;
+                    }
+
+                    atomic_min(t[pos].first, c);
+                    corner_slot[c] = (uint32_t)pos;
+                }
+            }
+        }, 1024);
+
+    if (off_grid)
+    {
+        return WELD_OFF_GRID;
+    }
+
+    if (full)
+    {
+        return WELD_FULL;
+    }
+
+    /* 2. Number the vertices by their first corner: flag the first
+     *    corners from the table, count them per chunk, then each chunk
+     *    numbers from its offset. The chunks are the same in both passes
+     *    and only the first corners touch the table again.
+     */
+
+    std::vector<uint8_t> is_first(corners);
+
+    mesh::parallel_for(cap, threads, [&](size_t begin, size_t end, unsigned)
+    {
+        for (size_t i = begin; i < end; i++)
+        {
+            if (table[i].key.load(std::memory_order_relaxed) != 0)
+            {
+                is_first[table[i].first.load(std::memory_order_relaxed)] = 1;
+            }
+        }
+    });
+
+    mesh::parallel_for(corners, threads,
+        [&](size_t begin, size_t end, unsigned w)
+        {
+            size_t n = 0;
+
+            for (size_t c = begin; c < end; c++)
+            {
+                n += is_first[c];
+            }
+
+            firsts[w] = n;
+        });
+
+    size_t total = 0;
+
+    for (size_t &n : firsts)
+    {
+        size_t chunk = n;
+
+        n = total;
+        total += chunk;
+    }
+
+    out.vertices.resize(total);
+    out.indices.resize(corners);
+
+    mesh::parallel_for(corners, threads,
+        [&](size_t begin, size_t end, unsigned w)
+        {
+            uint32_t id = (uint32_t)firsts[w];
+
+            for (size_t c = begin; c < end; c++)
+            {
+                if (is_first[c])
+                {
+                    table[slot[c]].id = id;
+                    out.vertices[id++] = file.vertex(c / 3, c % 3);
+                }
+            }
+        });
+
+    /* 3. The ids are all set, map every corner. */
+
+    mesh::parallel_for(corners, threads,
+        [&](size_t begin, size_t end, unsigned)
+        {
+            for (size_t c = begin; c < end; c++)
+            {
+                out.indices[c] = table[slot[c]].id;
+            }
+        });
+
+    return WELD_OK;
+}
+
+} /* namespace */
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+namespace mesh
+{
+
+indexed weld(const stl &file, float tolerance, unsigned threads)
+{
+    size_t corners = file.size() * 3;
+    indexed out;
+    int bits = 4;
+
+    if (corners >= NO_CORNER)
+    {
+        throw std::runtime_error("too many triangles to weld");
+    }
+
+    /* A closed mesh has about one vertex per 6 corners, so start with a
+     * table for corners / 2, a quarter of the size for no shared corners,
+     * and grow it 4 times if it gets 3/4 full.
+     */
+
+    while (((size_t)1 << bits) < corners / 2)
+    {
+        bits++;
+    }
+
+    for (;;)
+    {
+        switch (weld_table(file, tolerance, threads, bits, out))
+        {
+            case WELD_OK:
+                return out;
+
+            case WELD_FULL:
+                bits += 2;
+                break;
+
+            case WELD_OFF_GRID:
+                throw std::runtime_error("mesh too large for the weld "
+                                         "tolerance");
+        }
+    }
+}
+
+void save_ply(const indexed &mesh, const std::string &path)
+{
+    FILE *f = fopen(path.c_str(), "wb");
+
+    if (f == nullptr)
+    {
+        throw std::runtime_error("cannot create " + path + ": " +
+                                 strerror(errno));
+    }
+
+    fprintf(f, "ply\n"
+               "format binary_little_endian 1.0\n"
+               "element vertex %zu\n"
+               "property float x\n"
+               "property float y\n"
+               "property float z\n"
+               "element face %zu\n"
+               "property list uchar uint vertex_indices\n"
+               "end_header\n",
+            mesh.vertices.size(), mesh.triangles());
+
+    fwrite(mesh.vertices.data(), sizeof(vec3), mesh.vertices.size(), f);
+
+    for (size_t t = 0; t < mesh.triangles(); t++)
+    {
+        uint8_t n = 3;
+
+        fwrite(&n, 1, 1, f);
+        fwrite(&mesh.indices[3 * t], sizeof(uint32_t), 3, f);
+    }
+
+    if (ferror(f) | fclose(f))
+    {
+        throw std::runtime_error("cannot write " + path);
+    }
+}
+
+void save_stl(const indexed &mesh, const std::string &path,
+              const std::string &header, const std::vector<uint16_t> *attrs)
+{
+    FILE *f = fopen(path.c_str(), "wb");
+    char head[STL_HEADER_SIZE] = {};
+    uint32_t count = (uint32_t)mesh.triangles();
+
+    if (f == nullptr)
+    {
+        throw std::runtime_error("cannot create " + path + ": " +
+                                 strerror(errno));
+    }
+
+    memcpy(head, header.data(), std::min(header.size(), sizeof(head)));
+    fwrite(head, 1, sizeof(head), f);
+    fwrite(&count, sizeof(count), 1, f);
+
+    for (size_t t = 0; t < mesh.triangles(); t++)
+    {
+        unsigned char facet[STL_FACET_SIZE] = {};
+        const vec3 *v[3];
+
+        for (int k = 0; k < 3; k++)
+        {
+            v[k] = &mesh.vertices[mesh.indices[3 * t + k]];
+        }
+
+        double e1[3] = { (double)v[1]->x - v[0]->x, (double)v[1]->y - v[0]->y,
+                         (double)v[1]->z - v[0]->z };
+        double e2[3] = { (double)v[2]->x - v[0]->x, (double)v[2]->y - v[0]->y,
+                         (double)v[2]->z - v[0]->z };
+        double n[3] = { e1[1] * e2[2] - e1[2] * e2[1],
+                        e1[2] * e2[0] - e1[0] * e2[2],
+                        e1[0] * e2[1] - e1[1] * e2[0] };
+        double len = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        vec3 normal = { 0, 0, 0 };
+
+        if (len > 0)
+        {
+            normal = { (float)(n[0] / len), (float)(n[1] / len),
+                       (float)(n[2] / len) };
+        }
+
+        memcpy(facet, &normal, sizeof(normal));
+
+        for (int k = 0; k < 3; k++)
+        {
+            memcpy(facet + sizeof(vec3) * (k + 1), v[k], sizeof(vec3));
+        }
+
+        if (attrs != nullptr)
+        {
+            facet[STL_ATTR_OFFSET] = (uint8_t)(*attrs)[t];
+            facet[STL_ATTR_OFFSET + 1] = (uint8_t)((*attrs)[t] >> 8);
+        }
+
+        fwrite(facet, 1, sizeof(facet), f);
+    }
+
+    if (ferror(f) | fclose(f))
+    {
+        throw std::runtime_error("cannot write " + path);
+    }
+}
+
+} /* namespace mesh */
@@ -0,0 +1,523 @@
+/****************************************************************************
+ * tools/sim/faultsim.cpp
+ * Tomatotificatorul
+ *
+ * Copyright 2021 Iulian-Razvan Matesica <iulian.matesica@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ****************************************************************************/
+
+/* Runs the firmware on the host MCU model (mcu.hpp) with injected faults
+ * and reports what each one costs against a fault-free run: waterings,
+ * pump time, water and energy.
+ *
+ *   faultsim                           built-in fault suite
+ *   faultsim --brownout 1 --stuck 0:60 one custom fault set
+ *   faultsim -f fixed.so               the same, on another build
+ *
+ * Faults:
+ *   - brown-out resets when the pump starts (sagging battery), with the
+ *     reset 'brownout-delay' seconds into the watering,
+ *   - resets at random times,
+ *   - the water button held low, also across power-up,
+ *   - ADC noise and full-scale spikes,
+ *   - Timer0 interrupts stalled for a while.
+ *
+ * Scenario: the duration pot at 2.5V, the solar panel following a clear
+ * day from 07:00 to 19:00, time of day 00:00 at the start. With --site
+ * the panel follows the clear sky year of that site instead (solar.hpp),
+ * from --start-day.
+ */
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include "mcu.hpp"
+#include "solar.hpp"
+#include "cli.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+#define SECONDS_PER_DAY  86400.0
+
+/* Panel divider of the board, R1 = 47K, R2 = 10K, and the open circuit
+ * voltage at noon.
+ */
+
+#define SOLAR_DIVIDER    (10.0 / 57.0)
+#define SOLAR_PEAK_V     21.0
+#define SUNRISE_H        7.0
+#define SUNSET_H         19.0
+
+/* Status LED, 10mA at 5V. */
+
+#define LED_W            0.05
+#define VCC              5.0
+
+/****************************************************************************
+ * Private Types
+ ****************************************************************************/
+
+struct faults
+{
+    double brownout = 0;        /* Probability per pump start */
+    double brownout_delay = 2;  /* Seconds of pumping before the reset */
+    double resets = 0;          /* Random resets per day */
+    double stuck_at = -1;       /* PB1 held low from, seconds */
+    double stuck_for = 0;
+    double noise = 0;           /* ADC noise, LSB standard deviation */
+    double spikes = 0;          /* Probability per conversion */
+    double stalls = 0;          /* Timer0 stalls per day */
+    double stall_ms = 0;
+
+    bool any() const
+    {
+        return brownout > 0 || resets > 0 || stuck_at >= 0 || noise > 0 ||
+               spikes > 0 || stalls > 0;
+    }
+};
+
+struct scenario
+{
+    const char *name;
+    faults f;
+};
+
+struct options
+{
+    std::string device = "attiny13";
+    std::string firmware;
+    double clock = 0;
+    double days = 2;
+    unsigned seed = 1;
+    double pot = 2.5;
+    double flow = 20;           /* mL/s */
+    double pump_w = 6;          /* 12V, 0.5A */
+    bool verbose = false;
+    faults f;
+    bool use_site = false;
+    sim::site site;
+    double start_day = 0;
+    sim::panel panel;
+    std::vector<float> trace;   /* Panel volts, with use_site */
+};
+
+struct result
+{
+    sim::stats st;
+    double water_ml;
+    double energy_j;
+};
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+static const scenario g_suite[] =
+{
+    { "baseline",       {} },
+    { "brownout-25%",   { .brownout = 0.25 } },
+    { "brownout-100%",  { .brownout = 1 } },
+    { "resets-24/day",  { .resets = 24 } },
+    { "stuck-1h",       { .stuck_at = 10 * 3600, .stuck_for = 3600 } },
+    { "stuck-at-boot",  { .stuck_at = 0, .stuck_for = 600 } },
+    { "adc-noise-8",    { .noise = 8 } },
+    { "adc-spikes-1%",  { .spikes = 0.01 } },
+    { "timer-stall",    { .stalls = 200, .stall_ms = 300 } },
+};
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+static void usage(void)
+{
+    fprintf(stderr,
+        "usage: faultsim [options]\n"
+        "  -m DEVICE            attiny13 (default), attiny25, attiny45, "
+        "attiny85\n"
+        "  -f FIRMWARE.so       firmware (default sim/DEVICE.so next to "
+        "faultsim)\n"
+        "  --clock HZ           real clock of the unit\n"
+        "  -d DAYS              days per run (default 2)\n"
+        "  -s SEED              random seed (default 1)\n"
+        "  --pot V              duration pot voltage (default 2.5)\n"
+        "  --flow ML_S          pump flow (default 20)\n"
+        "  --pump-w W           pump power (default 6)\n"
+        "  -v                   print every watering\n"
+        "  --site SITE          LAT:LON:AZIMUTH:TILT, clear sky year of a "
+        "balcony\n"
+        "  --horizon LIST       its skyline, see solartrace\n"
+        "  --start-day N        day of the year at the start (default 0)\n"
+        "  --panel-load OHMS    load on the panel (default open circuit)\n"
+        "faults, any of them replaces the built-in suite:\n"
+        "  --brownout P         probability a pump start resets the MCU\n"
+        "  --brownout-delay S   seconds into the watering (default 2)\n"
+        "  --resets N           random resets per day\n"
+        "  --stuck T:D          PB1 low from T for D seconds\n"
+        "  --noise LSB          ADC noise, standard deviation\n"
+        "  --spikes P           full-scale ADC spike probability\n"
+        "  --stall N:MS         N Timer0 stalls of MS ms per day\n");
+    exit(2);
+}
+
+static void parse_pair(const char *s, double &a, double &b)
+{
+    std::string str = s;
+    size_t colon = str.find(':');
+
+    if (colon == std::string::npos)
+    {
+        throw std::runtime_error(std::string("expected A:B, got ") + s);
+    }
+
+    a = cli::parse_num(str.substr(0, colon).c_str());
+    b = cli::parse_num(str.substr(colon + 1).c_str());
+}
+
+static options parse_args(int argc, char **argv)
+{
+    options opt;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool has_val = i + 1 < argc;
+
+        if (arg == "-v")
+        {
+            opt.verbose = true;
+        }
+        else if (!has_val)
+        {
+            usage();
+        }
+        else if (arg == "-m")
+        {
+            opt.device = argv[++i];
+        }
+        else if (arg == "-f")
+        {
+            opt.firmware = argv[++i];
+        }
+        else if (arg == "--clock")
+        {
+            opt.clock = cli::parse_num(argv[++i]);
+        }
+        else if (arg == "-d")
+        {
+            opt.days = cli::parse_num(argv[++i]);
+        }
+        else if (arg == "-s")
+        {
+            opt.seed = (unsigned)cli::parse_num(argv[++i]);
+        }
+        else if (arg == "--pot")
+        {
+            opt.pot = cli::parse_num(argv[++i]);
+        }
+        else if (arg == "--flow")
+        {
+            opt.flow = cli::parse_num(argv[++i]);
+        }
+        else if (arg == "--pump-w")
+        {
+            opt.pump_w = cli::parse_num(argv[++i]);
+        }
+        else if (arg == "--site")
+        {
+            double lat, lon, az, tilt;
+
+            if (sscanf(argv[++i], "%lf:%lf:%lf:%lf", &lat, &lon, &az,
+                       &tilt) != 4)
+            {
+                usage();
+            }
+
+            opt.use_site = true;
+            opt.site.lat = lat;
+            opt.site.lon = lon;
+            opt.site.azimuth = az;
+            opt.site.tilt = tilt;
+            opt.site.tz = std::round(lon / 15);
+        }
+        else if (arg == "--horizon")
+        {
+            std::string list = argv[++i];
+            size_t pos = 0;
+
+            opt.site.horizon.clear();
+
+            while (pos <= list.size())
+            {
+                size_t comma = std::min(list.find(',', pos), list.size());
+
+                opt.site.horizon.push_back(
+                    cli::parse_num(list.substr(pos, comma - pos).c_str()));
+                pos = comma + 1;
+            }
+        }
+        else if (arg == "--panel-load")
+        {
+            opt.panel.load = cli::parse_num(argv[++i]);
+        }
+        else if (arg == "--start-day")
+        {
+            opt.start_day = cli::parse_num(argv[++i]);
+        }
+        else if (arg == "--brownout")
+        {
+            opt.f.brownout = cli::parse_num(argv[++i]);
+        }
+        else if (arg == "--brownout-delay")
+        {
+            opt.f.brownout_delay = cli::parse_num(argv[++i]);
+        }
+        else if (arg == "--resets")
+        {
+            opt.f.resets = cli::parse_num(argv[++i]);
+        }
+        else if (arg == "--stuck")
+        {
+            parse_pair(argv[++i], opt.f.stuck_at, opt.f.stuck_for);
+        }
+        else if (arg == "--noise")
+        {
+            opt.f.noise = cli::parse_num(argv[++i]);
+        }
+        else if (arg == "--spikes")
+        {
+            opt.f.spikes = cli::parse_num(argv[++i]);
+        }
+        else if (arg == "--stall")
+        {
+            parse_pair(argv[++i], opt.f.stalls, opt.f.stall_ms);
+        }
+        else
+        {
+            usage();
+        }
+    }
+
+    return opt;
+}
+
+/* Panel voltage on ADC2 over a clear day, time of day 00:00 at t = 0. */
+
+static double solar_volts(double t)
+{
+    double h = fmod(t, SECONDS_PER_DAY) / 3600;
+
+    if (h <= SUNRISE_H || h >= SUNSET_H)
+    {
+        return 0;
+    }
+
+    return SOLAR_PEAK_V * SOLAR_DIVIDER *
+           sin(M_PI * (h - SUNRISE_H) / (SUNSET_H - SUNRISE_H));
+}
+
+static result run(const options &opt, const sim::device &dev,
+                  const faults &f)
+{
+    sim::mcu m(opt.firmware, dev, opt.clock);
+    std::mt19937 rng(opt.seed);
+    std::uniform_real_distribution<double> uniform(0, 1);
+    std::normal_distribution<double> normal(0, 1);
+    double seconds = opt.days * SECONDS_PER_DAY;
+    result r;
+
+    m.adc_input = [&](double t, uint8_t channel)
+    {
+        if (channel == 3)
+        {
+            return opt.pot;
+        }
+
+        if (opt.use_site)
+        {
+            return sim::solar_at(opt.trace, t + opt.start_day *
+                                 SECONDS_PER_DAY) * SOLAR_DIVIDER;
+        }
+
+        return solar_volts(t);
+    };
+
+    if (f.noise > 0 || f.spikes > 0)
+    {
+        m.adc_fault = [&](double, uint8_t, uint16_t raw) -> uint16_t
+        {
+            double val = raw + f.noise * normal(rng);
+
+            if (f.spikes > 0 && uniform(rng) < f.spikes)
+            {
+                val = uniform(rng) < 0.5 ? 1023 : 0;
+            }
+
+            return (uint16_t)std::lround(std::clamp(val, 0.0, 1023.0));
+        };
+    }
+
+    if (f.brownout > 0)
+    {
+        m.on_pump = [&](double t, bool on)
+        {
+            if (on && uniform(rng) < f.brownout)
+            {
+                m.reset_at(t + f.brownout_delay);
+            }
+        };
+    }
+
+    for (int i = 0; i < std::lround(f.resets * opt.days); i++)
+    {
+        m.reset_at(uniform(rng) * seconds);
+    }
+
+    if (f.stuck_at >= 0)
+    {
+        m.press(f.stuck_at, f.stuck_at + f.stuck_for);
+    }
+
+    for (int i = 0; i < std::lround(f.stalls * opt.days); i++)
+    {
+        double start = uniform(rng) * seconds;
+
+        m.stall(start, start + f.stall_ms / 1e3);
+    }
+
+    m.run(seconds);
+
+    r.st = m.stats();
+    r.water_ml = r.st.pump_s * opt.flow;
+    r.energy_j = r.st.pump_s * opt.pump_w + r.st.led_s * LED_W +
+                 (r.st.active_mas + r.st.idle_mas) / 1e3 * VCC;
+
+    return r;
+}
+
+static void print_log(const result &r)
+{
+    for (const sim::watering &w : r.st.log)
+    {
+        int s = (int)w.start;
+
+        printf("    day %d %02d:%02d:%02d  %6.1fs\n", s / 86400,
+               s / 3600 % 24, s / 60 % 60, s % 60, w.seconds);
+    }
+}
+
+static void print_row(const char *name, const result &r, const result &base)
+{
+    printf("%-15s %6u %8u %9.1f %10.0f %9.0f %+9.0f %+9.1f %+9.0f %+8.1f\n",
+           name, r.st.resets, r.st.waterings, r.st.pump_s, r.water_ml,
+           r.energy_j, r.water_ml - base.water_ml, r.st.pump_s - base.st.pump_s,
+           r.energy_j - base.energy_j, r.st.clock_error_s);
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+int main(int argc, char **argv)
+{
+    try
+    {
+        options opt = parse_args(argc, argv);
+        const sim::device *dev = sim::find_device(opt.device);
+
+        if (dev == nullptr)
+        {
+            throw std::runtime_error("unknown device " + opt.device);
+        }
+
+        if (opt.firmware.empty())
+        {
+            std::string self = argv[0];
+            size_t slash = self.rfind('/');
+
+            opt.firmware = (slash == std::string::npos ?
+                            std::string(".") : self.substr(0, slash)) +
+                           "/sim/" + opt.device + ".so";
+        }
+
+        if (opt.clock == 0)
+        {
+            opt.clock = dev->clock;
+        }
+
+        if (opt.use_site)
+        {
+            opt.trace = sim::solar_year(opt.site, opt.panel).volts;
+        }
+
+        std::vector<scenario> runs;
+
+        if (opt.f.any())
+        {
+            runs.push_back(g_suite[0]);
+            runs.push_back({ "custom", opt.f });
+        }
+        else
+        {
+            runs.assign(std::begin(g_suite), std::end(g_suite));
+        }
+
+        printf("%s, %g days, pot %.2fV, pump %gW %gmL/s\n",
+               opt.firmware.c_str(), opt.days, opt.pot, opt.pump_w,
+               opt.flow);
+        printf("%-15s %6s %8s %9s %10s %9s %9s %9s %9s %8s\n",
+               "fault", "resets", "waterings", "pump s", "water mL",
+               "energy J", "+water", "+pump s", "+J", "clock s");
+
+        result base = run(opt, *dev, runs[0].f);
+
+        print_row(runs[0].name, base, base);
+
+        if (opt.verbose)
+        {
+            print_log(base);
+        }
+
+        for (size_t i = 1; i < runs.size(); i++)
+        {
+            result r = run(opt, *dev, runs[i].f);
+
+            print_row(runs[i].name, r, base);
+
+            if (opt.verbose)
+            {
+                print_log(r);
+            }
+        }
+    }
+    catch (const std::exception &e)
+    {
+        fprintf(stderr, "faultsim: %s\n", e.what());
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,878 @@
+/****************************************************************************
+ * tools/sim/mcu.cpp
+ * Tomatotificatorul
+ *
+ * Copyright 2021 Iulian-Razvan Matesica <iulian.matesica@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ****************************************************************************/
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include "mcu.hpp"
+
+#include <dlfcn.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+/* Bits, as in shim/avr/io.h. */
+
+#define BIT(n)              (1 << (n))
+
+#define SREG_I              7
+#define MCUCR_SE            5
+#define GIMSK_INT0          6
+#define GIFR_INTF0          6
+#define TIMSK_TOIE0         1
+#define TIMSK_OCIE0A        2
+#define TIFR_TOV0           1
+#define TIFR_OCF0A          2
+#define CLKPR_CLKPCE        7
+#define ADCSRA_ADEN         7
+#define ADCSRA_ADSC         6
+#define ADCSRA_ADIF         4
+
+#define PIN_PUMP            0
+#define PIN_BUTTON          1
+#define PIN_LED             2
+
+/* CLKPR at reset: the CKDIV8 fuse is programmed. */
+
+#define CLKPR_RESET         3
+
+/* Rough cost of the firmware, in CPU cycles: one register access with
+ * the code around it, an interrupt entry plus prologue and epilogue,
+ * the wake-up from idle and one EEPROM byte write (3.4ms).
+ */
+
+#define ACCESS_CYCLES       4
+#define ISR_CYCLES          40
+#define WAKE_CYCLES         6
+#define EEPROM_WRITE_S      3.4e-3
+
+/* Start-up time after a reset (SUT fuses), seconds. */
+
+#define BOOT_S              0.064
+
+/* Supply current per MHz of CPU clock, ATtiny13 at 5V, typical. */
+
+#define ACTIVE_MA_PER_MHZ   0.5
+#define IDLE_MA_PER_MHZ     0.15
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+namespace
+{
+
+const sim::device g_devices[] =
+{
+    { "attiny13", 64,  1205583 },   /* Default calibration block */
+    { "attiny25", 128, 1000000 },
+    { "attiny45", 256, 1000000 },
+    { "attiny85", 512, 1000000 },
+};
+
+sim::mcu *g_mcu;
+
+} /* namespace */
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/* Hooks called by the firmware. */
+
+extern "C" uint8_t sim_io_read(uint8_t reg)
+{
+    return g_mcu->io_read(reg);
+}
+
+extern "C" void sim_io_write(uint8_t reg, uint8_t val)
+{
+    g_mcu->io_write(reg, val);
+}
+
+extern "C" void sim_sleep(void)
+{
+    g_mcu->sleep();
+}
+
+extern "C" void sim_delay_cycles(double cycles)
+{
+    g_mcu->delay(cycles);
+}
+
+extern "C" uint8_t sim_eeprom_read(uint16_t addr)
+{
+    return g_mcu->eeprom_read(addr);
+}
+
+extern "C" void sim_eeprom_write(uint16_t addr, uint8_t val)
+{
+    g_mcu->eeprom_write(addr, val);
+}
+
+namespace sim
+{
+
+const device *find_device(const std::string &name)
+{
+    for (const device &d : g_devices)
+    {
+        if (name == d.name)
+        {
+            return &d;
+        }
+    }
+
+    return nullptr;
+}
+
+mcu::mcu(const std::string &firmware, const device &dev, double clock)
+    : eeprom(dev.eeprom_size, 0xff),
+      m_firmware(firmware),
+      m_dev(dev),
+      m_rc(clock * 8)
+{
+    /* Fail early on a bad path, run() loads it again. */
+
+    load();
+    unload();
+}
+
+mcu::~mcu()
+{
+    unload();
+}
+
+void mcu::press(double start, double end)
+{
+    m_edges.emplace_back(cycles(start), true);
+    m_edges.emplace_back(cycles(end), false);
+    std::stable_sort(m_edges.begin(), m_edges.end(),
+                     [](const auto &a, const auto &b)
+                     {
+                         return a.first < b.first;
+                     });
+}
+
+void mcu::reset_at(double t)
+{
+    m_resets.insert(std::max(cycles(t), m_now));
+}
+
+void mcu::stall(double start, double end)
+{
+    m_stalls.emplace_back(cycles(start), cycles(end));
+    std::sort(m_stalls.begin(), m_stalls.end());
+}
+
+double mcu::time() const
+{
+    return seconds(m_now);
+}
+
+bool mcu::pump_on() const
+{
+    return m_pump;
+}
+
+void mcu::run(double secs)
+{
+    m_end = m_now + cycles(secs);
+    g_mcu = this;
+
+    for (;;)
+    {
+        load();
+
+        /* Everything below returns here through longjmp(), from deep in
+         * the firmware: no objects with destructors live in between.
+         */
+
+        int why = setjmp(m_jmp);
+
+        if (why == STOP_NONE)
+        {
+            power_on();
+            m_main();
+
+            /* main() returned: the AVR runs into the cli/sleep of the
+             * C runtime and stays there.
+             */
+
+            m_reg[SIM_SREG] = 0;
+            advance(m_end);
+        }
+
+        unload();
+
+        if (why != STOP_RESET)
+        {
+            break;
+        }
+
+        m_stats.resets++;
+    }
+
+    if (m_pump)
+    {
+        m_stats.pump_s += seconds(m_now - m_pump_since);
+        m_stats.log.push_back({ seconds(m_pump_since),
+                                seconds(m_now - m_pump_since) });
+    }
+
+    if (m_led)
+    {
+        m_stats.led_s += seconds(m_now - m_led_since);
+    }
+
+    m_stats.clock_error_s = (double)m_fw_seconds - seconds(m_now - m_boot);
+    g_mcu = nullptr;
+}
+
+/****************************************************************************
+ * Hooks
+ ****************************************************************************/
+
+uint8_t mcu::io_read(uint8_t reg)
+{
+    uint8_t val;
+
+    spend(ACCESS_CYCLES);
+
+    switch (reg)
+    {
+        case SIM_PINB:
+        {
+            uint8_t ddr = m_reg[SIM_DDRB];
+
+            /* Inputs read high (pull-up or idle line) except a pressed
+             * button; outputs read back PORTB.
+             */
+
+            val = ~ddr & 0x3f & ~(m_pb1_low ? BIT(PIN_BUTTON) : 0);
+            val |= m_reg[SIM_PORTB] & ddr;
+            break;
+        }
+
+        case SIM_TCNT0:
+        case SIM_TIFR0:
+            timer_sync();
+            val = m_reg[reg];
+            break;
+
+        default:
+            val = m_reg[reg];
+            break;
+    }
+
+    poll_interrupts();
+    return val;
+}
+
+void mcu::io_write(uint8_t reg, uint8_t val)
+{
+    bool sei = false;
+
+    spend(ACCESS_CYCLES);
+
+    if (reg != SIM_CLKPR)
+    {
+        m_clkpr_armed = false;
+    }
+
+    switch (reg)
+    {
+        case SIM_PORTB:
+        case SIM_DDRB:
+            m_reg[reg] = val;
+            pins_changed();
+            break;
+
+        case SIM_PINB:
+            m_reg[SIM_PORTB] ^= val;
+            pins_changed();
+            break;
+
+        case SIM_GIFR:
+            m_reg[reg] &= ~val;
+            break;
+
+        case SIM_TIFR0:
+            timer_sync();
+            m_reg[reg] &= ~val;
+            break;
+
+        case SIM_TCNT0:
+        case SIM_OCR0A:
+        case SIM_TCCR0B:
+            timer_sync();
+            m_reg[reg] = val;
+            break;
+
+        case SIM_CLKPR:
+            if (val & BIT(CLKPR_CLKPCE))
+            {
+                m_clkpr_armed = true;
+            }
+            else if (m_clkpr_armed)
+            {
+                /* Restart the I/O clock count at the new rate. */
+
+                timer_sync();
+                m_io_base = m_io_last;
+                m_io_epoch = m_now;
+                m_reg[reg] = val & 0x0f;
+                m_clkpr_armed = false;
+            }
+            break;
+
+        case SIM_ADCSRA:
+        {
+            uint8_t old = m_reg[reg];
+
+            m_reg[reg] = (val & ~BIT(ADCSRA_ADIF)) |
+                         (old & BIT(ADCSRA_ADIF) & ~val);
+
+            if (!(val & BIT(ADCSRA_ADEN)))
+            {
+                m_reg[reg] &= ~BIT(ADCSRA_ADSC);
+                m_adc_done = UINT64_MAX;
+                m_adc_first = true;
+            }
+            else if ((val & BIT(ADCSRA_ADSC)) &&
+                     m_adc_done == UINT64_MAX)
+            {
+                adc_start();
+            }
+            break;
+        }
+
+        case SIM_SREG:
+            sei = !(m_reg[reg] & BIT(SREG_I)) && (val & BIT(SREG_I));
+            m_reg[reg] = val;
+            break;
+
+        case SIM_ADCL:
+        case SIM_ADCH:
+            break;
+
+        default:
+            m_reg[reg] = val;
+            break;
+    }
+
+    /* The instruction after SEI runs before any interrupt. */
+
+    if (sei)
+    {
+        m_sei_shadow = true;
+        return;
+    }
+
+    poll_interrupts();
+}
+
+void mcu::sleep()
+{
+    spend(1);
+
+    if (!(m_reg[SIM_MCUCR] & BIT(MCUCR_SE)))
+    {
+        return;
+    }
+
+    m_sei_shadow = false;
+
+    if (!(m_reg[SIM_SREG] & BIT(SREG_I)))
+    {
+        /* Nothing can wake it up. */
+
+        m_sleeping = true;
+        advance(m_end);
+    }
+
+    m_sleeping = true;
+
+    while (!interrupt_pending())
+    {
+        advance(next_event());
+    }
+
+    m_sleeping = false;
+    spend(WAKE_CYCLES);
+    poll_interrupts();
+}
+
+void mcu::delay(double cpu_cycles)
+{
+    spend((uint64_t)std::llround(cpu_cycles));
+}
+
+uint8_t mcu::eeprom_read(uint16_t addr)
+{
+    spend(ACCESS_CYCLES);
+    return addr < eeprom.size() ? eeprom[addr] : 0xff;
+}
+
+void mcu::eeprom_write(uint16_t addr, uint8_t val)
+{
+    if (addr < eeprom.size())
+    {
+        eeprom[addr] = val;
+    }
+
+    /* avr-libc waits for the write to complete. */
+
+    spend((uint64_t)(EEPROM_WRITE_S * m_rc) >> m_reg[SIM_CLKPR]);
+}
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+void mcu::load()
+{
+    /* RTLD_LOCAL and -fno-gnu-unique let dlclose() really unload it, so
+     * the next dlopen() starts with fresh statics.
+     */
+
+    m_handle = dlopen(m_firmware.c_str(), RTLD_NOW | RTLD_LOCAL);
+
+    if (m_handle == nullptr)
+    {
+        throw std::runtime_error(dlerror());
+    }
+
+    m_main = (int (*)(void))dlsym(m_handle, "firmware_main");
+    m_int0 = (isr_t)dlsym(m_handle, "INT0_vect");
+    m_ovf = (isr_t)dlsym(m_handle, "TIM0_OVF_vect");
+    m_compa = (isr_t)dlsym(m_handle, "TIM0_COMPA_vect");
+
+    if (m_main == nullptr)
+    {
+        unload();
+        throw std::runtime_error(m_firmware + ": no firmware_main");
+    }
+}
+
+void mcu::unload()
+{
+    if (m_handle != nullptr)
+    {
+        dlclose(m_handle);
+        m_handle = nullptr;
+    }
+}
+
+void mcu::power_on()
+{
+    memset(m_reg, 0, sizeof(m_reg));
+    m_reg[SIM_CLKPR] = CLKPR_RESET;
+    m_reg[SIM_OSCCAL] = 0x5a;
+
+    m_sleeping = false;
+    m_in_isr = false;
+    m_sei_shadow = false;
+    m_clkpr_armed = false;
+    m_adc_done = UINT64_MAX;
+    m_adc_first = true;
+
+    pins_changed();
+
+    /* Held in reset for the start-up time. */
+
+    m_sleeping = true;
+    advance(m_now + cycles(BOOT_S));
+    m_sleeping = false;
+
+    m_io_epoch = m_now;
+    m_io_base = 0;
+    m_io_last = 0;
+    m_boot = m_now;
+    m_fw_seconds = 0;
+}
+
+uint64_t mcu::cycles(double secs) const
+{
+    return (uint64_t)std::llround(secs * m_rc);
+}
+
+double mcu::seconds(uint64_t c) const
+{
+    return c / m_rc;
+}
+
+void mcu::spend(uint64_t cpu_cycles)
+{
+    advance(m_now + (cpu_cycles << m_reg[SIM_CLKPR]));
+}
+
+/* Moves the time to 'target', handling the external events on the way.
+ * Leaves through longjmp() on a reset or at the end of the run.
+ */
+
+void mcu::advance(uint64_t target)
+{
+    for (;;)
+    {
+        uint64_t edge = m_edge_next < m_edges.size() ?
+                        m_edges[m_edge_next].first : UINT64_MAX;
+        uint64_t reset = m_resets.empty() ? UINT64_MAX : *m_resets.begin();
+        uint64_t t = std::min({ edge, reset, m_adc_done, m_end });
+
+        if (t > target)
+        {
+            break;
+        }
+
+        account(std::max(t, m_now));
+
+        if (t == m_end)
+        {
+            timer_sync();
+            longjmp(m_jmp, STOP_END);
+        }
+        else if (t == reset)
+        {
+            m_resets.erase(m_resets.begin());
+            longjmp(m_jmp, STOP_RESET);
+        }
+        else if (t == m_adc_done)
+        {
+            adc_complete();
+        }
+        else
+        {
+            button_edge(m_edges[m_edge_next++].second);
+        }
+    }
+
+    account(target);
+}
+
+void mcu::account(uint64_t t)
+{
+    if (t <= m_now)
+    {
+        return;
+    }
+
+    double mhz = m_rc / (1 << m_reg[SIM_CLKPR]) / 1e6;
+    double s = seconds(t - m_now);
+
+    if (m_sleeping)
+    {
+        m_stats.idle_mas += s * mhz * IDLE_MA_PER_MHZ;
+    }
+    else
+    {
+        m_stats.active_mas += s * mhz * ACTIVE_MA_PER_MHZ;
+    }
+
+    m_now = t;
+}
+
+/* Timer0 prescaler, 0 if stopped. External clocks are not modelled. */
+
+uint16_t mcu::timer_prescaler() const
+{
+    static const uint16_t prescalers[8] = { 0, 1, 8, 64, 256, 1024, 0, 0 };
+
+    return prescalers[m_reg[SIM_TCCR0B] & 7];
+}
+
+/* Brings TCNT0 and the flags up to now. The counter takes the value
+ * 'match + 1' one timer clock after matching: TOV0 is 'match' 255,
+ * OCF0A is OCR0A.
+ */
+
+void mcu::timer_sync()
+{
+    uint64_t io = m_io_base + ((m_now - m_io_epoch) >> m_reg[SIM_CLKPR]);
+    uint16_t n = timer_prescaler();
+
+    if (n != 0 && io > m_io_last)
+    {
+        uint64_t ticks = io / n - m_io_last / n;
+        uint8_t c = m_reg[SIM_TCNT0];
+
+        if (ticks >= 256 || (uint8_t)(255 - c) < ticks)
+        {
+            m_reg[SIM_TIFR0] |= BIT(TIFR_TOV0);
+        }
+
+        if (ticks >= 256 || (uint8_t)(m_reg[SIM_OCR0A] - c) < ticks)
+        {
+            m_reg[SIM_TIFR0] |= BIT(TIFR_OCF0A);
+        }
+
+        m_reg[SIM_TCNT0] = (uint8_t)(c + ticks);
+    }
+
+    m_io_last = io;
+}
+
+/* Time the flag of 'match' gets set, the timer must be in sync. */
+
+uint64_t mcu::timer_flag_time(uint8_t match) const
+{
+    uint16_t n = timer_prescaler();
+
+    if (n == 0)
+    {
+        return UINT64_MAX;
+    }
+
+    uint64_t k = (uint8_t)(match - m_reg[SIM_TCNT0]) + 1;
+    uint64_t io = (m_io_last / n + k) * n;
+
+    return m_io_epoch + ((io - m_io_base) << m_reg[SIM_CLKPR]);
+}
+
+bool mcu::stalled() const
+{
+    for (const auto &s : m_stalls)
+    {
+        if (s.first > m_now)
+        {
+            break;
+        }
+
+        if (m_now < s.second)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool mcu::interrupt_pending()
+{
+    uint8_t isc = m_reg[SIM_MCUCR] & 3;
+
+    if ((m_reg[SIM_GIMSK] & BIT(GIMSK_INT0)) &&
+        ((m_reg[SIM_GIFR] & BIT(GIFR_INTF0)) || (isc == 0 && m_pb1_low)))
+    {
+        return true;
+    }
+
+    timer_sync();
+
+    return !stalled() &&
+           (m_reg[SIM_TIFR0] & m_reg[SIM_TIMSK0] &
+            (BIT(TIFR_TOV0) | BIT(TIFR_OCF0A))) != 0;
+}
+
+/* Runs the pending interrupts, by vector priority, if enabled. */
+
+void mcu::poll_interrupts()
+{
+    if (m_sei_shadow)
+    {
+        m_sei_shadow = false;
+    }
+
+    while (!m_in_isr && (m_reg[SIM_SREG] & BIT(SREG_I)) &&
+           interrupt_pending())
+    {
+        uint8_t pending = m_reg[SIM_TIFR0] & m_reg[SIM_TIMSK0];
+
+        if ((m_reg[SIM_GIMSK] & BIT(GIMSK_INT0)) &&
+            ((m_reg[SIM_GIFR] & BIT(GIFR_INTF0)) ||
+             ((m_reg[SIM_MCUCR] & 3) == 0 && m_pb1_low)))
+        {
+            m_reg[SIM_GIFR] &= ~BIT(GIFR_INTF0);
+            call_isr(m_int0, false);
+        }
+        else if (pending & BIT(TIFR_TOV0))
+        {
+            m_reg[SIM_TIFR0] &= ~BIT(TIFR_TOV0);
+            call_isr(m_ovf, false);
+        }
+        else
+        {
+            m_reg[SIM_TIFR0] &= ~BIT(TIFR_OCF0A);
+            call_isr(m_compa, true);
+        }
+    }
+}
+
+void mcu::call_isr(isr_t isr, bool compa)
+{
+    if (isr == nullptr)
+    {
+        /* avr-libc's __bad_interrupt jumps to the reset vector. */
+
+        longjmp(m_jmp, STOP_RESET);
+    }
+
+    m_in_isr = true;
+    m_reg[SIM_SREG] &= ~BIT(SREG_I);
+    spend(ISR_CYCLES / 2);
+
+    isr();
+
+    if (compa)
+    {
+        m_fw_seconds++;
+    }
+
+    spend(ISR_CYCLES / 2);
+    m_reg[SIM_SREG] |= BIT(SREG_I);
+    m_in_isr = false;
+}
+
+/* Earliest time something can wake the MCU up. */
+
+uint64_t mcu::next_event()
+{
+    uint64_t t = m_end;
+
+    timer_sync();
+
+    if (m_reg[SIM_TIMSK0] & BIT(TIMSK_TOIE0))
+    {
+        t = std::min(t, timer_flag_time(255));
+    }
+
+    if (m_reg[SIM_TIMSK0] & BIT(TIMSK_OCIE0A))
+    {
+        t = std::min(t, timer_flag_time(m_reg[SIM_OCR0A]));
+    }
+
+    if (m_edge_next < m_edges.size())
+    {
+        t = std::min(t, m_edges[m_edge_next].first);
+    }
+
+    if (!m_resets.empty())
+    {
+        t = std::min(t, *m_resets.begin());
+    }
+
+    for (const auto &s : m_stalls)
+    {
+        if (s.second > m_now)
+        {
+            t = std::min(t, s.second);
+            break;
+        }
+    }
+
+    return std::max(std::min(t, m_adc_done), m_now + 1);
+}
+
+void mcu::pins_changed()
+{
+    uint8_t out = m_reg[SIM_PORTB] & m_reg[SIM_DDRB];
+    bool pump = out & BIT(PIN_PUMP);
+    bool led = out & BIT(PIN_LED);
+
+    if (pump != m_pump)
+    {
+        m_pump = pump;
+
+        if (pump)
+        {
+            m_pump_since = m_now;
+            m_stats.waterings++;
+        }
+        else
+        {
+            m_stats.pump_s += seconds(m_now - m_pump_since);
+            m_stats.log.push_back({ seconds(m_pump_since),
+                                    seconds(m_now - m_pump_since) });
+        }
+
+        if (on_pump)
+        {
+            on_pump(seconds(m_now), pump);
+        }
+    }
+
+    if (led != m_led)
+    {
+        m_led = led;
+
+        if (led)
+        {
+            m_led_since = m_now;
+        }
+        else
+        {
+            m_stats.led_s += seconds(m_now - m_led_since);
+        }
+    }
+}
+
+void mcu::button_edge(bool low)
+{
+    uint8_t isc = m_reg[SIM_MCUCR] & 3;
+
+    if (low == m_pb1_low)
+    {
+        return;
+    }
+
+    m_pb1_low = low;
+
+    if ((isc == 1) || (isc == 2 && low) || (isc == 3 && !low))
+    {
+        m_reg[SIM_GIFR] |= BIT(GIFR_INTF0);
+    }
+}
+
+void mcu::adc_start()
+{
+    uint8_t adps = m_reg[SIM_ADCSRA] & 7;
+    uint64_t clocks = (m_adc_first ? 25 : 13) << (adps ? adps : 1);
+
+    m_adc_first = false;
+    m_adc_done = m_now + (clocks << m_reg[SIM_CLKPR]);
+}
+
+void mcu::adc_complete()
+{
+    uint8_t channel = m_reg[SIM_ADMUX] & 3;
+    double t = seconds(m_now);
+    double volts = adc_input ? adc_input(t, channel) : 0;
+    long raw = std::lround(volts / 5.0 * 1024);
+    uint16_t val = (uint16_t)std::clamp(raw, 0L, 1023L);
+
+    if (adc_fault)
+    {
+        val = std::min<uint16_t>(adc_fault(t, channel, val), 1023);
+    }
+
+    m_reg[SIM_ADCL] = val & 0xff;
+    m_reg[SIM_ADCH] = val >> 8;
+    m_reg[SIM_ADCSRA] &= ~BIT(ADCSRA_ADSC);
+    m_reg[SIM_ADCSRA] |= BIT(ADCSRA_ADIF);
+    m_adc_done = UINT64_MAX;
+}
+
+} /* namespace sim */
@@ -0,0 +1,232 @@
+/****************************************************************************
+ * tools/sim/mcu.hpp
+ * Tomatotificatorul
+ *
+ * Copyright 2021 Iulian-Razvan Matesica <iulian.matesica@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ****************************************************************************/
+
+#ifndef __TOOLS_SIM_MCU_HPP
+#define __TOOLS_SIM_MCU_HPP
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <csetjmp>
+#include <cstdint>
+#include <functional>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "shim/sim_hooks.h"
+
+/****************************************************************************
+ * Public Types
+ ****************************************************************************/
+
+namespace sim
+{
+
+struct device
+{
+    const char *name;
+    uint16_t eeprom_size;
+    double clock;         /* Real F_CPU of the simulated unit */
+};
+
+/* Returns nullptr for an unknown device. */
+
+const device *find_device(const std::string &name);
+
+struct watering
+{
+    double start;         /* Seconds since the start of the run */
+    double seconds;
+};
+
+struct stats
+{
+    uint32_t resets = 0;
+    uint32_t waterings = 0;
+    double pump_s = 0;
+    double led_s = 0;
+    double active_mas = 0;     /* MCU charge while awake, mA*s */
+    double idle_mas = 0;       /* MCU charge while sleeping, mA*s */
+    double clock_error_s = 0;  /* Firmware seconds - real seconds, at the
+                                * end, counted from the last reset */
+    std::vector<watering> log;
+};
+
+/* Host model of the MCU around the firmware built as a shared object
+ * (see the 'sim' target of tools/Makefile): Timer0, INT0 on PB1, the ADC,
+ * the EEPROM, CLKPR and the idle sleep. The firmware runs natively; its
+ * register accesses and sleeps move a virtual clock, and sleeping jumps
+ * straight to the next event.
+ *
+ * A reset reloads the shared object, so all the firmware statics start
+ * over, while the EEPROM and the inputs carry on.
+ *
+ * Only one mcu runs at a time.
+ */
+
+class mcu
+{
+public:
+    mcu(const std::string &firmware, const device &dev, double clock);
+    ~mcu();
+
+    mcu(const mcu &) = delete;
+    mcu &operator=(const mcu &) = delete;
+
+    /* Inputs, set before run(). Times in seconds since the start. */
+
+    /* Voltage on an ADC channel, VCC is 5V. */
+
+    std::function<double(double t, uint8_t channel)> adc_input;
+
+    /* Optional, may change a conversion result. */
+
+    std::function<uint16_t(double t, uint8_t channel, uint16_t raw)>
+        adc_fault;
+
+    /* Optional, called when PB0 turns the pump on or off. */
+
+    std::function<void(double t, bool on)> on_pump;
+
+    /* Water button held (PB1 low) from 'start' to 'end'. */
+
+    void press(double start, double end);
+
+    /* Power loss (e.g. brown-out) at 't', the MCU restarts. */
+
+    void reset_at(double t);
+
+    /* Timer0 interrupts held off from 'start' to 'end', as by a long
+     * critical section. The flags stay pending meanwhile.
+     */
+
+    void stall(double start, double end);
+
+    /* Runs the firmware from power-up for 'seconds'. */
+
+    void run(double seconds);
+
+    double time() const;
+    bool pump_on() const;
+    const sim::stats &stats() const { return m_stats; }
+
+    std::vector<uint8_t> eeprom;
+
+    /* Called through the hooks of shim/sim_hooks.h. */
+
+    uint8_t io_read(uint8_t reg);
+    void io_write(uint8_t reg, uint8_t val);
+    void sleep();
+    void delay(double cycles);
+    uint8_t eeprom_read(uint16_t addr);
+    void eeprom_write(uint16_t addr, uint8_t val);
+
+private:
+    enum stop
+    {
+        STOP_NONE,
+        STOP_RESET,
+        STOP_END,
+    };
+
+    typedef void (*isr_t)(void);
+
+    void load();
+    void unload();
+    void power_on();
+
+    uint64_t cycles(double seconds) const;
+    double seconds(uint64_t cycles) const;
+
+    void spend(uint64_t cpu_cycles);
+    void advance(uint64_t target);
+    void account(uint64_t t);
+
+    void timer_sync();
+    uint16_t timer_prescaler() const;
+    uint64_t timer_flag_time(uint8_t match) const;
+    bool stalled() const;
+
+    bool interrupt_pending();
+    void poll_interrupts();
+    void call_isr(isr_t isr, bool compa);
+    uint64_t next_event();
+
+    void pins_changed();
+    void button_edge(bool low);
+    void adc_start();
+    void adc_complete();
+
+    std::string m_firmware;
+    const device &m_dev;
+    double m_rc;                     /* RC oscillator, 8 * clock */
+
+    void *m_handle = nullptr;
+    int (*m_main)(void) = nullptr;
+    isr_t m_int0 = nullptr;
+    isr_t m_ovf = nullptr;
+    isr_t m_compa = nullptr;
+
+    jmp_buf m_jmp;
+
+    /* Time, in RC oscillator cycles. */
+
+    uint64_t m_now = 0;
+    uint64_t m_end = 0;
+    uint64_t m_boot = 0;
+
+    uint8_t m_reg[SIM_REG_COUNT] = {};
+    bool m_sleeping = false;
+    bool m_in_isr = false;
+    bool m_sei_shadow = false;
+    bool m_clkpr_armed = false;
+
+    /* Timer0: I/O clocks counted since 'm_io_epoch'. */
+
+    uint64_t m_io_epoch = 0;
+    uint64_t m_io_base = 0;
+    uint64_t m_io_last = 0;
+
+    /* PB1 edges: (time, low), sorted. */
+
+    std::vector<std::pair<uint64_t, bool>> m_edges;
+    size_t m_edge_next = 0;
+    bool m_pb1_low = false;
+
+    std::multiset<uint64_t> m_resets;
+    std::vector<std::pair<uint64_t, uint64_t>> m_stalls;
+
+    uint64_t m_adc_done = UINT64_MAX;
+    bool m_adc_first = true;
+
+    bool m_pump = false;
+    bool m_led = false;
+    uint64_t m_pump_since = 0;
+    uint64_t m_led_since = 0;
+    uint64_t m_fw_seconds = 0;
+
+    sim::stats m_stats;
+};
+
+} /* namespace sim */
+
+#endif /* __TOOLS_SIM_MCU_HPP */
@@ -0,0 +1,99 @@
+/****************************************************************************
+ * tools/sim/plant.cpp
+ * Tomatotificatorul
+ *
+ * Copyright 2021 Iulian-Razvan Matesica <iulian.matesica@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ****************************************************************************/
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include "plant.hpp"
+
+#include <algorithm>
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+/* Priestley-Taylor: alpha, slope of the saturation curve over it plus the
+ * psychrometric constant at 20C, net over incoming shortwave radiation
+ * and the latent heat of vaporization, J/kg.
+ */
+
+#define PT_ALPHA         1.26
+#define PT_SLOPE_RATIO   0.68
+#define NET_RADIATION    0.6
+#define LATENT_HEAT      2.45e6
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+namespace sim
+{
+
+bucket::bucket(const plant &p)
+    : m_plant(p),
+      m_capacity_ml(p.pot_l * p.field_capacity * 1e3),
+      m_wilt_ml(p.pot_l * p.wilting_point * 1e3),
+      m_water_ml(m_capacity_ml)
+{
+    m_score.min_moisture = moisture();
+}
+
+void bucket::step(double seconds, double irradiance, double water_ml)
+{
+    double available = m_capacity_ml - m_wilt_ml;
+    double readily = m_plant.depletion * available;
+    double depleted, ks, et_ml;
+
+    m_water_ml += water_ml;
+    m_score.watered_ml += water_ml;
+
+    if (m_water_ml > m_capacity_ml)
+    {
+        m_score.drained_ml += m_water_ml - m_capacity_ml;
+        m_water_ml = m_capacity_ml;
+    }
+
+    /* kg/m2 is mm is L/m2, ET in mL over the canopy. */
+
+    depleted = m_capacity_ml - m_water_ml;
+    ks = depleted <= readily ? 1 :
+         std::max(0.0, (available - depleted) / (available - readily));
+    et_ml = PT_ALPHA * PT_SLOPE_RATIO * NET_RADIATION * irradiance /
+            LATENT_HEAT * seconds * m_plant.crop_coef *
+            m_plant.canopy_m2 * 1e3 * ks;
+    et_ml = std::min(et_ml, m_water_ml - m_wilt_ml);
+    m_water_ml -= std::max(0.0, et_ml);
+    m_score.used_ml += std::max(0.0, et_ml);
+
+    if (ks < 1)
+    {
+        m_score.stress_h += seconds / 3600;
+        m_score.stress_sum_h += (1 - ks) * seconds / 3600;
+    }
+
+    m_score.min_moisture = std::min(m_score.min_moisture, moisture());
+}
+
+double bucket::moisture() const
+{
+    return m_water_ml / (m_plant.pot_l * 1e3);
+}
+
+} /* namespace sim */
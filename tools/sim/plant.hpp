@@ -0,0 +1,86 @@
+/****************************************************************************
+ * tools/sim/plant.hpp
+ * Tomatotificatorul
+ *
+ * Copyright 2021 Iulian-Razvan Matesica <iulian.matesica@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ****************************************************************************/
+
+#ifndef __TOOLS_SIM_PLANT_HPP
+#define __TOOLS_SIM_PLANT_HPP
+
+/****************************************************************************
+ * Public Types
+ ****************************************************************************/
+
+namespace sim
+{
+
+/* A potted plant, FAO-56 style. Defaults: a mid-season tomato in a 10L
+ * pot of potting mix.
+ */
+
+struct plant
+{
+    double pot_l = 10;
+    double field_capacity = 0.35;   /* Volume fraction held after drainage */
+    double wilting_point = 0.12;
+    double depletion = 0.4;         /* Fraction of the available water
+                                     * used before stress (FAO p) */
+    double canopy_m2 = 0.25;
+    double crop_coef = 1.15;        /* Kc */
+};
+
+struct plant_score
+{
+    double stress_h = 0;       /* Hours with Ks < 1 */
+    double stress_sum_h = 0;   /* The same weighted by 1 - Ks */
+    double watered_ml = 0;
+    double drained_ml = 0;     /* Above field capacity, out of the pot */
+    double used_ml = 0;        /* Evapotranspiration */
+    double min_moisture = 1;   /* Volume fraction */
+};
+
+/* Soil water balance of the pot: what the pump brings, less the
+ * evapotranspiration, the excess above field capacity draining away.
+ * Potential evapotranspiration is Priestley-Taylor on the irradiance the
+ * plant gets, times Kc and the canopy; it is cut by FAO-56's Ks once the
+ * depletion passes p of the available water. Starts at field capacity.
+ */
+
+class bucket
+{
+public:
+    explicit bucket(const plant &p);
+
+    /* 'seconds' under 'irradiance' W/m2, 'water_ml' poured at the
+     * start. Steps of a minute or so keep Ks accurate.
+     */
+
+    void step(double seconds, double irradiance, double water_ml);
+
+    double moisture() const;
+    const plant_score &score() const { return m_score; }
+
+private:
+    plant m_plant;
+    double m_capacity_ml;      /* At field capacity */
+    double m_wilt_ml;
+    double m_water_ml;
+    plant_score m_score;
+};
+
+} /* namespace sim */
+
+#endif /* __TOOLS_SIM_PLANT_HPP */
@@ -0,0 +1,533 @@
+/****************************************************************************
+ * tools/sim/plantsim.cpp
+ * Tomatotificatorul
+ *
+ * Copyright 2021 Iulian-Razvan Matesica <iulian.matesica@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ****************************************************************************/
+
+/* Scores watering schedules by what they do to the plant: runs the
+ * firmware on the host MCU model (mcu.hpp) with each schedule in EEPROM
+ * and each duration pot setting, pours what the pump delivers into a
+ * soil water balance (plant.hpp) under the site's clear sky year
+ * (solar.hpp), and ranks them by hours of water stress, water drained
+ * out of the pot and pump energy.
+ *
+ *   plantsim -e 07:00 -e 07:00,19:00 --pot 1,2.5,4
+ *   plantsim -e 19:00 -e 10:00/6 --panel-load 60
+ *   plantsim --search -d 30 --site 44.43:26.10:135:90
+ *
+ * The plant gets the irradiance of the panel, both being on the same
+ * balcony. Needs a device with CONFIG_SCHEDULE_EEPROM (ATtiny25 and up).
+ */
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include "mcu.hpp"
+#include "plant.hpp"
+#include "solar.hpp"
+#include "cli.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+#define SECONDS_PER_DAY   86400.0
+
+/* Of source_code/device.h and main.c. */
+
+#define EE_SCHEDULE_ADDR  0x10
+#define SCHEDULE_MAX      8
+#define WINDOW_MAX        7
+#define WINDOW_SHIFT      5
+#define SOLAR_DIVIDER     (10.0 / 57.0)
+#define SOLAR_PANEL_THRESHOLD  553
+
+#define STEP_S            60.0
+
+/****************************************************************************
+ * Private Types
+ ****************************************************************************/
+
+struct event
+{
+    uint8_t hour, minute, second;
+    uint8_t window;             /* Hours, CONFIG_SOLAR_WINDOW */
+};
+
+struct candidate
+{
+    std::string name;
+    std::vector<event> events;
+    double pot;
+};
+
+struct options
+{
+    std::string device = "attiny45";
+    std::string firmware;
+    double clock = 0;
+    double days = 14;
+    double start_day = 172;
+    sim::site site;
+    sim::panel panel;
+    std::vector<std::string> schedules;
+    std::vector<double> pots;
+    bool search = false;
+    double flow = 20;           /* mL/s */
+    double pump_w = 6;
+    sim::plant plant;
+    double w_stress = 1;        /* Score per hour of stress */
+    double w_drain = 1;         /* Per litre drained */
+    double w_energy = 0.1;      /* Per Wh of pumping */
+};
+
+struct result
+{
+    candidate c;
+    uint32_t waterings;
+    double pump_s;
+    double sun_s;               /* Pumping while the panel charges */
+    sim::plant_score plant;
+    double score;
+};
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+/* --search: the flash defaults, then morning, evening and spread out
+ * schedules, each at three durations.
+ */
+
+static const char *const g_search_schedules[] =
+{
+    "00:00:05,07:00",
+    "07:00",
+    "19:00",
+    "07:00,19:00",
+    "06:00,13:00,20:00",
+    "06:00,10:00,14:00,18:00",
+    "10:00/6",
+    "07:00/4,13:00/6",
+};
+
+static const double g_search_pots[] = { 1.0, 2.5, 4.0 };
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+static void usage(void)
+{
+    fprintf(stderr,
+        "usage: plantsim [options]\n"
+        "  -m DEVICE            attiny25, attiny45 (default), attiny85\n"
+        "  -f FIRMWARE.so       firmware (default sim/DEVICE.so next to "
+        "plantsim)\n"
+        "  --clock HZ           real clock of the unit\n"
+        "  -d DAYS              days per run (default 14)\n"
+        "  --site SITE          LAT:LON:AZIMUTH:TILT (default "
+        "44.43:26.10:180:90)\n"
+        "  --horizon LIST       its skyline, see solartrace\n"
+        "  --start-day N        day of the year at the start (default 172)\n"
+        "  --panel-load OHMS    load on the panel (default open circuit)\n"
+        "  -e HH:MM[:SS][/H],...\n"
+        "                       a schedule to score, repeatable; /H waters\n"
+        "                       within H hours, on the first solar surplus\n"
+        "  --pot V,...          duration pot voltages (default 2.5)\n"
+        "  --search             also score a built-in set of schedules\n"
+        "  --flow ML_S          pump flow (default 20)\n"
+        "  --pump-w W           pump power (default 6)\n"
+        "  --pot-l L            pot volume (default 10)\n"
+        "  --canopy M2          canopy area (default 0.25)\n"
+        "  --kc K               crop coefficient (default 1.15)\n"
+        "  --weights S:D:E      score = S * stress h + D * drained L + "
+        "E * pump Wh\n"
+        "                       (default 1:1:0.1), lowest first\n");
+    exit(2);
+}
+
+static std::vector<std::string> split(const std::string &s, char sep)
+{
+    std::vector<std::string> out;
+    size_t pos = 0;
+
+    while (pos <= s.size())
+    {
+        size_t next = std::min(s.find(sep, pos), s.size());
+
+        out.push_back(s.substr(pos, next - pos));
+        pos = next + 1;
+    }
+
+    return out;
+}
+
+static std::vector<event> parse_schedule(const std::string &s)
+{
+    std::vector<event> events;
+
+    for (const std::string &e : split(s, ','))
+    {
+        size_t slash = e.find('/');
+        std::string time = e.substr(0, slash);
+        unsigned h, m, sec = 0;
+        double w = 0;
+
+        if (slash != std::string::npos)
+        {
+            w = cli::parse_num(e.substr(slash + 1));
+        }
+
+        if (sscanf(time.c_str(), "%u:%u:%u", &h, &m, &sec) < 2 || h > 23 ||
+            m > 59 || sec > 59 || w > WINDOW_MAX || w != std::floor(w))
+        {
+            throw std::runtime_error("bad event: " + e);
+        }
+
+        events.push_back({ (uint8_t)h, (uint8_t)m, (uint8_t)sec,
+                           (uint8_t)w });
+    }
+
+    if (events.size() > SCHEDULE_MAX)
+    {
+        throw std::runtime_error("more than 8 events: " + s);
+    }
+
+    return events;
+}
+
+static options parse_args(int argc, char **argv)
+{
+    options opt;
+
+    opt.site.lat = 44.43;
+    opt.site.lon = 26.10;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool has_val = i + 1 < argc;
+
+        if (arg == "--search")
+        {
+            opt.search = true;
+        }
+        else if (!has_val)
+        {
+            usage();
+        }
+        else if (arg == "-m")
+        {
+            opt.device = argv[++i];
+        }
+        else if (arg == "-f")
+        {
+            opt.firmware = argv[++i];
+        }
+        else if (arg == "--clock")
+        {
+            opt.clock = cli::parse_num(argv[++i]);
+        }
+        else if (arg == "-d")
+        {
+            opt.days = cli::parse_num(argv[++i]);
+        }
+        else if (arg == "--site")
+        {
+            if (sscanf(argv[++i], "%lf:%lf:%lf:%lf", &opt.site.lat,
+                       &opt.site.lon, &opt.site.azimuth,
+                       &opt.site.tilt) != 4)
+            {
+                usage();
+            }
+        }
+        else if (arg == "--horizon")
+        {
+            opt.site.horizon.clear();
+
+            for (const std::string &h : split(argv[++i], ','))
+            {
+                opt.site.horizon.push_back(cli::parse_num(h));
+            }
+        }
+        else if (arg == "--start-day")
+        {
+            opt.start_day = cli::parse_num(argv[++i]);
+        }
+        else if (arg == "--panel-load")
+        {
+            opt.panel.load = cli::parse_num(argv[++i]);
+        }
+        else if (arg == "-e")
+        {
+            opt.schedules.push_back(argv[++i]);
+        }
+        else if (arg == "--pot")
+        {
+            for (const std::string &v : split(argv[++i], ','))
+            {
+                opt.pots.push_back(cli::parse_num(v));
+            }
+        }
+        else if (arg == "--flow")
+        {
+            opt.flow = cli::parse_num(argv[++i]);
+        }
+        else if (arg == "--pump-w")
+        {
+            opt.pump_w = cli::parse_num(argv[++i]);
+        }
+        else if (arg == "--pot-l")
+        {
+            opt.plant.pot_l = cli::parse_num(argv[++i]);
+        }
+        else if (arg == "--canopy")
+        {
+            opt.plant.canopy_m2 = cli::parse_num(argv[++i]);
+        }
+        else if (arg == "--kc")
+        {
+            opt.plant.crop_coef = cli::parse_num(argv[++i]);
+        }
+        else if (arg == "--weights")
+        {
+            if (sscanf(argv[++i], "%lf:%lf:%lf", &opt.w_stress,
+                       &opt.w_drain, &opt.w_energy) != 3)
+            {
+                usage();
+            }
+        }
+        else
+        {
+            usage();
+        }
+    }
+
+    opt.site.tz = std::round(opt.site.lon / 15);
+
+    if (opt.schedules.empty() && !opt.search)
+    {
+        usage();
+    }
+
+    return opt;
+}
+
+/* g_duration of pot_task() for the pot at 'volts'. */
+
+static int duration_s(double volts)
+{
+    long raw = std::clamp(std::lround(volts / 5.0 * 1024), 0L, 1023L);
+
+    return (int)((raw * 55 + 512) >> 10) + 5;
+}
+
+static result run(const options &opt, const sim::device &dev,
+                  const sim::solar_trace &tr, const candidate &c)
+{
+    sim::mcu m(opt.firmware, dev, opt.clock);
+    double t0 = opt.start_day * SECONDS_PER_DAY;
+    double seconds = opt.days * SECONDS_PER_DAY;
+    sim::bucket pot(opt.plant);
+    size_t addr = EE_SCHEDULE_ADDR;
+    result r{};
+
+    m.eeprom.at(addr++) = (uint8_t)c.events.size();
+
+    for (const event &e : c.events)
+    {
+        m.eeprom.at(addr++) = e.hour | e.window << WINDOW_SHIFT;
+        m.eeprom.at(addr++) = e.minute;
+        m.eeprom.at(addr++) = e.second;
+    }
+
+    m.adc_input = [&](double t, uint8_t channel)
+    {
+        return channel == 3 ? c.pot :
+               sim::solar_at(tr.volts, t0 + t) * SOLAR_DIVIDER;
+    };
+
+    m.run(seconds);
+
+    for (const sim::watering &w : m.stats().log)
+    {
+        for (double t = w.start; t < w.start + w.seconds; t++)
+        {
+            double adc = sim::solar_at(tr.volts, t0 + t) * SOLAR_DIVIDER /
+                         5.0 * 1024;
+
+            r.sun_s += adc >= SOLAR_PANEL_THRESHOLD;
+        }
+    }
+
+    /* The firmware does not sense the soil: pour its waterings in
+     * afterwards, a minute at a time.
+     */
+
+    const std::vector<sim::watering> &log = m.stats().log;
+    size_t next = 0;
+
+    for (double t = 0; t < seconds; t += STEP_S)
+    {
+        double water = 0;
+
+        while (next < log.size() && log[next].start + log[next].seconds <= t)
+        {
+            next++;
+        }
+
+        for (size_t i = next; i < log.size() && log[i].start < t + STEP_S;
+             i++)
+        {
+            double from = std::max(t, log[i].start);
+            double to = std::min(t + STEP_S, log[i].start + log[i].seconds);
+
+            water += std::max(0.0, to - from) * opt.flow;
+        }
+
+        pot.step(STEP_S, sim::solar_at(tr.irradiance, t0 + t + STEP_S / 2),
+                 water);
+    }
+
+    r.c = c;
+    r.waterings = m.stats().waterings;
+    r.pump_s = m.stats().pump_s;
+    r.plant = pot.score();
+    r.score = opt.w_stress * r.plant.stress_h +
+              opt.w_drain * r.plant.drained_ml / 1e3 +
+              opt.w_energy * r.pump_s * opt.pump_w / 3600;
+
+    return r;
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+int main(int argc, char **argv)
+{
+    try
+    {
+        options opt = parse_args(argc, argv);
+        const sim::device *dev = sim::find_device(opt.device);
+        std::vector<candidate> candidates;
+        std::vector<result> results;
+
+        if (dev == nullptr)
+        {
+            throw std::runtime_error("unknown device " + opt.device);
+        }
+
+        if (opt.device == "attiny13")
+        {
+            throw std::runtime_error("the ATtiny13 has its schedule in "
+                                     "flash, use attiny25 or up");
+        }
+
+        if (opt.firmware.empty())
+        {
+            std::string self = argv[0];
+            size_t slash = self.rfind('/');
+
+            opt.firmware = (slash == std::string::npos ?
+                            std::string(".") : self.substr(0, slash)) +
+                           "/sim/" + opt.device + ".so";
+        }
+
+        if (opt.clock == 0)
+        {
+            opt.clock = dev->clock;
+        }
+
+        if (opt.pots.empty())
+        {
+            opt.pots.push_back(2.5);
+        }
+
+        std::vector<std::string> schedules = opt.schedules;
+        std::vector<double> pots = opt.pots;
+
+        if (opt.search)
+        {
+            schedules.insert(schedules.end(), std::begin(g_search_schedules),
+                             std::end(g_search_schedules));
+            pots.insert(pots.end(), std::begin(g_search_pots),
+                        std::end(g_search_pots));
+            std::sort(pots.begin(), pots.end());
+            pots.erase(std::unique(pots.begin(), pots.end()), pots.end());
+        }
+
+        for (const std::string &s : schedules)
+        {
+            for (double v : pots)
+            {
+                candidates.push_back({ s, parse_schedule(s), v });
+            }
+        }
+
+        sim::solar_trace tr = sim::solar_year(opt.site, opt.panel);
+
+        for (const candidate &c : candidates)
+        {
+            results.push_back(run(opt, *dev, tr, c));
+        }
+
+        std::stable_sort(results.begin(), results.end(),
+                         [](const result &a, const result &b)
+                         {
+                             return a.score < b.score;
+                         });
+
+        printf("%s, %g days from day %g, site %.2f:%.2f:%g:%g, "
+               "%gL pot, %gm2 canopy, %gmL/s\n", opt.firmware.c_str(),
+               opt.days, opt.start_day, opt.site.lat, opt.site.lon,
+               opt.site.azimuth, opt.site.tilt, opt.plant.pot_l,
+               opt.plant.canopy_m2, opt.flow);
+        printf("%-24s %4s %4s %5s %8s %8s %7s %8s %6s %7s %5s %7s\n",
+               "schedule", "pot", "s", "runs", "water L", "drain L",
+               "used L", "stress h", "min %", "pump Wh", "sun %",
+               "score");
+
+        for (const result &r : results)
+        {
+            printf("%-24s %4.1f %4d %5u %8.1f %8.1f %7.1f %8.1f %6.1f "
+                   "%7.2f %5.0f %7.1f\n", r.c.name.c_str(), r.c.pot,
+                   duration_s(r.c.pot), r.waterings,
+                   r.plant.watered_ml / 1e3, r.plant.drained_ml / 1e3,
+                   r.plant.used_ml / 1e3, r.plant.stress_h,
+                   r.plant.min_moisture * 100,
+                   r.pump_s * opt.pump_w / 3600,
+                   r.pump_s > 0 ? r.sun_s / r.pump_s * 100 : 0, r.score);
+        }
+    }
+    catch (const std::exception &e)
+    {
+        fprintf(stderr, "plantsim: %s\n", e.what());
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,103 @@
+/****************************************************************************
+ * tools/sim/shim/avr/eeprom.h
+ * Tomatotificatorul
+ *
+ * Copyright 2021 Iulian-Razvan Matesica <iulian.matesica@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ****************************************************************************/
+
+#ifndef __TOOLS_SIM_SHIM_AVR_EEPROM_H
+#define __TOOLS_SIM_SHIM_AVR_EEPROM_H
+
+/* EEPROM pointers are addresses, as on the AVR. */
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../sim_hooks.h"
+
+/****************************************************************************
+ * Inline Functions
+ ****************************************************************************/
+
+#define SIM_EE_ADDR(p)  ((uint16_t)(uintptr_t)(p))
+
+static inline uint8_t eeprom_read_byte(const uint8_t *p)
+{
+    return sim_eeprom_read(SIM_EE_ADDR(p));
+}
+
+static inline uint16_t eeprom_read_word(const uint16_t *p)
+{
+    uint16_t addr = SIM_EE_ADDR(p);
+
+    return sim_eeprom_read(addr) | sim_eeprom_read(addr + 1) << 8;
+}
+
+static inline void eeprom_read_block(void *dst, const void *src, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        ((uint8_t *)dst)[i] = sim_eeprom_read(SIM_EE_ADDR(src) + i);
+    }
+}
+
+static inline void eeprom_write_byte(uint8_t *p, uint8_t val)
+{
+    sim_eeprom_write(SIM_EE_ADDR(p), val);
+}
+
+static inline void eeprom_update_byte(uint8_t *p, uint8_t val)
+{
+    if (sim_eeprom_read(SIM_EE_ADDR(p)) != val)
+    {
+        sim_eeprom_write(SIM_EE_ADDR(p), val);
+    }
+}
+
+static inline void eeprom_write_word(uint16_t *p, uint16_t val)
+{
+    sim_eeprom_write(SIM_EE_ADDR(p), val & 0xff);
+    sim_eeprom_write(SIM_EE_ADDR(p) + 1, val >> 8);
+}
+
+static inline void eeprom_update_word(uint16_t *p, uint16_t val)
+{
+    eeprom_update_byte((uint8_t *)p, val & 0xff);
+    eeprom_update_byte((uint8_t *)p + 1, val >> 8);
+}
+
+static inline void eeprom_write_block(const void *src, void *dst, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        sim_eeprom_write(SIM_EE_ADDR(dst) + i, ((const uint8_t *)src)[i]);
+    }
+}
+
+static inline void eeprom_update_block(const void *src, void *dst, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        eeprom_update_byte((uint8_t *)dst + i, ((const uint8_t *)src)[i]);
+    }
+}
+
+#define eeprom_busy_wait()  ((void)0)
+
+#endif /* __TOOLS_SIM_SHIM_AVR_EEPROM_H */
@@ -0,0 +1,42 @@
+/****************************************************************************
+ * tools/sim/shim/avr/interrupt.h
+ * Tomatotificatorul
+ *
+ * Copyright 2021 Iulian-Razvan Matesica <iulian.matesica@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ****************************************************************************/
+
+#ifndef __TOOLS_SIM_SHIM_AVR_INTERRUPT_H
+#define __TOOLS_SIM_SHIM_AVR_INTERRUPT_H
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <avr/io.h>
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+/* ISRs become exported C functions named after the vector, looked up by
+ * the model when the firmware is loaded.
+ */
+
+#define ISR(vector, ...)  extern "C" void vector(void)
+
+#define sei()  (SREG = SREG | 0x80)
+#define cli()  (SREG = SREG & 0x7f)
+
+#endif /* __TOOLS_SIM_SHIM_AVR_INTERRUPT_H */
@@ -0,0 +1,214 @@
+/****************************************************************************
+ * tools/sim/shim/avr/io.h
+ * Tomatotificatorul
+ *
+ * Copyright 2021 Iulian-Razvan Matesica <iulian.matesica@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ****************************************************************************/
+
+#ifndef __TOOLS_SIM_SHIM_AVR_IO_H
+#define __TOOLS_SIM_SHIM_AVR_IO_H
+
+/* Host replacement of <avr/io.h>. Registers are proxy objects, so every
+ * access of the firmware reaches the MCU model, which advances the time
+ * and runs the interrupts. Bit positions follow the ATtiny13 for all
+ * devices; the model uses the same ones.
+ */
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <stdint.h>
+
+#include "../sim_hooks.h"
+
+/****************************************************************************
+ * Public Types
+ ****************************************************************************/
+
+struct sim_reg8
+{
+    uint8_t reg;
+
+    operator uint8_t() const { return sim_io_read(reg); }
+
+    const sim_reg8 &operator=(uint8_t val) const
+    {
+        sim_io_write(reg, val);
+        return *this;
+    }
+
+    const sim_reg8 &operator|=(int val) const
+    {
+        sim_io_write(reg, sim_io_read(reg) | val);
+        return *this;
+    }
+
+    const sim_reg8 &operator&=(int val) const
+    {
+        sim_io_write(reg, sim_io_read(reg) & val);
+        return *this;
+    }
+
+    const sim_reg8 &operator^=(int val) const
+    {
+        sim_io_write(reg, sim_io_read(reg) ^ val);
+        return *this;
+    }
+
+    uint8_t operator++(int) const
+    {
+        uint8_t val = sim_io_read(reg);
+
+        sim_io_write(reg, val + 1);
+        return val;
+    }
+
+    uint8_t operator--(int) const
+    {
+        uint8_t val = sim_io_read(reg);
+
+        sim_io_write(reg, val - 1);
+        return val;
+    }
+};
+
+/* ADCL must be read first, as on the AVR. */
+
+struct sim_adc16
+{
+    operator uint16_t() const
+    {
+        uint8_t low = sim_io_read(SIM_ADCL);
+
+        return low | sim_io_read(SIM_ADCH) << 8;
+    }
+};
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+#define SIM_REG(name)  (sim_reg8{ SIM_##name })
+
+#define PORTB    SIM_REG(PORTB)
+#define DDRB     SIM_REG(DDRB)
+#define PINB     SIM_REG(PINB)
+#define PCMSK    SIM_REG(PCMSK)
+#define MCUCR    SIM_REG(MCUCR)
+#define MCUSR    SIM_REG(MCUSR)
+#define GIMSK    SIM_REG(GIMSK)
+#define GIFR     SIM_REG(GIFR)
+#define TIMSK0   SIM_REG(TIMSK0)
+#define TIFR0    SIM_REG(TIFR0)
+#define TCCR0A   SIM_REG(TCCR0A)
+#define TCCR0B   SIM_REG(TCCR0B)
+#define TCNT0    SIM_REG(TCNT0)
+#define OCR0A    SIM_REG(OCR0A)
+#define OCR0B    SIM_REG(OCR0B)
+#define GTCCR    SIM_REG(GTCCR)
+#define OSCCAL   SIM_REG(OSCCAL)
+#define CLKPR    SIM_REG(CLKPR)
+#define WDTCR    SIM_REG(WDTCR)
+#define ACSR     SIM_REG(ACSR)
+#define ADMUX    SIM_REG(ADMUX)
+#define ADCSRA   SIM_REG(ADCSRA)
+#define ADCSRB   SIM_REG(ADCSRB)
+#define ADCL     SIM_REG(ADCL)
+#define ADCH     SIM_REG(ADCH)
+#define DIDR0    SIM_REG(DIDR0)
+#define SREG     SIM_REG(SREG)
+#define ADC      (sim_adc16{})
+
+#define PB0      0
+#define PB1      1
+#define PB2      2
+#define PB3      3
+#define PB4      4
+#define PB5      5
+
+/* MCUCR */
+
+#define ISC00    0
+#define ISC01    1
+#define SM0      3
+#define SM1      4
+#define SE       5
+
+/* MCUSR */
+
+#define PORF     0
+#define EXTRF    1
+#define BORF     2
+#define WDRF     3
+
+/* GIMSK, GIFR */
+
+#define PCIE     5
+#define INT0     6
+#define PCIF     5
+#define INTF0    6
+
+/* TIMSK0, TIFR0 */
+
+#define TOIE0    1
+#define OCIE0A   2
+#define OCIE0B   3
+#define TOV0     1
+#define OCF0A    2
+#define OCF0B    3
+
+/* TCCR0A, TCCR0B */
+
+#define WGM00    0
+#define WGM01    1
+#define COM0B0   4
+#define COM0B1   5
+#define COM0A0   6
+#define COM0A1   7
+#define CS00     0
+#define CS01     1
+#define CS02     2
+#define WGM02    3
+
+/* GTCCR, CLKPR */
+
+#define PSR10    0
+#define TSM      7
+#define CLKPS0   0
+#define CLKPCE   7
+
+/* ADMUX, ADCSRA, DIDR0 */
+
+#define MUX0     0
+#define MUX1     1
+#define ADLAR    5
+#define REFS0    6
+#define ADPS0    0
+#define ADPS1    1
+#define ADPS2    2
+#define ADIE     3
+#define ADIF     4
+#define ADATE    5
+#define ADSC     6
+#define ADEN     7
+#define ADC1D    2
+#define ADC3D    3
+#define ADC2D    4
+#define ADC0D    5
+
+#define _BV(bit) (1 << (bit))
+
+#endif /* __TOOLS_SIM_SHIM_AVR_IO_H */
@@ -0,0 +1,46 @@
+/****************************************************************************
+ * tools/sim/shim/avr/pgmspace.h
+ * Tomatotificatorul
+ *
+ * Copyright 2021 Iulian-Razvan Matesica <iulian.matesica@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ****************************************************************************/
+
+#ifndef __TOOLS_SIM_SHIM_AVR_PGMSPACE_H
+#define __TOOLS_SIM_SHIM_AVR_PGMSPACE_H
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <string.h>
+
+/* Flash data is ordinary memory on the host. The readers return the
+ * type pointed to, so function pointers survive pgm_read_word().
+ */
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+#define PROGMEM
+#define PSTR(s)             (s)
+
+#define pgm_read_byte(addr)  (*(addr))
+#define pgm_read_word(addr)  (*(addr))
+#define pgm_read_dword(addr) (*(addr))
+
+#define memcpy_P(dst, src, n) memcpy((dst), (src), (n))
+
+#endif /* __TOOLS_SIM_SHIM_AVR_PGMSPACE_H */
@@ -0,0 +1,43 @@
+/****************************************************************************
+ * tools/sim/shim/avr/sleep.h
+ * Tomatotificatorul
+ *
+ * Copyright 2021 Iulian-Razvan Matesica <iulian.matesica@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ****************************************************************************/
+
+#ifndef __TOOLS_SIM_SHIM_AVR_SLEEP_H
+#define __TOOLS_SIM_SHIM_AVR_SLEEP_H
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <avr/io.h>
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+/* Only the idle mode is modelled. */
+
+#define SLEEP_MODE_IDLE        0
+
+#define set_sleep_mode(mode)   ((void)(mode))
+#define sleep_enable()         (MCUCR |= (1 << SE))
+#define sleep_disable()        (MCUCR &= ~(1 << SE))
+#define sleep_cpu()            sim_sleep()
+#define sleep_mode()           sim_sleep()
+
+#endif /* __TOOLS_SIM_SHIM_AVR_SLEEP_H */
@@ -0,0 +1,96 @@
+/****************************************************************************
+ * tools/sim/shim/sim_hooks.h
+ * Tomatotificatorul
+ *
+ * Copyright 2021 Iulian-Razvan Matesica <iulian.matesica@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ****************************************************************************/
+
+#ifndef __TOOLS_SIM_SHIM_SIM_HOOKS_H
+#define __TOOLS_SIM_SHIM_SIM_HOOKS_H
+
+/* Interface between the firmware, built for the host as a shared object
+ * against the headers of this directory, and the MCU model of
+ * tools/sim/mcu.cpp which provides these functions.
+ */
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <stdint.h>
+
+/****************************************************************************
+ * Public Types
+ ****************************************************************************/
+
+/* I/O registers, by name: the model does not care about addresses. */
+
+enum sim_reg
+{
+    SIM_PORTB,
+    SIM_DDRB,
+    SIM_PINB,
+    SIM_PCMSK,
+    SIM_MCUCR,
+    SIM_MCUSR,
+    SIM_GIMSK,
+    SIM_GIFR,
+    SIM_TIMSK0,
+    SIM_TIFR0,
+    SIM_TCCR0A,
+    SIM_TCCR0B,
+    SIM_TCNT0,
+    SIM_OCR0A,
+    SIM_OCR0B,
+    SIM_GTCCR,
+    SIM_OSCCAL,
+    SIM_CLKPR,
+    SIM_WDTCR,
+    SIM_ACSR,
+    SIM_ADMUX,
+    SIM_ADCSRA,
+    SIM_ADCSRB,
+    SIM_ADCL,
+    SIM_ADCH,
+    SIM_DIDR0,
+    SIM_SREG,
+    SIM_REG_COUNT
+};
+
+/****************************************************************************
+ * Public Function Prototypes
+ ****************************************************************************/
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+uint8_t sim_io_read(uint8_t reg);
+void sim_io_write(uint8_t reg, uint8_t val);
+void sim_sleep(void);
+void sim_delay_cycles(double cycles);
+uint8_t sim_eeprom_read(uint16_t addr);
+void sim_eeprom_write(uint16_t addr, uint8_t val);
+
+/* The firmware main(), renamed with -Dmain=firmware_main. */
+
+int firmware_main(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __TOOLS_SIM_SHIM_SIM_HOOKS_H */
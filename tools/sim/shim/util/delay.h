@@ -0,0 +1,38 @@
+/****************************************************************************
+ * tools/sim/shim/util/delay.h
+ * Tomatotificatorul
+ *
+ * Copyright 2021 Iulian-Razvan Matesica <iulian.matesica@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ****************************************************************************/
+
+#ifndef __TOOLS_SIM_SHIM_UTIL_DELAY_H
+#define __TOOLS_SIM_SHIM_UTIL_DELAY_H
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include "../sim_hooks.h"
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+/* Busy waits count F_CPU cycles, like the avr-libc ones. */
+
+#define _delay_ms(ms)  sim_delay_cycles((double)(ms) * F_CPU / 1e3)
+#define _delay_us(us)  sim_delay_cycles((double)(us) * F_CPU / 1e6)
+
+#endif /* __TOOLS_SIM_SHIM_UTIL_DELAY_H */
@@ -0,0 +1,491 @@
+/****************************************************************************
+ * tools/sim/simcheck.cpp
+ * Tomatotificatorul
+ *
+ * Copyright 2021 Iulian-Razvan Matesica <iulian.matesica@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ****************************************************************************/
+
+/* Pass/fail scenarios of the firmware on the host MCU model (mcu.hpp),
+ * for the behaviours faultsim and plantsim only print: 'make -C tools
+ * check' runs them all and fails if one does.
+ *
+ *   simcheck                 all scenarios
+ *   simcheck -v midnight     one, printing its waterings
+ *
+ * Each scenario writes a schedule to the EEPROM (see device.h), so they
+ * run on the ATtiny45 build. Times are seconds from power-up, which is
+ * 00:00:00 for the firmware.
+ */
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include "mcu.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+#define DAY               86400.0
+
+/* Of source_code/device.h and main.c. */
+
+#define EE_SCHEDULE_ADDR  0x10
+#define WINDOW_SHIFT      5
+#define SOLAR_DIVIDER     (10.0 / 57.0)
+
+/* Start and end of a watering, against the expected time. */
+
+#define TOLERANCE_S       1.5
+
+/****************************************************************************
+ * Private Types
+ ****************************************************************************/
+
+struct event
+{
+    uint8_t hour, minute, second;
+    uint8_t window;             /* Hours */
+};
+
+/* One run of the firmware. */
+
+struct setup
+{
+    std::vector<event> events;
+    int duration = 30;          /* Pot setting, seconds */
+    std::function<double(double t)> panel;  /* Volts, dark if empty */
+    double seconds = DAY;
+    std::vector<double> press;  /* Start, end of a button press */
+};
+
+struct scenario
+{
+    const char *name;
+    const char *what;
+    void (*fn)(void);
+};
+
+struct options
+{
+    std::string firmware;
+    bool verbose = false;
+    std::vector<std::string> names;
+};
+
+/****************************************************************************
+ * Private Function Prototypes
+ ****************************************************************************/
+
+static void check_midnight(void);
+static void check_midnight_event(void);
+static void check_late_at_boot(void);
+static void check_press_while_pumping(void);
+static void check_stuck_at_boot(void);
+static void check_window_deadline(void);
+static void check_window_surplus(void);
+static void check_budget(void);
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+static const scenario g_scenarios[] =
+{
+    { "midnight", "23:59:50 for 30s stops at 00:00:20", check_midnight },
+    { "midnight-event", "00:00:00 waters at power-up and every day",
+      check_midnight_event },
+    { "late-at-boot", "23:59:58 waits for 23:59:58, not power-up",
+      check_late_at_boot },
+    { "press-while-pumping", "a press during a watering waters after it",
+      check_press_while_pumping },
+    { "stuck-at-boot", "a button held at power-up delays the boot by 2s",
+      check_stuck_at_boot },
+    { "window-deadline", "02:00/3 in the dark waters at 05:00",
+      check_window_deadline },
+    { "window-surplus", "02:00/3 waters on the 03:00 surplus",
+      check_window_surplus },
+    { "budget", "dark days shorten the waterings day by day",
+      check_budget },
+};
+
+static options g_opt;
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+static void usage(void)
+{
+    fprintf(stderr,
+        "usage: simcheck [options] [SCENARIO]...\n"
+        "  -f FIRMWARE.so       firmware (default sim/attiny45.so next to "
+        "simcheck)\n"
+        "  -v                   print the waterings of each scenario\n"
+        "scenarios:\n");
+
+    for (const scenario &s : g_scenarios)
+    {
+        fprintf(stderr, "  %-20s %s\n", s.name, s.what);
+    }
+
+    exit(2);
+}
+
+static options parse_args(int argc, char **argv)
+{
+    options opt;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+
+        if (arg == "-v")
+        {
+            opt.verbose = true;
+        }
+        else if (arg == "-f" && i + 1 < argc)
+        {
+            opt.firmware = argv[++i];
+        }
+        else if (arg[0] == '-')
+        {
+            usage();
+        }
+        else
+        {
+            opt.names.push_back(arg);
+        }
+    }
+
+    return opt;
+}
+
+static void expect(bool ok, const char *fmt, double a, double b)
+{
+    char msg[160];
+
+    if (!ok)
+    {
+        snprintf(msg, sizeof(msg), fmt, a, b);
+        throw std::runtime_error(msg);
+    }
+}
+
+static void expect_near(double got, double want, const char *what)
+{
+    char fmt[96];
+
+    snprintf(fmt, sizeof(fmt), "%s at %%.1fs, expected %%.1fs", what);
+    expect(fabs(got - want) <= TOLERANCE_S, fmt, got, want);
+}
+
+/* Pot voltage for a g_duration of 'seconds', see pot_task(). */
+
+static double pot_volts(int seconds)
+{
+    for (int raw = 0; raw < 1024; raw++)
+    {
+        if (((raw * 55 + 512) >> 10) + 5 == seconds)
+        {
+            return raw * 5.0 / 1024;
+        }
+    }
+
+    throw std::runtime_error("no pot setting for " +
+                             std::to_string(seconds) + "s");
+}
+
+static std::vector<sim::watering> run(const setup &s)
+{
+    const sim::device *dev = sim::find_device("attiny45");
+    sim::mcu m(g_opt.firmware, *dev, dev->clock);
+    size_t addr = EE_SCHEDULE_ADDR;
+    double pot = pot_volts(s.duration);
+
+    m.eeprom.at(addr++) = (uint8_t)s.events.size();
+
+    for (const event &e : s.events)
+    {
+        m.eeprom.at(addr++) = e.hour | e.window << WINDOW_SHIFT;
+        m.eeprom.at(addr++) = e.minute;
+        m.eeprom.at(addr++) = e.second;
+    }
+
+    m.adc_input = [&](double t, uint8_t channel)
+    {
+        if (channel == 3)
+        {
+            return pot;
+        }
+
+        return s.panel ? s.panel(t) * SOLAR_DIVIDER : 0.0;
+    };
+
+    if (!s.press.empty())
+    {
+        m.press(s.press[0], s.press[1]);
+    }
+
+    m.run(s.seconds);
+
+    if (g_opt.verbose)
+    {
+        for (const sim::watering &w : m.stats().log)
+        {
+            printf("    %10.1f  %5.1fs\n", w.start, w.seconds);
+        }
+    }
+
+    return m.stats().log;
+}
+
+/* Water given on each day of 'log'. */
+
+static std::vector<double> daily(const std::vector<sim::watering> &log,
+                                 int days)
+{
+    std::vector<double> out(days);
+
+    for (const sim::watering &w : log)
+    {
+        int day = (int)(w.start / DAY);
+
+        if (day < days)
+        {
+            out[day] += w.seconds;
+        }
+    }
+
+    return out;
+}
+
+/****************************************************************************
+ * Scenarios
+ ****************************************************************************/
+
+static void check_midnight(void)
+{
+    setup s;
+
+    s.events = { { 23, 59, 50, 0 } };
+    s.duration = 30;
+    s.seconds = DAY + 60;
+
+    std::vector<sim::watering> log = run(s);
+
+    expect(log.size() == 1, "%.0f waterings, expected %.0f",
+           log.size(), 1);
+    expect_near(log[0].start, DAY - 10, "started");
+    expect_near(log[0].start + log[0].seconds, DAY + 20, "stopped");
+}
+
+static void check_midnight_event(void)
+{
+    setup s;
+
+    s.events = { { 0, 0, 0, 0 } };
+    s.duration = 10;
+    s.seconds = 2 * DAY + 60;
+
+    std::vector<sim::watering> log = run(s);
+
+    expect(log.size() == 3, "%.0f waterings, expected %.0f",
+           log.size(), 3);
+
+    for (size_t i = 0; i < log.size(); i++)
+    {
+        expect_near(log[i].start, i * DAY, "started");
+    }
+}
+
+static void check_late_at_boot(void)
+{
+    setup s;
+
+    s.events = { { 23, 59, 58, 0 } };
+    s.duration = 10;
+    s.seconds = DAY + 60;
+
+    std::vector<sim::watering> log = run(s);
+
+    expect(log.size() == 1, "%.0f waterings, expected %.0f",
+           log.size(), 1);
+    expect_near(log[0].start, DAY - 2, "started");
+}
+
+static void check_press_while_pumping(void)
+{
+    setup s;
+
+    s.events = { { 1, 0, 0, 0 } };
+    s.duration = 30;
+    s.seconds = 2 * 3600;
+    s.press = { 3600 + 10, 3600 + 10.5 };
+
+    std::vector<sim::watering> log = run(s);
+
+    expect(log.size() == 2, "%.0f waterings, expected %.0f",
+           log.size(), 2);
+    expect_near(log[1].start, log[0].start + log[0].seconds, "second");
+}
+
+static void check_stuck_at_boot(void)
+{
+    setup s;
+
+    /* Calibration mode, never released: it gives up after ~2s. */
+
+    s.events = { { 1, 0, 0, 0 } };
+    s.seconds = 2 * 3600;
+    s.press = { 0, 600 };
+
+    std::vector<sim::watering> log = run(s);
+
+    expect(log.size() == 1, "%.0f waterings, expected %.0f",
+           log.size(), 1);
+    expect_near(log[0].start, 3600 + 2, "started");
+}
+
+static void check_window_deadline(void)
+{
+    setup s;
+
+    s.events = { { 2, 0, 0, 3 } };
+    s.seconds = 6 * 3600;
+
+    std::vector<sim::watering> log = run(s);
+
+    expect(log.size() == 1, "%.0f waterings, expected %.0f",
+           log.size(), 1);
+    expect_near(log[0].start, 5 * 3600, "started");
+}
+
+static void check_window_surplus(void)
+{
+    setup s;
+
+    /* Dark, then 20V from 03:00: the solar task needs 4 samples of 4s
+     * in a row above the surplus threshold.
+     */
+
+    s.events = { { 2, 0, 0, 3 } };
+    s.panel = [](double t) { return t >= 3 * 3600 ? 20.0 : 0.0; };
+    s.seconds = 6 * 3600;
+
+    std::vector<sim::watering> log = run(s);
+
+    expect(log.size() == 1, "%.0f waterings, expected %.0f",
+           log.size(), 1);
+    expect(log[0].start >= 3 * 3600 + 12 && log[0].start <= 3 * 3600 + 24,
+           "started at %.1fs, expected %.0fs + 12..24s", log[0].start,
+           3 * 3600);
+}
+
+static void check_budget(void)
+{
+    setup s;
+
+    /* Eight 60s waterings a day off a battery that never charges. Day 0
+     * has no forecast and waters in full, then each day's budget is a
+     * quarter of the charge left above the reserve.
+     */
+
+    for (uint8_t h = 1; h < 24; h += 3)
+    {
+        s.events.push_back({ h, 30, 0, 0 });
+    }
+
+    s.duration = 60;
+    s.seconds = 5 * DAY;
+
+    std::vector<double> d = daily(run(s), 5);
+
+    expect(fabs(d[0] - 8 * 60) <= TOLERANCE_S, "day 0: %.1fs, expected %.0fs",
+           d[0], 8 * 60);
+
+    for (int i = 1; i < 5; i++)
+    {
+        expect(d[i] > 0 && d[i] < d[i - 1],
+               "not rationed: %.0fs after %.0fs", d[i], d[i - 1]);
+    }
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+int main(int argc, char **argv)
+{
+    int failed = 0;
+    int ran = 0;
+
+    g_opt = parse_args(argc, argv);
+
+    if (g_opt.firmware.empty())
+    {
+        std::string self = argv[0];
+        size_t slash = self.rfind('/');
+
+        g_opt.firmware = (slash == std::string::npos ?
+                          std::string(".") : self.substr(0, slash)) +
+                         "/sim/attiny45.so";
+    }
+
+    for (const scenario &s : g_scenarios)
+    {
+        bool wanted = g_opt.names.empty();
+
+        for (const std::string &n : g_opt.names)
+        {
+            wanted |= n == s.name;
+        }
+
+        if (!wanted)
+        {
+            continue;
+        }
+
+        ran++;
+
+        try
+        {
+            s.fn();
+            printf("PASS  %-20s %s\n", s.name, s.what);
+        }
+        catch (const std::exception &e)
+        {
+            printf("FAIL  %-20s %s: %s\n", s.name, s.what, e.what());
+            failed++;
+        }
+    }
+
+    if (ran == 0)
+    {
+        usage();
+    }
+
+    printf("%d of %d scenarios passed\n", ran - failed, ran);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,250 @@
+/****************************************************************************
+ * tools/sim/solar.cpp
+ * Tomatotificatorul
+ *
+ * Copyright 2021 Iulian-Razvan Matesica <iulian.matesica@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ****************************************************************************/
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include "solar.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+#define DEG              (M_PI / 180)
+
+/* Solar constant, W/m2, and Meinel's clear sky transmittance. */
+
+#define SOLAR_CONSTANT   1353.0
+#define TRANSMITTANCE    0.7
+#define DIFFUSE_RATIO    0.1
+#define ALBEDO           0.2
+
+#define STC_W            1000.0
+#define THERMAL_V        0.025693    /* kT/q at 25C */
+
+/****************************************************************************
+ * Private Types
+ ****************************************************************************/
+
+/* Hour angle steps of the minutes of a day, a quarter degree each. */
+
+struct rotation
+{
+    double cos_m[1440];
+    double sin_m[1440];
+
+    rotation()
+    {
+        for (int m = 0; m < 1440; m++)
+        {
+            cos_m[m] = cos(m * 0.25 * DEG);
+            sin_m[m] = sin(m * 0.25 * DEG);
+        }
+    }
+};
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+static const rotation g_rotation;
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+/* Young (1994), from the cosine of the zenith angle, good to the
+ * horizon.
+ */
+
+static double air_mass(double cz)
+{
+    return (1.002432 * cz * cz + 0.148386 * cz + 0.0096467) /
+           (cz * cz * cz + 0.149864 * cz * cz + 0.0102963 * cz +
+            0.000303978);
+}
+
+/* Panel voltage across 'load' ohms: Newton on the single diode equation
+ * from the smaller of the open circuit voltage and the short circuit
+ * current through the load, where it converges from above.
+ */
+
+static double loaded_volts(const sim::panel &p, double vt, double voc,
+                           double w)
+{
+    double il = p.isc * w / STC_W;
+    double i0 = p.isc / expm1(p.voc / vt);
+    double v = std::min(voc, il * p.load);
+
+    for (int i = 0; i < 20; i++)
+    {
+        double e = i0 * exp(v / vt);
+        double f = il - (e - i0) - v / p.load;
+        double df = -e / vt - 1 / p.load;
+        double step = f / df;
+
+        v -= step;
+
+        if (fabs(step) < 1e-4)
+        {
+            break;
+        }
+    }
+
+    return std::max(0.0, v);
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+namespace sim
+{
+
+/* The hour angle moves a quarter degree a minute, so the day's sun path
+ * is the per-minute rotation tables turned by the day's offset: only
+ * multiplies and adds over arrays, until the daylight minutes need
+ * their air mass.
+ */
+
+solar_trace solar_year(const site &s, const panel &p)
+{
+    const double *cos_m = g_rotation.cos_m, *sin_m = g_rotation.sin_m;
+    solar_trace tr;
+    double sin_lat = sin(s.lat * DEG), cos_lat = cos(s.lat * DEG);
+    double n_east = sin(s.tilt * DEG) * sin(s.azimuth * DEG);
+    double n_north = sin(s.tilt * DEG) * cos(s.azimuth * DEG);
+    double n_up = cos(s.tilt * DEG);
+    double sky = 1;
+    double vt = p.cells * p.ideality * THERMAL_V;
+    double v_dim = p.voc + vt * log(1 / STC_W);
+    std::vector<double> skyline;
+    double up[1440], east[1440], north[1440], facing[1440];
+
+    /* Sky view of the skyline, isotropic sky. */
+
+    if (!s.horizon.empty())
+    {
+        sky = 0;
+
+        for (double h : s.horizon)
+        {
+            double c = cos(std::clamp(h, 0.0, 90.0) * DEG);
+
+            skyline.push_back(sin(std::clamp(h, 0.0, 90.0) * DEG));
+            sky += c * c;
+        }
+
+        sky /= s.horizon.size();
+    }
+
+    double diffuse = sky * (1 + n_up) / 2;
+    double ground = ALBEDO * (1 - n_up) / 2;
+
+    tr.irradiance.resize(SOLAR_MINUTES);
+    tr.volts.resize(SOLAR_MINUTES);
+
+    for (int d = 0; d < SOLAR_DAYS; d++)
+    {
+        double g = 2 * M_PI * d / SOLAR_DAYS;
+        double decl = 0.006918 - 0.399912 * cos(g) + 0.070257 * sin(g) -
+                      0.006758 * cos(2 * g) + 0.000907 * sin(2 * g) -
+                      0.002697 * cos(3 * g) + 0.00148 * sin(3 * g);
+        double eot = 229.18 * (0.000075 + 0.001868 * cos(g) -
+                               0.032077 * sin(g) - 0.014615 * cos(2 * g) -
+                               0.040849 * sin(2 * g));
+        double h0 = ((eot + 4 * s.lon - 60 * s.tz) / 4 - 180) * DEG;
+        double ch0 = cos(h0), sh0 = sin(h0);
+        double sd = sin(decl), cd = cos(decl);
+        double e0 = SOLAR_CONSTANT * (1 + 0.033 * cos(g));
+        float *irr = &tr.irradiance[d * 1440];
+        float *volts = &tr.volts[d * 1440];
+
+        for (int m = 0; m < 1440; m++)
+        {
+            double ch = ch0 * cos_m[m] - sh0 * sin_m[m];
+            double sh = sh0 * cos_m[m] + ch0 * sin_m[m];
+
+            up[m] = sin_lat * sd + cos_lat * cd * ch;
+            east[m] = -cd * sh;
+            north[m] = cos_lat * sd - sin_lat * cd * ch;
+            facing[m] = n_east * east[m] + n_north * north[m] +
+                        n_up * up[m];
+        }
+
+        for (int m = 0; m < 1440; m++)
+        {
+            if (up[m] <= 0)
+            {
+                irr[m] = 0;
+                volts[m] = 0;
+                continue;
+            }
+
+            double dni = e0 * pow(TRANSMITTANCE, pow(air_mass(up[m]),
+                                                     0.678));
+            double dhi = DIFFUSE_RATIO * dni;
+            double beam = facing[m] > 0 ? dni * facing[m] : 0;
+
+            if (beam > 0 && !skyline.empty())
+            {
+                double az = atan2(east[m], north[m]);
+                int sector = (int)((az < 0 ? az + 2 * M_PI : az) /
+                                   (2 * M_PI) * skyline.size());
+
+                if (up[m] < skyline[std::min<size_t>(sector,
+                                                     skyline.size() - 1)])
+                {
+                    beam = 0;
+                }
+            }
+
+            double w = beam + dhi * diffuse + (dni * up[m] + dhi) * ground;
+
+            double voc = w >= 1 ? std::max(0.0, p.voc + vt * log(w / STC_W))
+                                : std::max(0.0, v_dim * w);
+
+            irr[m] = w;
+            volts[m] = p.load > 0 ? loaded_volts(p, vt, voc, w) : voc;
+        }
+    }
+
+    return tr;
+}
+
+double solar_at(const std::vector<float> &trace, double t)
+{
+    double m = fmod(t / 60, SOLAR_MINUTES);
+
+    if (m < 0)
+    {
+        m += SOLAR_MINUTES;
+    }
+
+    size_t i = std::min<size_t>((size_t)m, SOLAR_MINUTES - 1);
+    double f = m - i;
+
+    return trace[i] * (1 - f) + trace[(i + 1) % SOLAR_MINUTES] * f;
+}
+
+} /* namespace sim */
@@ -0,0 +1,111 @@
+/****************************************************************************
+ * tools/sim/solar.hpp
+ * Tomatotificatorul
+ *
+ * Copyright 2021 Iulian-Razvan Matesica <iulian.matesica@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ****************************************************************************/
+
+#ifndef __TOOLS_SIM_SOLAR_HPP
+#define __TOOLS_SIM_SOLAR_HPP
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <string>
+#include <vector>
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+/* A trace covers a 365 day year, one sample per minute of local clock
+ * time from January 1st, 00:00.
+ */
+
+#define SOLAR_DAYS       365
+#define SOLAR_MINUTES    (SOLAR_DAYS * 1440)
+
+/****************************************************************************
+ * Public Types
+ ****************************************************************************/
+
+namespace sim
+{
+
+/* Where the panel is. Angles in degrees: latitude north and longitude
+ * east positive, azimuth clockwise from north (180 faces south), tilt
+ * from horizontal.
+ */
+
+struct site
+{
+    std::string name;
+    double lat = 0;
+    double lon = 0;
+    double tz = 0;              /* Clock hours ahead of UTC */
+    double azimuth = 180;
+    double tilt = 90;           /* Railing mount */
+
+    /* Skyline around the panel, elevation in degrees of equal sectors
+     * from north clockwise (walls, the balcony above, buildings across
+     * the street). Empty for a free horizon.
+     */
+
+    std::vector<double> horizon;
+};
+
+/* A 36 cell "12V" panel, single diode model. Open circuit, its voltage
+ * is Voc + cells * n * kT/q * ln(G / STC) in sunlight, going to 0 in the
+ * dark. With a load, the voltage where the panel current, Isc * G / STC
+ * less the diode's, flows through it.
+ */
+
+struct panel
+{
+    double voc = 21.6;          /* At 1000W/m2 */
+    double isc = 0.6;           /* At 1000W/m2 */
+    double cells = 36;
+    double ideality = 1.3;
+    double load = 0;            /* Ohms, 0 for open circuit */
+};
+
+struct solar_trace
+{
+    std::vector<float> irradiance;  /* On the panel, W/m2 */
+    std::vector<float> volts;       /* Panel voltage */
+};
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/* Clear sky year of 's': sun position by Spencer's series (declination
+ * and equation of time once a day), beam by Meinel with Young's air mass,
+ * isotropic diffuse cut by the skyline's sky view and 0.2 ground albedo.
+ * Beam is lost whenever the sun is below the skyline or behind the panel.
+ */
+
+solar_trace solar_year(const site &s, const panel &p);
+
+/* Trace value at 't' seconds since January 1st 00:00, linear between the
+ * minutes and wrapping around the year.
+ */
+
+double solar_at(const std::vector<float> &trace, double t);
+
+} /* namespace sim */
+
+#endif /* __TOOLS_SIM_SOLAR_HPP */
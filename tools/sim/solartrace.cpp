@@ -0,0 +1,411 @@
+/****************************************************************************
+ * tools/sim/solartrace.cpp
+ * Tomatotificatorul
+ *
+ * Copyright 2021 Iulian-Razvan Matesica <iulian.matesica@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ****************************************************************************/
+
+/* Clear sky panel voltage traces (solar.hpp) for sites without weather
+ * data, a year per minute, many sites in parallel. For each site it
+ * prints the harvest and how the firmware's solar task would see it:
+ * adc_read(2) against SOLAR_PANEL_THRESHOLD.
+ *
+ *   solartrace home:44.43:26.10:180:90
+ *   solartrace --horizon 0,0,0,40,40,40,0,0 -o out home:44.43:26.10:135:90
+ *   solartrace -s sites.txt -j 8
+ *
+ * A sites file holds one site per line, '#' starts a comment:
+ *
+ *   NAME LAT LON AZIMUTH TILT [HORIZON]
+ */
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include "solar.hpp"
+#include "../mesh/parallel.hpp"
+#include "cli.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+/* Panel divider of the board, R1 = 47K, R2 = 10K, and the threshold of
+ * source_code/main.c.
+ */
+
+#define SOLAR_DIVIDER          (10.0 / 57.0)
+#define SOLAR_PANEL_THRESHOLD  553
+
+/****************************************************************************
+ * Private Types
+ ****************************************************************************/
+
+struct options
+{
+    std::vector<sim::site> sites;
+    std::vector<double> horizon;
+    bool tz_set = false;
+    double tz = 0;
+    sim::panel panel;
+    std::string out_dir;
+    unsigned threads = 0;
+};
+
+struct summary
+{
+    double kwh_m2 = 0;          /* On the panel, a year */
+    double charging_mean = 0;   /* Hours a day the firmware sees */
+    double charging_min = 0;
+    double charging_max = 0;
+    int dark_days = 0;          /* Never above the threshold */
+    double ms = 0;
+};
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+static void usage(void)
+{
+    fprintf(stderr,
+        "usage: solartrace [options] [NAME:LAT:LON:AZIMUTH:TILT]...\n"
+        "  angles in degrees, north and east positive, azimuth clockwise\n"
+        "  from north (180 faces south), tilt from horizontal (90 for a\n"
+        "  railing)\n"
+        "  -s FILE              sites file, NAME LAT LON AZIMUTH TILT "
+        "[HORIZON] a line\n"
+        "  --horizon LIST       skyline of the command line sites, "
+        "elevations in\n"
+        "                       degrees of equal sectors from north, "
+        "e.g. 0,0,30,30\n"
+        "  --tz HOURS           clock ahead of UTC (default longitude / 15)\n"
+        "  --voc V              panel open circuit voltage (default 21.6)\n"
+        "  --isc A              panel short circuit current (default 0.6)\n"
+        "  --load OHMS          load on the panel (default open circuit)\n"
+        "  -o DIR               write DIR/NAME.csv: minute, W/m2, panel V, "
+        "ADC2\n"
+        "  -j N                 threads (default all cores)\n");
+    exit(2);
+}
+
+static std::vector<std::string> split(const std::string &s, char sep)
+{
+    std::vector<std::string> out;
+    std::stringstream ss(s);
+    std::string item;
+
+    while (std::getline(ss, item, sep))
+    {
+        out.push_back(item);
+    }
+
+    return out;
+}
+
+static std::vector<double> parse_horizon(const std::string &s)
+{
+    std::vector<double> h;
+
+    for (const std::string &e : split(s, ','))
+    {
+        h.push_back(cli::parse_num(e, -HUGE_VAL));
+    }
+
+    return h;
+}
+
+static sim::site make_site(const std::vector<std::string> &f)
+{
+    sim::site s;
+
+    s.name = f[0];
+    s.lat = cli::parse_num(f[1], -HUGE_VAL);
+    s.lon = cli::parse_num(f[2], -HUGE_VAL);
+    s.azimuth = cli::parse_num(f[3], -HUGE_VAL);
+    s.tilt = cli::parse_num(f[4], -HUGE_VAL);
+
+    if (fabs(s.lat) > 90 || fabs(s.lon) > 180 || s.tilt < 0 ||
+        s.tilt > 180)
+    {
+        throw std::runtime_error("bad site " + s.name);
+    }
+
+    return s;
+}
+
+static void load_sites(const std::string &path, options &opt)
+{
+    std::ifstream in(path);
+    std::string line;
+
+    if (!in)
+    {
+        throw std::runtime_error("cannot open " + path);
+    }
+
+    while (std::getline(in, line))
+    {
+        std::stringstream ss(line.substr(0, line.find('#')));
+        std::vector<std::string> f;
+        std::string word;
+
+        while (ss >> word)
+        {
+            f.push_back(word);
+        }
+
+        if (f.empty())
+        {
+            continue;
+        }
+
+        if (f.size() != 5 && f.size() != 6)
+        {
+            throw std::runtime_error(path + ": bad line: " + line);
+        }
+
+        opt.sites.push_back(make_site(f));
+
+        if (f.size() == 6)
+        {
+            opt.sites.back().horizon = parse_horizon(f[5]);
+        }
+    }
+}
+
+static options parse_args(int argc, char **argv)
+{
+    options opt;
+    std::vector<sim::site> cli;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool has_val = i + 1 < argc;
+
+        if (arg[0] != '-')
+        {
+            std::vector<std::string> f = split(arg, ':');
+
+            if (f.size() != 5)
+            {
+                usage();
+            }
+
+            cli.push_back(make_site(f));
+        }
+        else if (!has_val)
+        {
+            usage();
+        }
+        else if (arg == "-s")
+        {
+            load_sites(argv[++i], opt);
+        }
+        else if (arg == "--horizon")
+        {
+            opt.horizon = parse_horizon(argv[++i]);
+        }
+        else if (arg == "--tz")
+        {
+            opt.tz = cli::parse_num(argv[++i], -HUGE_VAL);
+            opt.tz_set = true;
+        }
+        else if (arg == "--voc")
+        {
+            opt.panel.voc = cli::parse_num(argv[++i]);
+        }
+        else if (arg == "--isc")
+        {
+            opt.panel.isc = cli::parse_num(argv[++i]);
+        }
+        else if (arg == "--load")
+        {
+            opt.panel.load = cli::parse_num(argv[++i]);
+        }
+        else if (arg == "-o")
+        {
+            opt.out_dir = argv[++i];
+        }
+        else if (arg == "-j")
+        {
+            opt.threads = (unsigned)cli::parse_num(argv[++i]);
+        }
+        else
+        {
+            usage();
+        }
+    }
+
+    for (sim::site &s : cli)
+    {
+        s.horizon = opt.horizon;
+        opt.sites.push_back(s);
+    }
+
+    for (sim::site &s : opt.sites)
+    {
+        s.tz = opt.tz_set ? opt.tz : std::round(s.lon / 15);
+    }
+
+    if (opt.sites.empty())
+    {
+        usage();
+    }
+
+    return opt;
+}
+
+/* What solar_task() reads, the ADC of mcu.cpp. */
+
+static uint16_t adc2(double volts)
+{
+    long raw = std::lround(volts * SOLAR_DIVIDER / 5.0 * 1024);
+
+    return (uint16_t)std::clamp(raw, 0L, 1023L);
+}
+
+static summary run_site(const sim::site &s, const options &opt)
+{
+    auto start = std::chrono::steady_clock::now();
+    sim::solar_trace tr = sim::solar_year(s, opt.panel);
+    summary sum;
+
+    sum.ms = std::chrono::duration<double, std::milli>(
+                 std::chrono::steady_clock::now() - start).count();
+    sum.charging_min = 24;
+
+    for (int d = 0; d < SOLAR_DAYS; d++)
+    {
+        int minutes = 0;
+
+        for (int m = d * 1440; m < (d + 1) * 1440; m++)
+        {
+            sum.kwh_m2 += tr.irradiance[m] / 60e3;
+            minutes += adc2(tr.volts[m]) >= SOLAR_PANEL_THRESHOLD;
+        }
+
+        sum.charging_mean += minutes / 60.0 / SOLAR_DAYS;
+        sum.charging_min = std::min(sum.charging_min, minutes / 60.0);
+        sum.charging_max = std::max(sum.charging_max, minutes / 60.0);
+        sum.dark_days += minutes == 0;
+    }
+
+    if (!opt.out_dir.empty())
+    {
+        std::string path = opt.out_dir + "/" + s.name + ".csv";
+        FILE *f = fopen(path.c_str(), "w");
+
+        if (f == nullptr)
+        {
+            throw std::runtime_error("cannot write " + path);
+        }
+
+        fprintf(f, "minute,irradiance,volts,adc2\n");
+
+        for (int m = 0; m < SOLAR_MINUTES; m++)
+        {
+            fprintf(f, "%d,%.1f,%.2f,%u\n", m, tr.irradiance[m],
+                    tr.volts[m], adc2(tr.volts[m]));
+        }
+
+        if (fclose(f) != 0)
+        {
+            throw std::runtime_error("cannot write " + path);
+        }
+    }
+
+    return sum;
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+int main(int argc, char **argv)
+{
+    try
+    {
+        options opt = parse_args(argc, argv);
+        std::vector<summary> sums(opt.sites.size());
+        std::vector<std::string> errors(opt.sites.size());
+        auto start = std::chrono::steady_clock::now();
+
+        unsigned workers = mesh::parallel_for(opt.sites.size(), opt.threads,
+            [&](size_t begin, size_t end, unsigned)
+            {
+                for (size_t i = begin; i < end; i++)
+                {
+                    try
+                    {
+                        sums[i] = run_site(opt.sites[i], opt);
+                    }
+                    catch (const std::exception &e)
+                    {
+                        errors[i] = e.what();
+                    }
+                }
+            }, 1);
+
+        double wall = std::chrono::duration<double, std::milli>(
+                          std::chrono::steady_clock::now() - start).count();
+
+        for (const std::string &e : errors)
+        {
+            if (!e.empty())
+            {
+                throw std::runtime_error(e);
+            }
+        }
+
+        printf("%-16s %7s %8s %5s %5s %8s %14s %5s %7s\n", "site", "lat",
+               "lon", "az", "tilt", "kWh/m2", "charging h/d", "dark",
+               "ms");
+
+        for (size_t i = 0; i < opt.sites.size(); i++)
+        {
+            const sim::site &s = opt.sites[i];
+            const summary &sum = sums[i];
+
+            printf("%-16s %7.2f %8.2f %5.0f %5.0f %8.0f %4.1f %4.1f %4.1f "
+                   "%5d %7.1f\n", s.name.c_str(), s.lat, s.lon, s.azimuth,
+                   s.tilt, sum.kwh_m2, sum.charging_mean, sum.charging_min,
+                   sum.charging_max, sum.dark_days, sum.ms);
+        }
+
+        printf("%zu sites in %.0f ms, %u threads\n", opt.sites.size(), wall,
+               workers);
+    }
+    catch (const std::exception &e)
+    {
+        fprintf(stderr, "solartrace: %s\n", e.what());
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,273 @@
+/****************************************************************************
+ * tools/simavr/calref.c
+ * Tomatotificatorul
+ *
+ * Copyright 2021 Iulian-Razvan Matesica <iulian.matesica@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ****************************************************************************/
+
+/* Runs the calibration mode of main.elf in simavr against a synthetic 
+ * reference and checks the result stored in EEPROM.
+ *
+ * simavr runs at a fixed frequency, so the RC oscillator is modelled 
+ * here: the reference period, in CPU cycles, follows the OSCCAL value 
+ * the firmware writes. 
+ *
+ *   calref [-m MCU] [-f HZ] [-e ERROR_PPM] [-s STEP_PPM] [-o FACTORY] 
+ *          main.elf
+ */
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sim_avr.h>
+#include <sim_elf.h>
+#include <sim_cycle_timers.h>
+#include <avr_ioport.h>
+#include <avr_eeprom.h>
+
+#include "calib.h"
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+/* Must match CAL_REF_HZ in main.c. */
+
+#define REF_HZ          1000
+
+/* OSCCAL, data space address, the same on all supported devices. */
+
+#define OSCCAL_ADDR     (0x31 + 0x20)
+
+/* EEPROM offset of the calibration result, EE_CALIB_ADDR in device.h. */
+
+#define EE_CALIB        0x00
+
+#define BUTTON_RELEASE  0.020
+#define REF_START       0.040
+#define TIMEOUT         30.0
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+static const char *g_mcu = "attiny13";
+static double g_f_cpu = 1204508;
+static double g_error_ppm = 25000;
+static double g_step_ppm = 7000;
+static int g_factory = 0x40;
+
+static avr_irq_t *g_pb1;
+static int g_level;
+static double g_phase;
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+static double osc_hz(int osccal)
+{
+    return g_f_cpu * (1.0 + g_error_ppm / 1e6) *
+           (1.0 + g_step_ppm / 1e6 * (osccal - g_factory));
+}
+
+static avr_cycle_count_t ref_toggle(avr_t *avr, avr_cycle_count_t when, 
+                                    void *param)
+{
+    double half = osc_hz(avr->data[OSCCAL_ADDR]) / (2.0 * REF_HZ);
+    avr_cycle_count_t step;
+
+    (void)param;
+
+    g_level = !g_level;
+    avr_raise_irq(g_pb1, g_level);
+
+    /* Keep the fractional cycles, the reference must not drift. */
+
+    g_phase += half;
+    step = (avr_cycle_count_t)g_phase;
+    g_phase -= step;
+
+    return when + step;
+}
+
+static avr_cycle_count_t button_release(avr_t *avr, avr_cycle_count_t when,
+                                        void *param)
+{
+    (void)param;
+    (void)when;
+
+    g_level = 1;
+    avr_raise_irq(g_pb1, 1);
+    avr_cycle_timer_register(avr, (REF_START - BUTTON_RELEASE) * g_f_cpu,
+                             ref_toggle, NULL);
+    return 0;
+}
+
+static const uint8_t *eeprom(avr_t *avr)
+{
+    avr_eeprom_desc_t desc = { .ee = NULL, .offset = 0, .size = 16 };
+
+    avr_ioctl(avr, AVR_IOCTL_EEPROM_GET, &desc);
+    return desc.ee;
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+int main(int argc, char **argv)
+{
+    elf_firmware_t fw;
+    avr_t *avr;
+    const uint8_t *ee;
+    int state;
+    int opt;
+    int range;
+    int best;
+
+    while ((opt = getopt(argc, argv, "m:f:e:s:o:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'm':
+                g_mcu = optarg;
+                break;
+
+            case 'f':
+                g_f_cpu = atof(optarg);
+                break;
+
+            case 'e':
+                g_error_ppm = atof(optarg);
+                break;
+
+            case 's':
+                g_step_ppm = atof(optarg);
+                break;
+
+            case 'o':
+                g_factory = strtol(optarg, NULL, 0);
+                break;
+
+            default:
+                fprintf(stderr, "usage: calref [-m MCU] [-f HZ] "
+                        "[-e ERROR_PPM] [-s STEP_PPM] [-o FACTORY] "
+                        "main.elf\n");
+                return 2;
+        }
+    }
+
+    if (optind >= argc)
+    {
+        fprintf(stderr, "calref: missing main.elf\n");
+        return 2;
+    }
+
+    memset(&fw, 0, sizeof(fw));
+
+    if (elf_read_firmware(argv[optind], &fw) != 0)
+    {
+        fprintf(stderr, "calref: cannot load %s\n", argv[optind]);
+        return 1;
+    }
+
+    avr = avr_make_mcu_by_name(g_mcu);
+
+    if (avr == NULL)
+    {
+        fprintf(stderr, "calref: unknown MCU %s\n", g_mcu);
+        return 1;
+    }
+
+    avr_init(avr);
+    avr->frequency = g_f_cpu;
+    avr_load_firmware(avr, &fw);
+
+    /* The factory value is loaded at reset on the real chip. */
+
+    avr->data[OSCCAL_ADDR] = g_factory;
+
+    /* Hold the water button at power-up. */
+
+    g_pb1 = avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ('B'), 1);
+    g_level = 0;
+    avr_raise_irq(g_pb1, 0);
+    avr_cycle_timer_register(avr, BUTTON_RELEASE * g_f_cpu, 
+                             button_release, NULL);
+
+    do
+    {
+        state = avr_run(avr);
+        ee = eeprom(avr);
+    }
+    while (state != cpu_Done && state != cpu_Crashed &&
+           ee[EE_CALIB] != CALIB_VERSION && 
+           avr->cycle < TIMEOUT * g_f_cpu);
+
+    if (ee[EE_CALIB] != CALIB_VERSION)
+    {
+        printf("FAIL: no calibration stored after %.1fs\n", 
+               avr->cycle / g_f_cpu);
+        return 1;
+    }
+
+    /* The setting the firmware should have found, in the OSCCAL range
+     * of the factory value.
+     */
+
+    range = g_factory & 0x80;
+    best = range;
+
+    for (int i = range; i < range + 128; i++)
+    {
+        if (fabs(osc_hz(i) - g_f_cpu) < fabs(osc_hz(best) - g_f_cpu))
+        {
+            best = i;
+        }
+    }
+
+    {
+        int osccal = ee[EE_CALIB + 1];
+        long cycles = (long)(ee[EE_CALIB + 4] | ee[EE_CALIB + 5] << 8) * 256 +
+                      ee[EE_CALIB + 6];
+        double actual = osc_hz(osccal);
+        double error = (cycles - actual) / actual * 1e6;
+
+        printf("osccal   0x%02x (expected 0x%02x)\n", osccal, best);
+        printf("ppm      %.0f (model %.0f)\n",
+               (cycles - g_f_cpu) / g_f_cpu * 1e6,
+               (actual - g_f_cpu) / g_f_cpu * 1e6);
+        printf("second   %ld cycles (model %.0f, error %.1f ppm)\n", 
+               cycles, actual, error);
+        printf("done in  %.1fs\n", avr->cycle / g_f_cpu);
+
+        if (osccal != best || fabs(error) > 50)
+        {
+            printf("FAIL\n");
+            return 1;
+        }
+    }
+
+    printf("PASS\n");
+    return 0;
+}
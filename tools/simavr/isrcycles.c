@@ -0,0 +1,325 @@
+/****************************************************************************
+ * tools/simavr/isrcycles.c
+ * Tomatotificatorul
+ *
+ * Copyright 2021 Iulian-Razvan Matesica <iulian.matesica@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ****************************************************************************/
+
+/* Runs main.elf through a fixed scenario in simavr and reports the cycles
+ * spent in every interrupt vector (count, worst case, total) and outside
+ * of sleep. Used by the build profiles and 'make budget'.
+ *
+ * Scenario: duration pot at mid-scale, solar panel charging, the
+ * scheduled 00:00:05 event, a button press at 10s, 30s in total.
+ *
+ * simavr runs a cycle per CPU cycle at whatever frequency it is given
+ * and ignores CLKPR, so the scenario follows the writes to it: its
+ * seconds are the firmware's at any system clock prescaler. -f is the
+ * clock at the reset prescaler (CKDIV8).
+ *
+ *   isrcycles [-m MCU] [-f HZ] [-t SECONDS] main.elf
+ */
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sim_avr.h>
+#include <sim_elf.h>
+#include <sim_interrupts.h>
+#include <avr_adc.h>
+#include <avr_ioport.h>
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+#define MAX_VECTORS      32
+
+/* CLKPR in data space, the same on the ATtiny13 and ATtinyX5. */
+
+#define CLKPR_ADDR       0x46
+#define CLKPCE           0x80
+#define CLKPS_MASK       0x0f
+#define CLKPS_RESET      3         /* CKDIV8 */
+
+#define POT_MV           2500
+#define SOLAR_MV         3000
+
+#define BUTTON_PRESS     10.0
+#define BUTTON_RELEASE   10.2
+
+/****************************************************************************
+ * Private Types
+ ****************************************************************************/
+
+struct vector_stats
+{
+    unsigned long count;
+    avr_cycle_count_t start;
+    avr_cycle_count_t max;
+    avr_cycle_count_t total;
+};
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+static avr_t *g_avr;
+static avr_irq_t *g_pb1;
+static struct vector_stats g_stats[MAX_VECTORS];
+
+/* Scenario time: 'g_base_seconds' at 'g_base_cycle', then cycles at
+ * the clock set by CLKPR.
+ */
+
+static double g_f_reset;
+static double g_base_seconds;
+static avr_cycle_count_t g_base_cycle;
+static avr_cycle_count_t g_clkpce_cycle;
+static int g_clkpce;
+
+static const char *const g_tiny13_names[] =
+{
+    "RESET", "INT0", "PCINT0", "TIM0_OVF", "EE_RDY", "ANA_COMP",
+    "TIM0_COMPA", "TIM0_COMPB", "WDT", "ADC",
+};
+
+static const char *const g_tinyx5_names[] =
+{
+    "RESET", "INT0", "PCINT0", "TIM1_COMPA", "TIM1_OVF", "TIM0_OVF",
+    "EE_RDY", "ANA_COMP", "ADC", "TIM1_COMPB", "TIM0_COMPA", "TIM0_COMPB",
+    "WDT", "USI_START", "USI_OVF",
+};
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+static void isr_running(struct avr_irq_t *irq, uint32_t value, void *param)
+{
+    struct vector_stats *stats = &g_stats[(uintptr_t)param];
+    avr_cycle_count_t cycles;
+
+    (void)irq;
+
+    if (value)
+    {
+        stats->start = g_avr->cycle;
+        return;
+    }
+
+    cycles = g_avr->cycle - stats->start;
+    stats->count++;
+    stats->total += cycles;
+
+    if (cycles > stats->max)
+    {
+        stats->max = cycles;
+    }
+}
+
+static double seconds_now(void)
+{
+    return g_base_seconds +
+           (g_avr->cycle - g_base_cycle) / (double)g_avr->frequency;
+}
+
+/* The prescaler changes if the write follows CLKPCE within 4 cycles. */
+
+static void clkpr_write(avr_t *avr, avr_io_addr_t addr, uint8_t v,
+                        void *param)
+{
+    (void)param;
+
+    avr->data[addr] = v;
+
+    if (v & CLKPCE)
+    {
+        g_clkpce = 1;
+        g_clkpce_cycle = avr->cycle;
+        return;
+    }
+
+    if (g_clkpce && avr->cycle - g_clkpce_cycle <= 4)
+    {
+        g_base_seconds = seconds_now();
+        g_base_cycle = avr->cycle;
+        avr->frequency = ldexp(g_f_reset, CLKPS_RESET - (v & CLKPS_MASK));
+    }
+
+    g_clkpce = 0;
+}
+
+static const char *vector_name(const char *mcu, int vector)
+{
+    if (strcmp(mcu, "attiny13") == 0 && vector < 10)
+    {
+        return g_tiny13_names[vector];
+    }
+
+    if (strncmp(mcu, "attiny", 6) == 0 && mcu[7] == '5' && vector < 15)
+    {
+        return g_tinyx5_names[vector];
+    }
+
+    return "?";
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+int main(int argc, char **argv)
+{
+    const char *mcu = "attiny13";
+    double f_cpu = 1204508;
+    double seconds = 30;
+    int button = 1;
+    avr_cycle_count_t sleeping = 0;
+    avr_cycle_count_t before;
+    elf_firmware_t fw;
+    int state;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "m:f:t:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'm':
+                mcu = optarg;
+                break;
+
+            case 'f':
+                f_cpu = atof(optarg);
+                break;
+
+            case 't':
+                seconds = atof(optarg);
+                break;
+
+            default:
+                fprintf(stderr, "usage: isrcycles [-m MCU] [-f HZ] "
+                        "[-t SECONDS] main.elf\n");
+                return 2;
+        }
+    }
+
+    if (optind >= argc)
+    {
+        fprintf(stderr, "isrcycles: missing main.elf\n");
+        return 2;
+    }
+
+    memset(&fw, 0, sizeof(fw));
+
+    if (elf_read_firmware(argv[optind], &fw) != 0)
+    {
+        fprintf(stderr, "isrcycles: cannot load %s\n", argv[optind]);
+        return 1;
+    }
+
+    g_avr = avr_make_mcu_by_name(mcu);
+
+    if (g_avr == NULL)
+    {
+        fprintf(stderr, "isrcycles: unknown MCU %s\n", mcu);
+        return 1;
+    }
+
+    avr_init(g_avr);
+    g_avr->frequency = f_cpu;
+    g_f_reset = f_cpu;
+    avr_load_firmware(g_avr, &fw);
+    avr_register_io_write(g_avr, CLKPR_ADDR, clkpr_write, NULL);
+
+    for (uintptr_t v = 1; v < MAX_VECTORS; v++)
+    {
+        avr_irq_t *irq = avr_get_interrupt_irq(g_avr, v);
+
+        if (irq != NULL)
+        {
+            avr_irq_register_notify(irq + AVR_INT_IRQ_RUNNING, 
+                                    isr_running, (void *)v);
+        }
+    }
+
+    avr_raise_irq(avr_io_getirq(g_avr, AVR_IOCTL_ADC_GETIRQ, ADC_IRQ_ADC3),
+                  POT_MV);
+    avr_raise_irq(avr_io_getirq(g_avr, AVR_IOCTL_ADC_GETIRQ, ADC_IRQ_ADC2),
+                  SOLAR_MV);
+
+    g_pb1 = avr_io_getirq(g_avr, AVR_IOCTL_IOPORT_GETIRQ('B'), 1);
+    avr_raise_irq(g_pb1, button);
+
+    do
+    {
+        int was_sleeping = g_avr->state == cpu_Sleeping;
+        double now;
+
+        before = g_avr->cycle;
+        state = avr_run(g_avr);
+
+        if (was_sleeping)
+        {
+            sleeping += g_avr->cycle - before;
+        }
+
+        /* The firmware wakes every second, often enough for the button.
+         */
+
+        now = seconds_now();
+
+        if (button != (now < BUTTON_PRESS || now >= BUTTON_RELEASE))
+        {
+            button = !button;
+            avr_raise_irq(g_pb1, button);
+        }
+    }
+    while (state != cpu_Done && state != cpu_Crashed &&
+           seconds_now() < seconds);
+
+    if (state == cpu_Crashed)
+    {
+        fprintf(stderr, "isrcycles: firmware crashed at %llu cycles\n",
+                (unsigned long long)g_avr->cycle);
+        return 1;
+    }
+
+    printf("cycles %llu\n", (unsigned long long)g_avr->cycle);
+    printf("active %llu\n", (unsigned long long)(g_avr->cycle - sleeping));
+
+    for (int v = 1; v < MAX_VECTORS; v++)
+    {
+        struct vector_stats *stats = &g_stats[v];
+
+        if (stats->count == 0)
+        {
+            continue;
+        }
+
+        printf("vector %d %s %lu %llu %llu\n", v, vector_name(mcu, v),
+               stats->count, (unsigned long long)stats->max,
+               (unsigned long long)stats->total);
+    }
+
+    return 0;
+}